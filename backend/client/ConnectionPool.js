@@ -0,0 +1,128 @@
+// Connection Pool - Persistent, pipelined connections to one engine node
+
+const net = require('net');
+const config = require('../config');
+const { hasLineBreak } = require('../middleware');
+
+/**
+ * One persistent connection. The engine answers every command with exactly
+ * one line, in order, so commands are pipelined and each reply line settles
+ * the oldest pending request.
+ */
+class PooledConnection {
+    constructor(node, onClose) {
+        this.pending = [];
+        this.buffer = '';
+        this.closed = false;
+
+        this.socket = node.socketPath
+            ? net.connect(node.socketPath)
+            : net.connect(node.port, node.host);
+        this.socket.setNoDelay(true);
+
+        this.socket.on('data', (data) => {
+            this.buffer += data.toString();
+            let newline;
+            while ((newline = this.buffer.indexOf('\n')) !== -1) {
+                const line = this.buffer.slice(0, newline);
+                this.buffer = this.buffer.slice(newline + 1);
+                const request = this.pending.shift();
+                if (!request) {
+                    // Replies no longer line up with requests: every later
+                    // one would settle the wrong caller
+                    this.socket.destroy(new Error('Unexpected reply from engine'));
+                    return;
+                }
+                request.resolve(line.trim());
+            }
+            // Only time out while waiting: idle pooled connections stay open
+            if (this.pending.length === 0) this.socket.setTimeout(0);
+        });
+
+        this.socket.on('timeout', () => {
+            this.socket.destroy(new Error('Connection timeout'));
+        });
+
+        this.socket.on('error', (err) => {
+            this.fail(err.message === 'Connection timeout'
+                ? err : new Error(`Connection error: ${err.message}`));
+        });
+
+        this.socket.on('close', () => {
+            this.fail(new Error('Connection closed'));
+            onClose(this);
+        });
+    }
+
+    fail(err) {
+        this.closed = true;
+        for (const request of this.pending.splice(0)) {
+            request.reject(err);
+        }
+    }
+
+    /**
+     * @param {string} command - One line: a line break would make it two
+     *   commands with two replies, and shift every later reply
+     * @returns {Promise<string>}
+     */
+    send(command) {
+        return new Promise((resolve, reject) => {
+            if (this.closed) {
+                reject(new Error('Connection closed'));
+                return;
+            }
+            if (hasLineBreak(command)) {
+                reject(new Error('Command must not contain line breaks'));
+                return;
+            }
+            this.pending.push({ resolve, reject });
+            this.socket.setTimeout(config.SOCKET_TIMEOUT);
+            this.socket.write(command + '\n');
+        });
+    }
+}
+
+class ConnectionPool {
+    /**
+     * @param {{host: string, port: number, socketPath?: string}} node
+     * @param {number} size - Connections opened at most
+     */
+    constructor(node, size = config.POOL_SIZE) {
+        this.node = node;
+        this.size = Math.max(1, size);
+        this.connections = [];
+    }
+
+    /**
+     * Send a command on the least busy connection, opening a new one while
+     * the pool is below its size and every open one has requests in flight
+     * @param {string} command
+     * @returns {Promise<string>}
+     */
+    send(command) {
+        let conn = null;
+        for (const candidate of this.connections) {
+            if (!candidate.closed && (!conn || candidate.pending.length < conn.pending.length)) {
+                conn = candidate;
+            }
+        }
+
+        if (!conn || (conn.pending.length > 0 && this.connections.length < this.size)) {
+            conn = new PooledConnection(this.node, (closed) => {
+                this.connections = this.connections.filter((c) => c !== closed);
+            });
+            this.connections.push(conn);
+        }
+        return conn.send(command);
+    }
+
+    close() {
+        for (const conn of this.connections) {
+            conn.socket.destroy();
+        }
+        this.connections = [];
+    }
+}
+
+module.exports = ConnectionPool;
@@ -0,0 +1,61 @@
+// Consistent Hash Ring - Ketama-style key -> shard mapping
+
+const crypto = require('crypto');
+
+// Ketama places 160 points per server: 40 MD5 digests, 4 points each
+const DEFAULT_VNODES = 160;
+
+/**
+ * Four 32-bit ring points from one MD5 digest
+ * @param {string} str
+ * @returns {number[]}
+ */
+function md5Points(str) {
+    const digest = crypto.createHash('md5').update(str).digest();
+    return [0, 4, 8, 12].map((offset) => digest.readUInt32LE(offset));
+}
+
+class HashRing {
+    /**
+     * @param {Array<{host: string, port: number}>} nodes
+     * @param {number} vnodes - Points per node; more points spread keys more evenly
+     */
+    constructor(nodes, vnodes = DEFAULT_VNODES) {
+        this.nodes = nodes;
+        this.points = [];
+
+        nodes.forEach((node, index) => {
+            for (let i = 0; i < vnodes / 4; i++) {
+                for (const point of md5Points(`${node.host}:${node.port}-${i}`)) {
+                    this.points.push({ point, index });
+                }
+            }
+        });
+        this.points.sort((a, b) => a.point - b.point);
+    }
+
+    /**
+     * Node owning a key: the first ring point at or after the key's hash.
+     * Adding a node only takes over the keys that fall just before its
+     * points; every other key stays where it was.
+     * @param {string} key
+     * @returns {{host: string, port: number}}
+     */
+    nodeFor(key) {
+        const hash = md5Points(key)[0];
+        let lo = 0;
+        let hi = this.points.length;
+
+        while (lo < hi) {
+            const mid = (lo + hi) >>> 1;
+            if (this.points[mid].point < hash) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return this.nodes[this.points[lo % this.points.length].index];
+    }
+}
+
+module.exports = HashRing;
@@ -1,12 +1,152 @@
 // TCP Client - Communicates with Mini-Redis C Engine
 
-const net = require('net');
 const config = require('../config');
+const ConnectionPool = require('./ConnectionPool');
+const HashRing = require('./HashRing');
+
+const CLUSTER_SLOTS = 16384;
+const MAX_REDIRECTS = 5;
+
+// Commands whose second token is a key, routed by hash slot in cluster mode
+// and by the hash ring in sharded mode (MEMORY USAGE key is routed too)
+const KEY_COMMANDS = new Set(['GET', 'SET', 'DEL', 'UNLINK', 'TYPE', 'XADD', 'XRANGE',
+    'XREVRANGE', 'XLEN', 'XDEL', 'XTRIM', 'XACK', 'XPENDING', 'TS.CREATE', 'TS.ALTER', 'TS.ADD',
+    'TS.GET', 'TS.RANGE', 'TS.INFO', 'VADD', 'VREM', 'VSIM', 'VCARD', 'VDIM', 'VEMB',
+    'VINFO', 'GEOADD', 'GEOREM', 'GEOPOS', 'GEODIST', 'GEOHASH', 'GEOSEARCH', 'BF.RESERVE',
+    'BF.ADD', 'BF.MADD', 'BF.EXISTS', 'BF.MEXISTS', 'BF.CARD', 'BF.INFO', 'CF.RESERVE', 'CF.ADD',
+    'CF.ADDNX', 'CF.INSERT', 'CF.DEL', 'CF.EXISTS', 'CF.MEXISTS', 'CF.COUNT', 'CF.INFO']);
+
+// Commands whose third token is a key: XGROUP CREATE key ..., XINFO STREAM key
+const SUBCOMMAND_KEY_COMMANDS = new Set(['MEMORY', 'XGROUP', 'XINFO']);
+
+// Commands that act on a whole node, sent to every node when there are several
+const ALL_NODE_COMMANDS = new Set(['FLUSHALL']);
+
+// Commands that change the connection they arrive on. Pooled connections are
+// shared by every request, so these are refused rather than sent.
+const CONNECTION_COMMANDS = new Set(['SELECT', 'QUIT', 'MULTI', 'EXEC', 'DISCARD', 'WATCH',
+    'CLIENT']);
+
+/**
+ * Whether a command would change the state of its connection. ASKING only
+ * prefixes the command it runs, so the name is read after it.
+ * @param {string} command
+ * @returns {boolean}
+ */
+function isConnectionCommand(command) {
+    const tokens = command.trim().split(/\s+/);
+    const name = tokens[0].toUpperCase() === 'ASKING' && tokens.length > 1 ? tokens[1] : tokens[0];
+    return CONNECTION_COMMANDS.has(name.toUpperCase());
+}
+
+/**
+ * Key a command acts on, or null if it is not routed by key
+ * @param {string[]} tokens
+ * @returns {string|null}
+ */
+function commandKey(tokens) {
+    const name = tokens[0].toUpperCase();
+    if (KEY_COMMANDS.has(name) && tokens.length >= 2) {
+        return tokens[1];
+    }
+    if (SUBCOMMAND_KEY_COMMANDS.has(name) && tokens.length >= 3 &&
+        (name !== 'MEMORY' || tokens[1].toUpperCase() === 'USAGE')) {
+        return tokens[2];
+    }
+    if (name === 'XREADGROUP') {
+        // XREADGROUP GROUP group consumer [...] STREAMS key id
+        const streams = tokens.findIndex((token) => token.toUpperCase() === 'STREAMS');
+        return streams !== -1 && streams + 1 < tokens.length ? tokens[streams + 1] : null;
+    }
+    return null;
+}
+
+/**
+ * CRC16-CCITT (XMODEM), matching the engine's cluster_key_slot()
+ * @param {Buffer} buf
+ * @returns {number}
+ */
+function crc16(buf) {
+    let crc = 0;
+    for (const byte of buf) {
+        crc ^= byte << 8;
+        for (let bit = 0; bit < 8; bit++) {
+            crc = crc & 0x8000 ? ((crc << 1) ^ 0x1021) & 0xffff : (crc << 1) & 0xffff;
+        }
+    }
+    return crc;
+}
+
+/**
+ * Hash slot of a key; only a non-empty {hash tag} is hashed if present
+ * @param {string} key
+ * @returns {number}
+ */
+function keySlot(key) {
+    const buf = Buffer.from(key);
+    const open = buf.indexOf('{');
+    if (open !== -1) {
+        const close = buf.indexOf('}', open + 1);
+        if (close > open + 1) {
+            return crc16(buf.subarray(open + 1, close)) % CLUSTER_SLOTS;
+        }
+    }
+    return crc16(buf) % CLUSTER_SLOTS;
+}
+
+/**
+ * Parse "host:port,host:port" into node addresses
+ * @param {string} list
+ * @returns {Array<{host: string, port: number}>}
+ */
+function parseNodes(list) {
+    return (list || '').split(',').filter(Boolean).map((addr) => {
+        const colon = addr.lastIndexOf(':');
+        return { host: addr.slice(0, colon), port: parseInt(addr.slice(colon + 1), 10) };
+    });
+}
 
 class RedisClient {
-    constructor(host = config.REDIS_HOST, port = config.REDIS_PORT) {
+    constructor(host = config.REDIS_HOST, port = config.REDIS_PORT, socketPath = config.REDIS_SOCKET,
+                clusterNodes = config.REDIS_CLUSTER, shards = config.REDIS_SHARDS) {
         this.host = host;
         this.port = port;
+        this.socketPath = socketPath;
+
+        // Cluster mode: seed nodes, and the slot -> node map learned from them
+        this.seeds = parseNodes(clusterNodes);
+        this.slots = null;
+        this.slotsStale = false;
+
+        // Sharded mode: independent engines, keys placed by a hash ring
+        this.shards = this.seeds.length > 0 ? [] : parseNodes(shards);
+        this.ring = this.shards.length > 0 ? new HashRing(this.shards) : null;
+
+        // One connection pool per node, keyed by address
+        this.pools = new Map();
+    }
+
+    get isCluster() {
+        return this.seeds.length > 0;
+    }
+
+    get isSharded() {
+        return this.shards.length > 0;
+    }
+
+    /**
+     * Human-readable engine address
+     * @returns {string}
+     */
+    get address() {
+        const list = (nodes) => nodes.map((n) => `${n.host}:${n.port}`).join(',');
+        if (this.isCluster) {
+            return `cluster:${list(this.seeds)}`;
+        }
+        if (this.isSharded) {
+            return `shards:${list(this.shards)}`;
+        }
+        return this.socketPath ? `unix:${this.socketPath}` : `${this.host}:${this.port}`;
     }
 
     /**
@@ -15,48 +155,162 @@ class RedisClient {
      * @returns {Promise<string>} - The response from the server
      */
     sendCommand(command) {
-        return new Promise((resolve, reject) => {
-            const socket = new net.Socket();
-            let response = '';
-
-            socket.setTimeout(config.SOCKET_TIMEOUT);
-
-            socket.on('connect', () => {
-                // Send command with newline
-                socket.write(command + '\n');
-            });
-
-            socket.on('data', (data) => {
-                response += data.toString();
-                // Check if we received a complete response (ends with newline)
-                if (response.endsWith('\n')) {
-                    socket.destroy();
-                    resolve(response.trim());
-                }
-            });
+        if (isConnectionCommand(command)) {
+            return Promise.reject(new Error('Connection commands are not supported over the pool'));
+        }
+        const name = command.trim().split(/\s+/)[0].toUpperCase();
+        if (ALL_NODE_COMMANDS.has(name) && (this.isCluster || this.isSharded)) {
+            return this.fanOut(command).then(
+                (replies) => replies.find((reply) => reply !== 'OK') || 'OK');
+        }
+        if (this.isCluster) {
+            return this.routeCommand(command);
+        }
+        if (this.isSharded) {
+            const key = commandKey(command.trim().split(/\s+/));
+            return this.sendTo(key !== null ? this.ring.nodeFor(key) : this.shards[0], command);
+        }
+        return this.sendTo({ host: this.host, port: this.port, socketPath: this.socketPath }, command);
+    }
 
-            socket.on('timeout', () => {
-                socket.destroy();
-                reject(new Error('Connection timeout'));
-            });
+    /**
+     * Send a command to one engine node over its connection pool
+     * @param {{host: string, port: number, socketPath?: string}} node
+     * @param {string} command
+     * @returns {Promise<string>}
+     */
+    sendTo(node, command) {
+        const address = node.socketPath || `${node.host}:${node.port}`;
+        let pool = this.pools.get(address);
+        if (!pool) {
+            pool = new ConnectionPool(node);
+            this.pools.set(address, pool);
+        }
+        return pool.send(command);
+    }
 
-            socket.on('error', (err) => {
-                reject(new Error(`Connection error: ${err.message}`));
-            });
+    /**
+     * Every engine process holding part of the data
+     * @returns {Promise<Array<{host: string, port: number, socketPath?: string}>>}
+     */
+    async allNodes() {
+        if (this.isCluster) {
+            return this.clusterNodes();
+        }
+        if (this.isSharded) {
+            return this.shards;
+        }
+        return [{ host: this.host, port: this.port, socketPath: this.socketPath }];
+    }
 
-            socket.on('close', () => {
-                if (response) {
-                    resolve(response.trim());
+    /**
+     * Send a command to every node in parallel
+     * @param {string} command
+     * @returns {Promise<string[]>}
+     */
+    async fanOut(command) {
+        const nodes = await this.allNodes();
+        return Promise.all(nodes.map((node) => this.sendTo(node, command)));
+    }
+
+    close() {
+        for (const pool of this.pools.values()) {
+            pool.close();
+        }
+        this.pools.clear();
+    }
+
+    // ========================================================================
+    // Cluster Routing
+    // ========================================================================
+
+    /**
+     * Load the slot map from the first seed that answers
+     */
+    async refreshSlots() {
+        let lastError = null;
+
+        for (const seed of this.seeds) {
+            try {
+                const ranges = JSON.parse(await this.sendTo(seed, 'CLUSTER SLOTS'));
+                const slots = new Array(CLUSTER_SLOTS).fill(null);
+                for (const range of ranges) {
+                    const node = { host: range.host, port: range.port };
+                    for (let slot = range.start; slot <= range.end; slot++) {
+                        slots[slot] = node;
+                    }
                 }
-            });
+                this.slots = slots;
+                this.slotsStale = false;
+                return;
+            } catch (err) {
+                lastError = err;
+            }
+        }
+        throw lastError || new Error('No cluster nodes configured');
+    }
 
-            socket.connect(this.port, this.host);
-        });
+    /**
+     * Every node that owns at least one slot. A MOVED reply means slots have
+     * changed hands, so the whole map is reloaded before fanning out.
+     * @returns {Promise<Array<{host: string, port: number}>>}
+     */
+    async clusterNodes() {
+        if (!this.slots || this.slotsStale) {
+            await this.refreshSlots();
+        }
+        const nodes = new Map();
+        for (const node of this.slots) {
+            if (node) nodes.set(`${node.host}:${node.port}`, node);
+        }
+        return [...nodes.values()];
+    }
+
+    /**
+     * Send a command to the node owning its key, following redirects.
+     * MOVED updates the cached map; ASK retries once with ASKING and leaves
+     * the map alone, since the slot is only mid-migration.
+     * @param {string} command
+     * @returns {Promise<string>}
+     */
+    async routeCommand(command) {
+        const key = commandKey(command.trim().split(/\s+/));
+
+        if (!this.slots) {
+            await this.refreshSlots();
+        }
+
+        if (key === null) {
+            const node = this.slots.find(Boolean) || this.seeds[0];
+            return this.sendTo(node, command);
+        }
+
+        const slot = keySlot(key);
+        let node = this.slots[slot] || this.seeds[0];
+        let asking = false;
+
+        for (let attempt = 0; attempt <= MAX_REDIRECTS; attempt++) {
+            const reply = await this.sendTo(node, asking ? `ASKING ${command}` : command);
+            const redirect = /^(MOVED|ASK) (\d+) (\S+):(\d+)$/.exec(reply);
+            if (!redirect) {
+                return reply;
+            }
+
+            node = { host: redirect[3], port: parseInt(redirect[4], 10) };
+            asking = redirect[1] === 'ASK';
+            if (!asking) {
+                this.slots[parseInt(redirect[2], 10)] = node;
+                this.slotsStale = true;
+            }
+        }
+        throw new Error(`Too many cluster redirects for: ${command}`);
     }
 
     // Convenience methods
     async ping() {
-        return this.sendCommand('PING');
+        // Healthy only if every node answers
+        const replies = await this.fanOut('PING');
+        return replies.find((reply) => reply !== 'PONG') || 'PONG';
     }
 
     async get(key) {
@@ -71,23 +325,103 @@ class RedisClient {
         return this.sendCommand(`DEL ${key}`);
     }
 
+    /**
+     * Get many keys at once. Each key goes to its own node and the pools
+     * pipeline them, so the nodes work through their shares in parallel.
+     * @param {string[]} keys
+     * @returns {Promise<string[]>} - Values in key order ('NULL' if missing)
+     */
+    async mget(keys) {
+        return Promise.all(keys.map((key) => this.get(key)));
+    }
+
     async keys() {
-        const response = await this.sendCommand('KEYS');
-        try {
-            return JSON.parse(response);
-        } catch {
-            return [];
-        }
+        const parse = (response) => {
+            try {
+                return JSON.parse(response);
+            } catch {
+                return [];
+            }
+        };
+
+        // Each node lists only its own keys
+        const replies = await this.fanOut('KEYS');
+        return replies.flatMap(parse);
+    }
+
+    /**
+     * Most accessed keys. Every node samples its own accesses, and a key
+     * lives on one node, so the lists merge by count alone.
+     * @param {number} count
+     * @returns {Promise<Array<{key: string, hits: number}>>}
+     */
+    async hotkeys(count = 10) {
+        return this.topKeys(`HOTKEYS ${count}`, 'hits', count);
+    }
+
+    /**
+     * Largest values, per type, across every node
+     * @param {number} count
+     * @returns {Promise<Array<{key: string, type: string, bytes: number, memory: number}>>}
+     */
+    async bigkeys(count = 10) {
+        return this.topKeys(`BIGKEYS ${count}`, 'bytes', count);
+    }
+
+    /**
+     * Run a top-N command on every node and keep the overall top N
+     * @param {string} command
+     * @param {string} field - Field to rank by
+     * @param {number} count
+     * @returns {Promise<Object[]>}
+     */
+    async topKeys(command, field, count) {
+        const parse = (response) => {
+            try {
+                return JSON.parse(response);
+            } catch {
+                return [];   // Sampling disabled on that node
+            }
+        };
+
+        const replies = await this.fanOut(command);
+        return replies.flatMap(parse)
+            .sort((a, b) => b[field] - a[field])
+            .slice(0, count);
     }
 
     async stats() {
-        const response = await this.sendCommand('STATS');
-        try {
-            return JSON.parse(response);
-        } catch {
-            return { keys: 0, memory_bytes: 0 };
+        const parse = (response) => {
+            try {
+                return JSON.parse(response);
+            } catch {
+                return { keys: 0, memory_bytes: 0 };
+            }
+        };
+
+        const replies = await this.fanOut('STATS');
+        if (replies.length === 1) {
+            return parse(replies[0]);
+        }
+
+        // Counters add up across nodes
+        const total = { nodes: replies.length };
+        for (const stats of replies.map(parse)) {
+            for (const [field, value] of Object.entries(stats)) {
+                if (typeof value === 'number') total[field] = (total[field] || 0) + value;
+            }
+        }
+        // Ratios do not add up: recompute from the summed byte counts
+        if (typeof total.fragmentation_ratio === 'number') {
+            total.fragmentation_ratio = total.memory_bytes > 0
+                ? Number(((total.memory_bytes + total.fragmentation_bytes) / total.memory_bytes).toFixed(2))
+                : null;
         }
+        return total;
     }
 }
 
+RedisClient.keySlot = keySlot;
+RedisClient.isConnectionCommand = isConnectionCommand;
+
 module.exports = RedisClient;
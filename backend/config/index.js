@@ -4,6 +4,14 @@ module.exports = {
     HTTP_PORT: process.env.PORT || 3001,
     REDIS_HOST: process.env.REDIS_HOST || 'localhost',
     REDIS_PORT: parseInt(process.env.REDIS_PORT, 10) || 6379,
+    // Unix socket path for a co-located engine (takes precedence over host/port)
+    REDIS_SOCKET: process.env.REDIS_SOCKET || '',
+    // Comma-separated host:port seeds of a cluster (takes precedence over both)
+    REDIS_CLUSTER: process.env.REDIS_CLUSTER || '',
+    // Comma-separated host:port engines sharded client-side on a hash ring
+    REDIS_SHARDS: process.env.REDIS_SHARDS || '',
+    // Persistent connections per engine node
+    POOL_SIZE: parseInt(process.env.REDIS_POOL_SIZE, 10) || 4,
     SOCKET_TIMEOUT: 5000,
     MAX_PAYLOAD_SIZE: 1e6 // 1MB
 };
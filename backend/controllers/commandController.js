@@ -1,6 +1,7 @@
 // Command execution controller
 
-const { sendJSON, sendError, parseBody } = require('../middleware');
+const { sendJSON, sendError, parseBody, hasLineBreak } = require('../middleware');
+const RedisClient = require('../client/RedisClient');
 
 /**
  * Execute raw command
@@ -13,6 +14,15 @@ async function executeCommand(req, res, redis) {
             sendError(res, 400, 'Missing command');
             return;
         }
+        if (hasLineBreak(body.command)) {
+            sendError(res, 400, 'Command must be a single line');
+            return;
+        }
+        // Connections are shared, so one request must not change them
+        if (RedisClient.isConnectionCommand(body.command)) {
+            sendError(res, 400, 'Connection commands are not supported over the pool');
+            return;
+        }
 
         const response = await redis.sendCommand(body.command);
         sendJSON(res, 200, { command: body.command, response });
@@ -1,6 +1,6 @@
 // Keys management controller
 
-const { sendJSON, sendError, parseBody } = require('../middleware');
+const { sendJSON, sendError, parseBody, hasLineBreak } = require('../middleware');
 
 /**
  * Get all keys
@@ -20,12 +20,8 @@ async function getAllKeys(req, res, redis) {
 async function getAllKeysWithValues(req, res, redis) {
     try {
         const keys = await redis.keys();
-        const entries = [];
-
-        for (const key of keys) {
-            const value = await redis.get(key);
-            entries.push({ key, value: value === 'NULL' ? null : value });
-        }
+        const values = await redis.mget(keys);
+        const entries = keys.map((key, i) => ({ key, value: values[i] === 'NULL' ? null : values[i] }));
 
         sendJSON(res, 200, { entries });
     } catch (err) {
@@ -60,6 +56,10 @@ async function setKey(req, res, redis) {
             sendError(res, 400, 'Missing key or value');
             return;
         }
+        if (hasLineBreak(body.key) || hasLineBreak(body.value)) {
+            sendError(res, 400, 'Key and value must not contain line breaks');
+            return;
+        }
 
         const result = await redis.set(body.key, body.value);
         if (result === 'OK') {
@@ -83,6 +83,10 @@ async function updateKey(req, res, redis, params) {
             sendError(res, 400, 'Missing value');
             return;
         }
+        if (hasLineBreak(params.key) || hasLineBreak(body.value)) {
+            sendError(res, 400, 'Key and value must not contain line breaks');
+            return;
+        }
 
         const result = await redis.set(params.key, body.value);
         if (result === 'OK') {
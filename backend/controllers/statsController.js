@@ -14,6 +14,19 @@ async function getStats(req, res, redis) {
     }
 }
 
+/**
+ * Get the hottest keys and the biggest values
+ */
+async function getKeyspace(req, res, redis) {
+    try {
+        const [hotkeys, bigkeys] = await Promise.all([redis.hotkeys(), redis.bigkeys()]);
+        sendJSON(res, 200, { hotkeys, bigkeys });
+    } catch (err) {
+        sendError(res, 500, err.message);
+    }
+}
+
 module.exports = {
-    getStats
+    getStats,
+    getKeyspace
 };
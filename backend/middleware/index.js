@@ -50,6 +50,14 @@ function sendError(res, statusCode, message) {
     sendJSON(res, statusCode, { error: message });
 }
 
+/**
+ * Whether a value has a CR or LF. The engine reads one command per line,
+ * so such a value cannot be sent as part of a command.
+ */
+function hasLineBreak(value) {
+    return /[\r\n]/.test(String(value));
+}
+
 /**
  * Log request
  */
@@ -63,5 +71,6 @@ module.exports = {
     parseBody,
     sendJSON,
     sendError,
+    hasLineBreak,
     logRequest
 };
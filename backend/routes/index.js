@@ -17,6 +17,7 @@ const routes = {
     'PUT /api/keys/:key': keysController.updateKey,
     'DELETE /api/keys/:key': keysController.deleteKey,
     'GET /api/stats': statsController.getStats,
+    'GET /api/keyspace': statsController.getKeyspace,
     'POST /api/command': commandController.executeCommand
 };
 
@@ -52,7 +52,7 @@ server.listen(config.HTTP_PORT, () => {
     console.log('  Mini-Redis API Server                   ');
     console.log('===========================================');
     console.log(`HTTP API listening on port ${config.HTTP_PORT}`);
-    console.log(`Redis connection: ${config.REDIS_HOST}:${config.REDIS_PORT}`);
+    console.log(`Redis connection: ${redis.address}`);
     console.log('');
     console.log('Available endpoints:');
     console.log('  GET    /api/health      - Health check');
@@ -0,0 +1,305 @@
+// ============================================================================
+// bench.c - Load Generator for Mini-Redis
+// ============================================================================
+//
+// Drives a running engine with a GET/SET mix over many connections and
+// reports throughput and round-trip latency. Each thread owns a share of
+// the connections and sends pipelined batches to all of them before
+// reading the replies back.
+//
+//   ./mini-redis-bench -p 6379 -t 4 -c 64 -n 1000000 -P 16 -r 90
+// ============================================================================
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+typedef struct BenchConfig {
+    const char *host;
+    const char *port;
+    int threads;
+    int connections;
+    long requests;
+    int pipeline;
+    int read_percent;         // Share of GETs; the rest are SETs
+    int keyspace;
+    int value_size;
+} BenchConfig;
+
+typedef struct BenchConn {
+    int fd;
+    char *rbuf;
+    size_t rlen;
+} BenchConn;
+
+typedef struct BenchThread {
+    int id;
+    const BenchConfig *config;
+    pthread_t thread;
+    BenchConn *conns;
+    int num_conns;
+    long requests;            // This thread's share
+    long completed;
+    uint64_t *latencies;      // Per-batch round trip, microseconds
+    size_t num_latencies;
+    int failed;
+} BenchThread;
+
+#define BENCH_RBUF_SIZE (256 * 1024)
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static int bench_connect(const BenchConfig *config) {
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(config->host, config->port, &hints, &res) != 0) return -1;
+
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+
+    if (fd >= 0) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+static int send_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Read until count reply lines have arrived
+static int read_replies(BenchConn *conn, int count) {
+    while (count > 0) {
+        char *nl = memchr(conn->rbuf, '\n', conn->rlen);
+        if (nl) {
+            size_t used = (size_t)(nl - conn->rbuf) + 1;
+            memmove(conn->rbuf, conn->rbuf + used, conn->rlen - used);
+            conn->rlen -= used;
+            count--;
+            continue;
+        }
+
+        if (conn->rlen == BENCH_RBUF_SIZE) return -1;
+        ssize_t n = recv(conn->fd, conn->rbuf + conn->rlen, BENCH_RBUF_SIZE - conn->rlen, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return -1;
+        }
+        conn->rlen += (size_t)n;
+    }
+    return 0;
+}
+
+static void *bench_thread(void *arg) {
+    BenchThread *t = (BenchThread *)arg;
+    const BenchConfig *config = t->config;
+    unsigned int seed = (unsigned int)(t->id * 7919 + 1);
+
+    size_t cmd_cap = (size_t)config->pipeline * (size_t)(config->value_size + 64);
+    char *cmd = (char *)malloc(cmd_cap);
+    char *value = (char *)malloc((size_t)config->value_size + 1);
+    int *sent = (int *)malloc((size_t)t->num_conns * sizeof(int));
+    if (!cmd || !value || !sent) {
+        t->failed = 1;
+        free(cmd);
+        free(value);
+        free(sent);
+        return NULL;
+    }
+    memset(value, 'x', (size_t)config->value_size);
+    value[config->value_size] = '\0';
+
+    size_t max_batches = (size_t)(t->requests / config->pipeline + t->num_conns + 1);
+    t->latencies = (uint64_t *)malloc(max_batches * sizeof(uint64_t));
+
+    while (t->completed < t->requests && !t->failed && t->latencies) {
+        uint64_t start = now_us();
+
+        for (int i = 0; i < t->num_conns; i++) {
+            long left = t->requests - t->completed - (long)i * config->pipeline;
+            int batch = left < config->pipeline ? (int)(left > 0 ? left : 0) : config->pipeline;
+            size_t len = 0;
+
+            for (int j = 0; j < batch; j++) {
+                int key = rand_r(&seed) % config->keyspace;
+                if (rand_r(&seed) % 100 < config->read_percent) {
+                    len += (size_t)snprintf(cmd + len, cmd_cap - len, "GET key:%d\n", key);
+                } else {
+                    len += (size_t)snprintf(cmd + len, cmd_cap - len, "SET key:%d %s\n", key, value);
+                }
+            }
+
+            sent[i] = batch;
+            if (batch > 0 && send_all(t->conns[i].fd, cmd, len) != 0) t->failed = 1;
+        }
+
+        for (int i = 0; i < t->num_conns && !t->failed; i++) {
+            if (sent[i] > 0 && read_replies(&t->conns[i], sent[i]) != 0) t->failed = 1;
+            t->completed += sent[i];
+        }
+
+        t->latencies[t->num_latencies++] = now_us() - start;
+    }
+
+    free(cmd);
+    free(value);
+    free(sent);
+    return NULL;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options]\n", prog);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -h <host>     Server host (default: 127.0.0.1)\n");
+    fprintf(stderr, "  -p <port>     Server port (default: 6379)\n");
+    fprintf(stderr, "  -t <n>        Client threads (default: 4)\n");
+    fprintf(stderr, "  -c <n>        Connections, spread over the threads (default: 64)\n");
+    fprintf(stderr, "  -n <n>        Total requests (default: 1000000)\n");
+    fprintf(stderr, "  -P <n>        Pipeline depth per connection (default: 16)\n");
+    fprintf(stderr, "  -r <percent>  Share of GET requests (default: 90)\n");
+    fprintf(stderr, "  -k <n>        Key space (default: 100000)\n");
+    fprintf(stderr, "  -d <bytes>    SET value size (default: 32)\n");
+}
+
+int main(int argc, char *argv[]) {
+    BenchConfig config = {
+        .host = "127.0.0.1", .port = "6379", .threads = 4, .connections = 64,
+        .requests = 1000000, .pipeline = 16, .read_percent = 90,
+        .keyspace = 100000, .value_size = 32
+    };
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc || argv[i][0] != '-' || strlen(argv[i]) != 2) {
+            print_usage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+        const char *v = argv[++i];
+        switch (argv[i - 1][1]) {
+        case 'h': config.host = v; break;
+        case 'p': config.port = v; break;
+        case 't': config.threads = atoi(v); break;
+        case 'c': config.connections = atoi(v); break;
+        case 'n': config.requests = atol(v); break;
+        case 'P': config.pipeline = atoi(v); break;
+        case 'r': config.read_percent = atoi(v); break;
+        case 'k': config.keyspace = atoi(v); break;
+        case 'd': config.value_size = atoi(v); break;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (config.threads < 1 || config.connections < config.threads || config.requests < 1 ||
+        config.pipeline < 1 || config.keyspace < 1 || config.value_size < 1 ||
+        config.value_size > 4096 || config.read_percent < 0 || config.read_percent > 100) {
+        fprintf(stderr, "Invalid benchmark parameters\n");
+        return 1;
+    }
+
+    BenchThread *threads = (BenchThread *)calloc((size_t)config.threads, sizeof(BenchThread));
+    if (!threads) return 1;
+
+    for (int i = 0; i < config.threads; i++) {
+        BenchThread *t = &threads[i];
+        t->id = i;
+        t->config = &config;
+        t->num_conns = config.connections / config.threads +
+                       (i < config.connections % config.threads);
+        t->requests = config.requests / config.threads +
+                      (i < config.requests % config.threads);
+        t->conns = (BenchConn *)calloc((size_t)t->num_conns, sizeof(BenchConn));
+        if (!t->conns) return 1;
+
+        for (int j = 0; j < t->num_conns; j++) {
+            t->conns[j].fd = bench_connect(&config);
+            t->conns[j].rbuf = (char *)malloc(BENCH_RBUF_SIZE);
+            if (t->conns[j].fd < 0 || !t->conns[j].rbuf) {
+                fprintf(stderr, "Failed to connect to %s:%s\n", config.host, config.port);
+                return 1;
+            }
+        }
+    }
+
+    uint64_t start = now_us();
+    for (int i = 0; i < config.threads; i++) {
+        pthread_create(&threads[i].thread, NULL, bench_thread, &threads[i]);
+    }
+
+    long completed = 0;
+    size_t num_latencies = 0;
+    int failed = 0;
+    for (int i = 0; i < config.threads; i++) {
+        pthread_join(threads[i].thread, NULL);
+        completed += threads[i].completed;
+        num_latencies += threads[i].num_latencies;
+        failed |= threads[i].failed;
+    }
+    uint64_t elapsed = now_us() - start;
+
+    uint64_t *latencies = (uint64_t *)malloc((num_latencies + 1) * sizeof(uint64_t));
+    size_t n = 0;
+    for (int i = 0; i < config.threads; i++) {
+        if (latencies && threads[i].latencies) {
+            memcpy(latencies + n, threads[i].latencies, threads[i].num_latencies * sizeof(uint64_t));
+            n += threads[i].num_latencies;
+        }
+        for (int j = 0; j < threads[i].num_conns; j++) {
+            close(threads[i].conns[j].fd);
+            free(threads[i].conns[j].rbuf);
+        }
+        free(threads[i].conns);
+        free(threads[i].latencies);
+    }
+    free(threads);
+
+    printf("requests:     %ld%s\n", completed, failed ? " (connection error)" : "");
+    printf("elapsed:      %.3f s\n", (double)elapsed / 1e6);
+    printf("throughput:   %.0f ops/sec\n", elapsed ? (double)completed * 1e6 / (double)elapsed : 0.0);
+    if (latencies && n > 0) {
+        qsort(latencies, n, sizeof(uint64_t), compare_u64);
+        printf("batch rtt:    p50 %llu us, p99 %llu us, max %llu us\n",
+               (unsigned long long)latencies[n / 2],
+               (unsigned long long)latencies[n * 99 / 100],
+               (unsigned long long)latencies[n - 1]);
+    }
+    free(latencies);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,504 @@
+// ============================================================================
+// cluster.c - Hash-Slot Partitioning Across Engine Processes
+// ============================================================================
+//
+// Keys map to one of 16384 slots (CRC16 of the key, or of its {hash tag}).
+// Every node holds the full slot -> node map and serves only its own slots;
+// a key in any other slot is answered with
+//   MOVED <slot> <host:port>    the slot lives there, update the map
+//   ASK <slot> <host:port>      the slot is being migrated, retry this one
+//                               command there prefixed with ASKING
+//
+// There is no gossip: the operator (or cluster.sh) sends the same
+// CLUSTER SETSLOT commands to every node. Migration moves keys in batches
+// with CLUSTER MIGRATE, which pipelines ASKING SET lines to the target and
+// deletes each key once the target has acknowledged it. Only string keys
+// can travel that way: MIGRATE moves the strings of a batch and reports an
+// error while a key of another type is left in a migrating slot.
+//
+// Slot state is only modified by commands running under the engine lock (or
+// every stripe); lock-free GETs read it with atomic loads.
+// ============================================================================
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "mini_redis.h"
+
+#define CLUSTER_MAX_NODES 256
+#define CLUSTER_HOST_LEN 64
+#define CLUSTER_IO_TIMEOUT_SEC 5
+#define CLUSTER_MAX_BATCH 10000
+
+typedef struct ClusterNode {
+    char host[CLUSTER_HOST_LEN];
+    int port;
+} ClusterNode;
+
+static int g_cluster_enabled = 0;
+static ClusterNode g_nodes[CLUSTER_MAX_NODES];   // g_nodes[0] is this node
+static int g_num_nodes = 0;
+
+// Node index per slot, -1 when unset
+static int16_t g_owner[CLUSTER_SLOTS];
+static int16_t g_migrating[CLUSTER_SLOTS];       // Target of an outgoing move
+static int16_t g_importing[CLUSTER_SLOTS];       // Source of an incoming move
+
+// ============================================================================
+// Key -> Slot
+// ============================================================================
+
+// CRC16-CCITT (XMODEM), the variant Redis Cluster uses
+static uint16_t crc16(const char *buf, size_t len) {
+    uint16_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)((unsigned char)buf[i] << 8);
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+unsigned int cluster_key_slot(const char *key) {
+    size_t len = strlen(key);
+
+    // Only the part inside the first non-empty {...} is hashed, so related
+    // keys can be kept in one slot
+    const char *open = memchr(key, '{', len);
+    if (open) {
+        const char *close = memchr(open + 1, '}', len - (size_t)(open - key) - 1);
+        if (close && close > open + 1) {
+            return crc16(open + 1, (size_t)(close - open - 1)) & (CLUSTER_SLOTS - 1);
+        }
+    }
+    return crc16(key, len) & (CLUSTER_SLOTS - 1);
+}
+
+// ============================================================================
+// Node Table
+// ============================================================================
+
+// Find or add the node for "host:port"; returns its index or -1
+static int node_lookup(const char *addr) {
+    const char *colon = strrchr(addr, ':');
+    if (!colon || colon == addr || (size_t)(colon - addr) >= CLUSTER_HOST_LEN) return -1;
+
+    char *end;
+    long port = strtol(colon + 1, &end, 10);
+    if (*end != '\0' || port <= 0 || port > 65535) return -1;
+
+    size_t host_len = (size_t)(colon - addr);
+    for (int i = 0; i < g_num_nodes; i++) {
+        if (g_nodes[i].port == port && strlen(g_nodes[i].host) == host_len &&
+            strncmp(g_nodes[i].host, addr, host_len) == 0) {
+            return i;
+        }
+    }
+
+    if (g_num_nodes == CLUSTER_MAX_NODES) return -1;
+    ClusterNode *node = &g_nodes[g_num_nodes];
+    memcpy(node->host, addr, host_len);
+    node->host[host_len] = '\0';
+    node->port = (int)port;
+
+    // Published before any slot can refer to it
+    __atomic_store_n(&g_num_nodes, g_num_nodes + 1, __ATOMIC_RELEASE);
+    return g_num_nodes - 1;
+}
+
+int cluster_init(const char *host, int port) {
+    char addr[CLUSTER_HOST_LEN + 8];
+    snprintf(addr, sizeof(addr), "%s:%d", host, port);
+
+    for (int i = 0; i < CLUSTER_SLOTS; i++) {
+        g_owner[i] = g_migrating[i] = g_importing[i] = -1;
+    }
+    g_num_nodes = 0;
+    if (node_lookup(addr) != 0) return -1;
+
+    g_cluster_enabled = 1;
+    return 0;
+}
+
+int cluster_enabled(void) {
+    return g_cluster_enabled;
+}
+
+static char *reply_format(const char *fmt, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, args);
+    va_end(args);
+
+    size_t len = strlen(buffer) + 1;
+    char *reply = (char *)malloc(len);
+    if (reply) memcpy(reply, buffer, len);
+    return reply;
+}
+
+// ============================================================================
+// Redirection
+// ============================================================================
+char *cluster_redirect(HashTable *ht, const char *key, int asking) {
+    if (!g_cluster_enabled) return NULL;
+
+    unsigned int slot = cluster_key_slot(key);
+    int owner = __atomic_load_n(&g_owner[slot], __ATOMIC_ACQUIRE);
+
+    if (owner == 0) {
+        // Keys already moved out of a migrating slot are found on the target
+        int target = __atomic_load_n(&g_migrating[slot], __ATOMIC_ACQUIRE);
+        ValueType type;
+        if (target > 0 && !ht_lookup(ht, key, &type)) {
+            return reply_format("ASK %u %s:%d", slot, g_nodes[target].host, g_nodes[target].port);
+        }
+        return NULL;
+    }
+
+    if (asking && __atomic_load_n(&g_importing[slot], __ATOMIC_ACQUIRE) > 0) {
+        return NULL;
+    }
+    if (owner < 0) {
+        return reply_format("ERROR: CLUSTERDOWN Hash slot %u not served", slot);
+    }
+    return reply_format("MOVED %u %s:%d", slot, g_nodes[owner].host, g_nodes[owner].port);
+}
+
+// ============================================================================
+// Migration
+// ============================================================================
+static int node_connect(const ClusterNode *node) {
+    struct addrinfo hints, *res;
+    char port[8];
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(port, sizeof(port), "%d", node->port);
+    if (getaddrinfo(node->host, port, &hints, &res) != 0) return -1;
+
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd >= 0) {
+        // A stalled target must not hold the engine lock forever
+        struct timeval tv = { CLUSTER_IO_TIMEOUT_SEC, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        if (connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+static int send_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Send the entries listed in idx to a target as one pipelined batch and
+// mark the ones it acknowledged
+// Returns 0 on success, -1 on a connection failure
+static int migrate_to(const ClusterNode *node, HashEntry **entries, const size_t *idx,
+                      size_t count, int *acked) {
+    size_t cap = 0;
+    for (size_t i = 0; i < count; i++) {
+        cap += entries[idx[i]]->key_len + entries[idx[i]]->value_len + 16;
+    }
+
+    char *buf = (char *)malloc(cap + 1);
+    if (!buf) return -1;
+
+    size_t len = 0;
+    for (size_t i = 0; i < count; i++) {
+        HashEntry *e = entries[idx[i]];
+        len += (size_t)snprintf(buf + len, cap + 1 - len, "ASKING SET %s %s\n", e->key, e->value);
+    }
+
+    int fd = node_connect(node);
+    if (fd < 0 || send_all(fd, buf, len) != 0) {
+        if (fd >= 0) close(fd);
+        free(buf);
+        return -1;
+    }
+
+    // Replies arrive in order: the i-th line answers the i-th key. They are
+    // short, so the request buffer is reused to collect them.
+    size_t have = 0, done = 0, start = 0;
+    while (done < count) {
+        char *nl = memchr(buf + start, '\n', have - start);
+        if (nl) {
+            *nl = '\0';
+            acked[idx[done++]] = strcmp(buf + start, "OK") == 0;
+            start = (size_t)(nl - buf) + 1;
+            continue;
+        }
+
+        memmove(buf, buf + start, have - start);
+        have -= start;
+        start = 0;
+        if (have == cap) break;
+
+        ssize_t n = recv(fd, buf + have, cap - have, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        have += (size_t)n;
+    }
+
+    close(fd);
+    free(buf);
+    return done == count ? 0 : -1;
+}
+
+// Move up to limit keys out of the migrating slots, each to its slot's target
+// Returns the number moved, or -1 with *error set
+static long cluster_migrate(HashTable *ht, size_t limit, const char **error) {
+    HashEntry **entries = (HashEntry **)malloc(limit * sizeof(HashEntry *));
+    int *targets = (int *)malloc(limit * sizeof(int));
+    int *acked = (int *)calloc(limit, sizeof(int));
+    size_t *idx = (size_t *)malloc(limit * sizeof(size_t));
+    size_t count = 0;
+    long moved = 0;
+
+    if (!entries || !targets || !acked || !idx) {
+        *error = "ERROR: Memory allocation failed";
+        moved = -1;
+        count = 0;
+    } else {
+        for (size_t i = 0; i < ht->num_buckets && count < limit; i++) {
+            for (HashEntry *e = ht->buckets[i]; e && count < limit; e = e->next) {
+                int target = g_migrating[cluster_key_slot(e->key)];
+                if (target > 0 && e->type != VALUE_STRING) {
+                    // Only strings travel as SET lines; the rest stay put
+                    *error = "ERROR: Only string keys can be migrated";
+                    moved = -1;
+                } else if (target > 0) {
+                    entries[count] = e;
+                    targets[count++] = target;
+                }
+            }
+        }
+    }
+
+    // One connection per target; targets[] is cleared as entries are sent
+    for (size_t i = 0; i < count; i++) {
+        int target = targets[i];
+        if (target < 0) continue;
+
+        size_t n = 0;
+        for (size_t j = i; j < count; j++) {
+            if (targets[j] == target) {
+                idx[n++] = j;
+                targets[j] = -1;
+            }
+        }
+
+        if (migrate_to(&g_nodes[target], entries, idx, n, acked) != 0) {
+            log_error("Migration to %s:%d failed", g_nodes[target].host, g_nodes[target].port);
+            *error = "ERROR: Migration target unreachable";
+            moved = -1;
+        }
+    }
+
+    // Acknowledged keys now live on the target. Copy them all before the
+    // first delete: deleting frees an entry, and a delete that shrinks the
+    // table may replace the others (epoch mode).
+    char (*keys)[MAX_KEY_SIZE + 1] = count ? malloc(count * sizeof(*keys)) : NULL;
+    if (count && !keys) {
+        *error = "ERROR: Memory allocation failed";
+        moved = -1;
+    }
+    for (size_t i = 0; keys && i < count; i++) {
+        if (acked[i]) memcpy(keys[i], entries[i]->key, entries[i]->key_len + 1);
+    }
+    for (size_t i = 0; keys && i < count; i++) {
+        if (acked[i] && ht_delete(ht, keys[i]) == 0 && moved >= 0) moved++;
+    }
+
+    free(keys);
+
+    free(entries);
+    free(targets);
+    free(acked);
+    free(idx);
+    return moved;
+}
+
+// ============================================================================
+// CLUSTER Command
+// ============================================================================
+
+// Parse "n" or "first-last" into a slot range
+static int parse_slot_range(const char *str, int *first, int *last) {
+    char *end;
+    long a = strtol(str, &end, 10), b = a;
+
+    if (end == str) return -1;
+    if (*end == '-') {
+        const char *start = end + 1;
+        b = strtol(start, &end, 10);
+        if (end == start) return -1;
+    }
+    if (*end != '\0' || a < 0 || b < a || b >= CLUSTER_SLOTS) return -1;
+
+    *first = (int)a;
+    *last = (int)b;
+    return 0;
+}
+
+static char *cluster_setslot(char **tokens, int num_tokens) {
+    int first, last;
+    if (num_tokens < 4) {
+        return reply_format("ERROR: CLUSTER SETSLOT <slot[-slot]> NODE|MIGRATING|IMPORTING <host:port>, or STABLE");
+    }
+    if (parse_slot_range(tokens[2], &first, &last) != 0) {
+        return reply_format("ERROR: Invalid slot range");
+    }
+
+    if (strcasecmp(tokens[3], "STABLE") == 0) {
+        for (int s = first; s <= last; s++) {
+            __atomic_store_n(&g_migrating[s], -1, __ATOMIC_RELEASE);
+            __atomic_store_n(&g_importing[s], -1, __ATOMIC_RELEASE);
+        }
+        return reply_format("OK");
+    }
+
+    int node = num_tokens >= 5 ? node_lookup(tokens[4]) : -1;
+    if (node < 0) {
+        return reply_format("ERROR: Invalid node address");
+    }
+
+    if (strcasecmp(tokens[3], "NODE") == 0) {
+        // Assigning a slot ends any migration of it
+        for (int s = first; s <= last; s++) {
+            __atomic_store_n(&g_migrating[s], -1, __ATOMIC_RELEASE);
+            __atomic_store_n(&g_importing[s], -1, __ATOMIC_RELEASE);
+            __atomic_store_n(&g_owner[s], (int16_t)node, __ATOMIC_RELEASE);
+        }
+    } else if (strcasecmp(tokens[3], "MIGRATING") == 0) {
+        if (node == 0) return reply_format("ERROR: Cannot migrate a slot to this node");
+        for (int s = first; s <= last; s++) {
+            if (g_owner[s] != 0) return reply_format("ERROR: Slot %d is not served here", s);
+        }
+        for (int s = first; s <= last; s++) {
+            __atomic_store_n(&g_migrating[s], (int16_t)node, __ATOMIC_RELEASE);
+        }
+    } else if (strcasecmp(tokens[3], "IMPORTING") == 0) {
+        if (node == 0) return reply_format("ERROR: Cannot import a slot from this node");
+        for (int s = first; s <= last; s++) {
+            __atomic_store_n(&g_importing[s], (int16_t)node, __ATOMIC_RELEASE);
+        }
+    } else {
+        return reply_format("ERROR: Unknown SETSLOT mode '%s'", tokens[3]);
+    }
+
+    log_info("CLUSTER SETSLOT %d-%d %s %s", first, last, tokens[3], tokens[4]);
+    return reply_format("OK");
+}
+
+// JSON array of contiguous slot ranges and their owners
+static char *cluster_slots(void) {
+    size_t cap = 4096, len = 0;
+    char *buf = (char *)malloc(cap);
+    if (!buf) return NULL;
+
+    buf[len++] = '[';
+    for (int s = 0; s < CLUSTER_SLOTS; ) {
+        int owner = g_owner[s];
+        int end = s;
+        while (end + 1 < CLUSTER_SLOTS && g_owner[end + 1] == owner) end++;
+
+        if (owner >= 0) {
+            if (len + CLUSTER_HOST_LEN + 64 >= cap) {
+                cap *= 2;
+                char *grown = (char *)realloc(buf, cap);
+                if (!grown) {
+                    free(buf);
+                    return NULL;
+                }
+                buf = grown;
+            }
+            len += (size_t)snprintf(buf + len, cap - len,
+                                    "%s{\"start\": %d, \"end\": %d, \"host\": \"%s\", \"port\": %d}",
+                                    len > 1 ? ", " : "", s, end,
+                                    g_nodes[owner].host, g_nodes[owner].port);
+        }
+        s = end + 1;
+    }
+    buf[len++] = ']';
+    buf[len] = '\0';
+    return buf;
+}
+
+char *cluster_command(HashTable *ht, char **tokens, int num_tokens) {
+    if (!g_cluster_enabled) {
+        return reply_format("ERROR: Cluster support is disabled (start with --cluster)");
+    }
+    if (num_tokens < 2) {
+        return reply_format("ERROR: CLUSTER requires a subcommand");
+    }
+
+    const char *sub = tokens[1];
+
+    if (strcasecmp(sub, "KEYSLOT") == 0 && num_tokens == 3) {
+        return reply_format("%u", cluster_key_slot(tokens[2]));
+    }
+    if (strcasecmp(sub, "MYSELF") == 0) {
+        return reply_format("%s:%d", g_nodes[0].host, g_nodes[0].port);
+    }
+    if (strcasecmp(sub, "SLOTS") == 0) {
+        char *reply = cluster_slots();
+        return reply ? reply : reply_format("ERROR: Memory allocation failed");
+    }
+    if (strcasecmp(sub, "SETSLOT") == 0) {
+        return cluster_setslot(tokens, num_tokens);
+    }
+    if (strcasecmp(sub, "COUNTKEYSINSLOT") == 0 && num_tokens == 3) {
+        int first, last;
+        if (parse_slot_range(tokens[2], &first, &last) != 0) {
+            return reply_format("ERROR: Invalid slot range");
+        }
+        size_t count = 0;
+        for (size_t i = 0; i < ht->num_buckets; i++) {
+            for (HashEntry *e = ht->buckets[i]; e; e = e->next) {
+                int slot = (int)cluster_key_slot(e->key);
+                if (slot >= first && slot <= last) count++;
+            }
+        }
+        return reply_format("%zu", count);
+    }
+    if (strcasecmp(sub, "MIGRATE") == 0 && num_tokens == 3) {
+        long limit = atol(tokens[2]);
+        if (limit < 1 || limit > CLUSTER_MAX_BATCH) {
+            return reply_format("ERROR: Batch size must be 1-%d", CLUSTER_MAX_BATCH);
+        }
+        const char *error = NULL;
+        long moved = cluster_migrate(ht, (size_t)limit, &error);
+        if (moved < 0) return reply_format("%s", error);
+
+        log_info("CLUSTER MIGRATE -> %ld keys moved", moved);
+        return reply_format("%ld", moved);
+    }
+
+    return reply_format("ERROR: Unknown CLUSTER subcommand '%s'", sub);
+}
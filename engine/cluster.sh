@@ -0,0 +1,130 @@
+#!/bin/bash
+
+# ============================================================================
+# Mini-Redis Local Cluster
+# ============================================================================
+# Usage:
+#   ./cluster.sh start [nodes] [base_port]      Start nodes, spread the slots
+#   ./cluster.sh slots                          Show the slot map
+#   ./cluster.sh migrate <slots> <from> <to>    Move slots between node ports
+#   ./cluster.sh stop                           Stop every node
+#
+# Nodes listen on base_port, base_port+1, ... (default 7000) and log to
+# $CLUSTER_DIR/<port>.log. Extra engine flags can be passed in ENGINE_ARGS.
+# ============================================================================
+
+set -e
+
+ENGINE_DIR="$(cd "$(dirname "$0")" && pwd)"
+CLUSTER_DIR="${CLUSTER_DIR:-/tmp/mini-redis-cluster}"
+HOST="127.0.0.1"
+BATCH="${BATCH:-500}"
+
+# Send one command to a node and print the reply
+node_cmd() {
+    local port=$1
+    shift
+    exec 3<>"/dev/tcp/$HOST/$port"
+    echo "$*" >&3
+    local reply
+    read -r reply <&3
+    exec 3<&-
+    echo "$reply"
+}
+
+node_ports() {
+    cat "$CLUSTER_DIR/ports" 2>/dev/null
+}
+
+# Apply a slot assignment on every node. The owner learns it first, then
+# any other nodes listed: the reverse order would let two nodes briefly
+# send MOVED to each other.
+assign_slots() {
+    local range=$1 owner=$2
+    shift 2
+    for port in "$owner" "$@" $(node_ports); do
+        node_cmd "$port" "CLUSTER SETSLOT $range NODE $HOST:$owner" > /dev/null
+    done
+}
+
+start_cluster() {
+    local nodes=${1:-3} base=${2:-7000}
+
+    if [ -s "$CLUSTER_DIR/ports" ]; then
+        echo "Cluster already running (./cluster.sh stop first)"
+        exit 1
+    fi
+
+    make -s -C "$ENGINE_DIR"
+    mkdir -p "$CLUSTER_DIR"
+    : > "$CLUSTER_DIR/ports"
+    : > "$CLUSTER_DIR/pids"
+
+    for ((i = 0; i < nodes; i++)); do
+        local port=$((base + i))
+        # shellcheck disable=SC2086
+        "$ENGINE_DIR/mini-redis" "$port" --cluster --cluster-announce "$HOST" $ENGINE_ARGS \
+            > "$CLUSTER_DIR/$port.log" 2>&1 &
+        echo $! >> "$CLUSTER_DIR/pids"
+        echo "$port" >> "$CLUSTER_DIR/ports"
+    done
+    sleep 1
+
+    # Contiguous, near-equal slot ranges
+    for ((i = 0; i < nodes; i++)); do
+        local first=$((16384 * i / nodes))
+        local last=$((16384 * (i + 1) / nodes - 1))
+        assign_slots "$first-$last" $((base + i))
+        echo "Node $HOST:$((base + i)): slots $first-$last"
+    done
+}
+
+migrate_slots() {
+    local range=$1 from=$2 to=$3
+
+    if [ -z "$to" ]; then
+        echo "Usage: ./cluster.sh migrate <slot[-slot]> <from_port> <to_port>"
+        exit 1
+    fi
+
+    # The target accepts ASKING commands first, then the source starts
+    # redirecting missing keys to it
+    node_cmd "$to" "CLUSTER SETSLOT $range IMPORTING $HOST:$from"
+    node_cmd "$from" "CLUSTER SETSLOT $range MIGRATING $HOST:$to"
+
+    local total=0 moved
+    while true; do
+        moved=$(node_cmd "$from" "CLUSTER MIGRATE $BATCH")
+        case $moved in
+            ''|*[!0-9]*) echo "Migration failed: $moved"; exit 1 ;;
+        esac
+        [ "$moved" -eq 0 ] && break
+        total=$((total + moved))
+    done
+
+    assign_slots "$range" "$to" "$from"
+    echo "Moved $total keys in slots $range from $from to $to"
+}
+
+case $1 in
+    start)
+        start_cluster "$2" "$3"
+        ;;
+    slots)
+        node_cmd "$(node_ports | head -n 1)" "CLUSTER SLOTS"
+        ;;
+    migrate)
+        migrate_slots "$2" "$3" "$4"
+        ;;
+    stop)
+        if [ -f "$CLUSTER_DIR/pids" ]; then
+            xargs kill < "$CLUSTER_DIR/pids" 2>/dev/null || true
+        fi
+        rm -f "$CLUSTER_DIR/pids" "$CLUSTER_DIR/ports"
+        echo "Cluster stopped"
+        ;;
+    *)
+        sed -n '4,12p' "$0" | sed 's/^# \{0,1\}//'
+        exit 1
+        ;;
+esac
@@ -0,0 +1,168 @@
+// ============================================================================
+// epoch.c - Epoch-Based Memory Reclamation for Lock-Free Readers
+// ============================================================================
+//
+// Readers bracket every access to shared table memory with epoch_enter() /
+// epoch_exit(). A writer that unlinks memory hands it to epoch_retire()
+// instead of free(); it is released once every reader that could still
+// hold a reference has left its critical section.
+//
+// Classic three-epoch scheme: the global epoch only advances when every
+// active reader has observed the current one, so memory retired in epoch
+// e is unreachable once the global epoch reaches e + 2.
+//
+// Writers (epoch_retire / epoch_reclaim) must be serialized by the caller.
+// ============================================================================
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "mini_redis.h"
+
+#define EPOCH_MAX_THREADS (MAX_THREADS + 2)
+#define EPOCH_RECLAIM_BATCH 64        // Retires between reclaim attempts
+
+// One record per reader thread, padded to its own cache line so readers
+// never contend with each other
+typedef struct EpochRecord {
+    _Alignas(64) uint64_t state;      // (epoch << 1) | active
+} EpochRecord;
+
+typedef struct RetiredItem {
+    struct RetiredItem *next;
+    void *ptr;
+    void (*free_fn)(void *);
+    uint64_t epoch;
+} RetiredItem;
+
+static EpochRecord g_records[EPOCH_MAX_THREADS];
+static int g_num_records = 0;
+static uint64_t g_global_epoch = 2;
+
+// Limbo list, newest first (writer-only)
+static RetiredItem *g_limbo = NULL;
+static size_t g_limbo_count = 0;
+static size_t g_retired_since_reclaim = 0;
+
+static _Thread_local int tls_record = -1;
+
+// ============================================================================
+// Reader Side
+// ============================================================================
+static EpochRecord *epoch_record(void) {
+    if (tls_record < 0) {
+        tls_record = __atomic_fetch_add(&g_num_records, 1, __ATOMIC_RELAXED);
+        if (tls_record >= EPOCH_MAX_THREADS) {
+            fprintf(stderr, "[FATAL] Too many epoch reader threads\n");
+            abort();
+        }
+    }
+    return &g_records[tls_record];
+}
+
+void epoch_enter(void) {
+    EpochRecord *rec = epoch_record();
+    uint64_t epoch = __atomic_load_n(&g_global_epoch, __ATOMIC_ACQUIRE);
+
+    // Sequentially consistent: the announcement must be visible before any
+    // shared pointer is read
+    __atomic_store_n(&rec->state, (epoch << 1) | 1, __ATOMIC_SEQ_CST);
+}
+
+void epoch_exit(void) {
+    __atomic_store_n(&epoch_record()->state, 0, __ATOMIC_RELEASE);
+}
+
+// ============================================================================
+// Writer Side
+// ============================================================================
+
+// Advance the global epoch if every active reader has caught up with it
+static void epoch_try_advance(void) {
+    uint64_t global = __atomic_load_n(&g_global_epoch, __ATOMIC_SEQ_CST);
+    int n = __atomic_load_n(&g_num_records, __ATOMIC_ACQUIRE);
+
+    if (n > EPOCH_MAX_THREADS) n = EPOCH_MAX_THREADS;
+    for (int i = 0; i < n; i++) {
+        uint64_t state = __atomic_load_n(&g_records[i].state, __ATOMIC_SEQ_CST);
+        if ((state & 1) && (state >> 1) != global) return;
+    }
+
+    __atomic_store_n(&g_global_epoch, global + 1, __ATOMIC_SEQ_CST);
+}
+
+// Free every item retired at least two epochs ago
+static void epoch_free_expired(void) {
+    uint64_t global = __atomic_load_n(&g_global_epoch, __ATOMIC_ACQUIRE);
+    RetiredItem **link = &g_limbo;
+
+    // The list is newest first: skip items that are still too young
+    while (*link && (*link)->epoch + 2 > global) {
+        link = &(*link)->next;
+    }
+
+    RetiredItem *item = *link;
+    *link = NULL;
+
+    while (item) {
+        RetiredItem *next = item->next;
+        item->free_fn(item->ptr);
+        free(item);
+        g_limbo_count--;
+        item = next;
+    }
+}
+
+void epoch_retire(void *ptr, void (*free_fn)(void *)) {
+    RetiredItem *item = (RetiredItem *)malloc(sizeof(RetiredItem));
+
+    if (!item) {
+        // No memory to defer with: wait for readers to drain instead
+        epoch_synchronize();
+        free_fn(ptr);
+        return;
+    }
+
+    item->ptr = ptr;
+    item->free_fn = free_fn;
+    item->epoch = __atomic_load_n(&g_global_epoch, __ATOMIC_ACQUIRE);
+    item->next = g_limbo;
+    g_limbo = item;
+    g_limbo_count++;
+
+    if (++g_retired_since_reclaim >= EPOCH_RECLAIM_BATCH) {
+        epoch_reclaim();
+    }
+}
+
+void epoch_reclaim(void) {
+    g_retired_since_reclaim = 0;
+    epoch_try_advance();
+    epoch_free_expired();
+}
+
+void epoch_synchronize(void) {
+    // Two full advances guarantee every reader seen so far has left
+    uint64_t target = __atomic_load_n(&g_global_epoch, __ATOMIC_ACQUIRE) + 2;
+
+    while (__atomic_load_n(&g_global_epoch, __ATOMIC_ACQUIRE) < target) {
+        epoch_try_advance();
+    }
+    epoch_free_expired();
+}
+
+size_t epoch_pending(void) {
+    return g_limbo_count;
+}
+
+void epoch_drain(void) {
+    // Shutdown: no readers remain, free everything
+    while (g_limbo) {
+        RetiredItem *next = g_limbo->next;
+        g_limbo->free_fn(g_limbo->ptr);
+        free(g_limbo);
+        g_limbo = next;
+    }
+    g_limbo_count = 0;
+}
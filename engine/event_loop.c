@@ -0,0 +1,1041 @@
+// ============================================================================
+// event_loop.c - Pluggable I/O Backends for Mini-Redis
+// ============================================================================
+//
+// Three backends share one interface:
+//   io_uring - multishot accept, multishot recv into a provided buffer ring,
+//              linked send chains (Linux 6.0+)
+//   epoll    - level-triggered readiness loop (Linux)
+//   poll     - portable readiness loop (everywhere else)
+//
+// The backends only move bytes. Framing, command execution and reply
+// queueing live in server.c (client_feed / client_eof).
+// ============================================================================
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "mini_redis.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <linux/io_uring.h>
+#endif
+
+// How often a blocked loop wakes up to check the running flag
+#define EL_WAIT_TIMEOUT_MS 100
+
+typedef struct IoBackend {
+    const char *name;
+    int  (*init)(EventLoop *el);
+    int  (*add_listener)(EventLoop *el, int fd);
+    void (*run)(EventLoop *el, volatile int *running);
+    void (*close_client)(EventLoop *el, Client *c);
+    void (*destroy)(EventLoop *el);
+} IoBackend;
+
+struct EventLoop {
+    const IoBackend *backend;
+    void *state;                      // Backend-private state
+    int listeners[MAX_LISTENERS];
+    int num_listeners;
+    Client *clients;                  // All connected clients
+    size_t num_clients;
+    TimerWheel *timers;
+    uint64_t now_ms;                  // Cached clock, refreshed per wakeup
+    uint64_t idle_timeout_ms;         // 0 = never close idle clients
+};
+
+// ============================================================================
+// Shared Helpers
+// ============================================================================
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// Idle timer: fires at the earliest moment the client could have been
+// idle long enough; activity since arming just pushes it out again, so
+// busy clients cost nothing per command
+static void idle_timer_fired(TimerWheel *tw, Timer *t) {
+    Client *c = (Client *)t->arg;
+    EventLoop *el = c->el;
+    uint64_t idle = el->now_ms - c->last_active_ms;
+
+    if (idle < el->idle_timeout_ms) {
+        tw_add(tw, t, el->idle_timeout_ms - idle);
+        return;
+    }
+
+    log_info("Client %s idle for %llu s, closing", c->addr,
+             (unsigned long long)(idle / 1000));
+    el->backend->close_client(el, c);
+}
+
+static void el_link_client(EventLoop *el, Client *c) {
+    c->el = el;
+    c->prev = NULL;
+    c->next = el->clients;
+    if (el->clients) el->clients->prev = c;
+    el->clients = c;
+    el->num_clients++;
+
+    c->last_active_ms = el->now_ms;
+    tw_init_timer(&c->idle_timer, idle_timer_fired, c);
+    if (el->idle_timeout_ms > 0) {
+        tw_add(el->timers, &c->idle_timer, el->idle_timeout_ms);
+    }
+}
+
+static void el_unlink_client(EventLoop *el, Client *c) {
+    tw_cancel(el->timers, &c->idle_timer);
+    if (c->prev) c->prev->next = c->next;
+    else el->clients = c->next;
+    if (c->next) c->next->prev = c->prev;
+    el->num_clients--;
+}
+
+// How long a backend may block before timers need attention
+static int el_wait_timeout(EventLoop *el) {
+    return tw_next_timeout(el->timers, tw_now_ms(), EL_WAIT_TIMEOUT_MS);
+}
+
+// Refresh the cached clock and run due timers
+static void el_process_timers(EventLoop *el) {
+    el->now_ms = tw_now_ms();
+    tw_advance(el->timers, el->now_ms);
+}
+
+static void el_free_all_clients(EventLoop *el) {
+    while (el->clients) {
+        Client *c = el->clients;
+        el_unlink_client(el, c);
+        client_free(c);
+    }
+}
+
+// Accept one connection from a readiness backend's listener
+// Returns the new client, or NULL when the queue is drained or on error
+static Client *accept_client(EventLoop *el, int listen_fd) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            log_error("accept() failed: %s", strerror(errno));
+        }
+        return NULL;
+    }
+
+    if (set_nonblocking(fd) < 0) {
+        log_error("fcntl(O_NONBLOCK) failed: %s", strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    Client *c = client_create(fd);
+    if (!c) {
+        close(fd);
+        return NULL;
+    }
+
+    el_link_client(el, c);
+    return c;
+}
+
+// Write as much pending output as the socket accepts
+// Returns 0 when drained, 1 if output remains, -1 on error
+static int flush_replies(Client *c) {
+    while (client_has_pending_reply(c)) {
+        struct iovec iov[16];
+        int iovcnt = 0;
+
+        for (ReplyBlock *b = c->reply_head; b && iovcnt < 16; b = b->next) {
+            if (b->len == b->sent) continue;
+            iov[iovcnt].iov_base = b->data + b->sent;
+            iov[iovcnt].iov_len = b->len - b->sent;
+            iovcnt++;
+        }
+
+        ssize_t n = writev(c->fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 1;
+            log_error("send() failed: %s", strerror(errno));
+            return -1;
+        }
+        client_reply_consume(c, (size_t)n);
+    }
+    return 0;
+}
+
+// Handle a readable client socket (one recv per wakeup for fairness)
+// Returns -1 if the client should be closed
+static int read_client(Client *c) {
+    char buffer[BUFFER_SIZE];
+
+    for (;;) {
+        ssize_t n = recv(c->fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            c->last_active_ms = c->el->now_ms;
+            return client_feed(c, buffer, (size_t)n);
+        }
+        if (n == 0) {
+            client_eof(c);
+            return 0;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+        log_error("recv() failed: %s", strerror(errno));
+        return -1;
+    }
+}
+
+// Output drained below the soft limit: run commands buffered while paused
+// until they run out or the socket pushes back again
+// Returns the flush_replies() result, or -1 on error
+static int resume_client(Client *c) {
+    int rc = 0;
+
+    while (rc == 0 && client_has_pending_input(c)) {
+        size_t before = c->query_len;
+        if (client_process_input(c) != 0) return -1;
+        rc = flush_replies(c);
+        if (c->query_len == before) break;  // Only a partial line is left
+    }
+    return rc;
+}
+
+// ============================================================================
+// poll() Backend
+// ============================================================================
+typedef struct PollState {
+    struct pollfd *fds;
+    Client **owners;        // NULL for listeners
+    size_t cap;
+} PollState;
+
+static int poll_init(EventLoop *el) {
+    PollState *ps = (PollState *)calloc(1, sizeof(PollState));
+    if (!ps) return -1;
+    el->state = ps;
+    return 0;
+}
+
+static int poll_add_listener(EventLoop *el, int fd) {
+    (void)el;
+    return set_nonblocking(fd);
+}
+
+static int poll_reserve(PollState *ps, size_t n) {
+    if (n <= ps->cap) return 0;
+
+    size_t new_cap = ps->cap ? ps->cap : 64;
+    while (new_cap < n) new_cap *= 2;
+
+    struct pollfd *fds = (struct pollfd *)realloc(ps->fds, new_cap * sizeof(*fds));
+    if (!fds) return -1;
+    ps->fds = fds;
+
+    Client **owners = (Client **)realloc(ps->owners, new_cap * sizeof(*owners));
+    if (!owners) return -1;
+    ps->owners = owners;
+
+    ps->cap = new_cap;
+    return 0;
+}
+
+static void poll_close_client(EventLoop *el, Client *c) {
+    el_unlink_client(el, c);
+    client_free(c);
+}
+
+static void poll_run(EventLoop *el, volatile int *running) {
+    PollState *ps = (PollState *)el->state;
+
+    while (*running) {
+        el_process_timers(el);
+
+        if (poll_reserve(ps, el->num_listeners + el->num_clients) != 0) {
+            log_error("poll: out of memory");
+            return;
+        }
+
+        // Rebuild the interest set; cheap compared to the syscall itself
+        nfds_t nfds = 0;
+        for (int i = 0; i < el->num_listeners; i++) {
+            ps->fds[nfds].fd = el->listeners[i];
+            ps->fds[nfds].events = POLLIN;
+            ps->owners[nfds++] = NULL;
+        }
+        for (Client *c = el->clients; c; c = c->next) {
+            ps->fds[nfds].fd = c->fd;
+            ps->fds[nfds].events = (client_can_read(c) ? POLLIN : 0) |
+                                   (client_has_pending_reply(c) ? POLLOUT : 0);
+            ps->owners[nfds++] = c;
+        }
+
+        int ready = poll(ps->fds, nfds, el_wait_timeout(el));
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            log_error("poll() failed: %s", strerror(errno));
+            return;
+        }
+        el->now_ms = tw_now_ms();
+
+        for (nfds_t i = 0; i < nfds && ready > 0; i++) {
+            short revents = ps->fds[i].revents;
+            if (!revents) continue;
+            ready--;
+
+            Client *c = ps->owners[i];
+            if (!c) {
+                while (accept_client(el, ps->fds[i].fd)) {}
+                continue;
+            }
+
+            int rc = 0;
+            if ((revents & (POLLIN | POLLHUP | POLLERR)) && client_can_read(c)) {
+                rc = read_client(c);
+            }
+            if (rc == 0) rc = flush_replies(c);
+            if (rc >= 0) rc = resume_client(c);
+            if (rc < 0 || (c->closing && !client_has_pending_reply(c))) {
+                poll_close_client(el, c);
+            }
+        }
+    }
+}
+
+static void poll_destroy(EventLoop *el) {
+    PollState *ps = (PollState *)el->state;
+    if (!ps) return;
+    free(ps->fds);
+    free(ps->owners);
+    free(ps);
+}
+
+static const IoBackend poll_backend = {
+    "poll", poll_init, poll_add_listener, poll_run, poll_close_client, poll_destroy
+};
+
+#ifdef __linux__
+// ============================================================================
+// epoll Backend
+// ============================================================================
+// Listener registrations carry (fd << 1) | 1 in data.u64; clients carry
+// their (8-byte aligned) Client pointer, so the low bit tells them apart.
+#define EPOLL_MAX_EVENTS 256
+
+typedef struct EpollState {
+    int epfd;
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+} EpollState;
+
+static int epoll_init(EventLoop *el) {
+    EpollState *es = (EpollState *)calloc(1, sizeof(EpollState));
+    if (!es) return -1;
+
+    es->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (es->epfd < 0) {
+        free(es);
+        return -1;
+    }
+
+    el->state = es;
+    return 0;
+}
+
+static int epoll_add_listener(EventLoop *el, int fd) {
+    EpollState *es = (EpollState *)el->state;
+    struct epoll_event ev;
+
+    if (set_nonblocking(fd) < 0) return -1;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = ((uint64_t)fd << 1) | 1;
+    return epoll_ctl(es->epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+// Keep the registered interest in sync with the client's state
+static int epoll_update(EpollState *es, Client *c) {
+    int want = (client_can_read(c) ? EPOLLIN : 0) |
+               (client_has_pending_reply(c) ? EPOLLOUT : 0);
+    if (want == c->io_events) return 0;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = want;
+    ev.data.ptr = c;
+    c->io_events = want;
+    return epoll_ctl(es->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+static void epoll_close_client(EventLoop *el, Client *c) {
+    EpollState *es = (EpollState *)el->state;
+    epoll_ctl(es->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    el_unlink_client(el, c);
+    client_free(c);
+}
+
+static void epoll_accept(EventLoop *el, int listen_fd) {
+    EpollState *es = (EpollState *)el->state;
+    Client *c;
+
+    while ((c = accept_client(el, listen_fd)) != NULL) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = c;
+        c->io_events = EPOLLIN;
+
+        if (epoll_ctl(es->epfd, EPOLL_CTL_ADD, c->fd, &ev) < 0) {
+            log_error("epoll_ctl() failed: %s", strerror(errno));
+            el_unlink_client(el, c);
+            client_free(c);
+        }
+    }
+}
+
+static void epoll_run(EventLoop *el, volatile int *running) {
+    EpollState *es = (EpollState *)el->state;
+
+    while (*running) {
+        int n = epoll_wait(es->epfd, es->events, EPOLL_MAX_EVENTS, el_wait_timeout(el));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            log_error("epoll_wait() failed: %s", strerror(errno));
+            return;
+        }
+        el->now_ms = tw_now_ms();
+
+        for (int i = 0; i < n; i++) {
+            struct epoll_event *ev = &es->events[i];
+
+            if (ev->data.u64 & 1) {
+                epoll_accept(el, (int)(ev->data.u64 >> 1));
+                continue;
+            }
+
+            Client *c = (Client *)ev->data.ptr;
+            int rc = 0;
+            if ((ev->events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && client_can_read(c)) {
+                rc = read_client(c);
+            }
+            if (rc == 0) rc = flush_replies(c);
+            if (rc >= 0) rc = resume_client(c);
+            if (rc >= 0 && c->closing && !client_has_pending_reply(c)) rc = -1;
+            if (rc >= 0) rc = epoll_update(es, c);
+
+            if (rc < 0) epoll_close_client(el, c);
+        }
+
+        el_process_timers(el);
+    }
+}
+
+static void epoll_destroy(EventLoop *el) {
+    EpollState *es = (EpollState *)el->state;
+    if (!es) return;
+    close(es->epfd);
+    free(es);
+}
+
+static const IoBackend epoll_backend = {
+    "epoll", epoll_init, epoll_add_listener, epoll_run, epoll_close_client, epoll_destroy
+};
+
+// ============================================================================
+// io_uring Backend
+// ============================================================================
+// Submission user_data is a tagged pointer: the low 3 bits carry the
+// operation, the rest a Client pointer (or a listener index for accepts).
+#define URING_ENTRIES 1024
+#define URING_BUF_COUNT 256           // Provided receive buffers (power of 2)
+#define URING_BUF_GROUP 0
+
+enum { OP_ACCEPT = 1, OP_RECV = 2, OP_SEND = 3, OP_CANCEL = 4 };
+
+#define URING_TAG(ptr, op) ((uint64_t)(uintptr_t)(ptr) | (op))
+#define URING_OP(data) ((int)((data) & 7))
+#define URING_PTR(data) ((void *)(uintptr_t)((data) & ~(uint64_t)7))
+
+typedef struct UringState {
+    int ring_fd;
+
+    // Submission queue
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned sq_local_tail;           // Tail including unpublished SQEs
+    unsigned sq_pending;              // SQEs not yet passed to io_uring_enter
+    struct io_uring_sqe *sqes;
+
+    // Completion queue
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    // Mappings (for teardown)
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+
+    // Provided buffer ring for multishot recv
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_size;
+    char *bufs;
+    unsigned short buf_tail;
+} UringState;
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                              unsigned flags, void *arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                        flags, arg, argsz);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr);
+}
+
+// Multishot recv and buffer rings need Linux 6.0
+static int uring_kernel_supported(void) {
+    struct utsname u;
+    int major = 0, minor = 0;
+
+    if (uname(&u) != 0) return 0;
+    if (sscanf(u.release, "%d.%d", &major, &minor) != 2) return 0;
+    return major > 6 || (major == 6 && minor >= 0);
+}
+
+static void uring_publish_sq(UringState *us) {
+    __atomic_store_n(us->sq_tail, us->sq_local_tail, __ATOMIC_RELEASE);
+}
+
+static int uring_submit(UringState *us) {
+    uring_publish_sq(us);
+    while (us->sq_pending > 0) {
+        int ret = sys_io_uring_enter(us->ring_fd, us->sq_pending, 0, 0, NULL, 0);
+        if (ret < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+            return -1;
+        }
+        us->sq_pending -= (unsigned)ret;
+    }
+    return 0;
+}
+
+static struct io_uring_sqe *uring_get_sqe(UringState *us) {
+    unsigned head = __atomic_load_n(us->sq_head, __ATOMIC_ACQUIRE);
+
+    if (us->sq_local_tail - head >= URING_ENTRIES) {
+        // Ring full: hand what we have to the kernel first
+        if (uring_submit(us) != 0) return NULL;
+        head = __atomic_load_n(us->sq_head, __ATOMIC_ACQUIRE);
+        if (us->sq_local_tail - head >= URING_ENTRIES) return NULL;
+    }
+
+    unsigned index = us->sq_local_tail & *us->sq_mask;
+    struct io_uring_sqe *sqe = &us->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    us->sq_array[index] = index;
+    us->sq_local_tail++;
+    us->sq_pending++;
+    return sqe;
+}
+
+static void uring_recycle_buffer(UringState *us, unsigned short bid) {
+    struct io_uring_buf *buf =
+        &us->buf_ring->bufs[us->buf_tail & (URING_BUF_COUNT - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(us->bufs + (size_t)bid * BUFFER_SIZE);
+    buf->len = BUFFER_SIZE;
+    buf->bid = bid;
+    us->buf_tail++;
+    __atomic_store_n(&us->buf_ring->tail, us->buf_tail, __ATOMIC_RELEASE);
+}
+
+static int uring_arm_accept(EventLoop *el, int index) {
+    UringState *us = (UringState *)el->state;
+    struct io_uring_sqe *sqe = uring_get_sqe(us);
+    if (!sqe) return -1;
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = el->listeners[index];
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = URING_TAG((uintptr_t)index << 3, OP_ACCEPT);
+    return 0;
+}
+
+static int uring_arm_recv(UringState *us, Client *c) {
+    struct io_uring_sqe *sqe = uring_get_sqe(us);
+    if (!sqe) return -1;
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = c->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = URING_TAG(c, OP_RECV);
+    c->io_refs++;
+    c->io_recv_armed = 1;
+    return 0;
+}
+
+// Stop the multishot recv of a client that must not be read (output
+// backpressure); it is re-armed once the client can read again
+static int uring_cancel_recv(UringState *us, Client *c) {
+    struct io_uring_sqe *sqe = uring_get_sqe(us);
+    if (!sqe) return -1;
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = URING_TAG(c, OP_RECV);
+    sqe->user_data = URING_TAG(c, OP_CANCEL);
+    c->io_refs++;
+    c->io_recv_cancel = 1;
+    return 0;
+}
+
+// Submit every unsent reply block as one linked chain of sends. The chain
+// keeps replies ordered without waiting for each completion in turn.
+static int uring_arm_sends(UringState *us, Client *c) {
+    struct io_uring_sqe *prev = NULL;
+
+    if (c->io_sends > 0 || c->io_dead) return 0;
+
+    for (ReplyBlock *b = c->reply_head; b; b = b->next) {
+        if (b->len == b->sent) continue;
+
+        struct io_uring_sqe *sqe = uring_get_sqe(us);
+        if (!sqe) return -1;
+
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = c->fd;
+        sqe->addr = (uint64_t)(uintptr_t)(b->data + b->sent);
+        sqe->len = (uint32_t)(b->len - b->sent);
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        sqe->user_data = URING_TAG(c, OP_SEND);
+        if (prev) prev->flags |= IOSQE_IO_LINK;
+        prev = sqe;
+
+        b->inflight = 1;
+        c->io_sends++;
+        c->io_refs++;
+    }
+    return 0;
+}
+
+// Shut the socket down so every outstanding operation completes; the client
+// is freed once the kernel has handed all of them back.
+static void uring_close_client(EventLoop *el, Client *c) {
+    if (!c->io_dead) {
+        c->io_dead = 1;
+        shutdown(c->fd, SHUT_RDWR);
+    }
+    if (c->io_refs == 0) {
+        el_unlink_client(el, c);
+        client_free(c);
+    }
+}
+
+// Queue sends, apply read backpressure, or close once a finished client
+// has drained its output
+static void uring_after_io(EventLoop *el, Client *c) {
+    UringState *us = (UringState *)el->state;
+    int rc = 0;
+
+    if (c->io_dead || c->killed) {
+        uring_close_client(el, c);
+        return;
+    }
+    if (client_has_pending_input(c) && client_process_input(c) != 0) {
+        uring_close_client(el, c);
+        return;
+    }
+    if (client_has_pending_reply(c)) {
+        rc = uring_arm_sends(us, c);
+    } else if (c->closing && c->io_sends == 0) {
+        uring_close_client(el, c);
+        return;
+    }
+
+    if (rc == 0 && !c->closing) {
+        int can_read = client_can_read(c);
+        if (!can_read && c->io_recv_armed && !c->io_recv_cancel) {
+            rc = uring_cancel_recv(us, c);
+        } else if (can_read && !c->io_recv_armed) {
+            rc = uring_arm_recv(us, c);
+        }
+    }
+
+    if (rc != 0) uring_close_client(el, c);
+}
+
+static void uring_handle_accept(EventLoop *el, struct io_uring_cqe *cqe,
+                                volatile int *running) {
+    UringState *us = (UringState *)el->state;
+    int index = (int)((uintptr_t)URING_PTR(cqe->user_data) >> 3);
+
+    if (cqe->res >= 0) {
+        Client *c = client_create(cqe->res);
+        if (!c) {
+            close(cqe->res);
+        } else {
+            el_link_client(el, c);
+            if (uring_arm_recv(us, c) != 0) uring_close_client(el, c);
+        }
+    } else if (cqe->res != -ECANCELED) {
+        log_error("io_uring accept failed: %s", strerror(-cqe->res));
+    }
+
+    if (!(cqe->flags & IORING_CQE_F_MORE) && *running) {
+        uring_arm_accept(el, index);
+    }
+}
+
+static void uring_handle_recv(EventLoop *el, struct io_uring_cqe *cqe) {
+    UringState *us = (UringState *)el->state;
+    Client *c = (Client *)URING_PTR(cqe->user_data);
+    int more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+    int rc = 0;
+
+    if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+        unsigned short bid = (unsigned short)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        if (!c->io_dead) {
+            c->last_active_ms = el->now_ms;
+            rc = client_feed(c, us->bufs + (size_t)bid * BUFFER_SIZE, (size_t)cqe->res);
+        }
+        uring_recycle_buffer(us, bid);
+    } else if (cqe->res == 0) {
+        if (!c->io_dead) client_eof(c);
+    } else if (cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -ECANCELED) {
+        if (!c->io_dead) log_error("recv() failed: %s", strerror(-cqe->res));
+        rc = -1;
+    }
+
+    // Buffer starvation, cancellation or a kernel-side stop end the
+    // multishot recv; uring_after_io re-arms it while the client is readable
+    if (!more) {
+        c->io_refs--;
+        c->io_recv_armed = 0;
+    }
+
+    if (rc < 0) {
+        uring_close_client(el, c);
+        return;
+    }
+    uring_after_io(el, c);
+}
+
+static void uring_handle_send(EventLoop *el, struct io_uring_cqe *cqe) {
+    Client *c = (Client *)URING_PTR(cqe->user_data);
+    ReplyBlock *b = c->reply_head;
+
+    // Linked sends complete in submission order: this is the first block
+    // still marked in flight
+    while (b && !b->inflight) b = b->next;
+
+    c->io_sends--;
+    c->io_refs--;
+
+    if (b) {
+        b->inflight = 0;
+        if (cqe->res > 0) {
+            client_reply_consume(c, (size_t)cqe->res);
+        } else if (cqe->res < 0 && cqe->res != -ECANCELED && cqe->res != -EAGAIN) {
+            if (!c->io_dead) log_error("send() failed: %s", strerror(-cqe->res));
+            uring_close_client(el, c);
+            return;
+        }
+    }
+
+    if (c->io_sends == 0) uring_after_io(el, c);
+    else if (c->io_dead) uring_close_client(el, c);
+}
+
+static void uring_handle_cancel(EventLoop *el, struct io_uring_cqe *cqe) {
+    Client *c = (Client *)URING_PTR(cqe->user_data);
+
+    c->io_refs--;
+    c->io_recv_cancel = 0;
+    uring_after_io(el, c);
+}
+
+static int uring_init(EventLoop *el) {
+    if (!uring_kernel_supported()) return -1;
+
+    UringState *us = (UringState *)calloc(1, sizeof(UringState));
+    if (!us) return -1;
+    us->ring_fd = -1;
+    el->state = us;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = URING_ENTRIES * 4;
+
+    us->ring_fd = sys_io_uring_setup(URING_ENTRIES, &params);
+    if (us->ring_fd < 0) return -1;
+
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) ||
+        !(params.features & IORING_FEAT_EXT_ARG)) {
+        return -1;
+    }
+
+    // Map the rings (single mapping covers both SQ and CQ rings)
+    us->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    us->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (us->cq_ring_size > us->sq_ring_size) us->sq_ring_size = us->cq_ring_size;
+
+    us->sq_ring = mmap(NULL, us->sq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, us->ring_fd, IORING_OFF_SQ_RING);
+    if (us->sq_ring == MAP_FAILED) {
+        us->sq_ring = NULL;
+        return -1;
+    }
+    us->cq_ring = us->sq_ring;
+
+    us->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    us->sqes = (struct io_uring_sqe *)mmap(NULL, us->sqes_size, PROT_READ | PROT_WRITE,
+                                           MAP_SHARED | MAP_POPULATE, us->ring_fd,
+                                           IORING_OFF_SQES);
+    if (us->sqes == MAP_FAILED) {
+        us->sqes = NULL;
+        return -1;
+    }
+
+    char *sq = (char *)us->sq_ring;
+    us->sq_head = (unsigned *)(sq + params.sq_off.head);
+    us->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    us->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    us->sq_array = (unsigned *)(sq + params.sq_off.array);
+    us->sq_local_tail = *us->sq_tail;
+
+    char *cq = (char *)us->cq_ring;
+    us->cq_head = (unsigned *)(cq + params.cq_off.head);
+    us->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    us->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    us->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    // Register the provided buffer ring used by multishot recv
+    us->buf_ring_size = URING_BUF_COUNT * sizeof(struct io_uring_buf);
+    us->buf_ring = (struct io_uring_buf_ring *)mmap(NULL, us->buf_ring_size,
+                                                    PROT_READ | PROT_WRITE,
+                                                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (us->buf_ring == MAP_FAILED) {
+        us->buf_ring = NULL;
+        return -1;
+    }
+
+    us->bufs = (char *)malloc((size_t)URING_BUF_COUNT * BUFFER_SIZE);
+    if (!us->bufs) return -1;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)us->buf_ring;
+    reg.ring_entries = URING_BUF_COUNT;
+    reg.bgid = URING_BUF_GROUP;
+    if (sys_io_uring_register(us->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        return -1;
+    }
+
+    us->buf_tail = 0;
+    for (unsigned i = 0; i < URING_BUF_COUNT; i++) {
+        uring_recycle_buffer(us, (unsigned short)i);
+    }
+
+    return 0;
+}
+
+static int uring_add_listener(EventLoop *el, int fd) {
+    (void)fd;  // Already stored at listeners[num_listeners]
+    return uring_arm_accept(el, el->num_listeners);
+}
+
+static void uring_run(EventLoop *el, volatile int *running) {
+    UringState *us = (UringState *)el->state;
+
+    while (*running) {
+        struct __kernel_timespec ts = { 0, el_wait_timeout(el) * 1000000LL };
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+
+        // Submit everything queued and wait for at least one completion
+        uring_publish_sq(us);
+        int ret = sys_io_uring_enter(us->ring_fd, us->sq_pending, 1,
+                                     IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                                     &arg, sizeof(arg));
+        if (ret < 0) {
+            if (errno != EINTR && errno != ETIME && errno != EAGAIN && errno != EBUSY) {
+                log_error("io_uring_enter() failed: %s", strerror(errno));
+                return;
+            }
+        } else {
+            us->sq_pending -= (unsigned)ret;
+        }
+
+        el->now_ms = tw_now_ms();
+
+        unsigned head = *us->cq_head;
+        unsigned tail = __atomic_load_n(us->cq_tail, __ATOMIC_ACQUIRE);
+
+        while (head != tail) {
+            struct io_uring_cqe *cqe = &us->cqes[head & *us->cq_mask];
+
+            switch (URING_OP(cqe->user_data)) {
+                case OP_ACCEPT: uring_handle_accept(el, cqe, running); break;
+                case OP_RECV:   uring_handle_recv(el, cqe); break;
+                case OP_SEND:   uring_handle_send(el, cqe); break;
+                case OP_CANCEL: uring_handle_cancel(el, cqe); break;
+                default: break;
+            }
+
+            head++;
+            __atomic_store_n(us->cq_head, head, __ATOMIC_RELEASE);
+            if (head == tail) {
+                tail = __atomic_load_n(us->cq_tail, __ATOMIC_ACQUIRE);
+            }
+        }
+
+        el_process_timers(el);
+    }
+}
+
+static void uring_destroy(EventLoop *el) {
+    UringState *us = (UringState *)el->state;
+    if (!us) return;
+
+    // Ring teardown is asynchronous and pending accepts keep the listening
+    // sockets alive until it finishes; shut them down so the port is
+    // released immediately
+    for (int i = 0; i < el->num_listeners; i++) {
+        shutdown(el->listeners[i], SHUT_RDWR);
+    }
+
+    // Closing the ring cancels every outstanding operation, so clients can
+    // be freed directly afterwards
+    if (us->ring_fd >= 0) close(us->ring_fd);
+    if (us->sqes) munmap(us->sqes, us->sqes_size);
+    if (us->sq_ring) munmap(us->sq_ring, us->sq_ring_size);
+    if (us->buf_ring) munmap(us->buf_ring, us->buf_ring_size);
+    free(us->bufs);
+    free(us);
+}
+
+static const IoBackend uring_backend = {
+    "io_uring", uring_init, uring_add_listener, uring_run, uring_close_client,
+    uring_destroy
+};
+#endif // __linux__
+
+// ============================================================================
+// Backend Selection
+// ============================================================================
+// Ordered by preference; "auto" (or an unavailable choice) walks the list
+// from the requested backend onwards.
+static const IoBackend *const backends[] = {
+#ifdef __linux__
+    &uring_backend,
+    &epoll_backend,
+#endif
+    &poll_backend,
+};
+
+#define NUM_BACKENDS (sizeof(backends) / sizeof(backends[0]))
+
+EventLoop *el_create(const char *backend) {
+    size_t start = 0;
+
+    if (backend && strcmp(backend, "auto") != 0) {
+        while (start < NUM_BACKENDS && strcmp(backends[start]->name, backend) != 0) {
+            start++;
+        }
+        if (start == NUM_BACKENDS) {
+            log_error("Unknown I/O backend '%s', using auto", backend);
+            start = 0;
+        }
+    }
+
+    EventLoop *el = (EventLoop *)calloc(1, sizeof(EventLoop));
+    if (!el) return NULL;
+
+    el->timers = tw_create();
+    if (!el->timers) {
+        free(el);
+        return NULL;
+    }
+    el->now_ms = tw_now_ms();
+
+    for (size_t i = start; i < NUM_BACKENDS; i++) {
+        el->state = NULL;
+        if (backends[i]->init(el) == 0) {
+            el->backend = backends[i];
+            if (i != start) {
+                log_info("I/O backend '%s' unavailable, fell back to '%s'",
+                         backends[start]->name, backends[i]->name);
+            }
+            return el;
+        }
+        backends[i]->destroy(el);
+    }
+
+    tw_destroy(el->timers);
+    free(el);
+    return NULL;
+}
+
+const char *el_backend_name(const EventLoop *el) {
+    return el->backend->name;
+}
+
+int el_add_listener(EventLoop *el, int fd) {
+    if (el->num_listeners >= MAX_LISTENERS) return -1;
+    el->listeners[el->num_listeners] = fd;
+    if (el->backend->add_listener(el, fd) != 0) return -1;
+    el->num_listeners++;
+    return 0;
+}
+
+void el_run(EventLoop *el, volatile int *running) {
+    el->backend->run(el, running);
+}
+
+TimerWheel *el_timers(EventLoop *el) {
+    return el->timers;
+}
+
+void el_set_idle_timeout(EventLoop *el, int seconds) {
+    el->idle_timeout_ms = seconds > 0 ? (uint64_t)seconds * 1000 : 0;
+}
+
+void el_close_client(EventLoop *el, Client *c) {
+    el->backend->close_client(el, c);
+}
+
+void el_destroy(EventLoop *el) {
+    if (!el) return;
+    el->backend->destroy(el);
+    el_free_all_clients(el);
+    tw_destroy(el->timers);
+    free(el);
+}
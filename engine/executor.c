@@ -0,0 +1,269 @@
+// ============================================================================
+// executor.c - Single Command Executor Fed by I/O Threads
+// ============================================================================
+//
+// In executor mode the worker threads only do I/O: they read sockets, frame
+// command lines and write replies. Every command is executed by one thread
+// that owns the hash table, so the table keeps its single-threaded design.
+//
+// Each I/O thread has a channel: a request ring (I/O thread -> executor) and
+// a reply ring (executor -> I/O thread). Both are single-producer /
+// single-consumer, so a hand-off is one release store. A batch's replies
+// stream back while the executor is still running the rest of it. Either
+// side spins briefly when its ring is empty, then sleeps until woken.
+// ============================================================================
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include "mini_redis.h"
+
+#define EXEC_RING_SIZE 256            // Power of two
+#define EXEC_SPIN 64                  // Empty polls before sleeping
+#define EXEC_IDLE_WAIT_MS 100         // Executor re-checks the running flag
+
+// ============================================================================
+// SPSC Ring
+// ============================================================================
+typedef struct SpscRing {
+    _Alignas(64) size_t head;         // Next slot to pop (consumer)
+    _Alignas(64) size_t tail;         // Next slot to push (producer)
+    _Alignas(64) void *slots[EXEC_RING_SIZE];
+} SpscRing;
+
+static int spsc_push(SpscRing *r, void *item) {
+    size_t tail = r->tail;
+    if (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == EXEC_RING_SIZE) return 0;
+
+    r->slots[tail & (EXEC_RING_SIZE - 1)] = item;
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_SEQ_CST);
+    return 1;
+}
+
+static void *spsc_pop(SpscRing *r) {
+    size_t head = r->head;
+    if (head == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)) return NULL;
+
+    void *item = r->slots[head & (EXEC_RING_SIZE - 1)];
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+    return item;
+}
+
+static int spsc_empty(SpscRing *r) {
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) ==
+           __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST);
+}
+
+// ============================================================================
+// Sleep / Wake
+// ============================================================================
+// The sleeper publishes its flag and re-checks its ring before waiting; the
+// waker publishes its item before reading the flag. With both sides
+// sequentially consistent one of them always sees the other.
+typedef struct Waiter {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int sleeping;
+} Waiter;
+
+static void waiter_init(Waiter *w) {
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    w->sleeping = 0;
+}
+
+static void waiter_destroy(Waiter *w) {
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+}
+
+static void waiter_wake(Waiter *w) {
+    if (!__atomic_load_n(&w->sleeping, __ATOMIC_SEQ_CST)) return;
+    pthread_mutex_lock(&w->lock);
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+// Sleep until woken or timeout_ms passes, unless ready() already holds
+static void waiter_sleep(Waiter *w, int (*ready)(void *), void *arg, int timeout_ms) {
+    pthread_mutex_lock(&w->lock);
+    __atomic_store_n(&w->sleeping, 1, __ATOMIC_SEQ_CST);
+
+    if (!ready(arg)) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += timeout_ms / 1000;
+        ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&w->cond, &w->lock, &ts);
+    }
+
+    __atomic_store_n(&w->sleeping, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&w->lock);
+}
+
+// ============================================================================
+// Channels
+// ============================================================================
+typedef struct ExecChannel {
+    SpscRing requests;                // char * command lines
+    SpscRing replies;                 // char * replies, in request order
+    Waiter waiter;                    // I/O thread waiting for replies
+    void *ctx;                        // Passed to execute for the lines in flight
+} ExecChannel;
+
+static ExecChannel *g_channels = NULL;
+static int g_num_channels = 0;
+static int g_bound_channels = 0;      // I/O threads that may still submit
+static Waiter g_exec_waiter;          // Executor waiting for requests
+
+// Pushed in place of a reply the executor could not allocate
+static char g_exec_failed;
+
+static _Thread_local ExecChannel *tls_channel = NULL;
+
+int exec_init(int num_channels) {
+    g_channels = (ExecChannel *)aligned_alloc(64, sizeof(ExecChannel) * (size_t)num_channels);
+    if (!g_channels) return -1;
+
+    memset(g_channels, 0, sizeof(ExecChannel) * (size_t)num_channels);
+    for (int i = 0; i < num_channels; i++) {
+        waiter_init(&g_channels[i].waiter);
+    }
+    waiter_init(&g_exec_waiter);
+    g_num_channels = num_channels;
+    return 0;
+}
+
+void exec_destroy(void) {
+    if (!g_channels) return;
+    for (int i = 0; i < g_num_channels; i++) {
+        waiter_destroy(&g_channels[i].waiter);
+    }
+    waiter_destroy(&g_exec_waiter);
+    free(g_channels);
+    g_channels = NULL;
+    g_num_channels = 0;
+}
+
+void exec_bind_thread(int index) {
+    tls_channel = &g_channels[index];
+    __atomic_add_fetch(&g_bound_channels, 1, __ATOMIC_SEQ_CST);
+}
+
+void exec_unbind_thread(void) {
+    if (!tls_channel) return;
+    tls_channel = NULL;
+    __atomic_sub_fetch(&g_bound_channels, 1, __ATOMIC_SEQ_CST);
+    waiter_wake(&g_exec_waiter);
+}
+
+// ============================================================================
+// I/O Thread Side
+// ============================================================================
+static int replies_ready(void *arg) {
+    return !spsc_empty(&((ExecChannel *)arg)->replies);
+}
+
+int exec_submit(void *ctx, char **lines, size_t count, ExecReplyFn on_reply, void *arg) {
+    ExecChannel *ch = tls_channel;
+    size_t pushed = 0, done = 0;
+    int spins = 0;
+    int rc = 0;
+
+    // Every earlier line has been answered, so the executor is done with
+    // the old context; pushing the first line publishes the new one
+    ch->ctx = ctx;
+
+    while (done < count) {
+        size_t before = pushed;
+        while (pushed < count && spsc_push(&ch->requests, lines[pushed])) pushed++;
+        if (pushed != before) waiter_wake(&g_exec_waiter);
+
+        char *reply;
+        int progress = 0;
+        while ((reply = (char *)spsc_pop(&ch->replies)) != NULL) {
+            if (reply == &g_exec_failed) {
+                rc = -1;
+            } else {
+                if (rc == 0 && on_reply(arg, done, reply) != 0) rc = -1;
+                free(reply);
+            }
+            done++;
+            progress = 1;
+        }
+
+        if (progress || pushed != before) {
+            spins = 0;
+        } else if (++spins < EXEC_SPIN) {
+            sched_yield();
+        } else {
+            waiter_sleep(&ch->waiter, replies_ready, ch, EXEC_IDLE_WAIT_MS);
+            spins = 0;
+        }
+    }
+
+    return rc;
+}
+
+// ============================================================================
+// Executor Thread
+// ============================================================================
+static int requests_ready(void *arg) {
+    (void)arg;
+    for (int i = 0; i < g_num_channels; i++) {
+        if (!spsc_empty(&g_channels[i].requests)) return 1;
+    }
+    return 0;
+}
+
+void exec_run(ExecCommandFn execute, volatile int *running) {
+    int spins = 0;
+
+    // Keep serving until the last I/O thread has left: one may be blocked
+    // waiting for replies when the server is asked to stop
+    while (*running || __atomic_load_n(&g_bound_channels, __ATOMIC_SEQ_CST) > 0) {
+        int progress = 0;
+
+        // Round-robin, one ring's worth per channel so no I/O thread starves
+        for (int i = 0; i < g_num_channels; i++) {
+            ExecChannel *ch = &g_channels[i];
+            char *line;
+            int served = 0;
+
+            while (served < EXEC_RING_SIZE && (line = (char *)spsc_pop(&ch->requests)) != NULL) {
+                char *reply = execute(ch->ctx, line);
+
+                // The I/O thread is draining replies concurrently, so the
+                // ring only fills when it holds a full batch of them
+                void *item = reply ? (void *)reply : (void *)&g_exec_failed;
+                while (!spsc_push(&ch->replies, item)) {
+                    waiter_wake(&ch->waiter);
+                    sched_yield();
+                }
+                served++;
+            }
+
+            if (served) {
+                waiter_wake(&ch->waiter);
+                progress = 1;
+            }
+        }
+
+        if (progress) {
+            spins = 0;
+        } else if (++spins < EXEC_SPIN) {
+            sched_yield();
+        } else {
+            waiter_sleep(&g_exec_waiter, requests_ready, NULL, EXEC_IDLE_WAIT_MS);
+            spins = 0;
+        }
+    }
+}
@@ -0,0 +1,905 @@
+// ============================================================================
+// filters.c - Bloom and Cuckoo Filters
+// ============================================================================
+//
+// Probabilistic set membership in a few bits per item instead of a key
+// each: a filter answers "not seen" exactly and "seen" with a small,
+// configurable false positive rate.
+//   - Bloom filters are blocked: an item's bits all lie in one 64-byte
+//     block, so a check touches one cache line per layer. Each layer is
+//     sized for its error rate; once full, a new layer `expansion` times
+//     larger with half the error rate is added, keeping the overall rate
+//     under the one asked for
+//   - Cuckoo filters keep a 16-bit fingerprint per item in one of two
+//     4-slot buckets, so an item can also be deleted. A full filter gets
+//     a new layer, as a Bloom filter does
+//   - BF.MADD, BF.MEXISTS, CF.MEXISTS and CF.INSERT hash a group of items
+//     and prefetch all of their blocks before probing any, so the cache
+//     misses of a group overlap instead of queueing
+// ============================================================================
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <math.h>
+#include "mini_redis.h"
+
+#define FILTER_BLOCK 64            // Cache line: a Bloom block, 8 Cuckoo buckets
+#define FILTER_GROUP 16            // Items hashed and prefetched together
+#define FILTER_MAX_LAYERS 32
+#define BF_BLOCK_BITS 512
+#define BF_MAX_HASHES 24
+#define BF_DEFAULT_ERROR 0.01
+#define BF_DEFAULT_CAPACITY 100
+#define BF_DEFAULT_EXPANSION 2
+#define CF_BUCKET_SIZE 4
+#define CF_DEFAULT_CAPACITY 1024
+#define CF_DEFAULT_EXPANSION 1
+#define CF_DEFAULT_MAX_ITERATIONS 20
+#define CF_MAX_ITERATIONS 1024
+#define FILTER_MAX_CAPACITY (1ULL << 36)
+#define LN2 0.69314718055994530942
+
+typedef struct BloomLayer {
+    uint64_t *blocks;         // nblocks * 8 words, cache-line aligned
+    uint64_t nblocks;         // Below 2^32
+    uint64_t capacity;
+    uint64_t count;           // Items added to this layer
+    int hashes;               // Bits set per item
+    double error;
+} BloomLayer;
+
+struct BloomFilter {
+    BloomLayer layers[FILTER_MAX_LAYERS];
+    int num_layers;
+    unsigned expansion;       // 0: a full filter refuses new items
+    double error;             // Rate asked for
+    uint64_t items;
+    size_t memory;            // Allocator bytes of all of the above
+};
+
+typedef struct CuckooLayer {
+    uint16_t *slots;          // nbuckets * CF_BUCKET_SIZE, 0 is empty
+    uint64_t nbuckets;        // Power of two
+    uint64_t count;
+} CuckooLayer;
+
+struct CuckooFilter {
+    CuckooLayer layers[FILTER_MAX_LAYERS];
+    int num_layers;
+    unsigned expansion;
+    unsigned max_iterations;  // Evictions tried before a layer is full
+    uint64_t inserted;
+    uint64_t deleted;
+    uint64_t rng;
+    size_t memory;
+};
+
+// ============================================================================
+// Hashing and Allocation
+// ============================================================================
+// FNV-1a, then a murmur finalizer so every bit depends on every byte
+static uint64_t item_hash(const char *item) {
+    uint64_t h = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)item; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Cache-line aligned and zeroed; size is a multiple of FILTER_BLOCK
+static void *block_alloc(size_t *memory, size_t size) {
+    void *ptr = aligned_alloc(FILTER_BLOCK, size);
+    if (!ptr) return NULL;
+    memset(ptr, 0, size);
+    *memory += alloc_usable_size(ptr, size);
+    return ptr;
+}
+
+// ============================================================================
+// Bloom Filters
+// ============================================================================
+// False positive rate of a blocked filter with the given bits per item and
+// hashes. Blocks do not all fill alike: the items in one follow a Poisson
+// distribution, and the fuller blocks cost more than the emptier ones save.
+static double bloom_rate(double bits_per_item, int hashes) {
+    double load = BF_BLOCK_BITS / bits_per_item;
+    double p = exp(-load), rate = 0;
+
+    for (int n = 0; n < load + 12 * sqrt(load) + 12; n++) {
+        rate += p * pow(1 - pow(1 - 1.0 / BF_BLOCK_BITS, (double)n * hashes), hashes);
+        p *= load / (n + 1);
+    }
+    return rate;
+}
+
+// Bits per item, and the hashes for them, that bring a layer to the error
+// rate: the classic size for an unblocked filter, grown until it does.
+// At least a bit each, which also keeps exp(-load) from underflowing.
+static double bloom_size(double error, int *hashes) {
+    double bits_per_item = fmax(-log(error) / (LN2 * LN2), 1.0);
+
+    for (;; bits_per_item *= 1.02) {
+        for (int k = 1; k <= BF_MAX_HASHES; k++) {
+            if (bloom_rate(bits_per_item, k) <= error) {
+                *hashes = k;
+                return bits_per_item;
+            }
+        }
+    }
+}
+
+static int bloom_add_layer(BloomFilter *bf, uint64_t capacity, double error) {
+    if (bf->num_layers == FILTER_MAX_LAYERS) return -1;
+
+    int hashes;
+    double bits_per_item = bloom_size(error, &hashes);
+    double blocks = ceil((double)capacity * bits_per_item / BF_BLOCK_BITS);
+    if (blocks >= 4294967296.0) return -1;
+
+    BloomLayer *layer = &bf->layers[bf->num_layers];
+    layer->nblocks = blocks < 1 ? 1 : (uint64_t)blocks;
+    layer->blocks = (uint64_t *)block_alloc(&bf->memory, layer->nblocks * FILTER_BLOCK);
+    if (!layer->blocks) return -1;
+
+    layer->hashes = hashes;
+    layer->capacity = capacity;
+    layer->count = 0;
+    layer->error = error;
+    bf->num_layers++;
+    return 0;
+}
+
+static BloomFilter *bloom_create(uint64_t capacity, double error, unsigned expansion) {
+    BloomFilter *bf = (BloomFilter *)calloc(1, sizeof(BloomFilter));
+    if (!bf) return NULL;
+
+    bf->memory = alloc_usable_size(bf, sizeof(BloomFilter));
+    bf->expansion = expansion;
+    bf->error = error;
+    // Layers at error/2, error/4, ... sum to under the rate asked for
+    if (bloom_add_layer(bf, capacity, expansion ? error / 2 : error) != 0) {
+        free(bf);
+        return NULL;
+    }
+    return bf;
+}
+
+void bloom_free(BloomFilter *bf) {
+    if (!bf) return;
+    for (int i = 0; i < bf->num_layers; i++) free(bf->layers[i].blocks);
+    free(bf);
+}
+
+size_t bloom_memory(const BloomFilter *bf) {
+    return bf->memory;
+}
+
+static const uint64_t *bloom_block(const BloomLayer *layer, uint64_t hash) {
+    // Multiply-shift maps the top half of the hash onto the blocks
+    return layer->blocks + (((hash >> 32) * layer->nblocks) >> 32) * 8;
+}
+
+// The item's bits within its block. Double hashing repeats its patterns
+// too often within 512 bits, so each bit is drawn from a mixed sequence.
+static void bloom_mask(const BloomLayer *layer, uint64_t hash, uint64_t mask[8]) {
+    uint64_t x = hash;
+
+    memset(mask, 0, 8 * sizeof(uint64_t));
+    for (int i = 0; i < layer->hashes; i++) {
+        x += 0x9e3779b97f4a7c15ULL;
+        uint64_t z = (x ^ (x >> 31)) * 0xbf58476d1ce4e5b9ULL;
+        uint32_t bit = (uint32_t)(z >> 55);
+        mask[bit / 64] |= 1ULL << (bit % 64);
+    }
+}
+
+// All eight words tested at once, so the loop has no early exit
+static int bloom_block_has(const uint64_t *block, const uint64_t mask[8]) {
+    uint64_t missing = 0;
+    for (int w = 0; w < 8; w++) missing |= mask[w] & ~block[w];
+    return missing == 0;
+}
+
+static int bloom_has(const BloomFilter *bf, uint64_t hash) {
+    uint64_t mask[8];
+
+    // Newest first: it holds the most items once the filter has grown
+    for (int i = bf->num_layers - 1; i >= 0; i--) {
+        bloom_mask(&bf->layers[i], hash, mask);
+        if (bloom_block_has(bloom_block(&bf->layers[i], hash), mask)) return 1;
+    }
+    return 0;
+}
+
+// Returns 1 if added, 0 if it may have been added before, -1 if the filter
+// is full and cannot grow
+static int bloom_add(BloomFilter *bf, uint64_t hash) {
+    if (bloom_has(bf, hash)) return 0;
+
+    BloomLayer *layer = &bf->layers[bf->num_layers - 1];
+    if (layer->count >= layer->capacity) {
+        if (bf->expansion == 0 || layer->capacity * bf->expansion > FILTER_MAX_CAPACITY ||
+            bloom_add_layer(bf, layer->capacity * bf->expansion, layer->error / 2) != 0) {
+            return -1;
+        }
+        layer = &bf->layers[bf->num_layers - 1];
+    }
+
+    uint64_t mask[8];
+    uint64_t *block = (uint64_t *)bloom_block(layer, hash);
+    bloom_mask(layer, hash, mask);
+    for (int w = 0; w < 8; w++) block[w] |= mask[w];
+    layer->count++;
+    bf->items++;
+    return 1;
+}
+
+static void bloom_prefetch(const BloomFilter *bf, uint64_t hash) {
+    for (int i = 0; i < bf->num_layers; i++) {
+        __builtin_prefetch(bloom_block(&bf->layers[i], hash), 1);
+    }
+}
+
+// ============================================================================
+// Cuckoo Filters
+// ============================================================================
+static int cuckoo_add_layer(CuckooFilter *cf, uint64_t capacity) {
+    if (cf->num_layers == FILTER_MAX_LAYERS) return -1;
+
+    uint64_t nbuckets = FILTER_BLOCK / (CF_BUCKET_SIZE * sizeof(uint16_t));
+    while (nbuckets * CF_BUCKET_SIZE < capacity) nbuckets *= 2;
+
+    CuckooLayer *layer = &cf->layers[cf->num_layers];
+    layer->slots = (uint16_t *)block_alloc(&cf->memory,
+                                           nbuckets * CF_BUCKET_SIZE * sizeof(uint16_t));
+    if (!layer->slots) return -1;
+    layer->nbuckets = nbuckets;
+    layer->count = 0;
+    cf->num_layers++;
+    return 0;
+}
+
+static CuckooFilter *cuckoo_create(uint64_t capacity, unsigned expansion,
+                                   unsigned max_iterations) {
+    CuckooFilter *cf = (CuckooFilter *)calloc(1, sizeof(CuckooFilter));
+    if (!cf) return NULL;
+
+    cf->memory = alloc_usable_size(cf, sizeof(CuckooFilter));
+    cf->expansion = expansion;
+    cf->max_iterations = max_iterations;
+    cf->rng = 0x9e3779b97f4a7c15ULL ^ (uintptr_t)cf;
+    if (cuckoo_add_layer(cf, capacity) != 0) {
+        free(cf);
+        return NULL;
+    }
+    return cf;
+}
+
+void cuckoo_free(CuckooFilter *cf) {
+    if (!cf) return;
+    for (int i = 0; i < cf->num_layers; i++) free(cf->layers[i].slots);
+    free(cf);
+}
+
+size_t cuckoo_memory(const CuckooFilter *cf) {
+    return cf->memory;
+}
+
+// Never 0, which marks an empty slot
+static uint16_t cuckoo_fingerprint(uint64_t hash) {
+    uint16_t fp = (uint16_t)(hash >> 48);
+    return fp ? fp : 1;
+}
+
+// Either bucket is found from the other and the fingerprint alone, which
+// is what lets an item be moved without knowing the item
+static uint64_t cuckoo_alt(const CuckooLayer *layer, uint64_t bucket, uint16_t fp) {
+    return (bucket ^ (fp * 0x5bd1e995ULL)) & (layer->nbuckets - 1);
+}
+
+static uint16_t *cuckoo_bucket(const CuckooLayer *layer, uint64_t bucket) {
+    return layer->slots + bucket * CF_BUCKET_SIZE;
+}
+
+// Copies of fp in one bucket
+static int bucket_count(const uint16_t *b, uint16_t fp) {
+    int n = 0;
+    for (int s = 0; s < CF_BUCKET_SIZE; s++) n += b[s] == fp;
+    return n;
+}
+
+static int bucket_insert(uint16_t *b, uint16_t fp) {
+    for (int s = 0; s < CF_BUCKET_SIZE; s++) {
+        if (b[s] == 0) {
+            b[s] = fp;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int bucket_delete(uint16_t *b, uint16_t fp) {
+    for (int s = 0; s < CF_BUCKET_SIZE; s++) {
+        if (b[s] == fp) {
+            b[s] = 0;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Copies of the item's fingerprint across every layer
+static uint64_t cuckoo_count(const CuckooFilter *cf, uint64_t hash) {
+    uint16_t fp = cuckoo_fingerprint(hash);
+    uint64_t n = 0;
+
+    for (int i = 0; i < cf->num_layers; i++) {
+        const CuckooLayer *layer = &cf->layers[i];
+        uint64_t b1 = hash & (layer->nbuckets - 1), b2 = cuckoo_alt(layer, b1, fp);
+        n += (uint64_t)bucket_count(cuckoo_bucket(layer, b1), fp);
+        if (b2 != b1) n += (uint64_t)bucket_count(cuckoo_bucket(layer, b2), fp);
+    }
+    return n;
+}
+
+static int cuckoo_has(const CuckooFilter *cf, uint64_t hash) {
+    uint16_t fp = cuckoo_fingerprint(hash);
+
+    for (int i = cf->num_layers - 1; i >= 0; i--) {
+        const CuckooLayer *layer = &cf->layers[i];
+        uint64_t b1 = hash & (layer->nbuckets - 1);
+        if (bucket_count(cuckoo_bucket(layer, b1), fp) > 0 ||
+            bucket_count(cuckoo_bucket(layer, cuckoo_alt(layer, b1, fp)), fp) > 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Place fp in a layer, evicting fingerprints to their other bucket along
+// a random path. A path that runs out is walked back, so a failed insert
+// leaves the layer as it was.
+static int layer_insert(CuckooFilter *cf, CuckooLayer *layer, uint64_t hash) {
+    struct {
+        uint64_t bucket;
+        unsigned slot;
+    } path[CF_MAX_ITERATIONS];
+    uint16_t fp = cuckoo_fingerprint(hash);
+    uint64_t b1 = hash & (layer->nbuckets - 1), b2 = cuckoo_alt(layer, b1, fp);
+
+    if (bucket_insert(cuckoo_bucket(layer, b1), fp) || bucket_insert(cuckoo_bucket(layer, b2), fp)) {
+        layer->count++;
+        return 0;
+    }
+
+    uint64_t bucket = (cf->rng & 1) ? b1 : b2;
+    unsigned n;
+    for (n = 0; n < cf->max_iterations; n++) {
+        cf->rng ^= cf->rng >> 12;
+        cf->rng ^= cf->rng << 25;
+        cf->rng ^= cf->rng >> 27;
+        unsigned slot = (unsigned)((cf->rng * 2685821657736338717ULL) >> 62);
+
+        uint16_t *b = cuckoo_bucket(layer, bucket);
+        uint16_t evicted = b[slot];
+        b[slot] = fp;
+        path[n].bucket = bucket;
+        path[n].slot = slot;
+        fp = evicted;
+        bucket = cuckoo_alt(layer, bucket, fp);
+        if (bucket_insert(cuckoo_bucket(layer, bucket), fp)) {
+            layer->count++;
+            return 0;
+        }
+    }
+
+    while (n-- > 0) {
+        uint16_t *b = cuckoo_bucket(layer, path[n].bucket);
+        uint16_t placed = b[path[n].slot];
+        b[path[n].slot] = fp;
+        fp = placed;
+    }
+    return -1;
+}
+
+// Returns 0 once added, -1 if every layer is full and no more can be added
+static int cuckoo_add(CuckooFilter *cf, uint64_t hash) {
+    CuckooLayer *layer = &cf->layers[cf->num_layers - 1];
+
+    if (layer_insert(cf, layer, hash) != 0) {
+        uint64_t capacity = layer->nbuckets * CF_BUCKET_SIZE * cf->expansion;
+        if (capacity > FILTER_MAX_CAPACITY || cuckoo_add_layer(cf, capacity) != 0) return -1;
+        layer = &cf->layers[cf->num_layers - 1];
+        if (layer_insert(cf, layer, hash) != 0) return -1;
+    }
+    cf->inserted++;
+    return 0;
+}
+
+// Returns 1 if one copy of the item's fingerprint was removed
+static int cuckoo_delete(CuckooFilter *cf, uint64_t hash) {
+    uint16_t fp = cuckoo_fingerprint(hash);
+
+    for (int i = cf->num_layers - 1; i >= 0; i--) {
+        CuckooLayer *layer = &cf->layers[i];
+        uint64_t b1 = hash & (layer->nbuckets - 1);
+        if (bucket_delete(cuckoo_bucket(layer, b1), fp) ||
+            bucket_delete(cuckoo_bucket(layer, cuckoo_alt(layer, b1, fp)), fp)) {
+            layer->count--;
+            cf->deleted++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void cuckoo_prefetch(const CuckooFilter *cf, uint64_t hash, int newest_only) {
+    uint16_t fp = cuckoo_fingerprint(hash);
+
+    for (int i = newest_only ? cf->num_layers - 1 : 0; i < cf->num_layers; i++) {
+        const CuckooLayer *layer = &cf->layers[i];
+        uint64_t b1 = hash & (layer->nbuckets - 1);
+        __builtin_prefetch(cuckoo_bucket(layer, b1), 1);
+        __builtin_prefetch(cuckoo_bucket(layer, cuckoo_alt(layer, b1, fp)), 1);
+    }
+}
+
+// ============================================================================
+// Commands
+// ============================================================================
+static char *filter_reply(const char *fmt, ...) {
+    char buffer[512];
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, args);
+    va_end(args);
+
+    size_t len = strlen(buffer) + 1;
+    char *reply = (char *)malloc(len);
+    if (reply) memcpy(reply, buffer, len);
+    return reply;
+}
+
+static int parse_u64(const char *str, uint64_t min, uint64_t max, uint64_t *value) {
+    char *end;
+
+    if (*str < '0' || *str > '9') return -1;
+    errno = 0;
+    unsigned long long v = strtoull(str, &end, 10);
+    if (*end != '\0' || errno == ERANGE || v < min || v > max) return -1;
+    *value = v;
+    return 0;
+}
+
+// The filter at key, or NULL if there is none; *wrongtype is set if the
+// key holds another type
+static void *filter_lookup(HashTable *ht, const char *key, ValueType want, int *wrongtype) {
+    ValueType type;
+    void *value = ht_lookup(ht, key, &type);
+
+    *wrongtype = value && type != want;
+    return value && type == want ? value : NULL;
+}
+
+// Store a filter created for a command, or free it if the table cannot
+static int filter_store(HashTable *ht, const char *key, ValueType type, void *filter) {
+    if (ht_set_object(ht, key, type, filter) == 0) return 0;
+    if (type == VALUE_BLOOM) {
+        bloom_free((BloomFilter *)filter);
+    } else {
+        cuckoo_free((CuckooFilter *)filter);
+    }
+    return -1;
+}
+
+// Results of a multi-item command as a JSON array
+static char *results_reply(const int *results, int n) {
+    StrBuf sb;
+
+    sb_init(&sb);
+    sb_append(&sb, "[", 1);
+    for (int i = 0; i < n; i++) sb_printf(&sb, "%s%d", i ? ", " : "", results[i]);
+    sb_append(&sb, "]", 1);
+
+    char *reply = sb_finish(&sb);
+    return reply ? reply : filter_reply("ERROR: Memory allocation failed");
+}
+
+// BF.RESERVE key error_rate capacity [EXPANSION n] [NONSCALING]
+static char *cmd_bf_reserve(HashTable *ht, char **tokens, int num_tokens) {
+    uint64_t capacity, expansion = BF_DEFAULT_EXPANSION;
+    double error;
+    char *end;
+    ValueType type;
+
+    if (num_tokens < 4) {
+        return filter_reply("ERROR: BF.RESERVE takes key error_rate capacity [EXPANSION n] "
+                            "[NONSCALING]");
+    }
+    error = strtod(tokens[2], &end);
+    if (end == tokens[2] || *end != '\0' || !(error > 0 && error < 1)) {
+        return filter_reply("ERROR: error_rate must be between 0 and 1");
+    }
+    if (parse_u64(tokens[3], 1, FILTER_MAX_CAPACITY, &capacity) != 0) {
+        return filter_reply("ERROR: capacity must be between 1 and %llu",
+                            (unsigned long long)FILTER_MAX_CAPACITY);
+    }
+    for (int i = 4; i < num_tokens; i++) {
+        if (strcasecmp(tokens[i], "NONSCALING") == 0) {
+            expansion = 0;
+        } else if (strcasecmp(tokens[i], "EXPANSION") == 0 && i + 1 < num_tokens &&
+                   parse_u64(tokens[i + 1], 1, 32768, &expansion) == 0) {
+            i++;
+        } else {
+            return filter_reply("ERROR: Unknown BF.RESERVE option '%s'", tokens[i]);
+        }
+    }
+
+    if (ht_lookup(ht, tokens[1], &type)) return filter_reply("ERROR: Key already exists");
+    BloomFilter *bf = bloom_create(capacity, error, (unsigned)expansion);
+    if (!bf || filter_store(ht, tokens[1], VALUE_BLOOM, bf) != 0) {
+        if (!bf) return filter_reply("ERROR: Memory allocation failed");
+        return filter_reply("ERROR: Failed to create filter");
+    }
+    keystats_write(VALUE_BLOOM, ht->db, tokens[1], bf->memory);
+    return filter_reply("OK");
+}
+
+// BF.ADD key item / BF.MADD key item [item ...]
+// Each result is 1 if the item is new, 0 if it may have been added before,
+// -1 if a non-scaling filter is full
+static char *cmd_bf_add(HashTable *ht, char **tokens, int num_tokens, int multi) {
+    int wrongtype;
+
+    if (num_tokens < 3 || (!multi && num_tokens != 3)) {
+        return filter_reply(multi ? "ERROR: BF.MADD takes key item [item ...]"
+                                  : "ERROR: BF.ADD takes key item");
+    }
+    BloomFilter *bf = (BloomFilter *)filter_lookup(ht, tokens[1], VALUE_BLOOM, &wrongtype);
+    if (wrongtype) return filter_reply(WRONGTYPE_ERROR);
+
+    int created = !bf;
+    if (created) {
+        bf = bloom_create(BF_DEFAULT_CAPACITY, BF_DEFAULT_ERROR, BF_DEFAULT_EXPANSION);
+        if (!bf) return filter_reply("ERROR: Memory allocation failed");
+    }
+
+    int n = num_tokens - 2;
+    int *results = (int *)malloc((size_t)n * sizeof(int));
+    if (!results) {
+        if (created) bloom_free(bf);
+        return filter_reply("ERROR: Memory allocation failed");
+    }
+
+    size_t before = bf->memory;
+    uint64_t hashes[FILTER_GROUP];
+    for (int start = 0; start < n; start += FILTER_GROUP) {
+        int group = n - start < FILTER_GROUP ? n - start : FILTER_GROUP;
+        for (int j = 0; j < group; j++) {
+            hashes[j] = item_hash(tokens[2 + start + j]);
+            bloom_prefetch(bf, hashes[j]);
+        }
+        for (int j = 0; j < group; j++) results[start + j] = bloom_add(bf, hashes[j]);
+    }
+
+    if (created) {
+        if (filter_store(ht, tokens[1], VALUE_BLOOM, bf) != 0) {
+            free(results);
+            return filter_reply("ERROR: Failed to create filter");
+        }
+    } else {
+        ht_account_value(ht, (long long)bf->memory - (long long)before);
+    }
+    keystats_write(VALUE_BLOOM, ht->db, tokens[1], bf->memory);
+
+    char *reply = multi ? results_reply(results, n)
+                        : results[0] < 0 ? filter_reply("ERROR: Filter is full")
+                                         : filter_reply("%d", results[0]);
+    free(results);
+    return reply;
+}
+
+// BF.EXISTS key item / BF.MEXISTS key item [item ...]
+static char *cmd_bf_exists(HashTable *ht, char **tokens, int num_tokens, int multi) {
+    int wrongtype;
+
+    if (num_tokens < 3 || (!multi && num_tokens != 3)) {
+        return filter_reply(multi ? "ERROR: BF.MEXISTS takes key item [item ...]"
+                                  : "ERROR: BF.EXISTS takes key item");
+    }
+    BloomFilter *bf = (BloomFilter *)filter_lookup(ht, tokens[1], VALUE_BLOOM, &wrongtype);
+    if (wrongtype) return filter_reply(WRONGTYPE_ERROR);
+    if (!multi) return filter_reply("%d", bf ? bloom_has(bf, item_hash(tokens[2])) : 0);
+
+    int n = num_tokens - 2;
+    int *results = (int *)calloc((size_t)n, sizeof(int));
+    if (!results) return filter_reply("ERROR: Memory allocation failed");
+
+    uint64_t hashes[FILTER_GROUP];
+    for (int start = 0; bf && start < n; start += FILTER_GROUP) {
+        int group = n - start < FILTER_GROUP ? n - start : FILTER_GROUP;
+        for (int j = 0; j < group; j++) {
+            hashes[j] = item_hash(tokens[2 + start + j]);
+            bloom_prefetch(bf, hashes[j]);
+        }
+        for (int j = 0; j < group; j++) results[start + j] = bloom_has(bf, hashes[j]);
+    }
+
+    char *reply = results_reply(results, n);
+    free(results);
+    return reply;
+}
+
+// BF.CARD key
+static char *cmd_bf_card(HashTable *ht, char **tokens, int num_tokens) {
+    int wrongtype;
+
+    if (num_tokens != 2) return filter_reply("ERROR: BF.CARD requires a key");
+    BloomFilter *bf = (BloomFilter *)filter_lookup(ht, tokens[1], VALUE_BLOOM, &wrongtype);
+    if (wrongtype) return filter_reply(WRONGTYPE_ERROR);
+    return filter_reply("%llu", bf ? (unsigned long long)bf->items : 0ULL);
+}
+
+// BF.INFO key
+static char *cmd_bf_info(HashTable *ht, char **tokens, int num_tokens) {
+    int wrongtype;
+
+    if (num_tokens != 2) return filter_reply("ERROR: BF.INFO requires a key");
+    BloomFilter *bf = (BloomFilter *)filter_lookup(ht, tokens[1], VALUE_BLOOM, &wrongtype);
+    if (wrongtype) return filter_reply(WRONGTYPE_ERROR);
+    if (!bf) return filter_reply("ERROR: no such key");
+
+    uint64_t capacity = 0, bits = 0;
+    for (int i = 0; i < bf->num_layers; i++) {
+        capacity += bf->layers[i].capacity;
+        bits += bf->layers[i].nblocks * BF_BLOCK_BITS;
+    }
+    return filter_reply("{\"capacity\": %llu, \"size\": %zu, \"filters\": %d, \"items\": %llu, "
+                        "\"expansion\": %u, \"error_rate\": %g, \"hashes\": %d, "
+                        "\"bits_per_item\": %.2f}",
+                        (unsigned long long)capacity, bf->memory, bf->num_layers,
+                        (unsigned long long)bf->items, bf->expansion, bf->error,
+                        bf->layers[bf->num_layers - 1].hashes,
+                        (double)bits / (double)capacity);
+}
+
+// CF.RESERVE key capacity [EXPANSION n] [MAXITERATIONS n]
+static char *cmd_cf_reserve(HashTable *ht, char **tokens, int num_tokens) {
+    uint64_t capacity, expansion = CF_DEFAULT_EXPANSION, iterations = CF_DEFAULT_MAX_ITERATIONS;
+    ValueType type;
+
+    if (num_tokens < 3 || parse_u64(tokens[2], 1, FILTER_MAX_CAPACITY, &capacity) != 0) {
+        return filter_reply("ERROR: CF.RESERVE takes key capacity [EXPANSION n] "
+                            "[MAXITERATIONS n]");
+    }
+    for (int i = 3; i < num_tokens; i++) {
+        if (strcasecmp(tokens[i], "EXPANSION") == 0 && i + 1 < num_tokens &&
+            parse_u64(tokens[i + 1], 1, 32768, &expansion) == 0) {
+            i++;
+        } else if (strcasecmp(tokens[i], "MAXITERATIONS") == 0 && i + 1 < num_tokens &&
+                   parse_u64(tokens[i + 1], 1, CF_MAX_ITERATIONS, &iterations) == 0) {
+            i++;
+        } else {
+            return filter_reply("ERROR: Unknown CF.RESERVE option '%s'", tokens[i]);
+        }
+    }
+
+    if (ht_lookup(ht, tokens[1], &type)) return filter_reply("ERROR: Key already exists");
+    CuckooFilter *cf = cuckoo_create(capacity, (unsigned)expansion, (unsigned)iterations);
+    if (!cf) return filter_reply("ERROR: Memory allocation failed");
+    if (filter_store(ht, tokens[1], VALUE_CUCKOO, cf) != 0) {
+        return filter_reply("ERROR: Failed to create filter");
+    }
+    keystats_write(VALUE_CUCKOO, ht->db, tokens[1], cf->memory);
+    return filter_reply("OK");
+}
+
+// CF.ADD key item / CF.ADDNX key item /
+// CF.INSERT key [CAPACITY n] [NOCREATE] ITEMS item [item ...]
+// CF.ADD adds a copy even if the item is there, CF.ADDNX only if it is not.
+// Results are 1 if added, 0 if CF.ADDNX found it, -1 if the filter is full.
+static char *cmd_cf_add(HashTable *ht, char **tokens, int num_tokens, int nx) {
+    uint64_t capacity = CF_DEFAULT_CAPACITY;
+    int insert = strcasecmp(tokens[0], "CF.INSERT") == 0, nocreate = 0, first = 2;
+    int wrongtype;
+
+    if (insert) {
+        for (; first < num_tokens; first++) {
+            if (strcasecmp(tokens[first], "ITEMS") == 0) {
+                first++;
+                break;
+            } else if (strcasecmp(tokens[first], "NOCREATE") == 0) {
+                nocreate = 1;
+            } else if (strcasecmp(tokens[first], "CAPACITY") == 0 && first + 1 < num_tokens &&
+                       parse_u64(tokens[first + 1], 1, FILTER_MAX_CAPACITY, &capacity) == 0) {
+                first++;
+            } else {
+                first = num_tokens;
+            }
+        }
+        if (first >= num_tokens) {
+            return filter_reply("ERROR: CF.INSERT takes key [CAPACITY n] [NOCREATE] "
+                                "ITEMS item [item ...]");
+        }
+    } else if (num_tokens != 3) {
+        return filter_reply("ERROR: %s takes key item", nx ? "CF.ADDNX" : "CF.ADD");
+    }
+
+    CuckooFilter *cf = (CuckooFilter *)filter_lookup(ht, tokens[1], VALUE_CUCKOO, &wrongtype);
+    if (wrongtype) return filter_reply(WRONGTYPE_ERROR);
+    if (!cf && nocreate) return filter_reply("ERROR: no such key");
+
+    int created = !cf;
+    if (created) {
+        cf = cuckoo_create(capacity, CF_DEFAULT_EXPANSION, CF_DEFAULT_MAX_ITERATIONS);
+        if (!cf) return filter_reply("ERROR: Memory allocation failed");
+    }
+
+    int n = num_tokens - first;
+    int *results = (int *)malloc((size_t)n * sizeof(int));
+    if (!results) {
+        if (created) cuckoo_free(cf);
+        return filter_reply("ERROR: Memory allocation failed");
+    }
+
+    size_t before = cf->memory;
+    uint64_t hashes[FILTER_GROUP];
+    for (int start = 0; start < n; start += FILTER_GROUP) {
+        int group = n - start < FILTER_GROUP ? n - start : FILTER_GROUP;
+        for (int j = 0; j < group; j++) {
+            hashes[j] = item_hash(tokens[first + start + j]);
+            cuckoo_prefetch(cf, hashes[j], !nx);
+        }
+        for (int j = 0; j < group; j++) {
+            if (nx && cuckoo_has(cf, hashes[j])) {
+                results[start + j] = 0;
+            } else {
+                results[start + j] = cuckoo_add(cf, hashes[j]) == 0 ? 1 : -1;
+            }
+        }
+    }
+
+    if (created) {
+        if (filter_store(ht, tokens[1], VALUE_CUCKOO, cf) != 0) {
+            free(results);
+            return filter_reply("ERROR: Failed to create filter");
+        }
+    } else {
+        ht_account_value(ht, (long long)cf->memory - (long long)before);
+    }
+    keystats_write(VALUE_CUCKOO, ht->db, tokens[1], cf->memory);
+
+    char *reply = insert ? results_reply(results, n)
+                         : results[0] < 0 ? filter_reply("ERROR: Filter is full")
+                                          : filter_reply("%d", results[0]);
+    free(results);
+    return reply;
+}
+
+// CF.EXISTS key item / CF.MEXISTS key item [item ...]
+static char *cmd_cf_exists(HashTable *ht, char **tokens, int num_tokens, int multi) {
+    int wrongtype;
+
+    if (num_tokens < 3 || (!multi && num_tokens != 3)) {
+        return filter_reply(multi ? "ERROR: CF.MEXISTS takes key item [item ...]"
+                                  : "ERROR: CF.EXISTS takes key item");
+    }
+    CuckooFilter *cf = (CuckooFilter *)filter_lookup(ht, tokens[1], VALUE_CUCKOO, &wrongtype);
+    if (wrongtype) return filter_reply(WRONGTYPE_ERROR);
+    if (!multi) return filter_reply("%d", cf ? cuckoo_has(cf, item_hash(tokens[2])) : 0);
+
+    int n = num_tokens - 2;
+    int *results = (int *)calloc((size_t)n, sizeof(int));
+    if (!results) return filter_reply("ERROR: Memory allocation failed");
+
+    uint64_t hashes[FILTER_GROUP];
+    for (int start = 0; cf && start < n; start += FILTER_GROUP) {
+        int group = n - start < FILTER_GROUP ? n - start : FILTER_GROUP;
+        for (int j = 0; j < group; j++) {
+            hashes[j] = item_hash(tokens[2 + start + j]);
+            cuckoo_prefetch(cf, hashes[j], 0);
+        }
+        for (int j = 0; j < group; j++) results[start + j] = cuckoo_has(cf, hashes[j]);
+    }
+
+    char *reply = results_reply(results, n);
+    free(results);
+    return reply;
+}
+
+// CF.DEL key item / CF.COUNT key item
+static char *cmd_cf_item(HashTable *ht, char **tokens, int num_tokens, int del) {
+    int wrongtype;
+
+    if (num_tokens != 3) return filter_reply("ERROR: %s takes key item", tokens[0]);
+    CuckooFilter *cf = (CuckooFilter *)filter_lookup(ht, tokens[1], VALUE_CUCKOO, &wrongtype);
+    if (wrongtype) return filter_reply(WRONGTYPE_ERROR);
+    if (!cf) return filter_reply(del ? "ERROR: no such key" : "0");
+
+    uint64_t hash = item_hash(tokens[2]);
+    if (del) return filter_reply("%d", cuckoo_delete(cf, hash));
+    return filter_reply("%llu", (unsigned long long)cuckoo_count(cf, hash));
+}
+
+// CF.INFO key
+static char *cmd_cf_info(HashTable *ht, char **tokens, int num_tokens) {
+    int wrongtype;
+
+    if (num_tokens != 2) return filter_reply("ERROR: CF.INFO requires a key");
+    CuckooFilter *cf = (CuckooFilter *)filter_lookup(ht, tokens[1], VALUE_CUCKOO, &wrongtype);
+    if (wrongtype) return filter_reply(WRONGTYPE_ERROR);
+    if (!cf) return filter_reply("ERROR: no such key");
+
+    uint64_t buckets = 0, items = 0;
+    for (int i = 0; i < cf->num_layers; i++) {
+        buckets += cf->layers[i].nbuckets;
+        items += cf->layers[i].count;
+    }
+    return filter_reply("{\"size\": %zu, \"buckets\": %llu, \"filters\": %d, \"items\": %llu, "
+                        "\"items_inserted\": %llu, \"items_deleted\": %llu, "
+                        "\"bucket_size\": %d, \"fingerprint_bits\": 16, \"expansion\": %u, "
+                        "\"max_iterations\": %u, \"load_factor\": %.3f}",
+                        cf->memory, (unsigned long long)buckets, cf->num_layers,
+                        (unsigned long long)items, (unsigned long long)cf->inserted,
+                        (unsigned long long)cf->deleted, CF_BUCKET_SIZE, cf->expansion,
+                        cf->max_iterations,
+                        (double)items / (double)(buckets * CF_BUCKET_SIZE));
+}
+
+// ============================================================================
+// Dispatch
+// ============================================================================
+static const struct {
+    const char *name;
+    int writes;
+} filter_commands[] = {
+    { "BF.RESERVE", 1 }, { "BF.ADD", 1 }, { "BF.MADD", 1 }, { "BF.EXISTS", 0 },
+    { "BF.MEXISTS", 0 }, { "BF.CARD", 0 }, { "BF.INFO", 0 }, { "CF.RESERVE", 1 },
+    { "CF.ADD", 1 }, { "CF.ADDNX", 1 }, { "CF.INSERT", 1 }, { "CF.DEL", 1 },
+    { "CF.EXISTS", 0 }, { "CF.MEXISTS", 0 }, { "CF.COUNT", 0 }, { "CF.INFO", 0 },
+};
+
+const char *filter_command_key(char **tokens, int num_tokens, int *writes) {
+    for (size_t i = 0; i < sizeof(filter_commands) / sizeof(filter_commands[0]); i++) {
+        if (strcasecmp(tokens[0], filter_commands[i].name) == 0) {
+            *writes = filter_commands[i].writes;
+            return num_tokens >= 2 ? tokens[1] : NULL;
+        }
+    }
+    return NULL;
+}
+
+char *filter_command(HashTable *ht, char **tokens, int num_tokens) {
+    const char *name = tokens[0];
+
+    if (strcasecmp(name, "BF.RESERVE") == 0) return cmd_bf_reserve(ht, tokens, num_tokens);
+    if (strcasecmp(name, "BF.ADD") == 0) return cmd_bf_add(ht, tokens, num_tokens, 0);
+    if (strcasecmp(name, "BF.MADD") == 0) return cmd_bf_add(ht, tokens, num_tokens, 1);
+    if (strcasecmp(name, "BF.EXISTS") == 0) return cmd_bf_exists(ht, tokens, num_tokens, 0);
+    if (strcasecmp(name, "BF.MEXISTS") == 0) return cmd_bf_exists(ht, tokens, num_tokens, 1);
+    if (strcasecmp(name, "BF.CARD") == 0) return cmd_bf_card(ht, tokens, num_tokens);
+    if (strcasecmp(name, "BF.INFO") == 0) return cmd_bf_info(ht, tokens, num_tokens);
+    if (strcasecmp(name, "CF.RESERVE") == 0) return cmd_cf_reserve(ht, tokens, num_tokens);
+    if (strcasecmp(name, "CF.ADD") == 0) return cmd_cf_add(ht, tokens, num_tokens, 0);
+    if (strcasecmp(name, "CF.ADDNX") == 0) return cmd_cf_add(ht, tokens, num_tokens, 1);
+    if (strcasecmp(name, "CF.INSERT") == 0) return cmd_cf_add(ht, tokens, num_tokens, 0);
+    if (strcasecmp(name, "CF.DEL") == 0) return cmd_cf_item(ht, tokens, num_tokens, 1);
+    if (strcasecmp(name, "CF.COUNT") == 0) return cmd_cf_item(ht, tokens, num_tokens, 0);
+    if (strcasecmp(name, "CF.EXISTS") == 0) return cmd_cf_exists(ht, tokens, num_tokens, 0);
+    if (strcasecmp(name, "CF.MEXISTS") == 0) return cmd_cf_exists(ht, tokens, num_tokens, 1);
+    if (strcasecmp(name, "CF.INFO") == 0) return cmd_cf_info(ht, tokens, num_tokens);
+    return NULL;
+}
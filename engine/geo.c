@@ -0,0 +1,965 @@
+// ============================================================================
+// geo.c - Geospatial Sets on 52-bit Geohashes
+// ============================================================================
+//
+// A geo set holds named points, ordered by the 52-bit geohash of their
+// position in a skip list, with a hash index from member to node.
+//   - Nearby points share geohash prefixes, so every point in one geohash
+//     cell is one contiguous score range of the list
+//   - GEOSEARCH covers the shape's bounding box with at most nine cells at
+//     the finest level that allows it, and scans their merged ranges
+//   - Every point also keeps its unit vector on the sphere. Candidates are
+//     gathered into arrays and measured in batches by plain loops the
+//     compiler vectorizes: a squared chord for the radius, and a
+//     polynomial for the box's longitude bound, so only hits pay for a
+//     square root or an arcsine
+// ============================================================================
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <math.h>
+#include "mini_redis.h"
+
+#define GEO_STEP_MAX 26            // Bits per coordinate: 52-bit hashes
+#define GEO_LAT_MIN -85.05112878   // Web Mercator limits, as Redis uses
+#define GEO_LAT_MAX 85.05112878
+#define GEO_LON_MIN -180.0
+#define GEO_LON_MAX 180.0
+#define GEO_EARTH_RADIUS 6372797.560856  // Meters
+#define GEO_MAX_CELLS 9            // Cells a search scans at most
+#define GEO_BATCH 256              // Candidates measured at once
+#define GEO_MAX_LEVEL 32
+#define GEO_MIN_CAP 16
+#define GEO_TOMBSTONE ((GeoNode *)(uintptr_t)1)
+
+static const double geo_pi = 3.14159265358979323846;
+
+typedef struct GeoNode {
+    uint64_t score;           // Geohash of the position
+    double x, y, z;           // Unit vector of the cell centre
+    double cos_lat;
+    char *member;
+    int level;
+    struct GeoNode *next[];   // One per level
+} GeoNode;
+
+struct GeoSet {
+    GeoNode *head;            // Sentinel with GEO_MAX_LEVEL links
+    int level;                // Levels in use
+    size_t count;
+    GeoNode **members;        // Open addressing by member name
+    size_t members_cap;       // Power of two
+    size_t members_used;      // Nodes and tombstones
+    uint64_t rng;
+    size_t memory;            // Allocator bytes of all of the above
+};
+
+// ============================================================================
+// Accounted Allocations
+// ============================================================================
+static void *mem_alloc(size_t *memory, size_t size) {
+    void *ptr = malloc(size);
+    if (ptr) *memory += alloc_usable_size(ptr, size);
+    return ptr;
+}
+
+static void mem_free(size_t *memory, void *ptr, size_t size) {
+    if (!ptr) return;
+    *memory -= alloc_usable_size(ptr, size);
+    free(ptr);
+}
+
+// ============================================================================
+// Geohash Encoding
+// ============================================================================
+// Bit i of v to bit 2i
+static uint64_t spread(uint32_t v) {
+    uint64_t x = v;
+    x = (x | (x << 16)) & 0x0000ffff0000ffffULL;
+    x = (x | (x << 8)) & 0x00ff00ff00ff00ffULL;
+    x = (x | (x << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    x = (x | (x << 2)) & 0x3333333333333333ULL;
+    x = (x | (x << 1)) & 0x5555555555555555ULL;
+    return x;
+}
+
+// Bit 2i of x to bit i
+static uint32_t squash(uint64_t x) {
+    x &= 0x5555555555555555ULL;
+    x = (x | (x >> 1)) & 0x3333333333333333ULL;
+    x = (x | (x >> 2)) & 0x0f0f0f0f0f0f0f0fULL;
+    x = (x | (x >> 4)) & 0x00ff00ff00ff00ffULL;
+    x = (x | (x >> 8)) & 0x0000ffff0000ffffULL;
+    x = (x | (x >> 16)) & 0x00000000ffffffffULL;
+    return (uint32_t)x;
+}
+
+// Latitude cells on the even bits, longitude cells on the odd ones, so the
+// top bit splits east from west
+static uint64_t interleave(uint32_t lat_cell, uint32_t lon_cell) {
+    return spread(lat_cell) | (spread(lon_cell) << 1);
+}
+
+static uint32_t cell_of(double value, double min, double max) {
+    double cell = (value - min) / (max - min) * (double)(1u << GEO_STEP_MAX);
+    uint32_t last = (1u << GEO_STEP_MAX) - 1;
+    return cell >= last ? last : (uint32_t)cell;
+}
+
+static uint64_t geo_encode(double lon, double lat) {
+    return interleave(cell_of(lat, GEO_LAT_MIN, GEO_LAT_MAX),
+                      cell_of(lon, GEO_LON_MIN, GEO_LON_MAX));
+}
+
+// Centre of the hash's cell, the position reported for a member
+static void geo_decode(uint64_t hash, double *lon, double *lat) {
+    double cells = (double)(1u << GEO_STEP_MAX);
+    *lat = GEO_LAT_MIN + (squash(hash) + 0.5) * (GEO_LAT_MAX - GEO_LAT_MIN) / cells;
+    *lon = GEO_LON_MIN + (squash(hash >> 1) + 0.5) * (GEO_LON_MAX - GEO_LON_MIN) / cells;
+}
+
+// The standard 11-character base32 geohash, which spans latitudes -90..90
+static void geo_hash_string(uint64_t hash, char *out) {
+    static const char alphabet[] = "0123456789bcdefghjkmnpqrstuvwxyz";
+    double lon, lat;
+
+    geo_decode(hash, &lon, &lat);
+    uint64_t bits = interleave(cell_of(lat, -90.0, 90.0), cell_of(lon, GEO_LON_MIN, GEO_LON_MAX));
+    for (int i = 0; i < 10; i++) out[i] = alphabet[(bits >> (52 - (i + 1) * 5)) & 0x1f];
+    // 52 bits fill ten characters; the eleventh is zero, as in Redis
+    out[10] = '0';
+    out[11] = '\0';
+}
+
+static double radians(double degrees) {
+    return degrees * geo_pi / 180.0;
+}
+
+static double degrees(double radians) {
+    return radians * 180.0 / geo_pi;
+}
+
+static void unit_vector(double lon, double lat, double *x, double *y, double *z, double *c) {
+    double phi = radians(lat), lambda = radians(lon);
+    *c = cos(phi);
+    *x = *c * cos(lambda);
+    *y = *c * sin(lambda);
+    *z = sin(phi);
+}
+
+// Great-circle distance in meters for a squared chord of the unit sphere;
+// the same as the haversine formula, since the chord is twice its root
+static double chord_distance(double chord2) {
+    double half = sqrt(chord2) / 2;
+    return 2 * GEO_EARTH_RADIUS * asin(half < 1 ? half : 1);
+}
+
+static double node_distance(const GeoNode *a, const GeoNode *b) {
+    double dx = a->x - b->x, dy = a->y - b->y, dz = a->z - b->z;
+    return chord_distance(dx * dx + dy * dy + dz * dz);
+}
+
+// ============================================================================
+// Skip List
+// ============================================================================
+static size_t node_size(int level) {
+    return sizeof(GeoNode) + (size_t)level * sizeof(GeoNode *);
+}
+
+static int node_before(const GeoNode *n, uint64_t score, const char *member) {
+    return n->score < score || (n->score == score && strcmp(n->member, member) < 0);
+}
+
+// Levels with probability 1/4 each, as in Redis's sorted sets
+static int random_level(GeoSet *g) {
+    int level = 1;
+
+    for (;;) {
+        g->rng ^= g->rng >> 12;
+        g->rng ^= g->rng << 25;
+        g->rng ^= g->rng >> 27;
+        uint64_t r = g->rng * 2685821657736338717ULL;
+        for (int i = 0; i < 32; i++, r >>= 2) {
+            if ((r & 3) != 0 || level == GEO_MAX_LEVEL) return level;
+            level++;
+        }
+    }
+}
+
+static void list_insert(GeoSet *g, GeoNode *node) {
+    GeoNode *update[GEO_MAX_LEVEL];
+    GeoNode *x = g->head;
+
+    for (int i = g->level - 1; i >= 0; i--) {
+        while (x->next[i] && node_before(x->next[i], node->score, node->member)) x = x->next[i];
+        update[i] = x;
+    }
+    for (int i = g->level; i < node->level; i++) update[i] = g->head;
+    if (node->level > g->level) g->level = node->level;
+
+    for (int i = 0; i < node->level; i++) {
+        node->next[i] = update[i]->next[i];
+        update[i]->next[i] = node;
+    }
+}
+
+static void list_remove(GeoSet *g, GeoNode *node) {
+    GeoNode *x = g->head;
+
+    for (int i = g->level - 1; i >= 0; i--) {
+        while (x->next[i] && node_before(x->next[i], node->score, node->member)) x = x->next[i];
+        if (x->next[i] == node) x->next[i] = node->next[i];
+    }
+    while (g->level > 1 && !g->head->next[g->level - 1]) g->level--;
+}
+
+// First node with a score of at least score
+static GeoNode *list_seek(const GeoSet *g, uint64_t score) {
+    GeoNode *x = g->head;
+
+    for (int i = g->level - 1; i >= 0; i--) {
+        while (x->next[i] && x->next[i]->score < score) x = x->next[i];
+    }
+    return x->next[0];
+}
+
+// ============================================================================
+// Member Index
+// ============================================================================
+static size_t member_hash(const char *member) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)member; *p; p++) {
+        h = (h ^ *p) * 16777619u;
+    }
+    return h;
+}
+
+// Node of a member, or NULL; *pos is its index position
+static GeoNode *member_find(const GeoSet *g, const char *member, size_t *pos) {
+    if (g->members_cap == 0) return NULL;
+
+    size_t mask = g->members_cap - 1;
+    for (size_t i = member_hash(member) & mask;; i = (i + 1) & mask) {
+        GeoNode *node = g->members[i];
+        if (!node) return NULL;
+        if (node != GEO_TOMBSTONE && strcmp(node->member, member) == 0) {
+            if (pos) *pos = i;
+            return node;
+        }
+    }
+}
+
+static void member_place(GeoNode **members, size_t cap, GeoNode *node) {
+    size_t mask = cap - 1;
+    size_t i = member_hash(node->member) & mask;
+    while (members[i] && members[i] != GEO_TOMBSTONE) i = (i + 1) & mask;
+    members[i] = node;
+}
+
+// Room for one more member: rebuilt without tombstones at 3/4 full
+static int members_reserve(GeoSet *g) {
+    if ((g->members_used + 1) * 4 <= g->members_cap * 3) return 0;
+
+    size_t cap = g->members_cap ? g->members_cap : GEO_MIN_CAP;
+    while ((g->count + 1) * 2 > cap) cap *= 2;
+
+    GeoNode **members = (GeoNode **)mem_alloc(&g->memory, cap * sizeof(GeoNode *));
+    if (!members) return -1;
+    memset(members, 0, cap * sizeof(GeoNode *));
+    for (GeoNode *n = g->head->next[0]; n; n = n->next[0]) member_place(members, cap, n);
+
+    mem_free(&g->memory, g->members, g->members_cap * sizeof(GeoNode *));
+    g->members = members;
+    g->members_cap = cap;
+    g->members_used = g->count;
+    return 0;
+}
+
+// ============================================================================
+// Set Object
+// ============================================================================
+static GeoSet *set_create(void) {
+    GeoSet *g = (GeoSet *)calloc(1, sizeof(GeoSet));
+    if (!g) return NULL;
+
+    g->memory = alloc_usable_size(g, sizeof(GeoSet));
+    g->head = (GeoNode *)mem_alloc(&g->memory, node_size(GEO_MAX_LEVEL));
+    if (!g->head) {
+        free(g);
+        return NULL;
+    }
+    memset(g->head, 0, node_size(GEO_MAX_LEVEL));
+    g->head->level = GEO_MAX_LEVEL;
+    g->level = 1;
+    g->rng = 0x9e3779b97f4a7c15ULL ^ (uintptr_t)g;
+    return g;
+}
+
+void geo_free(GeoSet *g) {
+    if (!g) return;
+
+    GeoNode *n = g->head->next[0];
+    while (n) {
+        GeoNode *next = n->next[0];
+        free(n->member);
+        free(n);
+        n = next;
+    }
+    free(g->head);
+    free(g->members);
+    free(g);
+}
+
+size_t geo_memory(const GeoSet *g) {
+    return g->memory;
+}
+
+static void node_free(GeoSet *g, GeoNode *node) {
+    mem_free(&g->memory, node->member, strlen(node->member) + 1);
+    mem_free(&g->memory, node, node_size(node->level));
+}
+
+static void set_remove(GeoSet *g, GeoNode *node, size_t pos) {
+    list_remove(g, node);
+    g->members[pos] = GEO_TOMBSTONE;
+    g->count--;
+    node_free(g, node);
+}
+
+// Add a member, or move it. Returns 1 if added, 0 if it moved or stayed,
+// -1 if memory ran out. *changed is set if the set changed.
+static int set_add(GeoSet *g, const char *member, double lon, double lat, int *changed) {
+    uint64_t score = geo_encode(lon, lat);
+    size_t pos;
+    GeoNode *old = member_find(g, member, &pos);
+
+    *changed = 0;
+    if (old && old->score == score) return 0;
+    if (old) set_remove(g, old, pos);
+    if (members_reserve(g) != 0) return -1;
+
+    int level = random_level(g);
+    size_t len = strlen(member) + 1;
+    GeoNode *node = (GeoNode *)mem_alloc(&g->memory, node_size(level));
+    char *copy = (char *)mem_alloc(&g->memory, len);
+    if (!node || !copy) {
+        mem_free(&g->memory, node, node_size(level));
+        mem_free(&g->memory, copy, len);
+        return -1;
+    }
+    memcpy(copy, member, len);
+
+    double clon, clat;
+    geo_decode(score, &clon, &clat);
+    node->score = score;
+    node->member = copy;
+    node->level = level;
+    unit_vector(clon, clat, &node->x, &node->y, &node->z, &node->cos_lat);
+    list_insert(g, node);
+    member_place(g->members, g->members_cap, node);
+    g->members_used++;
+    g->count++;
+
+    *changed = 1;
+    return old ? 0 : 1;
+}
+
+// ============================================================================
+// Search
+// ============================================================================
+typedef struct GeoShape {
+    int box;
+    double lon, lat;          // Centre
+    double x, y, z;           // Its unit vector
+    double chord2;            // Radius: largest squared chord
+    double zlo, zhi;          // Box: sines of the latitude bounds
+    double cos_lon, sin_lon;  // Box: of the centre's longitude
+    double lon_limit;         // Box: bound of cos²(lat) * 2 * sin²(dlon / 2)
+    double lat_min, lat_max;  // Bounding box, degrees
+    double lon_min, lon_max;
+    int full_lon;             // The bounding box wraps the globe
+} GeoShape;
+
+static void shape_radius(GeoShape *s, double radius) {
+    double angle = radius / GEO_EARTH_RADIUS;
+    double half = angle / 2 < geo_pi / 2 ? sin(angle / 2) : 1;
+
+    s->box = 0;
+    s->chord2 = 4 * half * half;
+    s->lat_min = s->lat - degrees(angle);
+    s->lat_max = s->lat + degrees(angle);
+
+    // The widest longitude spread is where the circle touches its tangent
+    // meridians
+    double ratio = angle < geo_pi / 2 ? sin(angle) / cos(radians(s->lat)) : 2;
+    s->full_lon = s->lat_min <= -90 || s->lat_max >= 90 || ratio >= 1;
+    double spread = s->full_lon ? 180 : degrees(asin(ratio));
+    s->lon_min = s->lon - spread;
+    s->lon_max = s->lon + spread;
+}
+
+// As Redis measures a box: the height along the meridian, and a point's
+// east-west distance along its own parallel
+static void shape_box(GeoShape *s, double width, double height) {
+    double half_height = height / 2 / GEO_EARTH_RADIUS;
+    double quarter_width = width / 4 / GEO_EARTH_RADIUS;
+    double lat = radians(s->lat);
+    double limit = quarter_width < geo_pi / 2 ? sin(quarter_width) : 1;
+
+    s->box = 1;
+    s->zlo = sin(lat - half_height > -geo_pi / 2 ? lat - half_height : -geo_pi / 2);
+    s->zhi = sin(lat + half_height < geo_pi / 2 ? lat + half_height : geo_pi / 2);
+    s->cos_lon = cos(radians(s->lon));
+    s->sin_lon = sin(radians(s->lon));
+    s->lon_limit = 2 * limit * limit;
+    s->lat_min = s->lat - degrees(half_height);
+    s->lat_max = s->lat + degrees(half_height);
+
+    // The parallels are shortest at the latitude nearest a pole
+    double far = fabs(s->lat_min) > fabs(s->lat_max) ? fabs(s->lat_min) : fabs(s->lat_max);
+    double ratio = far < 90 ? limit / cos(radians(far)) : 2;
+    s->full_lon = ratio >= 1;
+    double spread = s->full_lon ? 180 : degrees(2 * asin(ratio));
+    s->lon_min = s->lon - spread;
+    s->lon_max = s->lon + spread;
+}
+
+typedef struct GeoRange {
+    uint64_t min;             // Inclusive
+    uint64_t max;             // Exclusive
+} GeoRange;
+
+static int range_compare(const void *a, const void *b) {
+    uint64_t x = ((const GeoRange *)a)->min, y = ((const GeoRange *)b)->min;
+    return x < y ? -1 : x > y;
+}
+
+static uint64_t cell_index(double value, double min, double max, uint64_t cells) {
+    double cell = floor((value - min) / (max - min) * (double)cells);
+    return cell <= 0 ? 0 : cell >= (double)(cells - 1) ? cells - 1 : (uint64_t)cell;
+}
+
+// Score ranges of the cells covering the shape's bounding box, at the
+// finest step where at most GEO_MAX_CELLS do, sorted and merged
+// Returns the number of ranges
+static size_t shape_ranges(const GeoShape *s, GeoRange *out) {
+    double lat_min = s->lat_min > GEO_LAT_MIN ? s->lat_min : GEO_LAT_MIN;
+    double lat_max = s->lat_max < GEO_LAT_MAX ? s->lat_max : GEO_LAT_MAX;
+    uint64_t lat_lo = 0, lat_hi = 0, lon_count = 0, cells = 0;
+    int64_t lon_lo = 0;
+    int step;
+
+    if (lat_min > lat_max) return 0;
+    for (step = GEO_STEP_MAX; step >= 1; step--) {
+        cells = 1ULL << step;
+        lat_lo = cell_index(lat_min, GEO_LAT_MIN, GEO_LAT_MAX, cells);
+        lat_hi = cell_index(lat_max, GEO_LAT_MIN, GEO_LAT_MAX, cells);
+        if (s->full_lon) {
+            lon_lo = 0;
+            lon_count = cells;
+        } else {
+            // Unclamped, so a box across the antimeridian wraps around
+            double width = (GEO_LON_MAX - GEO_LON_MIN) / (double)cells;
+            lon_lo = (int64_t)floor((s->lon_min - GEO_LON_MIN) / width);
+            int64_t lon_hi = (int64_t)floor((s->lon_max - GEO_LON_MIN) / width);
+            lon_count = (uint64_t)(lon_hi - lon_lo + 1);
+            if (lon_count > cells) lon_count = cells;
+        }
+        if ((lat_hi - lat_lo + 1) * lon_count <= GEO_MAX_CELLS) break;
+    }
+
+    size_t n = 0;
+    int shift = 2 * (GEO_STEP_MAX - step);
+    for (uint64_t lat = lat_lo; lat <= lat_hi; lat++) {
+        for (uint64_t i = 0; i < lon_count; i++) {
+            int64_t lon = (lon_lo + (int64_t)i) % (int64_t)cells;
+            if (lon < 0) lon += (int64_t)cells;
+            uint64_t hash = interleave((uint32_t)lat, (uint32_t)lon);
+            out[n].min = hash << shift;
+            out[n++].max = (hash + 1) << shift;
+        }
+    }
+
+    qsort(out, n, sizeof(GeoRange), range_compare);
+    size_t merged = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (merged > 0 && out[i].min <= out[merged - 1].max) {
+            if (out[i].max > out[merged - 1].max) out[merged - 1].max = out[i].max;
+        } else {
+            out[merged++] = out[i];
+        }
+    }
+    return merged;
+}
+
+// Candidates laid out as arrays. Measuring always runs over the whole
+// batch: a fixed trip count and no branches are what -O2 needs to
+// vectorize a loop.
+typedef struct GeoBatch {
+    size_t len;
+    double x[GEO_BATCH], y[GEO_BATCH], z[GEO_BATCH], c[GEO_BATCH];
+    double chord2[GEO_BATCH]; // Squared chord to the centre
+    double lon_term[GEO_BATCH];
+    GeoNode *nodes[GEO_BATCH];
+} GeoBatch;
+
+static void batch_measure(GeoBatch *b, const GeoShape *s) {
+    for (size_t i = 0; i < GEO_BATCH; i++) {
+        double dx = b->x[i] - s->x, dy = b->y[i] - s->y, dz = b->z[i] - s->z;
+        b->chord2[i] = dx * dx + dy * dy + dz * dz;
+        // cos²(lat) * (1 - cos(dlon)), with cos(lat) * cos(dlon) taken from
+        // the unit vector
+        b->lon_term[i] = b->c[i] * b->c[i] - b->c[i] * (b->x[i] * s->cos_lon + b->y[i] * s->sin_lon);
+    }
+}
+
+typedef struct GeoHit {
+    GeoNode *node;
+    double dist;              // Meters
+} GeoHit;
+
+typedef struct GeoSearch {
+    GeoHit *hits;
+    size_t len;
+    size_t cap;
+    size_t limit;             // Stop at this many (COUNT ... ANY), or 0
+    int failed;
+} GeoSearch;
+
+static void batch_flush(GeoBatch *b, const GeoShape *s, GeoSearch *out) {
+    batch_measure(b, s);
+
+    for (size_t i = 0; i < b->len; i++) {
+        int inside = s->box ? b->z[i] >= s->zlo && b->z[i] <= s->zhi &&
+                                  b->lon_term[i] <= s->lon_limit
+                            : b->chord2[i] <= s->chord2;
+        if (!inside || (out->limit && out->len == out->limit)) continue;
+
+        if (out->len == out->cap) {
+            size_t cap = out->cap ? out->cap * 2 : 64;
+            GeoHit *hits = (GeoHit *)realloc(out->hits, cap * sizeof(GeoHit));
+            if (!hits) {
+                out->failed = 1;
+                break;
+            }
+            out->hits = hits;
+            out->cap = cap;
+        }
+        out->hits[out->len].node = b->nodes[i];
+        out->hits[out->len++].dist = chord_distance(b->chord2[i]);
+    }
+    b->len = 0;
+}
+
+static void search(const GeoSet *g, const GeoShape *s, GeoSearch *out) {
+    GeoRange ranges[GEO_MAX_CELLS];
+    size_t num_ranges = shape_ranges(s, ranges);
+    GeoBatch *b = (GeoBatch *)calloc(1, sizeof(GeoBatch));
+
+    if (!b) {
+        out->failed = 1;
+        return;
+    }
+    for (size_t r = 0; r < num_ranges && !out->failed; r++) {
+        GeoNode *n = list_seek(g, ranges[r].min);
+        for (; n && n->score < ranges[r].max; n = n->next[0]) {
+            if (out->limit && out->len == out->limit) break;
+            b->x[b->len] = n->x;
+            b->y[b->len] = n->y;
+            b->z[b->len] = n->z;
+            b->c[b->len] = n->cos_lat;
+            b->nodes[b->len++] = n;
+            if (b->len == GEO_BATCH) batch_flush(b, s, out);
+        }
+    }
+    if (b->len > 0) batch_flush(b, s, out);
+    free(b);
+}
+
+static int hit_asc(const void *a, const void *b) {
+    double x = ((const GeoHit *)a)->dist, y = ((const GeoHit *)b)->dist;
+    return x < y ? -1 : x > y;
+}
+
+static int hit_desc(const void *a, const void *b) {
+    return hit_asc(b, a);
+}
+
+// ============================================================================
+// Commands
+// ============================================================================
+static char *geo_reply(const char *fmt, ...) {
+    char buffer[256];
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, args);
+    va_end(args);
+
+    size_t len = strlen(buffer) + 1;
+    char *reply = (char *)malloc(len);
+    if (reply) memcpy(reply, buffer, len);
+    return reply;
+}
+
+static char *finish_reply(StrBuf *sb) {
+    char *reply = sb_finish(sb);
+    return reply ? reply : geo_reply("ERROR: Memory allocation failed");
+}
+
+static int parse_double(const char *str, double *value) {
+    char *end;
+
+    *value = strtod(str, &end);
+    return end != str && *end == '\0' && isfinite(*value) ? 0 : -1;
+}
+
+// Meters per unit, or 0 for an unknown unit
+static double parse_unit(const char *unit) {
+    if (strcasecmp(unit, "m") == 0) return 1;
+    if (strcasecmp(unit, "km") == 0) return 1000;
+    if (strcasecmp(unit, "ft") == 0) return 0.3048;
+    if (strcasecmp(unit, "mi") == 0) return 1609.34;
+    return 0;
+}
+
+static int valid_position(double lon, double lat) {
+    return lon >= GEO_LON_MIN && lon <= GEO_LON_MAX && lat >= GEO_LAT_MIN && lat <= GEO_LAT_MAX;
+}
+
+// The set at key, or NULL if there is none; *wrongtype is set if the key
+// holds another type
+static GeoSet *set_lookup(HashTable *ht, const char *key, int *wrongtype) {
+    ValueType type;
+    void *value = ht_lookup(ht, key, &type);
+
+    *wrongtype = value && type != VALUE_GEO;
+    return value && type == VALUE_GEO ? (GeoSet *)value : NULL;
+}
+
+// GEOADD key [NX|XX] [CH] lon lat member [lon lat member ...]
+static char *cmd_geoadd(HashTable *ht, char **tokens, int num_tokens) {
+    int nx = 0, xx = 0, ch = 0, i = 2, wrongtype;
+
+    for (; i < num_tokens; i++) {
+        if (strcasecmp(tokens[i], "NX") == 0) {
+            nx = 1;
+        } else if (strcasecmp(tokens[i], "XX") == 0) {
+            xx = 1;
+        } else if (strcasecmp(tokens[i], "CH") == 0) {
+            ch = 1;
+        } else {
+            break;
+        }
+    }
+    if (nx && xx) return geo_reply("ERROR: NX and XX options at the same time are not compatible");
+    if (i == num_tokens || (num_tokens - i) % 3 != 0) {
+        return geo_reply("ERROR: GEOADD takes key [NX|XX] [CH] longitude latitude member ...");
+    }
+
+    // Every position is checked before anything changes
+    for (int j = i; j < num_tokens; j += 3) {
+        double lon, lat;
+        if (parse_double(tokens[j], &lon) != 0 || parse_double(tokens[j + 1], &lat) != 0 ||
+            !valid_position(lon, lat)) {
+            return geo_reply("ERROR: invalid longitude,latitude pair %.32s,%.32s", tokens[j],
+                             tokens[j + 1]);
+        }
+        if (strlen(tokens[j + 2]) > MAX_KEY_SIZE) return geo_reply("ERROR: Member name too long");
+    }
+
+    GeoSet *g = set_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) return geo_reply(WRONGTYPE_ERROR);
+    if (!g && xx) return geo_reply("0");
+
+    int created = !g;
+    if (created && !(g = set_create())) return geo_reply("ERROR: Memory allocation failed");
+
+    size_t before = g->memory;
+    long long added = 0, changed = 0;
+    int rc = 0;
+    for (int j = i; j < num_tokens && rc >= 0; j += 3) {
+        int exists = member_find(g, tokens[j + 2], NULL) != NULL, moved;
+        if ((nx && exists) || (xx && !exists)) continue;
+        rc = set_add(g, tokens[j + 2], atof(tokens[j]), atof(tokens[j + 1]), &moved);
+        if (rc > 0) added++;
+        if (moved) changed++;
+    }
+
+    if (created) {
+        if (g->count == 0 || ht_set_object(ht, tokens[1], VALUE_GEO, g) != 0) {
+            int empty = g->count == 0;
+            geo_free(g);
+            if (rc < 0 || !empty) return geo_reply("ERROR: Memory allocation failed");
+            return geo_reply("0");
+        }
+    } else {
+        ht_account_value(ht, (long long)g->memory - (long long)before);
+    }
+    keystats_write(VALUE_GEO, ht->db, tokens[1], g->memory);
+    if (rc < 0) return geo_reply("ERROR: Memory allocation failed");
+    return geo_reply("%lld", ch ? changed : added);
+}
+
+// GEOREM key member [member ...] - The key goes with its last member
+static char *cmd_georem(HashTable *ht, char **tokens, int num_tokens) {
+    int wrongtype;
+
+    if (num_tokens < 3) return geo_reply("ERROR: GEOREM takes key member [member ...]");
+    GeoSet *g = set_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) return geo_reply(WRONGTYPE_ERROR);
+    if (!g) return geo_reply("0");
+
+    size_t before = g->memory;
+    long long removed = 0;
+    for (int i = 2; i < num_tokens; i++) {
+        size_t pos;
+        GeoNode *node = member_find(g, tokens[i], &pos);
+        if (node) {
+            set_remove(g, node, pos);
+            removed++;
+        }
+    }
+
+    ht_account_value(ht, (long long)g->memory - (long long)before);
+    if (g->count == 0) ht_delete(ht, tokens[1]);
+    return geo_reply("%lld", removed);
+}
+
+// GEOPOS key member [member ...]
+static char *cmd_geopos(HashTable *ht, char **tokens, int num_tokens) {
+    int wrongtype;
+
+    if (num_tokens < 3) return geo_reply("ERROR: GEOPOS takes key member [member ...]");
+    GeoSet *g = set_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) return geo_reply(WRONGTYPE_ERROR);
+
+    StrBuf sb;
+    sb_init(&sb);
+    sb_append(&sb, "[", 1);
+    for (int i = 2; i < num_tokens; i++) {
+        GeoNode *node = g ? member_find(g, tokens[i], NULL) : NULL;
+        if (i > 2) sb_append(&sb, ", ", 2);
+        if (!node) {
+            sb_append(&sb, "null", 4);
+            continue;
+        }
+        double lon, lat;
+        geo_decode(node->score, &lon, &lat);
+        sb_printf(&sb, "[%.17g, %.17g]", lon, lat);
+    }
+    sb_append(&sb, "]", 1);
+    return finish_reply(&sb);
+}
+
+// GEODIST key member1 member2 [M|KM|FT|MI]
+static char *cmd_geodist(HashTable *ht, char **tokens, int num_tokens) {
+    int wrongtype;
+    double unit = 1;
+
+    if ((num_tokens != 4 && num_tokens != 5) || (num_tokens == 5 && !(unit = parse_unit(tokens[4])))) {
+        return geo_reply("ERROR: GEODIST takes key member1 member2 [M|KM|FT|MI]");
+    }
+    GeoSet *g = set_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) return geo_reply(WRONGTYPE_ERROR);
+
+    GeoNode *a = g ? member_find(g, tokens[2], NULL) : NULL;
+    GeoNode *b = g ? member_find(g, tokens[3], NULL) : NULL;
+    if (!a || !b) return geo_reply("NULL");
+    return geo_reply("%.4f", node_distance(a, b) / unit);
+}
+
+// GEOHASH key member [member ...]
+static char *cmd_geohash(HashTable *ht, char **tokens, int num_tokens) {
+    int wrongtype;
+
+    if (num_tokens < 3) return geo_reply("ERROR: GEOHASH takes key member [member ...]");
+    GeoSet *g = set_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) return geo_reply(WRONGTYPE_ERROR);
+
+    StrBuf sb;
+    sb_init(&sb);
+    sb_append(&sb, "[", 1);
+    for (int i = 2; i < num_tokens; i++) {
+        GeoNode *node = g ? member_find(g, tokens[i], NULL) : NULL;
+        char hash[12];
+        if (i > 2) sb_append(&sb, ", ", 2);
+        if (!node) {
+            sb_append(&sb, "null", 4);
+            continue;
+        }
+        geo_hash_string(node->score, hash);
+        sb_printf(&sb, "\"%s\"", hash);
+    }
+    sb_append(&sb, "]", 1);
+    return finish_reply(&sb);
+}
+
+static char *geosearch_usage(void) {
+    return geo_reply("ERROR: GEOSEARCH takes key FROMMEMBER member|FROMLONLAT lon lat "
+                     "BYRADIUS r unit|BYBOX width height unit [ASC|DESC] [COUNT n [ANY]] "
+                     "[WITHCOORD] [WITHDIST] [WITHHASH]");
+}
+
+// GEOSEARCH key FROMMEMBER member | FROMLONLAT lon lat
+//           BYRADIUS radius unit | BYBOX width height unit
+//           [ASC|DESC] [COUNT n [ANY]] [WITHCOORD] [WITHDIST] [WITHHASH]
+static char *cmd_geosearch(HashTable *ht, char **tokens, int num_tokens) {
+    const char *from_member = NULL;
+    double lon = 0, lat = 0, radius = 0, width = 0, height = 0, unit = 0;
+    int from = 0, by = 0, sort = 0, any = 0, with_coord = 0, with_dist = 0, with_hash = 0;
+    size_t count = 0;
+    int wrongtype;
+
+    for (int i = 2; i < num_tokens; i++) {
+        const char *opt = tokens[i];
+        if (strcasecmp(opt, "FROMMEMBER") == 0 && i + 1 < num_tokens && !from) {
+            from_member = tokens[++i];
+            from = 1;
+        } else if (strcasecmp(opt, "FROMLONLAT") == 0 && i + 2 < num_tokens && !from) {
+            if (parse_double(tokens[i + 1], &lon) != 0 || parse_double(tokens[i + 2], &lat) != 0 ||
+                !valid_position(lon, lat)) {
+                return geo_reply("ERROR: invalid longitude,latitude pair");
+            }
+            i += 2;
+            from = 1;
+        } else if (strcasecmp(opt, "BYRADIUS") == 0 && i + 2 < num_tokens && !by) {
+            if (parse_double(tokens[i + 1], &radius) != 0 || radius < 0 ||
+                !(unit = parse_unit(tokens[i + 2]))) {
+                return geo_reply("ERROR: BYRADIUS takes a radius and M, KM, FT or MI");
+            }
+            i += 2;
+            by = 1;
+        } else if (strcasecmp(opt, "BYBOX") == 0 && i + 3 < num_tokens && !by) {
+            if (parse_double(tokens[i + 1], &width) != 0 || width < 0 ||
+                parse_double(tokens[i + 2], &height) != 0 || height < 0 ||
+                !(unit = parse_unit(tokens[i + 3]))) {
+                return geo_reply("ERROR: BYBOX takes a width, a height and M, KM, FT or MI");
+            }
+            i += 3;
+            by = 2;
+        } else if (strcasecmp(opt, "ASC") == 0) {
+            sort = 1;
+        } else if (strcasecmp(opt, "DESC") == 0) {
+            sort = -1;
+        } else if (strcasecmp(opt, "COUNT") == 0 && i + 1 < num_tokens) {
+            char *end;
+            errno = 0;
+            long long n = strtoll(tokens[++i], &end, 10);
+            if (*end != '\0' || errno == ERANGE || n <= 0) {
+                return geo_reply("ERROR: COUNT must be > 0");
+            }
+            count = (size_t)n;
+        } else if (strcasecmp(opt, "ANY") == 0) {
+            any = 1;
+        } else if (strcasecmp(opt, "WITHCOORD") == 0) {
+            with_coord = 1;
+        } else if (strcasecmp(opt, "WITHDIST") == 0) {
+            with_dist = 1;
+        } else if (strcasecmp(opt, "WITHHASH") == 0) {
+            with_hash = 1;
+        } else {
+            return geosearch_usage();
+        }
+    }
+    if (num_tokens < 2 || !from || !by) return geosearch_usage();
+    if (any && !count) return geo_reply("ERROR: ANY requires COUNT");
+
+    GeoSet *g = set_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) return geo_reply(WRONGTYPE_ERROR);
+    if (!g) return geo_reply("[]");
+
+    GeoShape shape;
+    if (from_member) {
+        GeoNode *centre = member_find(g, from_member, NULL);
+        if (!centre) return geo_reply("ERROR: Member not found");
+        geo_decode(centre->score, &lon, &lat);
+    }
+    shape.lon = lon;
+    shape.lat = lat;
+    double c;
+    unit_vector(lon, lat, &shape.x, &shape.y, &shape.z, &c);
+    if (by == 1) {
+        shape_radius(&shape, radius * unit);
+    } else {
+        shape_box(&shape, width * unit, height * unit);
+    }
+
+    // Without ANY, COUNT keeps the nearest, as Redis does
+    if (count && !any && !sort) sort = 1;
+    GeoSearch found = { NULL, 0, 0, any ? count : 0, 0 };
+    search(g, &shape, &found);
+    if (found.failed) {
+        free(found.hits);
+        return geo_reply("ERROR: Memory allocation failed");
+    }
+    if (sort && found.len > 1) {
+        qsort(found.hits, found.len, sizeof(GeoHit), sort > 0 ? hit_asc : hit_desc);
+    }
+    if (count && found.len > count) found.len = count;
+
+    StrBuf sb;
+    int plain = !with_coord && !with_dist && !with_hash;
+    sb_init(&sb);
+    sb_append(&sb, "[", 1);
+    for (size_t i = 0; i < found.len; i++) {
+        const GeoHit *hit = &found.hits[i];
+        if (i > 0) sb_append(&sb, ", ", 2);
+        if (plain) {
+            sb_json_string(&sb, hit->node->member, strlen(hit->node->member));
+            continue;
+        }
+        sb_append(&sb, "{\"member\": ", 11);
+        sb_json_string(&sb, hit->node->member, strlen(hit->node->member));
+        if (with_dist) sb_printf(&sb, ", \"dist\": %.4f", hit->dist / unit);
+        if (with_hash) sb_printf(&sb, ", \"hash\": %llu", (unsigned long long)hit->node->score);
+        if (with_coord) {
+            double plon, plat;
+            geo_decode(hit->node->score, &plon, &plat);
+            sb_printf(&sb, ", \"coord\": [%.17g, %.17g]", plon, plat);
+        }
+        sb_append(&sb, "}", 1);
+    }
+    sb_append(&sb, "]", 1);
+    free(found.hits);
+    return finish_reply(&sb);
+}
+
+// ============================================================================
+// Dispatch
+// ============================================================================
+static const struct {
+    const char *name;
+    int writes;
+} geo_commands[] = {
+    { "GEOADD", 1 }, { "GEOREM", 1 }, { "GEOPOS", 0 },
+    { "GEODIST", 0 }, { "GEOHASH", 0 }, { "GEOSEARCH", 0 },
+};
+
+const char *geo_command_key(char **tokens, int num_tokens, int *writes) {
+    for (size_t i = 0; i < sizeof(geo_commands) / sizeof(geo_commands[0]); i++) {
+        if (strcasecmp(tokens[0], geo_commands[i].name) == 0) {
+            *writes = geo_commands[i].writes;
+            return num_tokens >= 2 ? tokens[1] : NULL;
+        }
+    }
+    return NULL;
+}
+
+char *geo_command(HashTable *ht, char **tokens, int num_tokens) {
+    const char *name = tokens[0];
+
+    if (strcasecmp(name, "GEOADD") == 0) return cmd_geoadd(ht, tokens, num_tokens);
+    if (strcasecmp(name, "GEOREM") == 0) return cmd_georem(ht, tokens, num_tokens);
+    if (strcasecmp(name, "GEOPOS") == 0) return cmd_geopos(ht, tokens, num_tokens);
+    if (strcasecmp(name, "GEODIST") == 0) return cmd_geodist(ht, tokens, num_tokens);
+    if (strcasecmp(name, "GEOHASH") == 0) return cmd_geohash(ht, tokens, num_tokens);
+    if (strcasecmp(name, "GEOSEARCH") == 0) return cmd_geosearch(ht, tokens, num_tokens);
+    return NULL;
+}
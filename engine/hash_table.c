@@ -2,11 +2,30 @@
 // hash_table.c - Custom Hash Table Implementation for Mini-Redis
 // ============================================================================
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "mini_redis.h"
 
+// Bucket arrays at least this large are mapped directly, so their pages
+// start untouched and their placement can be chosen
+#define BUCKET_MMAP_THRESHOLD (256 * 1024)
+
+// Entry nodes of every table, when ht_enable_entry_slab() is in effect;
+// shared so deferred frees (epoch_retire) need no table pointer
+static Slab *g_entry_slab = NULL;
+
+// Keys and values under ht_enable_defrag(): 16-byte classes up to 128,
+// then four per doubling up to 5120, which holds MAX_VALUE_SIZE + 1.
+// Larger strings fall back to malloc().
+#define STRING_CLASSES 29
+#define STRING_CLASS_MAX 5120
+
+static Slab *g_string_slabs[STRING_CLASSES];
+static int g_defrag_enabled = 0;
+
 // ============================================================================
 // Hash Function (DJB2 by Dan Bernstein)
 // ============================================================================
@@ -24,8 +43,62 @@ static uint64_t hash_djb2(const char *str) {
 // ============================================================================
 // Create a new hash entry
 // ============================================================================
+static HashEntry *entry_node_alloc(void) {
+    if (g_entry_slab) {
+        return (HashEntry *)slab_alloc(g_entry_slab);
+    }
+    return (HashEntry *)malloc(sizeof(HashEntry));
+}
+
+static void entry_node_free(HashEntry *entry) {
+    if (g_entry_slab) {
+        slab_free(g_entry_slab, entry);
+    } else {
+        free(entry);
+    }
+}
+
+// Size class of a string allocation of size bytes
+static int string_class(size_t size) {
+    if (size <= 128) {
+        return size == 0 ? 0 : (int)((size + 15) / 16) - 1;
+    }
+
+    size_t p = 7;
+    while (((size_t)1 << (p + 1)) < size) p++;
+    size_t step = (size_t)1 << (p - 2);
+    return 8 + (int)(p - 7) * 4 + (int)((size - ((size_t)1 << p) + step - 1) / step) - 1;
+}
+
+static size_t string_class_size(int cls) {
+    if (cls < 8) return (size_t)(cls + 1) * 16;
+
+    size_t p = 7 + (size_t)(cls - 8) / 4;
+    return ((size_t)1 << p) + (size_t)((cls - 8) % 4 + 1) * ((size_t)1 << (p - 2));
+}
+
+// Slab holding strings of size bytes, or NULL if they come from malloc()
+static Slab *string_slab(size_t size) {
+    if (!g_defrag_enabled || size > STRING_CLASS_MAX) return NULL;
+    return g_string_slabs[string_class(size)];
+}
+
+static char *string_alloc(size_t size) {
+    Slab *slab = string_slab(size);
+    return slab ? (char *)slab_alloc(slab) : (char *)malloc(size);
+}
+
+static void string_free(char *str, size_t size) {
+    Slab *slab = string_slab(size);
+    if (slab) {
+        slab_free(slab, str);
+    } else {
+        free(str);
+    }
+}
+
 static HashEntry *entry_create(const char *key, const char *value) {
-    HashEntry *entry = (HashEntry *)malloc(sizeof(HashEntry));
+    HashEntry *entry = entry_node_alloc();
     if (!entry) {
         return NULL;
     }
@@ -33,43 +106,248 @@ static HashEntry *entry_create(const char *key, const char *value) {
     entry->key_len = strlen(key);
     entry->value_len = strlen(value);
     
-    entry->key = (char *)malloc(entry->key_len + 1);
+    entry->key = string_alloc(entry->key_len + 1);
     if (!entry->key) {
-        free(entry);
+        entry_node_free(entry);
         return NULL;
     }
     
-    entry->value = (char *)malloc(entry->value_len + 1);
+    entry->value = string_alloc(entry->value_len + 1);
     if (!entry->value) {
-        free(entry->key);
-        free(entry);
+        string_free(entry->key, entry->key_len + 1);
+        entry_node_free(entry);
         return NULL;
     }
     
     strcpy(entry->key, key);
     strcpy(entry->value, value);
+    entry->type = VALUE_STRING;
     entry->next = NULL;
     
     return entry;
 }
 
+// Entry for a value of another type; takes obj only on success
+static HashEntry *entry_create_object(const char *key, ValueType type, void *obj) {
+    HashEntry *entry = entry_node_alloc();
+    if (!entry) {
+        return NULL;
+    }
+
+    entry->key_len = strlen(key);
+    entry->key = string_alloc(entry->key_len + 1);
+    if (!entry->key) {
+        entry_node_free(entry);
+        return NULL;
+    }
+
+    strcpy(entry->key, key);
+    entry->value = (char *)obj;
+    entry->value_len = 0;
+    entry->type = type;
+    entry->next = NULL;
+
+    return entry;
+}
+
+// Release an entry's value, whatever its type
+static void value_free(HashEntry *entry) {
+    switch (entry->type) {
+    case VALUE_STREAM:
+        stream_free((Stream *)entry->value);
+        break;
+    case VALUE_TIMESERIES:
+        ts_free((TimeSeries *)entry->value);
+        break;
+    case VALUE_VECTORSET:
+        vset_free((VectorSet *)entry->value);
+        break;
+    case VALUE_GEO:
+        geo_free((GeoSet *)entry->value);
+        break;
+    case VALUE_BLOOM:
+        bloom_free((BloomFilter *)entry->value);
+        break;
+    case VALUE_CUCKOO:
+        cuckoo_free((CuckooFilter *)entry->value);
+        break;
+    default:
+        string_free(entry->value, entry->value_len + 1);
+        break;
+    }
+}
+
 // ============================================================================
 // Free a hash entry
 // ============================================================================
 static void entry_destroy(HashEntry *entry) {
     if (entry) {
-        free(entry->key);
-        free(entry->value);
-        free(entry);
+        string_free(entry->key, entry->key_len + 1);
+        value_free(entry);
+        entry_node_free(entry);
     }
 }
 
+// ============================================================================
+// Bucket Arrays
+// ============================================================================
+static HashEntry **bucket_array_alloc(const HashTable *ht, size_t num_buckets) {
+    size_t size = num_buckets * sizeof(HashEntry *);
+
+    if (size < BUCKET_MMAP_THRESHOLD) {
+        return (HashEntry **)calloc(num_buckets, sizeof(HashEntry *));
+    }
+
+    // Anonymous mappings are zero-filled on first touch; page_map() backs
+    // them with huge pages when --hugepages asks for it
+    void *addr = page_map(size);
+    if (!addr) {
+        return NULL;
+    }
+    if (ht->numa_interleave) {
+        numa_interleave(addr, size);
+    }
+    return (HashEntry **)addr;
+}
+
+// Bytes a bucket array really occupies: its malloc() size class, or whole
+// pages once it is mapped
+static size_t bucket_array_memory(HashEntry **buckets, size_t num_buckets) {
+    size_t size = num_buckets * sizeof(HashEntry *);
+    return size < BUCKET_MMAP_THRESHOLD ? alloc_usable_size(buckets, size) : page_map_size(size);
+}
+
+static void bucket_array_free(HashEntry **buckets, size_t num_buckets) {
+    size_t size = num_buckets * sizeof(HashEntry *);
+
+    if (!buckets) return;
+    if (size < BUCKET_MMAP_THRESHOLD) {
+        free(buckets);
+    } else {
+        page_unmap(buckets, size);
+    }
+}
+
+// Deferred-free callbacks for epoch_retire()
+static void entry_free(void *ptr) {
+    entry_destroy((HashEntry *)ptr);
+}
+
+// A retired bucket view owns its array and the entry shells copied into
+// it by a resize; keys and values live on in the current view
+static void view_free(void *ptr) {
+    BucketView *view = (BucketView *)ptr;
+
+    for (size_t i = 0; i < view->num_buckets; i++) {
+        HashEntry *entry = view->buckets[i];
+        while (entry) {
+            HashEntry *next = entry->next;
+            entry_node_free(entry);
+            entry = next;
+        }
+    }
+
+    bucket_array_free(view->buckets, view->num_buckets);
+    free(view);
+}
+
+// Make a fully initialised entry (or chain link) visible to readers
+static void publish(HashEntry **link, HashEntry *entry) {
+    __atomic_store_n(link, entry, __ATOMIC_RELEASE);
+}
+
 // ============================================================================
 // Calculate memory used by an entry
 // ============================================================================
+// Counted as the allocator sees it: slab object and size-class sizes, or
+// what malloc() rounded each request up to, headers included
+static size_t string_memory(char *str, size_t size) {
+    Slab *slab = string_slab(size);
+    return slab ? slab_object_size(slab) : alloc_usable_size(str, size);
+}
+
+// Objects keep their own count, updated as they change
+static size_t value_memory(HashEntry *entry) {
+    switch (entry->type) {
+    case VALUE_STREAM:
+        return stream_memory((Stream *)entry->value);
+    case VALUE_TIMESERIES:
+        return ts_memory((TimeSeries *)entry->value);
+    case VALUE_VECTORSET:
+        return vset_memory((VectorSet *)entry->value);
+    case VALUE_GEO:
+        return geo_memory((GeoSet *)entry->value);
+    case VALUE_BLOOM:
+        return bloom_memory((BloomFilter *)entry->value);
+    case VALUE_CUCKOO:
+        return cuckoo_memory((CuckooFilter *)entry->value);
+    default:
+        return string_memory(entry->value, entry->value_len + 1);
+    }
+}
+
 static size_t entry_memory(HashEntry *entry) {
     if (!entry) return 0;
-    return sizeof(HashEntry) + entry->key_len + 1 + entry->value_len + 1;
+
+    size_t node = g_entry_slab ? slab_object_size(g_entry_slab)
+                               : alloc_usable_size(entry, sizeof(HashEntry));
+    return node + string_memory(entry->key, entry->key_len + 1) + value_memory(entry);
+}
+
+// Entry and memory counters are updated atomically: with striped locks,
+// writers in different stripes change them concurrently
+static void ht_account(HashTable *ht, long entries, long long bytes) {
+    __atomic_add_fetch(&ht->num_entries, (size_t)entries, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&ht->memory_used, (size_t)bytes, __ATOMIC_RELAXED);
+}
+
+// Memory the table holds besides its entries and bucket array
+static size_t ht_base_memory(HashTable *ht) {
+    return alloc_usable_size(ht, sizeof(HashTable)) +
+           alloc_usable_size(ht->view, sizeof(BucketView)) +
+           alloc_usable_size(ht->stripes, ht->num_stripes * sizeof(pthread_rwlock_t));
+}
+
+// Free a bucket array together with every entry chained to it
+static void bucket_array_destroy(HashEntry **buckets, size_t num_buckets) {
+    for (size_t i = 0; i < num_buckets; i++) {
+        HashEntry *entry = buckets[i];
+        while (entry) {
+            HashEntry *next = entry->next;
+            entry_destroy(entry);
+            entry = next;
+        }
+    }
+    bucket_array_free(buckets, num_buckets);
+}
+
+// Lazy-free callbacks
+static void detached_free(void *ptr) {
+    BucketView *view = (BucketView *)ptr;
+    bucket_array_destroy(view->buckets, view->num_buckets);
+    free(view);
+}
+
+static void entry_lazy_free(void *ptr) {
+    HashEntry *entry = (HashEntry *)ptr;
+    lazyfree_push(entry, entry_free, entry_memory(entry));
+}
+
+// Hand a bucket array that no reader can reach any more, with its entries,
+// to the lazy-free thread. view carries it if given, else a new one does.
+static void ht_flush_detach(HashTable *ht, HashEntry **buckets, size_t num_buckets,
+                            BucketView *view) {
+    size_t bytes = ht->memory_used - ht_base_memory(ht);
+
+    if (!view) view = (BucketView *)malloc(sizeof(BucketView));
+    if (!view) {
+        bucket_array_destroy(buckets, num_buckets);
+        return;
+    }
+
+    view->buckets = buckets;
+    view->num_buckets = num_buckets;
+    lazyfree_push(view, detached_free, bytes);
 }
 
 // ============================================================================
@@ -82,16 +360,23 @@ HashTable *ht_create(size_t initial_buckets) {
     }
     
     ht->num_buckets = initial_buckets > 0 ? initial_buckets : INITIAL_BUCKETS;
+    ht->min_buckets = ht->num_buckets;
+    ht->rehashes = 0;
     ht->num_entries = 0;
-    ht->memory_used = sizeof(HashTable);
+    ht->concurrent_reads = 0;
+    ht->view = NULL;
+    ht->stripes = NULL;
+    ht->num_stripes = 0;
+    ht->numa_interleave = 0;
+    ht->db = 0;
     
-    ht->buckets = (HashEntry **)calloc(ht->num_buckets, sizeof(HashEntry *));
+    ht->buckets = bucket_array_alloc(ht, ht->num_buckets);
     if (!ht->buckets) {
         free(ht);
         return NULL;
     }
     
-    ht->memory_used += ht->num_buckets * sizeof(HashEntry *);
+    ht->memory_used = ht_base_memory(ht) + bucket_array_memory(ht->buckets, ht->num_buckets);
     
     return ht;
 }
@@ -102,26 +387,101 @@ HashTable *ht_create(size_t initial_buckets) {
 void ht_destroy(HashTable *ht) {
     if (!ht) return;
     
-    // Free all entries
-    for (size_t i = 0; i < ht->num_buckets; i++) {
-        HashEntry *entry = ht->buckets[i];
-        while (entry) {
-            HashEntry *next = entry->next;
-            entry_destroy(entry);
-            entry = next;
-        }
+    // Entries are freed by the lazy-free thread, as for FLUSHALL ASYNC
+    ht_flush_detach(ht, ht->buckets, ht->num_buckets, ht->view);
+    
+    for (size_t i = 0; i < ht->num_stripes; i++) {
+        pthread_rwlock_destroy(&ht->stripes[i]);
     }
     
-    free(ht->buckets);
+    free(ht->stripes);
     free(ht);
 }
 
 // ============================================================================
-// Resize Hash Table (when load factor exceeded)
+// Enable Lock-Free Reads
+// ============================================================================
+int ht_enable_concurrent_reads(HashTable *ht) {
+    if (!ht) return -1;
+    if (ht->concurrent_reads) return 0;
+
+    BucketView *view = (BucketView *)malloc(sizeof(BucketView));
+    if (!view) {
+        return -1;
+    }
+
+    view->buckets = ht->buckets;
+    view->num_buckets = ht->num_buckets;
+    ht->view = view;
+    ht->memory_used += alloc_usable_size(view, sizeof(BucketView));
+    ht->concurrent_reads = 1;
+
+    return 0;
+}
+
+// ============================================================================
+// Resize With Concurrent Readers
 // ============================================================================
-static int ht_resize(HashTable *ht) {
-    size_t new_num_buckets = ht->num_buckets * 2;
-    HashEntry **new_buckets = (HashEntry **)calloc(new_num_buckets, sizeof(HashEntry *));
+// Readers may be walking the old chains, so entries are never relinked.
+// Each one is copied into the new array as a shell sharing its key and
+// value; the old array and shells are retired together once the new view
+// is published.
+static int ht_resize_concurrent(HashTable *ht, size_t new_num_buckets) {
+    BucketView *view = (BucketView *)malloc(sizeof(BucketView));
+    HashEntry **new_buckets = bucket_array_alloc(ht, new_num_buckets);
+
+    if (!view || !new_buckets) {
+        free(view);
+        bucket_array_free(new_buckets, new_num_buckets);
+        return -1;
+    }
+
+    view->buckets = new_buckets;
+    view->num_buckets = new_num_buckets;
+
+    // A shell may land in a larger malloc() chunk than the node it copies
+    long long shell_bytes = 0;
+    for (size_t i = 0; i < ht->num_buckets; i++) {
+        for (HashEntry *entry = ht->buckets[i]; entry; entry = entry->next) {
+            HashEntry *copy = entry_node_alloc();
+            if (!copy) {
+                // Shells only: keys and values still belong to the old view
+                view_free(view);
+                return -1;
+            }
+
+            *copy = *entry;
+            size_t new_index = hash_djb2(entry->key) % new_num_buckets;
+            copy->next = new_buckets[new_index];
+            new_buckets[new_index] = copy;
+            shell_bytes += (long long)entry_memory(copy) - (long long)entry_memory(entry);
+        }
+    }
+
+    ht->memory_used += (size_t)shell_bytes;
+    ht->memory_used -= bucket_array_memory(ht->buckets, ht->num_buckets);
+    ht->memory_used += bucket_array_memory(new_buckets, new_num_buckets);
+
+    BucketView *old = ht->view;
+    __atomic_store_n(&ht->view, view, __ATOMIC_RELEASE);
+    ht->buckets = new_buckets;
+    ht->num_buckets = new_num_buckets;
+    ht->rehashes++;
+
+    epoch_retire(old, view_free);
+
+    return 0;
+}
+
+// ============================================================================
+// Resize Hash Table (grow or shrink with the load factor, or reserve)
+// ============================================================================
+static int ht_resize(HashTable *ht, size_t new_num_buckets) {
+    if (ht->concurrent_reads) {
+        return ht_resize_concurrent(ht, new_num_buckets);
+    }
+    
+    HashEntry **new_buckets = bucket_array_alloc(ht, new_num_buckets);
     
     if (!new_buckets) {
         return -1;
@@ -145,12 +505,28 @@ static int ht_resize(HashTable *ht) {
     }
     
     // Update memory accounting
-    ht->memory_used -= ht->num_buckets * sizeof(HashEntry *);
-    ht->memory_used += new_num_buckets * sizeof(HashEntry *);
+    ht->memory_used -= bucket_array_memory(ht->buckets, ht->num_buckets);
+    ht->memory_used += bucket_array_memory(new_buckets, new_num_buckets);
     
-    free(ht->buckets);
+    bucket_array_free(ht->buckets, ht->num_buckets);
     ht->buckets = new_buckets;
     ht->num_buckets = new_num_buckets;
+    ht->rehashes++;
+    
+    return 0;
+}
+
+// Create an entry at the head of bucket index (chaining)
+static int ht_link_new(HashTable *ht, size_t index, const char *key, const char *value) {
+    HashEntry *new_entry = entry_create(key, value);
+    if (!new_entry) {
+        return -1;
+    }
+    
+    new_entry->next = ht->buckets[index];
+    publish(&ht->buckets[index], new_entry);
+    
+    ht_account(ht, 1, (long long)entry_memory(new_entry));
     
     return 0;
 }
@@ -168,59 +544,227 @@ int ht_set(HashTable *ht, const char *key, const char *value) {
         return -1;
     }
     
-    // Check load factor and resize if needed
-    float load_factor = (float)ht->num_entries / (float)ht->num_buckets;
-    if (load_factor > LOAD_FACTOR_THRESHOLD) {
-        if (ht_resize(ht) != 0) {
-            fprintf(stderr, "[WARN] Failed to resize hash table\n");
-            // Continue anyway, performance may degrade
-        }
+    // Check load factor and resize if needed; with striped locks the
+    // caller does this separately while holding every stripe
+    if (!ht->stripes && ht_maybe_resize(ht) != 0) {
+        fprintf(stderr, "[WARN] Failed to resize hash table\n");
+        // Continue anyway, performance may degrade
     }
     
     size_t index = hash_djb2(key) % ht->num_buckets;
     
     // Check if key already exists
     HashEntry *entry = ht->buckets[index];
+    HashEntry *prev = NULL;
     while (entry) {
+        if (strcmp(entry->key, key) == 0 && ht->concurrent_reads) {
+            // Readers may hold the old value: swap in a new entry
+            HashEntry *replacement = entry_create(key, value);
+            if (!replacement) {
+                return -1;
+            }
+
+            replacement->next = entry->next;
+            publish(prev ? &prev->next : &ht->buckets[index], replacement);
+
+            ht->memory_used -= entry_memory(entry);
+            ht->memory_used += entry_memory(replacement);
+            epoch_retire(entry, entry_free);
+
+            return 0;
+        }
         if (strcmp(entry->key, key) == 0) {
             // Update existing value
             size_t old_mem = entry_memory(entry);
             
-            char *new_value = (char *)malloc(strlen(value) + 1);
+            char *new_value = string_alloc(strlen(value) + 1);
             if (!new_value) {
                 return -1;
             }
             
             strcpy(new_value, value);
-            free(entry->value);
+            value_free(entry);
             entry->value = new_value;
             entry->value_len = strlen(value);
+            entry->type = VALUE_STRING;
             
             // Update memory accounting
-            ht->memory_used -= old_mem;
-            ht->memory_used += entry_memory(entry);
+            ht_account(ht, 0, (long long)entry_memory(entry) - (long long)old_mem);
             
             return 0;
         }
+        prev = entry;
         entry = entry->next;
     }
     
-    // Create new entry
-    HashEntry *new_entry = entry_create(key, value);
-    if (!new_entry) {
+    return ht_link_new(ht, index, key, value);
+}
+
+// ============================================================================
+// Insert a Key Known to Be Absent
+// ============================================================================
+int ht_insert_new(HashTable *ht, const char *key, const char *value) {
+    if (!ht || !key || !value) {
         return -1;
     }
     
-    // Insert at head of bucket (chaining)
-    new_entry->next = ht->buckets[index];
-    ht->buckets[index] = new_entry;
+    if (strlen(key) > MAX_KEY_SIZE || strlen(value) > MAX_VALUE_SIZE) {
+        return -1;
+    }
     
-    ht->num_entries++;
-    ht->memory_used += entry_memory(new_entry);
+    if (!ht->stripes && ht_maybe_resize(ht) != 0) {
+        fprintf(stderr, "[WARN] Failed to resize hash table\n");
+    }
     
+    return ht_link_new(ht, hash_djb2(key) % ht->num_buckets, key, value);
+}
+
+// ============================================================================
+// Values of Other Types
+// ============================================================================
+int ht_set_object(HashTable *ht, const char *key, ValueType type, void *obj) {
+    if (!ht || !key || !obj || type == VALUE_STRING || strlen(key) > MAX_KEY_SIZE) {
+        return -1;
+    }
+
+    if (!ht->stripes && ht_maybe_resize(ht) != 0) {
+        fprintf(stderr, "[WARN] Failed to resize hash table\n");
+    }
+
+    HashEntry *new_entry = entry_create_object(key, type, obj);
+    if (!new_entry) {
+        return -1;
+    }
+
+    size_t index = hash_djb2(key) % ht->num_buckets;
+    HashEntry **link = &ht->buckets[index];
+    while (*link && strcmp((*link)->key, key) != 0) {
+        link = &(*link)->next;
+    }
+
+    HashEntry *old = *link;
+    if (old) {
+        // Swap the whole entry, as a concurrent-reads update would
+        new_entry->next = old->next;
+        publish(link, new_entry);
+        ht_account(ht, 0, (long long)entry_memory(new_entry) - (long long)entry_memory(old));
+        if (ht->concurrent_reads) {
+            epoch_retire(old, entry_free);
+        } else {
+            entry_destroy(old);
+        }
+        return 0;
+    }
+
+    new_entry->next = ht->buckets[index];
+    publish(&ht->buckets[index], new_entry);
+    ht_account(ht, 1, (long long)entry_memory(new_entry));
+    return 0;
+}
+
+void ht_account_value(HashTable *ht, long long bytes) {
+    ht_account(ht, 0, bytes);
+}
+
+// ============================================================================
+// Bulk Loading
+// ============================================================================
+// Serializes linkers when partitions do not map to disjoint buckets, and
+// epoch_retire() calls, which expect a single writer
+static pthread_mutex_t g_bulk_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int ht_bulk_add(HtBulk *bulk, const char *key, const char *value) {
+    if (!bulk || !key || !value) {
+        return -1;
+    }
+
+    if (strlen(key) > MAX_KEY_SIZE || strlen(value) > MAX_VALUE_SIZE) {
+        return -1;
+    }
+
+    HashEntry *entry = entry_create(key, value);
+    if (!entry) {
+        return -1;
+    }
+
+    size_t part = hash_djb2(key) % HT_BULK_PARTS;
+    if (bulk->tail[part]) {
+        bulk->tail[part]->next = entry;
+    } else {
+        bulk->head[part] = entry;
+    }
+    bulk->tail[part] = entry;
+    bulk->count++;
+
     return 0;
 }
 
+void ht_bulk_discard(HtBulk *bulk) {
+    for (size_t part = 0; part < HT_BULK_PARTS; part++) {
+        HashEntry *entry = bulk->head[part];
+        while (entry) {
+            HashEntry *next = entry->next;
+            entry_destroy(entry);
+            entry = next;
+        }
+        bulk->head[part] = bulk->tail[part] = NULL;
+    }
+    bulk->count = 0;
+}
+
+size_t ht_bulk_link(HashTable *ht, HtBulk *bulks, size_t num_bulks, size_t part,
+                    int unique) {
+    // hash % HT_BULK_PARTS fixes hash % num_buckets only when it divides it
+    int shared = ht->num_buckets % HT_BULK_PARTS != 0;
+    size_t added = 0;
+    long long bytes = 0;
+
+    if (shared) pthread_mutex_lock(&g_bulk_lock);
+
+    for (size_t b = 0; b < num_bulks; b++) {
+        HashEntry *entry = bulks[b].head[part];
+        bulks[b].head[part] = bulks[b].tail[part] = NULL;
+
+        while (entry) {
+            HashEntry *next = entry->next;
+            size_t index = hash_djb2(entry->key) % ht->num_buckets;
+            HashEntry **link = &ht->buckets[index];
+
+            if (!unique) {
+                while (*link && strcmp((*link)->key, entry->key) != 0) {
+                    link = &(*link)->next;
+                }
+            }
+
+            HashEntry *old = unique ? NULL : *link;
+            bytes += (long long)entry_memory(entry);
+            if (old) {
+                // Replace in place: readers see either entry, never neither
+                entry->next = old->next;
+                publish(link, entry);
+                bytes -= (long long)entry_memory(old);
+                if (ht->concurrent_reads) {
+                    if (!shared) pthread_mutex_lock(&g_bulk_lock);
+                    epoch_retire(old, entry_free);
+                    if (!shared) pthread_mutex_unlock(&g_bulk_lock);
+                } else {
+                    entry_destroy(old);
+                }
+            } else {
+                entry->next = ht->buckets[index];
+                publish(&ht->buckets[index], entry);
+                added++;
+            }
+            entry = next;
+        }
+    }
+
+    if (shared) pthread_mutex_unlock(&g_bulk_lock);
+
+    ht_account(ht, (long)added, bytes);
+    return added;
+}
+
 // ============================================================================
 // Get Value by Key
 // ============================================================================
@@ -229,12 +773,27 @@ const char *ht_get(HashTable *ht, const char *key) {
         return NULL;
     }
     
+    if (ht->concurrent_reads) {
+        // Lock-free: one consistent view, chains followed with acquire loads
+        BucketView *view = __atomic_load_n(&ht->view, __ATOMIC_ACQUIRE);
+        size_t index = hash_djb2(key) % view->num_buckets;
+
+        HashEntry *entry = __atomic_load_n(&view->buckets[index], __ATOMIC_ACQUIRE);
+        while (entry) {
+            if (strcmp(entry->key, key) == 0) {
+                return entry->type == VALUE_STRING ? entry->value : NULL;
+            }
+            entry = __atomic_load_n(&entry->next, __ATOMIC_ACQUIRE);
+        }
+        return NULL;
+    }
+    
     size_t index = hash_djb2(key) % ht->num_buckets;
     
     HashEntry *entry = ht->buckets[index];
     while (entry) {
         if (strcmp(entry->key, key) == 0) {
-            return entry->value;
+            return entry->type == VALUE_STRING ? entry->value : NULL;
         }
         entry = entry->next;
     }
@@ -242,10 +801,39 @@ const char *ht_get(HashTable *ht, const char *key) {
     return NULL;
 }
 
+void *ht_lookup(HashTable *ht, const char *key, ValueType *type) {
+    if (!ht || !key) {
+        return NULL;
+    }
+
+    // An entry's type never changes once readers can see it: an update
+    // under concurrent reads swaps in a new entry
+    HashEntry **buckets;
+    size_t num_buckets;
+    if (ht->concurrent_reads) {
+        BucketView *view = __atomic_load_n(&ht->view, __ATOMIC_ACQUIRE);
+        buckets = view->buckets;
+        num_buckets = view->num_buckets;
+    } else {
+        buckets = ht->buckets;
+        num_buckets = ht->num_buckets;
+    }
+
+    HashEntry *entry = __atomic_load_n(&buckets[hash_djb2(key) % num_buckets], __ATOMIC_ACQUIRE);
+    while (entry) {
+        if (strcmp(entry->key, key) == 0) {
+            *type = entry->type;
+            return entry->value;
+        }
+        entry = __atomic_load_n(&entry->next, __ATOMIC_ACQUIRE);
+    }
+    return NULL;
+}
+
 // ============================================================================
 // Delete Key
 // ============================================================================
-int ht_delete(HashTable *ht, const char *key) {
+static int ht_remove(HashTable *ht, const char *key, int lazy) {
     if (!ht || !key) {
         return -1;
     }
@@ -258,15 +846,24 @@ int ht_delete(HashTable *ht, const char *key) {
     while (entry) {
         if (strcmp(entry->key, key) == 0) {
             // Found the entry
-            if (prev) {
-                prev->next = entry->next;
+            publish(prev ? &prev->next : &ht->buckets[index], entry->next);
+            
+            size_t bytes = entry_memory(entry);
+            ht_account(ht, -1, -(long long)bytes);
+            lazy = lazy && bytes >= LAZYFREE_MIN_BYTES;
+            if (ht->concurrent_reads) {
+                epoch_retire(entry, lazy ? entry_lazy_free : entry_free);
+            } else if (lazy) {
+                lazyfree_push(entry, entry_free, bytes);
             } else {
-                ht->buckets[index] = entry->next;
+                entry_destroy(entry);
             }
             
-            ht->memory_used -= entry_memory(entry);
-            ht->num_entries--;
-            entry_destroy(entry);
+            // Mass deletes shrink the table; with striped locks the caller
+            // does this separately while holding every stripe
+            if (!ht->stripes && ht_maybe_shrink(ht) != 0) {
+                fprintf(stderr, "[WARN] Failed to shrink hash table\n");
+            }
             
             return 0;
         }
@@ -277,6 +874,61 @@ int ht_delete(HashTable *ht, const char *key) {
     return -1;  // Not found
 }
 
+int ht_delete(HashTable *ht, const char *key) {
+    return ht_remove(ht, key, 0);
+}
+
+int ht_unlink(HashTable *ht, const char *key) {
+    return ht_remove(ht, key, 1);
+}
+
+// ============================================================================
+// Flush
+// ============================================================================
+int ht_flush(HashTable *ht, int async) {
+    if (!ht) return -1;
+
+    HashEntry **old_buckets = ht->buckets;
+    size_t old_num_buckets = ht->num_buckets;
+    HashEntry **buckets = bucket_array_alloc(ht, ht->min_buckets);
+    BucketView *view = NULL;
+
+    if (!buckets) return -1;
+
+    if (ht->concurrent_reads) {
+        view = (BucketView *)malloc(sizeof(BucketView));
+        if (!view) {
+            bucket_array_free(buckets, ht->min_buckets);
+            return -1;
+        }
+        view->buckets = buckets;
+        view->num_buckets = ht->min_buckets;
+
+        // Once every reader has left, nobody can reach the old view
+        BucketView *old = ht->view;
+        __atomic_store_n(&ht->view, view, __ATOMIC_RELEASE);
+        epoch_synchronize();
+        view = old;
+    }
+
+    ht->buckets = buckets;
+    ht->num_buckets = ht->min_buckets;
+
+    // memory_used still covers the old entries: the detach counts them
+    if (async) {
+        ht_flush_detach(ht, old_buckets, old_num_buckets, view);
+    } else {
+        bucket_array_destroy(old_buckets, old_num_buckets);
+        free(view);
+    }
+
+    __atomic_store_n(&ht->num_entries, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&ht->memory_used,
+                     ht_base_memory(ht) + bucket_array_memory(buckets, ht->min_buckets),
+                     __ATOMIC_RELAXED);
+    return 0;
+}
+
 // ============================================================================
 // Get Statistics
 // ============================================================================
@@ -287,6 +939,314 @@ void ht_stats(HashTable *ht, size_t *num_keys, size_t *memory_bytes) {
         return;
     }
     
-    if (num_keys) *num_keys = ht->num_entries;
-    if (memory_bytes) *memory_bytes = ht->memory_used;
+    if (num_keys) *num_keys = __atomic_load_n(&ht->num_entries, __ATOMIC_RELAXED);
+    if (memory_bytes) *memory_bytes = __atomic_load_n(&ht->memory_used, __ATOMIC_RELAXED);
+}
+
+void ht_memory_stats(HashTable *ht, size_t *dataset, size_t *overhead) {
+    size_t table = ht_base_memory(ht) + bucket_array_memory(ht->buckets, ht->num_buckets);
+    size_t used = __atomic_load_n(&ht->memory_used, __ATOMIC_RELAXED);
+
+    *overhead = table;
+    *dataset = used > table ? used - table : 0;
+}
+
+int ht_key_memory(HashTable *ht, const char *key, size_t *bytes) {
+    if (!ht || !key) return -1;
+
+    size_t index = hash_djb2(key) % ht->num_buckets;
+    for (HashEntry *entry = ht->buckets[index]; entry; entry = entry->next) {
+        if (strcmp(entry->key, key) == 0) {
+            *bytes = entry_memory(entry);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// ============================================================================
+// Resize Protocol
+// ============================================================================
+int ht_needs_resize(const HashTable *ht) {
+    size_t entries = __atomic_load_n(&ht->num_entries, __ATOMIC_RELAXED);
+    return (float)entries / (float)ht->num_buckets > LOAD_FACTOR_THRESHOLD;
+}
+
+int ht_maybe_resize(HashTable *ht) {
+    if (!ht_needs_resize(ht)) {
+        return 0;
+    }
+    return ht_resize(ht, ht->num_buckets * 2);
+}
+
+int ht_needs_shrink(const HashTable *ht) {
+    size_t entries = __atomic_load_n(&ht->num_entries, __ATOMIC_RELAXED);
+    return (float)entries / (float)ht->num_buckets < SHRINK_LOAD_FACTOR &&
+           ht->num_buckets > ht->min_buckets;
+}
+
+int ht_maybe_shrink(HashTable *ht) {
+    if (!ht_needs_shrink(ht)) {
+        return 0;
+    }
+
+    // Halving keeps the bucket count a multiple of the stripe count, as
+    // long as it stays at or above the initial size
+    size_t entries = __atomic_load_n(&ht->num_entries, __ATOMIC_RELAXED);
+    size_t new_num_buckets = ht->num_buckets;
+    while (new_num_buckets / 2 >= ht->min_buckets &&
+           (float)entries / (float)(new_num_buckets / 2) <= SHRINK_TARGET_LOAD) {
+        new_num_buckets /= 2;
+    }
+    return ht_resize(ht, new_num_buckets);
+}
+
+int ht_reserve(HashTable *ht, size_t entries, int keep) {
+    if (!ht) return -1;
+
+    // Doubling keeps the bucket count a multiple of the stripe count
+    size_t num_buckets = ht->min_buckets;
+    while ((float)entries / (float)num_buckets > LOAD_FACTOR_THRESHOLD) {
+        if (num_buckets > SIZE_MAX / (2 * sizeof(HashEntry *))) return -1;
+        num_buckets *= 2;
+    }
+
+    if (ht->num_buckets < num_buckets && ht_resize(ht, num_buckets) != 0) return -1;
+    if (keep) ht->min_buckets = num_buckets;
+    return 0;
+}
+
+// ============================================================================
+// Striped Locks
+// ============================================================================
+int ht_enable_striped_locks(HashTable *ht, size_t stripes) {
+    if (!ht || ht->stripes || stripes == 0) return -1;
+
+    // A stripe must map to the same buckets before and after every doubling
+    if ((stripes & (stripes - 1)) != 0 || ht->num_buckets % stripes != 0) {
+        return -1;
+    }
+
+    ht->stripes = (pthread_rwlock_t *)malloc(stripes * sizeof(pthread_rwlock_t));
+    if (!ht->stripes) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < stripes; i++) {
+        pthread_rwlock_init(&ht->stripes[i], NULL);
+    }
+    ht->num_stripes = stripes;
+    ht->memory_used += alloc_usable_size(ht->stripes, stripes * sizeof(pthread_rwlock_t));
+
+    return 0;
+}
+
+size_t ht_stripe(const HashTable *ht, const char *key) {
+    return (size_t)(hash_djb2(key) & (ht->num_stripes - 1));
+}
+
+void ht_stripe_lock(HashTable *ht, size_t stripe, int exclusive) {
+    if (exclusive) {
+        pthread_rwlock_wrlock(&ht->stripes[stripe]);
+    } else {
+        pthread_rwlock_rdlock(&ht->stripes[stripe]);
+    }
+}
+
+void ht_stripe_unlock(HashTable *ht, size_t stripe) {
+    pthread_rwlock_unlock(&ht->stripes[stripe]);
+}
+
+void ht_lock_all(HashTable *ht, int exclusive) {
+    // Fixed order, so whole-table lockers cannot deadlock each other
+    for (size_t i = 0; i < ht->num_stripes; i++) {
+        ht_stripe_lock(ht, i, exclusive);
+    }
+}
+
+void ht_unlock_all(HashTable *ht) {
+    for (size_t i = ht->num_stripes; i > 0; i--) {
+        ht_stripe_unlock(ht, i - 1);
+    }
+}
+
+// ============================================================================
+// NUMA Placement
+// ============================================================================
+void ht_enable_numa_interleave(HashTable *ht) {
+    // Applies to bucket arrays allocated from now on, i.e. every resize
+    if (ht) ht->numa_interleave = 1;
+}
+
+// ============================================================================
+// Entry Slab
+// ============================================================================
+int ht_enable_entry_slab(HashTable *ht) {
+    // Nodes already allocated with malloc() could not be told apart
+    if (!ht || __atomic_load_n(&ht->num_entries, __ATOMIC_RELAXED) > 0) return -1;
+    if (g_entry_slab) return 0;
+
+    g_entry_slab = slab_create(sizeof(HashEntry));
+    return g_entry_slab ? 0 : -1;
+}
+
+size_t ht_entry_slab_bytes(void) {
+    return slab_bytes(g_entry_slab);
+}
+
+// ============================================================================
+// Active Defragmentation
+// ============================================================================
+int ht_enable_defrag(HashTable *ht) {
+    if (!ht || __atomic_load_n(&ht->num_entries, __ATOMIC_RELAXED) > 0) return -1;
+    if (g_defrag_enabled) return 0;
+    if (ht_enable_entry_slab(ht) != 0) return -1;
+
+    for (int i = 0; i < STRING_CLASSES; i++) {
+        g_string_slabs[i] = slab_create(string_class_size(i));
+        if (!g_string_slabs[i]) return -1;
+    }
+    g_defrag_enabled = 1;
+    return 0;
+}
+
+int ht_alloc_usage(size_t *resident, size_t *used) {
+    size_t r, u;
+
+    if (!g_defrag_enabled) return -1;
+
+    slab_usage(g_entry_slab, resident, used);
+    for (int i = 0; i < STRING_CLASSES; i++) {
+        slab_usage(g_string_slabs[i], &r, &u);
+        *resident += r;
+        *used += u;
+    }
+    return 0;
+}
+
+static int string_should_move(const char *str, size_t size) {
+    Slab *slab = string_slab(size);
+    return slab && slab_should_move(slab, str);
+}
+
+// Reallocate a string in place of the old one; NULL leaves it where it is
+static char *string_move(char *str, size_t size) {
+    char *copy = string_alloc(size);
+    if (!copy) return NULL;
+
+    memcpy(copy, str, size);
+    string_free(str, size);
+    return copy;
+}
+
+// What a defrag copy leaves for epoch_retire(): the old node, and the
+// strings the copy no longer shares (NULL if it kept them)
+typedef struct DefragHusk {
+    HashEntry *node;
+    char *key;
+    char *value;
+    size_t key_size;
+    size_t value_size;
+} DefragHusk;
+
+static void husk_free(void *ptr) {
+    DefragHusk *husk = (DefragHusk *)ptr;
+    if (husk->key) string_free(husk->key, husk->key_size);
+    if (husk->value) string_free(husk->value, husk->value_size);
+    entry_node_free(husk->node);
+    free(husk);
+}
+
+// Copy entry for lock-free readers: a new node, with fresh key and value
+// only where they should move and shared otherwise, so nothing is
+// reallocated that global mode would leave alone. Returns NULL, leaving
+// the entry where it is, if an allocation fails.
+static HashEntry *entry_defrag_copy(HashEntry *entry, int move_key, int move_value,
+                                    DefragHusk **husk) {
+    size_t key_size = entry->key_len + 1, value_size = entry->value_len + 1;
+    HashEntry *copy = entry_node_alloc();
+    char *key = move_key ? string_alloc(key_size) : entry->key;
+    char *value = move_value ? string_alloc(value_size) : entry->value;
+    *husk = (DefragHusk *)malloc(sizeof(DefragHusk));
+
+    if (!copy || !key || !value || !*husk) {
+        if (copy) entry_node_free(copy);
+        if (move_key && key) string_free(key, key_size);
+        if (move_value && value) string_free(value, value_size);
+        free(*husk);
+        return NULL;
+    }
+
+    if (move_key) memcpy(key, entry->key, key_size);
+    if (move_value) memcpy(value, entry->value, value_size);
+    *copy = *entry;
+    copy->key = key;
+    copy->value = value;
+    **husk = (DefragHusk){entry, move_key ? entry->key : NULL,
+                          move_value ? entry->value : NULL, key_size, value_size};
+    return copy;
+}
+
+size_t ht_defrag(HashTable *ht, size_t *cursor, size_t max_buckets) {
+    size_t moved = 0;
+    size_t i = *cursor;
+
+    if (!ht || !g_defrag_enabled) return 0;
+
+    for (size_t n = 0; n < max_buckets && i < ht->num_buckets; n++, i++) {
+        HashEntry **link = &ht->buckets[i];
+        HashEntry *entry;
+
+        while ((entry = *link) != NULL) {
+            int move_node = slab_should_move(g_entry_slab, entry);
+            int move_key = string_should_move(entry->key, entry->key_len + 1);
+            int move_value = entry->type == VALUE_STRING &&
+                             string_should_move(entry->value, entry->value_len + 1);
+
+            if (ht->concurrent_reads) {
+                // Readers may be using the entry: swap in a copy, as an
+                // update would. Objects are shared, never copied.
+                DefragHusk *husk;
+                HashEntry *copy = move_node || move_key || move_value
+                                  ? entry_defrag_copy(entry, move_key, move_value, &husk) : NULL;
+                if (copy) {
+                    publish(link, copy);
+                    ht_account(ht, 0, (long long)entry_memory(copy) - (long long)entry_memory(entry));
+                    epoch_retire(husk, husk_free);
+                    entry = copy;
+                    moved += (size_t)(move_node + move_key + move_value);
+                }
+            } else {
+                char *str;
+                if (move_key && (str = string_move(entry->key, entry->key_len + 1))) {
+                    entry->key = str;
+                    moved++;
+                }
+                if (move_value && (str = string_move(entry->value, entry->value_len + 1))) {
+                    entry->value = str;
+                    moved++;
+                }
+
+                HashEntry *copy = move_node ? entry_node_alloc() : NULL;
+                if (copy) {
+                    *copy = *entry;
+                    *link = copy;
+                    entry_node_free(entry);
+                    entry = copy;
+                    moved++;
+                }
+            }
+            link = &entry->next;
+        }
+    }
+
+    // Retired originals still count as live in their old runs, which would
+    // keep those runs looking worth draining and get the copies moved again.
+    // Free them before the next step weighs the runs.
+    if (ht->concurrent_reads && moved > 0) {
+        epoch_synchronize();
+    }
+
+    *cursor = i < ht->num_buckets ? i : 0;
+    return moved;
 }
@@ -0,0 +1,302 @@
+// ============================================================================
+// keystats.c - Hot-Key Sampling and Big-Key Tracking
+// ============================================================================
+//
+// Hot keys: one key access in sample_rate (on average) is counted in a
+// count-min sketch, and the keys with the highest estimates are kept in a
+// small min-heap. Each thread draws its own random countdown to the next
+// sample, so the common case costs one thread-local decrement. Counts are
+// halved every KEYSTATS_DECAY_SAMPLES samples, so the heap follows what is
+// hot now rather than what was ever hot.
+//
+// Big keys: every write reports its value size; sizes above the smallest
+// one tracked for that value type are kept in a per-type min-heap. Keys
+// deleted or shrunk since are only noticed by keystats_big_refresh().
+// ============================================================================
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mini_redis.h"
+
+#define CMS_DEPTH 4
+#define CMS_WIDTH 4096                  // Power of two
+#define KEYSTATS_DECAY_SAMPLES (1 << 16)
+
+static const char *value_type_names[VALUE_TYPES] = { "string", "stream", "timeseries",
+                                                     "vectorset", "geo", "bloom", "cuckoo" };
+
+typedef struct TrackedKey {
+    int db;
+    char key[MAX_KEY_SIZE + 1];
+    size_t count;             // Sampled hits or value bytes
+} TrackedKey;
+
+// Min-heap on count: the root is the first to be evicted
+typedef struct KeyHeap {
+    TrackedKey slots[KEYSTATS_TRACKED];
+    size_t size;
+    size_t floor;             // Root count once full, read without the lock
+} KeyHeap;
+
+static uint32_t g_sketch[CMS_DEPTH][CMS_WIDTH];
+static unsigned g_sample_rate = DEFAULT_HOTKEYS_SAMPLE;
+static size_t g_samples = 0;
+
+static KeyHeap g_hot;
+static KeyHeap g_big[VALUE_TYPES];
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static _Thread_local uint64_t tls_rng = 0;
+static _Thread_local unsigned tls_countdown = 0;
+
+// ============================================================================
+// Heap
+// ============================================================================
+static void heap_swap(KeyHeap *h, size_t a, size_t b) {
+    TrackedKey tmp = h->slots[a];
+    h->slots[a] = h->slots[b];
+    h->slots[b] = tmp;
+}
+
+// Restore the heap after slot i's count changed either way
+static void heap_fix(KeyHeap *h, size_t i) {
+    while (i > 0 && h->slots[i].count < h->slots[(i - 1) / 2].count) {
+        heap_swap(h, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    for (;;) {
+        size_t min = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < h->size && h->slots[l].count < h->slots[min].count) min = l;
+        if (r < h->size && h->slots[r].count < h->slots[min].count) min = r;
+        if (min == i) break;
+        heap_swap(h, i, min);
+        i = min;
+    }
+}
+
+static void heap_publish_floor(KeyHeap *h) {
+    size_t floor = h->size == KEYSTATS_TRACKED ? h->slots[0].count : 0;
+    __atomic_store_n(&h->floor, floor, __ATOMIC_RELAXED);
+}
+
+static void heap_remove(KeyHeap *h, size_t i) {
+    h->slots[i] = h->slots[--h->size];
+    if (i < h->size) heap_fix(h, i);
+}
+
+// Set key's count, adding it if it beats the smallest tracked key
+static void heap_offer(KeyHeap *h, int db, const char *key, size_t count) {
+    for (size_t i = 0; i < h->size; i++) {
+        if (h->slots[i].db == db && strcmp(h->slots[i].key, key) == 0) {
+            h->slots[i].count = count;
+            heap_fix(h, i);
+            heap_publish_floor(h);
+            return;
+        }
+    }
+
+    size_t i;
+    if (h->size < KEYSTATS_TRACKED) {
+        i = h->size++;
+    } else if (count > h->slots[0].count) {
+        i = 0;
+    } else {
+        return;
+    }
+    h->slots[i].db = db;
+    snprintf(h->slots[i].key, sizeof(h->slots[i].key), "%s", key);
+    h->slots[i].count = count;
+    heap_fix(h, i);
+    heap_publish_floor(h);
+}
+
+// Copy out the tracked keys, largest count first
+static size_t heap_top(const KeyHeap *h, KeyCount *out, size_t max) {
+    KeyHeap copy = *h;
+    size_t n = 0;
+
+    while (copy.size > 0) {
+        // Pop the root repeatedly, then reverse: smallest comes off first
+        TrackedKey root = copy.slots[0];
+        heap_remove(&copy, 0);
+        if (copy.size < max) {
+            out[copy.size].db = root.db;
+            memcpy(out[copy.size].key, root.key, sizeof(root.key));
+            out[copy.size].count = root.count;
+            n++;
+        }
+    }
+    return n;
+}
+
+// ============================================================================
+// Count-Min Sketch
+// ============================================================================
+// The same key in two databases counts separately
+static uint64_t key_hash(int db, const char *key) {
+    uint64_t hash = 14695981039346656037ULL;    // FNV-1a
+    for (unsigned i = 0; i < sizeof(db); i++) {
+        hash ^= (unsigned char)((unsigned)db >> (8 * i));
+        hash *= 1099511628211ULL;
+    }
+    while (*key) {
+        hash ^= (unsigned char)*key++;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Count one sample of key; returns its estimated samples so far
+static size_t sketch_add(int db, const char *key) {
+    uint64_t hash = key_hash(db, key);
+    uint32_t h1 = (uint32_t)hash, h2 = (uint32_t)(hash >> 32) | 1;
+    uint32_t estimate = UINT32_MAX;
+
+    for (uint32_t row = 0; row < CMS_DEPTH; row++) {
+        uint32_t *cell = &g_sketch[row][(h1 + row * h2) & (CMS_WIDTH - 1)];
+        uint32_t value = __atomic_add_fetch(cell, 1, __ATOMIC_RELAXED);
+        if (value < estimate) estimate = value;
+    }
+    return estimate;
+}
+
+// Halve every counter and every tracked count (caller holds g_lock)
+static void sketch_decay(void) {
+    for (size_t row = 0; row < CMS_DEPTH; row++) {
+        for (size_t i = 0; i < CMS_WIDTH; i++) {
+            uint32_t value = __atomic_load_n(&g_sketch[row][i], __ATOMIC_RELAXED);
+            while (!__atomic_compare_exchange_n(&g_sketch[row][i], &value, value / 2, 1,
+                                                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            }
+        }
+    }
+
+    // Halving every count keeps the heap order
+    for (size_t i = 0; i < g_hot.size; i++) g_hot.slots[i].count /= 2;
+    heap_publish_floor(&g_hot);
+}
+
+// Countdown to the next sample, uniform in [1, 2 * rate - 1]: one in rate
+// on average, without locking onto a periodic access pattern
+static unsigned next_countdown(unsigned rate) {
+    if (tls_rng == 0) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        tls_rng = ((uint64_t)ts.tv_nsec << 20) ^ (uint64_t)(uintptr_t)&tls_rng ^ 0x9e3779b97f4a7c15ULL;
+    }
+    tls_rng ^= tls_rng << 13;
+    tls_rng ^= tls_rng >> 7;
+    tls_rng ^= tls_rng << 17;
+    return rate <= 1 ? 1 : 1 + (unsigned)(tls_rng % (2 * (uint64_t)rate - 1));
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+void keystats_set_sample_rate(unsigned rate) {
+    __atomic_store_n(&g_sample_rate, rate, __ATOMIC_RELAXED);
+}
+
+unsigned keystats_sample_rate(void) {
+    return __atomic_load_n(&g_sample_rate, __ATOMIC_RELAXED);
+}
+
+const char *keystats_type_name(ValueType type) {
+    return value_type_names[type];
+}
+
+void keystats_access(int db, const char *key) {
+    unsigned rate = __atomic_load_n(&g_sample_rate, __ATOMIC_RELAXED);
+    if (rate == 0) return;
+
+    if (tls_countdown > 1) {
+        tls_countdown--;
+        return;
+    }
+    tls_countdown = next_countdown(rate);
+
+    size_t estimate = sketch_add(db, key);
+    size_t samples = __atomic_add_fetch(&g_samples, 1, __ATOMIC_RELAXED);
+
+    // Most samples are of cold keys that cannot enter a full heap
+    if (estimate <= __atomic_load_n(&g_hot.floor, __ATOMIC_RELAXED) &&
+        samples % KEYSTATS_DECAY_SAMPLES != 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_lock);
+    if (samples % KEYSTATS_DECAY_SAMPLES == 0) {
+        sketch_decay();
+        estimate /= 2;
+    }
+    heap_offer(&g_hot, db, key, estimate);
+    pthread_mutex_unlock(&g_lock);
+}
+
+void keystats_write(ValueType type, int db, const char *key, size_t bytes) {
+    KeyHeap *h = &g_big[type];
+    if (bytes <= __atomic_load_n(&h->floor, __ATOMIC_RELAXED)) return;
+
+    pthread_mutex_lock(&g_lock);
+    heap_offer(h, db, key, bytes);
+    pthread_mutex_unlock(&g_lock);
+}
+
+size_t keystats_hot(KeyCount *out, size_t max) {
+    unsigned rate = keystats_sample_rate();
+
+    pthread_mutex_lock(&g_lock);
+    size_t n = heap_top(&g_hot, out, max);
+    pthread_mutex_unlock(&g_lock);
+
+    // Samples stand for rate accesses each
+    for (size_t i = 0; i < n; i++) out[i].count *= rate;
+    return n;
+}
+
+size_t keystats_big(ValueType type, KeyCount *out, size_t max) {
+    pthread_mutex_lock(&g_lock);
+    size_t n = heap_top(&g_big[type], out, max);
+    pthread_mutex_unlock(&g_lock);
+    return n;
+}
+
+void keystats_big_refresh(ValueType type,
+                          int (*size_of)(void *ctx, int db, const char *key, size_t *bytes),
+                          void *ctx) {
+    KeyHeap *h = &g_big[type];
+
+    pthread_mutex_lock(&g_lock);
+    for (size_t i = 0; i < h->size;) {
+        size_t bytes;
+        if (size_of(ctx, h->slots[i].db, h->slots[i].key, &bytes) != 0) {
+            heap_remove(h, i);
+            continue;
+        }
+        if (bytes != h->slots[i].count) {
+            h->slots[i].count = bytes;
+            heap_fix(h, i);
+            // The slot now holds a key not yet checked: look at it again
+            continue;
+        }
+        i++;
+    }
+    heap_publish_floor(h);
+    pthread_mutex_unlock(&g_lock);
+}
+
+void keystats_reset(void) {
+    pthread_mutex_lock(&g_lock);
+    for (size_t row = 0; row < CMS_DEPTH; row++) {
+        for (size_t i = 0; i < CMS_WIDTH; i++) {
+            __atomic_store_n(&g_sketch[row][i], 0, __ATOMIC_RELAXED);
+        }
+    }
+    g_hot.size = 0;
+    heap_publish_floor(&g_hot);
+    pthread_mutex_unlock(&g_lock);
+}
@@ -0,0 +1,141 @@
+// ============================================================================
+// lazyfree.c - Background Reclamation of Unlinked Memory
+// ============================================================================
+//
+// UNLINK and FLUSHALL ASYNC detach memory from the table in O(1) and hand it
+// here instead of freeing it on the event loop. Producers push jobs onto a
+// lock-free stack (one CAS); the background thread takes the whole stack
+// with one exchange and frees it oldest first.
+//
+// The thread only sleeps when the stack is empty, so a producer takes the
+// mutex only when it pushes onto an empty stack, to wake it.
+// ============================================================================
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "mini_redis.h"
+
+typedef struct LazyJob {
+    struct LazyJob *next;
+    void *ptr;
+    void (*free_fn)(void *);
+    size_t bytes;
+} LazyJob;
+
+static LazyJob *g_jobs = NULL;            // Newest first
+
+static pthread_t g_thread;
+static int g_started = 0;
+static int g_stopping = 0;
+static pthread_mutex_t g_wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_wake = PTHREAD_COND_INITIALIZER;
+
+static size_t g_pending_bytes = 0;
+static size_t g_pending_objects = 0;
+static size_t g_freed_objects = 0;
+
+static void lazyfree_run_jobs(LazyJob *jobs) {
+    // Reverse the stack so memory is freed in the order it was released
+    LazyJob *fifo = NULL;
+    while (jobs) {
+        LazyJob *next = jobs->next;
+        jobs->next = fifo;
+        fifo = jobs;
+        jobs = next;
+    }
+
+    while (fifo) {
+        LazyJob *next = fifo->next;
+        fifo->free_fn(fifo->ptr);
+        __atomic_sub_fetch(&g_pending_bytes, fifo->bytes, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&g_pending_objects, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&g_freed_objects, 1, __ATOMIC_RELAXED);
+        free(fifo);
+        fifo = next;
+    }
+}
+
+static void *lazyfree_main(void *arg) {
+    (void)arg;
+
+    for (;;) {
+        LazyJob *jobs = __atomic_exchange_n(&g_jobs, NULL, __ATOMIC_ACQUIRE);
+        if (jobs) {
+            lazyfree_run_jobs(jobs);
+            continue;
+        }
+
+        pthread_mutex_lock(&g_wake_lock);
+        while (!__atomic_load_n(&g_jobs, __ATOMIC_ACQUIRE) && !g_stopping) {
+            pthread_cond_wait(&g_wake, &g_wake_lock);
+        }
+        int stop = g_stopping && !__atomic_load_n(&g_jobs, __ATOMIC_ACQUIRE);
+        pthread_mutex_unlock(&g_wake_lock);
+        if (stop) break;
+    }
+    return NULL;
+}
+
+int lazyfree_start(void) {
+    if (g_started) return 0;
+    if (pthread_create(&g_thread, NULL, lazyfree_main, NULL) != 0) return -1;
+    g_started = 1;
+    return 0;
+}
+
+void lazyfree_stop(void) {
+    if (!g_started) return;
+
+    pthread_mutex_lock(&g_wake_lock);
+    g_stopping = 1;
+    pthread_cond_signal(&g_wake);
+    pthread_mutex_unlock(&g_wake_lock);
+
+    pthread_join(g_thread, NULL);
+    g_started = 0;
+    g_stopping = 0;
+}
+
+void lazyfree_push(void *ptr, void (*free_fn)(void *), size_t bytes) {
+    LazyJob *job = g_started ? (LazyJob *)malloc(sizeof(LazyJob)) : NULL;
+
+    // Without the thread (or memory for a job) the caller pays for the free
+    if (!job) {
+        free_fn(ptr);
+        __atomic_add_fetch(&g_freed_objects, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    job->ptr = ptr;
+    job->free_fn = free_fn;
+    job->bytes = bytes;
+    __atomic_add_fetch(&g_pending_bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&g_pending_objects, 1, __ATOMIC_RELAXED);
+
+    LazyJob *head = __atomic_load_n(&g_jobs, __ATOMIC_RELAXED);
+    do {
+        job->next = head;
+    } while (!__atomic_compare_exchange_n(&g_jobs, &head, job, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    // A non-empty stack means the thread is awake or about to take it
+    if (!head) {
+        pthread_mutex_lock(&g_wake_lock);
+        pthread_cond_signal(&g_wake);
+        pthread_mutex_unlock(&g_wake_lock);
+    }
+}
+
+size_t lazyfree_pending_bytes(void) {
+    return __atomic_load_n(&g_pending_bytes, __ATOMIC_RELAXED);
+}
+
+size_t lazyfree_pending_objects(void) {
+    return __atomic_load_n(&g_pending_objects, __ATOMIC_RELAXED);
+}
+
+size_t lazyfree_freed_objects(void) {
+    return __atomic_load_n(&g_freed_objects, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,680 @@
+// ============================================================================
+// loader.c - Bulk Import from CSV, NDJSON and RESP Files
+// ============================================================================
+//
+// --load and LOAD put a whole file into the table without going through the
+// text protocol:
+//   1. The file is mapped and cut into chunks at record boundaries.
+//   2. Loader threads take chunks in turn, parse them and build entries off
+//      the table (ht_bulk_add), sorted into the table's bulk partitions.
+//   3. The table is grown once for the final key count (ht_reserve).
+//   4. Loader threads take partitions in turn and link them (ht_bulk_link).
+//      Partitions own disjoint buckets, so linking needs no locks.
+// Chunks are linked in file order, so the last record for a key wins, as
+// it would with one SET per record.
+//
+// Records the engine could not serve back over the text protocol are
+// skipped and counted: empty keys, keys with whitespace or control
+// characters, values with line breaks or NULs, and anything too long.
+// ============================================================================
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mini_redis.h"
+
+#define LOAD_MAX_THREADS 16
+#define LOAD_MIN_CHUNK (1 << 20)       // Smaller files use fewer threads
+#define LOAD_CHUNKS_PER_THREAD 4       // Evens out chunks that parse slower
+
+static const char *format_names[] = { "auto", "csv", "ndjson", "resp" };
+
+typedef struct LoadJob {
+    const char *data;
+    size_t size;
+    LoadFormat format;
+    size_t *bounds;           // Chunk i is [bounds[i], bounds[i + 1])
+    size_t num_chunks;
+    HtBulk *bulks;            // One per chunk
+    size_t *skipped;          // One per chunk
+    int failed;               // Out of memory while building entries
+    size_t next;              // Next chunk or partition to take
+    HashTable *ht;
+    int unique;
+    size_t added;
+} LoadJob;
+
+int load_parse_format(const char *name, LoadFormat *format) {
+    for (int i = LOAD_CSV; i <= LOAD_RESP; i++) {
+        if (strcasecmp(name, format_names[i]) == 0) {
+            *format = (LoadFormat)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *load_format_name(LoadFormat format) {
+    return format_names[format];
+}
+
+static LoadFormat format_from_path(const char *path) {
+    const char *dot = strrchr(path, '.');
+    if (!dot || strchr(dot, '/')) return LOAD_AUTO;
+
+    if (strcasecmp(dot, ".csv") == 0) return LOAD_CSV;
+    if (strcasecmp(dot, ".ndjson") == 0 || strcasecmp(dot, ".jsonl") == 0 ||
+        strcasecmp(dot, ".json") == 0) {
+        return LOAD_NDJSON;
+    }
+    if (strcasecmp(dot, ".resp") == 0) return LOAD_RESP;
+    return LOAD_AUTO;
+}
+
+static double elapsed_seconds(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// ============================================================================
+// Records
+// ============================================================================
+
+// Output buffer for one decoded field; overflowing marks it too long
+typedef struct Field {
+    char *buf;
+    size_t cap;               // Longest field accepted
+    size_t len;
+    int overflow;
+} Field;
+
+static void field_reset(Field *f) {
+    f->len = 0;
+    f->overflow = 0;
+}
+
+static void field_put(Field *f, char c) {
+    if (f->len < f->cap) {
+        f->buf[f->len++] = c;
+    } else {
+        f->overflow = 1;
+    }
+}
+
+static int key_valid(const Field *key) {
+    if (key->overflow || key->len == 0) return 0;
+    for (size_t i = 0; i < key->len; i++) {
+        unsigned char c = (unsigned char)key->buf[i];
+        if (c <= ' ' || c == 0x7f) return 0;
+    }
+    return 1;
+}
+
+static int value_valid(const Field *value) {
+    if (value->overflow || value->len == 0) return 0;
+    return !memchr(value->buf, '\n', value->len) && !memchr(value->buf, '\r', value->len) &&
+           !memchr(value->buf, '\0', value->len);
+}
+
+static void load_record(LoadJob *job, size_t chunk, Field *key, Field *value) {
+    if (!key_valid(key) || !value_valid(value)) {
+        job->skipped[chunk]++;
+        return;
+    }
+
+    key->buf[key->len] = '\0';
+    value->buf[value->len] = '\0';
+    if (ht_bulk_add(&job->bulks[chunk], key->buf, value->buf) != 0) {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    keystats_write(VALUE_STRING, job->ht->db, key->buf, value->len);
+}
+
+// ============================================================================
+// CSV: key,value per line, fields optionally quoted with "" for a quote
+// ============================================================================
+
+// Decode one field starting at p; returns the position after it, or NULL
+// if a quoted field is not closed
+static const char *csv_field(const char *p, const char *end, int last, Field *f) {
+    field_reset(f);
+
+    if (p < end && *p == '"') {
+        for (p++; p < end; p++) {
+            if (*p == '"') {
+                if (p + 1 < end && p[1] == '"') {
+                    field_put(f, '"');
+                    p++;
+                } else {
+                    return p + 1;
+                }
+            } else {
+                field_put(f, *p);
+            }
+        }
+        return NULL;
+    }
+
+    // The value runs to the end of the line, commas included
+    const char *stop = last || p >= end ? NULL : memchr(p, ',', (size_t)(end - p));
+    if (!stop) stop = end;
+    for (; p < stop; p++) field_put(f, *p);
+    return p;
+}
+
+static int csv_record(const char *line, const char *end, Field *key, Field *value) {
+    const char *p = csv_field(line, end, 0, key);
+    if (!p || p >= end || *p != ',') return -1;
+
+    p = csv_field(p + 1, end, 1, value);
+    return p == end ? 0 : -1;
+}
+
+static int csv_is_header(const char *line, const char *end) {
+    return (size_t)(end - line) == 9 && strncasecmp(line, "key,value", 9) == 0;
+}
+
+// ============================================================================
+// NDJSON: one object per line with string "key" and "value" members
+// ============================================================================
+
+static const char *json_ws(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+    return p;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static const char *json_hex4(const char *p, const char *end, unsigned *out) {
+    if (end - p < 4) return NULL;
+    *out = 0;
+    for (int i = 0; i < 4; i++) {
+        int d = hex_digit(p[i]);
+        if (d < 0) return NULL;
+        *out = *out << 4 | (unsigned)d;
+    }
+    return p + 4;
+}
+
+static void utf8_put(Field *f, unsigned cp) {
+    if (cp < 0x80) {
+        field_put(f, (char)cp);
+    } else if (cp < 0x800) {
+        field_put(f, (char)(0xc0 | cp >> 6));
+        field_put(f, (char)(0x80 | (cp & 0x3f)));
+    } else if (cp < 0x10000) {
+        field_put(f, (char)(0xe0 | cp >> 12));
+        field_put(f, (char)(0x80 | (cp >> 6 & 0x3f)));
+        field_put(f, (char)(0x80 | (cp & 0x3f)));
+    } else {
+        field_put(f, (char)(0xf0 | cp >> 18));
+        field_put(f, (char)(0x80 | (cp >> 12 & 0x3f)));
+        field_put(f, (char)(0x80 | (cp >> 6 & 0x3f)));
+        field_put(f, (char)(0x80 | (cp & 0x3f)));
+    }
+}
+
+// Decode the string at p (opening quote included) into f, or only skip it
+// if f is NULL; returns the position after the closing quote, NULL if
+// malformed
+static const char *json_string(const char *p, const char *end, Field *f) {
+    if (p >= end || *p != '"') return NULL;
+    if (f) field_reset(f);
+
+    for (p++; p < end; p++) {
+        char c = *p;
+        if (c == '"') return p + 1;
+        if ((unsigned char)c < 0x20) return NULL;
+        if (c != '\\') {
+            if (f) field_put(f, c);
+            continue;
+        }
+
+        if (++p >= end) return NULL;
+        switch (*p) {
+        case '"': case '\\': case '/': c = *p; break;
+        case 'b': c = '\b'; break;
+        case 'f': c = '\f'; break;
+        case 'n': c = '\n'; break;
+        case 'r': c = '\r'; break;
+        case 't': c = '\t'; break;
+        case 'u': {
+            unsigned cp, low;
+            if (!(p = json_hex4(p + 1, end, &cp))) return NULL;
+            // A surrogate pair spells one code point above the BMP
+            if (cp >= 0xd800 && cp < 0xdc00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u' &&
+                json_hex4(p + 2, end, &low) && low >= 0xdc00 && low < 0xe000) {
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                p += 6;
+            }
+            if (f) utf8_put(f, cp);
+            p--;
+            continue;
+        }
+        default:
+            return NULL;
+        }
+        if (f) field_put(f, c);
+    }
+    return NULL;
+}
+
+// Skip any value: nested containers are matched bracket for bracket
+static const char *json_skip(const char *p, const char *end) {
+    int depth = 0;
+
+    do {
+        p = json_ws(p, end);
+        if (p >= end) return NULL;
+
+        if (*p == '"') {
+            if (!(p = json_string(p, end, NULL))) return NULL;
+        } else if (*p == '{' || *p == '[') {
+            depth++;
+            p++;
+        } else if (*p == '}' || *p == ']') {
+            if (depth == 0) return NULL;
+            depth--;
+            p++;
+        } else {
+            // Numbers, literals and separators inside containers
+            if (depth == 0 && (*p == ',' || *p == ':')) return NULL;
+            p++;
+            while (depth == 0 && p < end && *p != ',' && *p != '}' && *p != ']' &&
+                   *p != ' ' && *p != '\t' && *p != '\r') {
+                p++;
+            }
+        }
+    } while (depth > 0);
+
+    return p;
+}
+
+// Scalars that are not strings (numbers, true, false) load as their text
+static const char *json_scalar(const char *p, const char *end, Field *f) {
+    if (p < end && *p == '"') return json_string(p, end, f);
+    if (p >= end || *p == '{' || *p == '[' || (end - p >= 4 && strncmp(p, "null", 4) == 0)) {
+        return NULL;
+    }
+
+    field_reset(f);
+    while (p < end && *p != ',' && *p != '}' && *p != ' ' && *p != '\t' && *p != '\r') {
+        field_put(f, *p++);
+    }
+    return f->len > 0 ? p : NULL;
+}
+
+static int ndjson_record(const char *line, const char *end, Field *key, Field *value) {
+    const char *p = json_ws(line, end);
+    int have_key = 0, have_value = 0;
+    char name[8];
+    Field name_field = { name, sizeof(name) - 1, 0, 0 };
+
+    if (p >= end || *p++ != '{') return -1;
+
+    p = json_ws(p, end);
+    if (p < end && *p == '}') return -1;
+
+    for (;;) {
+        p = json_ws(p, end);
+        if (!(p = json_string(p, end, &name_field))) return -1;
+        p = json_ws(p, end);
+        if (p >= end || *p++ != ':') return -1;
+        p = json_ws(p, end);
+
+        if (!name_field.overflow && name_field.len == 3 && memcmp(name, "key", 3) == 0) {
+            p = json_scalar(p, end, key);
+            have_key = 1;
+        } else if (!name_field.overflow && name_field.len == 5 &&
+                   memcmp(name, "value", 5) == 0) {
+            p = json_scalar(p, end, value);
+            have_value = 1;
+        } else {
+            p = json_skip(p, end);
+        }
+        if (!p) return -1;
+
+        p = json_ws(p, end);
+        if (p >= end) return -1;
+        if (*p == '}') break;
+        if (*p++ != ',') return -1;
+    }
+
+    return have_key && have_value && json_ws(p + 1, end) == end ? 0 : -1;
+}
+
+// ============================================================================
+// RESP: SET key value commands as arrays of bulk strings (redis-cli --pipe)
+// ============================================================================
+
+// Parse "<prefix><digits>\r\n" at p; returns the position after it or NULL
+static const char *resp_length(const char *p, const char *end, char prefix, size_t *out) {
+    if (p >= end || *p++ != prefix) return NULL;
+
+    size_t n = 0;
+    const char *digits = p;
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (n > (SIZE_MAX - 9) / 10) return NULL;
+        n = n * 10 + (size_t)(*p++ - '0');
+    }
+    if (p == digits || end - p < 2 || p[0] != '\r' || p[1] != '\n') return NULL;
+
+    *out = n;
+    return p + 2;
+}
+
+// Parse the array at p, pointing args at up to max_args of its strings.
+// Returns its length in bytes, 0 if it is malformed or cut short.
+static size_t resp_record(const char *p, const char *end, const char **args,
+                          size_t *lens, size_t max_args, size_t *num_args) {
+    const char *start = p;
+    size_t count;
+
+    if (!(p = resp_length(p, end, '*', &count))) return 0;
+
+    for (size_t i = 0; i < count; i++) {
+        size_t len;
+        if (!(p = resp_length(p, end, '$', &len))) return 0;
+        if ((size_t)(end - p) < len + 2 || p[len] != '\r' || p[len + 1] != '\n') return 0;
+        if (i < max_args) {
+            args[i] = p;
+            lens[i] = len;
+        }
+        p += len + 2;
+    }
+
+    *num_args = count;
+    return (size_t)(p - start);
+}
+
+// Blank lines between or after commands, as some exporters write them
+static size_t resp_gap(const char *p, const char *end) {
+    const char *start = p;
+    while (p < end && (*p == '\r' || *p == '\n')) p++;
+    return (size_t)(p - start);
+}
+
+static void copy_field(Field *f, const char *src, size_t len) {
+    field_reset(f);
+    if (len > f->cap) {
+        f->overflow = 1;
+        return;
+    }
+    memcpy(f->buf, src, len);
+    f->len = len;
+}
+
+// ============================================================================
+// Chunking and Parsing
+// ============================================================================
+
+// Chunks start right after a newline; RESP chunks at a command, found by
+// hopping from one to the next. Returns -1 (with error set) on bad RESP.
+static int load_split(LoadJob *job, char *error, size_t error_len) {
+    size_t n = job->num_chunks;
+
+    job->bounds[0] = 0;
+    job->bounds[n] = job->size;
+
+    if (job->format != LOAD_RESP) {
+        for (size_t i = 1; i < n; i++) {
+            size_t at = job->size / n * i;
+            if (at < job->bounds[i - 1]) at = job->bounds[i - 1];
+            if (at > 0 && job->data[at - 1] != '\n') {
+                const char *nl = memchr(job->data + at, '\n', job->size - at);
+                at = nl ? (size_t)(nl - job->data) + 1 : job->size;
+            }
+            job->bounds[i] = at;
+        }
+        return 0;
+    }
+
+    const char *args[1];
+    size_t lens[1], num_args, at = 0, i = 1;
+    while (at < job->size) {
+        at += resp_gap(job->data + at, job->data + job->size);
+        if (at >= job->size) break;
+
+        size_t len = resp_record(job->data + at, job->data + job->size, args, lens, 0,
+                                 &num_args);
+        if (len == 0) {
+            snprintf(error, error_len, "Malformed RESP at byte %zu", at);
+            return -1;
+        }
+        at += len;
+        while (i < n && at >= job->size / n * i) job->bounds[i++] = at;
+    }
+    while (i < n) job->bounds[i++] = job->size;
+    return 0;
+}
+
+static void parse_lines(LoadJob *job, size_t chunk, Field *key, Field *value) {
+    const char *p = job->data + job->bounds[chunk];
+    const char *stop = job->data + job->bounds[chunk + 1];
+
+    while (p < stop && !__atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+        const char *nl = memchr(p, '\n', (size_t)(stop - p));
+        const char *end = nl ? nl : stop;
+        const char *next = nl ? nl + 1 : stop;
+
+        if (end > p && end[-1] == '\r') end--;
+        if (end == p || (chunk == 0 && p == job->data && job->format == LOAD_CSV &&
+                         csv_is_header(p, end))) {
+            p = next;
+            continue;
+        }
+
+        int rc = job->format == LOAD_CSV ? csv_record(p, end, key, value)
+                                         : ndjson_record(p, end, key, value);
+        if (rc == 0) {
+            load_record(job, chunk, key, value);
+        } else {
+            job->skipped[chunk]++;
+        }
+        p = next;
+    }
+}
+
+static void parse_resp(LoadJob *job, size_t chunk, Field *key, Field *value) {
+    const char *p = job->data + job->bounds[chunk];
+    const char *stop = job->data + job->bounds[chunk + 1];
+    const char *args[3];
+    size_t lens[3], num_args;
+
+    while (p < stop && !__atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+        p += resp_gap(p, stop);
+        if (p >= stop) break;
+
+        // load_split() already walked every command, so none is malformed
+        size_t len = resp_record(p, stop, args, lens, 3, &num_args);
+        if (len == 0) break;
+        p += len;
+        if (num_args != 3 || lens[0] != 3 || strncasecmp(args[0], "SET", 3) != 0) {
+            job->skipped[chunk]++;
+            continue;
+        }
+
+        copy_field(key, args[1], lens[1]);
+        copy_field(value, args[2], lens[2]);
+        load_record(job, chunk, key, value);
+    }
+}
+
+static void *load_parse_main(void *arg) {
+    LoadJob *job = (LoadJob *)arg;
+    char key_buf[MAX_KEY_SIZE + 1];
+    char value_buf[MAX_VALUE_SIZE + 1];
+    Field key = { key_buf, MAX_KEY_SIZE, 0, 0 };
+    Field value = { value_buf, MAX_VALUE_SIZE, 0, 0 };
+    size_t chunk;
+
+    while ((chunk = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->num_chunks) {
+        if (job->format == LOAD_RESP) {
+            parse_resp(job, chunk, &key, &value);
+        } else {
+            parse_lines(job, chunk, &key, &value);
+        }
+    }
+    return NULL;
+}
+
+static void *load_link_main(void *arg) {
+    LoadJob *job = (LoadJob *)arg;
+    size_t part;
+
+    while ((part = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < HT_BULK_PARTS) {
+        size_t added = ht_bulk_link(job->ht, job->bulks, job->num_chunks, part, job->unique);
+        __atomic_add_fetch(&job->added, added, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+// Run fn on threads threads, the caller being one of them. If a thread
+// cannot be created the others take its share.
+static void load_run(LoadJob *job, int threads, void *(*fn)(void *)) {
+    pthread_t tids[LOAD_MAX_THREADS];
+    int started = 0;
+
+    job->next = 0;
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&tids[started], NULL, fn, job) == 0) started++;
+    }
+    fn(job);
+    for (int i = 0; i < started; i++) {
+        pthread_join(tids[i], NULL);
+    }
+}
+
+static int load_threads(size_t size) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = size / LOAD_MIN_CHUNK;
+
+    if (cpus < 1) cpus = 1;
+    if (threads > (size_t)cpus) threads = (size_t)cpus;
+    if (threads > LOAD_MAX_THREADS) threads = LOAD_MAX_THREADS;
+    return threads < 1 ? 1 : (int)threads;
+}
+
+// ============================================================================
+// Load a File
+// ============================================================================
+static int load_mapped(HashTable *ht, const char *data, size_t size, LoadFormat format,
+                       int unique, LoadResult *result) {
+    LoadJob job;
+    memset(&job, 0, sizeof(job));
+    job.data = data;
+    job.size = size;
+    job.format = format;
+    job.ht = ht;
+    job.unique = unique;
+
+    result->threads = load_threads(size);
+    job.num_chunks = result->threads == 1 ? 1 : (size_t)result->threads * LOAD_CHUNKS_PER_THREAD;
+    job.bounds = (size_t *)malloc((job.num_chunks + 1) * sizeof(size_t));
+    job.bulks = (HtBulk *)calloc(job.num_chunks, sizeof(HtBulk));
+    job.skipped = (size_t *)calloc(job.num_chunks, sizeof(size_t));
+    if (!job.bounds || !job.bulks || !job.skipped) {
+        snprintf(result->error, sizeof(result->error), "Out of memory");
+        free(job.bounds);
+        free(job.bulks);
+        free(job.skipped);
+        return -1;
+    }
+
+    int rc = load_split(&job, result->error, sizeof(result->error));
+    if (rc == 0) {
+        load_run(&job, result->threads, load_parse_main);
+
+        size_t records = 0, num_keys;
+        for (size_t i = 0; i < job.num_chunks; i++) {
+            records += job.bulks[i].count;
+            result->skipped += job.skipped[i];
+        }
+
+        ht_stats(ht, &num_keys, NULL);
+        if (job.failed) {
+            snprintf(result->error, sizeof(result->error), "Out of memory");
+            rc = -1;
+        } else if (records > SIZE_MAX - num_keys || ht_reserve(ht, num_keys + records, 0) != 0) {
+            snprintf(result->error, sizeof(result->error), "Failed to reserve capacity");
+            rc = -1;
+        } else {
+            load_run(&job, result->threads, load_link_main);
+            result->loaded = records;
+            result->added = job.added;
+        }
+    }
+
+    for (size_t i = 0; i < job.num_chunks; i++) {
+        ht_bulk_discard(&job.bulks[i]);
+    }
+    free(job.bounds);
+    free(job.bulks);
+    free(job.skipped);
+    return rc;
+}
+
+int load_file(HashTable *ht, const char *path, LoadFormat format, int unique,
+              LoadResult *result) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    memset(result, 0, sizeof(*result));
+
+    if (format == LOAD_AUTO) format = format_from_path(path);
+    if (format == LOAD_AUTO) {
+        snprintf(result->error, sizeof(result->error),
+                 "Unknown file format (use .csv, .ndjson or .resp, or name it)");
+        return -1;
+    }
+    result->format = format;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        snprintf(result->error, sizeof(result->error), "Cannot open file: %s", strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        snprintf(result->error, sizeof(result->error), "Not a regular file");
+        close(fd);
+        return -1;
+    }
+
+    size_t size = (size_t)st.st_size;
+    int rc = 0;
+    if (size > 0) {
+        void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            snprintf(result->error, sizeof(result->error), "Cannot map file: %s",
+                     strerror(errno));
+            close(fd);
+            return -1;
+        }
+        // Every page is read once, by whichever thread parses it
+        madvise(data, size, MADV_WILLNEED);
+        rc = load_mapped(ht, (const char *)data, size, format, unique, result);
+        munmap(data, size);
+    }
+    close(fd);
+
+    result->bytes = size;
+    result->seconds = elapsed_seconds(&start);
+    return rc;
+}
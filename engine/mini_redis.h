@@ -3,36 +3,98 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <pthread.h>
 
 // ============================================================================
 // Configuration
 // ============================================================================
 #define DEFAULT_PORT 6379
+#define DEFAULT_BACKLOG 511
+#define MAX_THREADS 64
 #define INITIAL_BUCKETS 64
 #define LOAD_FACTOR_THRESHOLD 0.75
+#define SHRINK_LOAD_FACTOR 0.1       // Shrink below this load factor...
+#define SHRINK_TARGET_LOAD 0.5       // ...to the smallest table at or under this
 #define MAX_KEY_SIZE 256
 #define MAX_VALUE_SIZE 4096
 #define BUFFER_SIZE 8192
+#define MAX_QUERY_SIZE (64 * 1024)   // Longest command line we will buffer
+#define REPLY_BLOCK_SIZE (16 * 1024) // Default size of an output buffer block
+#define MAX_LISTENERS 8
+#define DEFAULT_TCP_KEEPALIVE 300    // Seconds; 0 disables
+#define TW_TICK_MS 10                // Timer wheel resolution
+#define STATS_SAMPLE_INTERVAL_MS 100
+#define EPOCH_RECLAIM_INTERVAL_MS 100
+#define DEFAULT_LOCK_STRIPES 64      // Must divide INITIAL_BUCKETS
+#define EXEC_BATCH 64                // Lines handed to the executor at once
+#define LAZYFREE_MIN_BYTES 1024      // UNLINK frees smaller entries inline
+#define DEFRAG_INTERVAL_MS 10        // Active defrag runs a slice this often
+#define DEFRAG_SLICE_US 1000         // Longest a slice holds the table
+#define DEFRAG_MIN_WASTE (1 << 20)   // Fragmented bytes ignored
+#define DEFAULT_DEFRAG_THRESHOLD 1.2 // Allocator fragmentation that starts defrag
+#define DEFAULT_HOTKEYS_SAMPLE 100   // Key accesses per HOTKEYS sample
+#define KEYSTATS_TRACKED 32          // Keys kept by HOTKEYS and, per type, BIGKEYS
+#define DEFAULT_DATABASES 16         // Logical databases reachable with SELECT
+#define MAX_DATABASES 1024
+#define DEFAULT_VECTOR_THREADS 2    // Workers splitting exact vector scans
 
 // ============================================================================
 // Hash Table Entry
 // ============================================================================
+// What a key holds. Strings live in the entry; every other type is an
+// object owned by its module (stream.c, timeseries.c, vector.c, geo.c,
+// filters.c), which hash_table.c frees and measures through that module.
+typedef enum ValueType {
+    VALUE_STRING = 0,
+    VALUE_STREAM,
+    VALUE_TIMESERIES,
+    VALUE_VECTORSET,
+    VALUE_GEO,
+    VALUE_BLOOM,
+    VALUE_CUCKOO,
+    VALUE_TYPES
+} ValueType;
+
+#define WRONGTYPE_ERROR "ERROR: WRONGTYPE Operation against a key holding the wrong kind of value"
+
 typedef struct HashEntry {
     char *key;
-    char *value;
-    size_t key_len;
-    size_t value_len;
+    char *value;             // The string, or the object of another type
+    uint32_t key_len;
+    ValueType type;
+    size_t value_len;        // Strings only
     struct HashEntry *next;  // Chaining for collision resolution
 } HashEntry;
 
+// Bucket array as seen by lock-free readers; replaced as a whole on resize
+typedef struct BucketView {
+    HashEntry **buckets;
+    size_t num_buckets;
+} BucketView;
+
 // ============================================================================
 // Hash Table
 // ============================================================================
 typedef struct HashTable {
     HashEntry **buckets;
     size_t num_buckets;
+    size_t min_buckets;  // Shrinking stops here (initial size or ht_reserve())
+    size_t rehashes;     // Resizes so far, for STATS
     size_t num_entries;
     size_t memory_used;  // Track memory usage
+
+    // Lock-free reads (ht_enable_concurrent_reads): entries are immutable
+    // once published and unlinked memory is retired through epoch.c
+    int concurrent_reads;
+    BucketView *view;
+
+    // Bucket-striped locks (ht_enable_striped_locks): stripe = hash % stripes,
+    // which stays fixed across resizes since num_buckets is a multiple of it
+    pthread_rwlock_t *stripes;
+    size_t num_stripes;
+
+    int numa_interleave;      // Spread large bucket arrays over all nodes
+    int db;                   // Logical database index (SELECT), for keystats
 } HashTable;
 
 // ============================================================================
@@ -49,23 +111,770 @@ void ht_destroy(HashTable *ht);
 // Returns 0 on success, -1 on failure
 int ht_set(HashTable *ht, const char *key, const char *value);
 
+// Insert a key the caller guarantees is not in the table yet, skipping
+// the duplicate scan (bulk loads of unique keys). A duplicate would shadow
+// the older entry instead of replacing it.
+// Returns 0 on success, -1 on failure
+int ht_insert_new(HashTable *ht, const char *key, const char *value);
+
+// Entries built off-table for a bulk load, split by hash into partitions
+// that own disjoint sets of buckets, each kept in arrival order
+#define HT_BULK_PARTS 64
+
+typedef struct HtBulk {
+    HashEntry *head[HT_BULK_PARTS];
+    HashEntry *tail[HT_BULK_PARTS];
+    size_t count;
+} HtBulk;
+
+// Build an entry for key and value and append it to its partition. Needs no
+// table lock: loader threads each fill their own bulk in parallel.
+// Returns 0 on success, -1 on failure
+int ht_bulk_add(HtBulk *bulk, const char *key, const char *value);
+
+// Free every entry a bulk still holds
+void ht_bulk_discard(HtBulk *bulk);
+
+// Move partition part of each bulk, bulks in order, into the table; a key
+// seen again replaces the earlier entry unless unique promises it cannot
+// happen. The table must be sized beforehand (ht_reserve()): no resize
+// happens here. Different parts may be linked by different threads at once
+// while the caller holds the table as a writer would.
+// Returns the number of keys added
+size_t ht_bulk_link(HashTable *ht, HtBulk *bulks, size_t num_bulks, size_t part,
+                    int unique);
+
 // Get value for a key
-// Returns pointer to value or NULL if not found
+// Returns pointer to value or NULL if not found or not a string
 const char *ht_get(HashTable *ht, const char *key);
 
+// Get the value of a key of any type, setting *type: the string, or the
+// type's object
+// Returns NULL if not found
+void *ht_lookup(HashTable *ht, const char *key, ValueType *type);
+
+// Insert or replace key with obj, a value of a type other than
+// VALUE_STRING. The table owns obj from then on and frees it with its
+// type's free function.
+// Returns 0 on success, -1 on failure (obj is left to the caller)
+int ht_set_object(HashTable *ht, const char *key, ValueType type, void *obj);
+
+// Account for an object that grew by bytes (negative if it shrank) in
+// place. Objects change in place only under the locking ht_set() needs;
+// lock-free readers never look inside them.
+void ht_account_value(HashTable *ht, long long bytes);
+
 // Delete a key
 // Returns 0 if deleted, -1 if not found
 int ht_delete(HashTable *ht, const char *key);
 
-// Get statistics
+// Delete a key, leaving the free to the lazy-free thread if the entry is
+// large enough to be worth it
+// Returns 0 if deleted, -1 if not found
+int ht_unlink(HashTable *ht, const char *key);
+
+// Remove every key, leaving the table at its minimum size. With async, the
+// old bucket array is detached in O(1) and freed, entries and all, on the
+// lazy-free thread.
+// Returns 0 on success, -1 on failure
+int ht_flush(HashTable *ht, int async);
+
+// Get statistics. Memory is counted as the allocator hands it out: malloc
+// size classes and headers, slab object sizes and mapped pages.
 void ht_stats(HashTable *ht, size_t *num_keys, size_t *memory_bytes);
 
+// Split memory_bytes into entries (keys, values and their nodes) and the
+// table itself (bucket array, locks, bookkeeping). Caller holds the table
+// as a writer would.
+void ht_memory_stats(HashTable *ht, size_t *dataset, size_t *overhead);
+
+// Bytes held by one key's entry, node, key and value together
+// Returns 0 on success, -1 if not found
+int ht_key_memory(HashTable *ht, const char *key, size_t *bytes);
+
+// Allow ht_get() to run concurrently with one writer. Writers must still be
+// serialized by the caller; readers must call ht_get() between epoch_enter()
+// and epoch_exit() and copy the value before leaving.
+// Returns 0 on success, -1 on failure
+int ht_enable_concurrent_reads(HashTable *ht);
+
+// Protect the table with an array of reader-writer locks. Callers lock the
+// stripe of the key they touch; ht_set() no longer resizes inline, the
+// caller runs ht_maybe_resize() or ht_maybe_shrink() with every stripe held
+// exclusively.
+// Returns 0 on success, -1 on failure
+int ht_enable_striped_locks(HashTable *ht, size_t stripes);
+
+// Stripe covering key
+size_t ht_stripe(const HashTable *ht, const char *key);
+
+void ht_stripe_lock(HashTable *ht, size_t stripe, int exclusive);
+void ht_stripe_unlock(HashTable *ht, size_t stripe);
+
+// Lock every stripe in index order (whole-table operations, resize)
+void ht_lock_all(HashTable *ht, int exclusive);
+void ht_unlock_all(HashTable *ht);
+
+// Returns 1 if the load factor is above LOAD_FACTOR_THRESHOLD
+int ht_needs_resize(const HashTable *ht);
+
+// Double the bucket array if the load factor calls for it. Inserts only ever
+// grow the table, so a reservation survives until keys are deleted.
+// Returns 0 on success or if no resize was needed, -1 on failure
+int ht_maybe_resize(HashTable *ht);
+
+// Returns 1 if the load factor is below SHRINK_LOAD_FACTOR with room to shrink
+int ht_needs_shrink(const HashTable *ht);
+
+// Shrink the bucket array to the smallest size at or under SHRINK_TARGET_LOAD,
+// if the load factor calls for it. Only deletes call this; the gap between
+// the thresholds keeps the table from flapping around one size.
+// Locking is as for ht_maybe_resize().
+// Returns 0 on success or if no resize was needed, -1 on failure
+int ht_maybe_shrink(HashTable *ht);
+
+// Grow the bucket array once so that entries keys fit under the load
+// factor, instead of doubling repeatedly as they arrive. Never shrinks; with
+// keep, the table will not shrink below the reserved size afterwards.
+// Locking is as for ht_maybe_resize().
+// Returns 0 on success, -1 on failure
+int ht_reserve(HashTable *ht, size_t entries, int keep);
+
+// Interleave bucket arrays across NUMA nodes: every worker reads them, so
+// no single node should own them
+void ht_enable_numa_interleave(HashTable *ht);
+
+// Allocate entry nodes from a huge-page backed slab shared by all tables.
+// Must be enabled before any table holds entries.
+// Returns 0 on success, -1 on failure
+int ht_enable_entry_slab(HashTable *ht);
+
+// Bytes mapped by the entry slab (0 when it is not in use)
+size_t ht_entry_slab_bytes(void);
+
+// Allocate entry nodes, keys and values from slabs (one per size class) so
+// ht_defrag() can compact them. Must be enabled before any table holds
+// entries. Returns 0 on success, -1 on failure
+int ht_enable_defrag(HashTable *ht);
+
+// Slab pages in use and bytes of live allocations across every table
+// Returns -1 if defrag is not enabled
+int ht_alloc_usage(size_t *resident, size_t *used);
+
+// Move the entries, keys and values of up to max_buckets buckets, starting
+// at *cursor, out of sparse slab runs. *cursor is advanced and wraps to 0
+// once the last bucket is done. Locking is as for ht_set() on every
+// bucket visited: lock-free readers may keep running, but a call that moved
+// anything waits for them to leave so that what it retired is freed.
+// Returns the number of allocations moved
+size_t ht_defrag(HashTable *ht, size_t *cursor, size_t max_buckets);
+
+// ============================================================================
+// Huge Pages and Slabs (slab.c)
+// ============================================================================
+typedef enum HugePageMode {
+    HUGEPAGES_OFF = 0,        // Regular pages
+    HUGEPAGES_THP,            // madvise(MADV_HUGEPAGE)
+    HUGEPAGES_EXPLICIT        // MAP_HUGETLB, falling back to THP
+} HugePageMode;
+
+// Backing for every page_map() from now on
+void page_set_mode(HugePageMode mode);
+HugePageMode page_mode(void);
+
+// Backing actually in use: "4k", "thp", "explicit-2mb" or
+// "explicit-fallback-thp"
+const char *page_backing_name(void);
+
+// Zero-filled anonymous mapping; returns NULL on failure
+void *page_map(size_t size);
+void page_unmap(void *addr, size_t size);
+
+// Bytes actually mapped by page_map(size)
+size_t page_map_size(size_t size);
+
+// Bytes malloc() really set aside for ptr, which was allocated with size
+// bytes; 0 for NULL
+size_t alloc_usable_size(void *ptr, size_t size);
+
+// Fixed-size object allocator carved from 2 MB mappings; thread-safe
+typedef struct Slab Slab;
+
+// Returns NULL on failure or if obj_size exceeds 16 KB
+Slab *slab_create(size_t obj_size);
+void slab_destroy(Slab *slab);
+void *slab_alloc(Slab *slab);
+void slab_free(Slab *slab, void *obj);
+size_t slab_bytes(const Slab *slab);
+
+// Size of every object, after rounding for alignment
+size_t slab_object_size(const Slab *slab);
+
+// Bytes of pages in use and bytes of live objects; resident / used is the
+// slab's fragmentation ratio
+void slab_usage(Slab *slab, size_t *resident, size_t *used);
+
+// Returns 1 if obj sits in a run no fuller than the one slab_alloc() would
+// use next, or in one emptier than average, so reallocating it helps pack
+// the slab
+int slab_should_move(Slab *slab, const void *obj);
+
+// ============================================================================
+// Hardware Counters (perf.c)
+// ============================================================================
+
+// Start counting dTLB read misses on the calling thread
+// Returns 0 on success, -1 if perf events are unavailable
+int perf_thread_start(void);
+
+// Sum of every thread's counter; returns -1 if none could be opened
+int perf_dtlb_misses(uint64_t *misses);
+
+void perf_shutdown(void);
+
+// ============================================================================
+// NUMA (numa.c)
+// ============================================================================
+
+// Parse a cpulist ("0-3,8-11") into at most max CPU numbers
+// Returns the count, or -1 if the list is malformed
+int numa_parse_cpulist(const char *list, int *cpus, int max);
+
+// Discover the topology; returns the number of nodes with CPUs (1 if the
+// machine or OS has no NUMA)
+int numa_init(void);
+int numa_num_nodes(void);
+
+// Node that owns cpu
+int numa_cpu_node(int cpu);
+
+// CPU for a worker: workers are spread round-robin over the nodes
+int numa_worker_cpu(int worker);
+
+// Pin the calling thread to cpu and prefer memory from its node
+// Returns 0 on success, -1 on failure
+int numa_bind_thread(int cpu);
+
+// Restrict the process (CPUs and memory) to one node; threads created
+// afterwards inherit it. Returns 0 on success, -1 on failure
+int numa_bind_process(int node);
+
+// Spread the not-yet-touched pages of a mapping over every node
+void numa_interleave(void *addr, size_t len);
+
+// ============================================================================
+// Cluster (cluster.c)
+// ============================================================================
+#define CLUSTER_SLOTS 16384
+
+// Enable cluster mode; host:port is how other nodes and clients reach us
+// Returns 0 on success, -1 on failure
+int cluster_init(const char *host, int port);
+int cluster_enabled(void);
+
+// Slot of a key: CRC16 of the key, or of its {hash tag}, mod 16384
+unsigned int cluster_key_slot(const char *key);
+
+// NULL if this node serves key, else a malloc'd MOVED / ASK / CLUSTERDOWN
+// reply. asking is set for commands sent as "ASKING <command>".
+char *cluster_redirect(HashTable *ht, const char *key, int asking);
+
+// CLUSTER subcommands; returns a malloc'd reply. Must run with the table
+// locked for writing.
+char *cluster_command(HashTable *ht, char **tokens, int num_tokens);
+
+// ============================================================================
+// Command Executor (executor.c)
+// ============================================================================
+
+// Runs one command line on the executor thread with the ctx it was
+// submitted with; returns a malloc'd reply
+typedef char *(*ExecCommandFn)(void *ctx, const char *line);
+
+// Receives each reply in order on the I/O thread (reply is freed afterwards)
+// Returns 0 on success, -1 on failure
+typedef int (*ExecReplyFn)(void *arg, size_t index, const char *reply);
+
+// Create one channel per I/O thread
+// Returns 0 on success, -1 on failure
+int exec_init(int num_channels);
+void exec_destroy(void);
+
+// Route the calling I/O thread's commands through channel index
+void exec_bind_thread(int index);
+void exec_unbind_thread(void);
+
+// Execute count lines on the executor and wait for all of their replies
+// Returns 0 on success, -1 if a reply failed
+int exec_submit(void *ctx, char **lines, size_t count, ExecReplyFn on_reply, void *arg);
+
+// Executor main loop; returns once *running is 0 and every I/O thread has
+// unbound
+void exec_run(ExecCommandFn execute, volatile int *running);
+
+// ============================================================================
+// Epoch-Based Reclamation (epoch.c)
+// ============================================================================
+
+// Reader critical section; cheap enough to wrap a single lookup
+void epoch_enter(void);
+void epoch_exit(void);
+
+// Free ptr once no reader can still reference it (writers only)
+void epoch_retire(void *ptr, void (*free_fn)(void *));
+
+// Advance the epoch if possible and free expired memory (writers only)
+void epoch_reclaim(void);
+
+// Block until every current reader has left, then reclaim (writers only)
+void epoch_synchronize(void);
+
+// Number of retired allocations not yet freed
+size_t epoch_pending(void);
+
+// Free everything still retired; only valid once all readers are gone
+void epoch_drain(void);
+
+// ============================================================================
+// Lazy Free (lazyfree.c)
+// ============================================================================
+
+// Start the background thread; until then lazyfree_push() frees inline
+// Returns 0 on success, -1 on failure
+int lazyfree_start(void);
+
+// Free everything still queued, then stop the thread
+void lazyfree_stop(void);
+
+// Call free_fn(ptr) on the background thread; bytes count as pending until
+// then. Safe from any thread.
+void lazyfree_push(void *ptr, void (*free_fn)(void *), size_t bytes);
+
+size_t lazyfree_pending_bytes(void);
+size_t lazyfree_pending_objects(void);
+size_t lazyfree_freed_objects(void);
+
+// ============================================================================
+// Bulk Loading (loader.c)
+// ============================================================================
+typedef enum LoadFormat {
+    LOAD_AUTO = 0,            // From the file extension
+    LOAD_CSV,                 // key,value per line, "quoted" fields allowed
+    LOAD_NDJSON,              // {"key": ..., "value": ...} per line
+    LOAD_RESP                 // SET key value arrays, as for redis-cli --pipe
+} LoadFormat;
+
+typedef struct LoadResult {
+    LoadFormat format;
+    size_t loaded;            // Records applied, new keys or not
+    size_t added;             // Keys that were not in the table
+    size_t skipped;           // Malformed records and ones the engine cannot serve
+    size_t bytes;             // File size
+    int threads;
+    double seconds;
+    char error[128];          // Why load_file() failed
+} LoadResult;
+
+// Parse a format name: csv, ndjson or resp. Returns 0 on success, -1 if unknown
+int load_parse_format(const char *name, LoadFormat *format);
+const char *load_format_name(LoadFormat format);
+
+// Load every record of a file into the table, using a thread per CPU for
+// parsing and linking. With unique, the caller promises no key repeats or
+// is already present, and duplicate checks are skipped. Locking is as for
+// ht_reserve() for the whole load. Nothing is added if parsing fails.
+// Returns 0 on success, -1 with result->error set
+int load_file(HashTable *ht, const char *path, LoadFormat format, int unique,
+              LoadResult *result);
+
+// ============================================================================
+// Hot and Big Keys (keystats.c)
+// ============================================================================
+typedef struct KeyCount {
+    int db;                   // Database the key lives in
+    char key[MAX_KEY_SIZE + 1];
+    size_t count;             // Estimated accesses, or value bytes
+} KeyCount;
+
+// Sample one key access in rate on average; 0 stops sampling
+void keystats_set_sample_rate(unsigned rate);
+unsigned keystats_sample_rate(void);
+
+const char *keystats_type_name(ValueType type);
+
+// Note an access to key in database db; cheap unless it is picked as a
+// sample. Safe from any thread.
+void keystats_access(int db, const char *key);
+
+// Note that key in database db now holds a value of bytes bytes. Safe from
+// any thread.
+void keystats_write(ValueType type, int db, const char *key, size_t bytes);
+
+// Hottest keys with their estimated accesses, most accessed first
+// Returns the number copied to out
+size_t keystats_hot(KeyCount *out, size_t max);
+
+// Largest values of a type seen written, largest first
+// Returns the number copied to out
+size_t keystats_big(ValueType type, KeyCount *out, size_t max);
+
+// Re-read the size of every tracked big key with size_of, which returns -1
+// for a key that is gone. Caller holds every database as a writer would.
+void keystats_big_refresh(ValueType type,
+                          int (*size_of)(void *ctx, int db, const char *key, size_t *bytes),
+                          void *ctx);
+
+// Forget every access counted so far
+void keystats_reset(void);
+
+// ============================================================================
+// Streams (stream.c)
+// ============================================================================
+typedef struct Stream Stream;
+
+void stream_free(Stream *s);
+
+// Bytes the allocator set aside for the stream, kept up to date as it
+// changes
+size_t stream_memory(const Stream *s);
+
+// Key a stream command acts on, or NULL if tokens are not a stream command
+// with a key. *writes is set if the command may change the stream.
+const char *stream_command_key(char **tokens, int num_tokens, int *writes);
+
+// XADD, XRANGE, XREADGROUP and the other X commands; returns a malloc'd
+// reply, or NULL if tokens[0] is not a stream command. Runs with the key
+// held as for ht_set(), or as for ht_get() when the command only reads.
+char *stream_command(HashTable *ht, char **tokens, int num_tokens);
+
+// ============================================================================
+// Time Series (timeseries.c)
+// ============================================================================
+typedef struct TimeSeries TimeSeries;
+
+void ts_free(TimeSeries *ts);
+
+// Bytes the allocator set aside for the series, kept up to date as it
+// changes
+size_t ts_memory(const TimeSeries *ts);
+
+// Key a TS.* command acts on, or NULL if tokens are not one with a key.
+// *writes is set if the command may change the series.
+const char *ts_command_key(char **tokens, int num_tokens, int *writes);
+
+// TS.ADD, TS.RANGE and the other TS.* commands; returns a malloc'd reply,
+// or NULL if tokens[0] is not one of them. Runs with the key held as for
+// ht_set(), or as for ht_get() when the command only reads.
+char *ts_command(HashTable *ht, char **tokens, int num_tokens);
+
+// ============================================================================
+// Vector Sets (vector.c)
+// ============================================================================
+typedef struct VectorSet VectorSet;
+
+// Pick the distance kernels for this CPU and start threads workers for
+// exact scans (0 scans on the querying thread alone)
+// Returns the kernel name ("avx512", "avx2" or "scalar"), or NULL if the
+// workers could not be started
+const char *vset_init(int threads);
+void vset_shutdown(void);
+
+// Drops the table's reference; a search still running keeps the set alive
+void vset_free(VectorSet *s);
+
+// Bytes the allocator set aside for the set, kept up to date as it changes
+size_t vset_memory(const VectorSet *s);
+
+// Key a V* command acts on, or NULL if tokens are not one with a key.
+// *writes is set if the command may change the set.
+const char *vset_command_key(char **tokens, int num_tokens, int *writes);
+
+// VADD, VSIM and the other vector set commands; returns a malloc'd reply,
+// or NULL if tokens[0] is not one of them. Runs with the key held as for
+// ht_set(), or as for ht_get() when the command only reads.
+char *vset_command(HashTable *ht, char **tokens, int num_tokens);
+
+// Between these, a VSIM only pins its set and replies with a placeholder;
+// vset_defer_end(), called once the table locks are released, runs the
+// search and returns its reply in place of reply (which it frees)
+void vset_defer_begin(void);
+char *vset_defer_end(char *reply);
+
+// ============================================================================
+// Geo Sets (geo.c)
+// ============================================================================
+typedef struct GeoSet GeoSet;
+
+void geo_free(GeoSet *g);
+
+// Bytes the allocator set aside for the set, kept up to date as it changes
+size_t geo_memory(const GeoSet *g);
+
+// Key a GEO* command acts on, or NULL if tokens are not one with a key.
+// *writes is set if the command may change the set.
+const char *geo_command_key(char **tokens, int num_tokens, int *writes);
+
+// GEOADD, GEOSEARCH and the other GEO* commands; returns a malloc'd reply,
+// or NULL if tokens[0] is not one of them. Runs with the key held as for
+// ht_set(), or as for ht_get() when the command only reads.
+char *geo_command(HashTable *ht, char **tokens, int num_tokens);
+
+// ============================================================================
+// Bloom and Cuckoo Filters (filters.c)
+// ============================================================================
+typedef struct BloomFilter BloomFilter;
+typedef struct CuckooFilter CuckooFilter;
+
+void bloom_free(BloomFilter *bf);
+void cuckoo_free(CuckooFilter *cf);
+
+// Bytes the allocator set aside for the filter, kept up to date as it grows
+size_t bloom_memory(const BloomFilter *bf);
+size_t cuckoo_memory(const CuckooFilter *cf);
+
+// Key a BF.* or CF.* command acts on, or NULL if tokens are not one with a
+// key. *writes is set if the command may change the filter.
+const char *filter_command_key(char **tokens, int num_tokens, int *writes);
+
+// BF.ADD, CF.DEL and the other BF.* and CF.* commands; returns a malloc'd
+// reply, or NULL if tokens[0] is not one of them. Runs with the key held as
+// for ht_set(), or as for ht_get() when the command only reads.
+char *filter_command(HashTable *ht, char **tokens, int num_tokens);
+
+// ============================================================================
+// String Builder (strbuf.c)
+// ============================================================================
+// Growable reply buffer. A failed allocation is remembered and reported by
+// sb_finish(), so callers append without checking each step.
+typedef struct StrBuf {
+    char *buf;
+    size_t len;
+    size_t cap;
+    int failed;
+} StrBuf;
+
+void sb_init(StrBuf *sb);
+void sb_append(StrBuf *sb, const char *data, size_t len);
+void sb_printf(StrBuf *sb, const char *fmt, ...);
+
+// Append len bytes of str as a quoted, escaped JSON string
+void sb_json_string(StrBuf *sb, const char *str, size_t len);
+
+// The built string (caller frees), or NULL if an allocation failed
+char *sb_finish(StrBuf *sb);
+
+// ============================================================================
+// Logging (server.c)
+// ============================================================================
+void log_info(const char *fmt, ...);
+void log_error(const char *fmt, ...);
+void log_debug(const char *fmt, ...);
+
+// ============================================================================
+// Timer Wheel (timer_wheel.c)
+// ============================================================================
+typedef struct TimerWheel TimerWheel;
+typedef struct Timer Timer;
+
+typedef void (*TimerCallback)(TimerWheel *tw, Timer *t);
+
+// Intrusive timer: embed in the owning struct, no allocation per timer
+struct Timer {
+    struct Timer *prev;
+    struct Timer *next;
+    struct Timer **slot;      // Slot list head while pending, else NULL
+    uint64_t expires;         // Absolute tick
+    TimerCallback callback;
+    void *arg;
+};
+
+// Monotonic milliseconds
+uint64_t tw_now_ms(void);
+
+TimerWheel *tw_create(void);
+void tw_destroy(TimerWheel *tw);
+
+void tw_init_timer(Timer *t, TimerCallback callback, void *arg);
+
+// Schedule (or reschedule) a timer delay_ms from now - O(1)
+void tw_add(TimerWheel *tw, Timer *t, uint64_t delay_ms);
+
+// Cancel a pending timer - O(1), no-op if not pending
+void tw_cancel(TimerWheel *tw, Timer *t);
+
+// Returns 1 if the timer is scheduled
+int tw_pending(const Timer *t);
+
+// Run every timer that is due at now_ms
+void tw_advance(TimerWheel *tw, uint64_t now_ms);
+
+// Milliseconds until the next timer may fire, capped at max_ms
+int tw_next_timeout(const TimerWheel *tw, uint64_t now_ms, int max_ms);
+
+// ============================================================================
+// Client Connection
+// ============================================================================
+
+// A chunk of pending output. Replies are appended to the tail block; blocks
+// are released from the head once the socket has accepted all of their bytes.
+typedef struct ReplyBlock {
+    struct ReplyBlock *next;
+    size_t len;       // Bytes written into data
+    size_t sent;      // Bytes already accepted by the socket
+    size_t cap;       // Capacity of data
+    int inflight;     // Owned by the kernel (io_uring send in progress)
+    char data[];
+} ReplyBlock;
+
+// Output buffer limits are configured per class of client. Every client is
+// normal: classes for pub/sub and replica connections come with those.
+typedef enum ClientClass {
+    CLIENT_CLASS_NORMAL = 0,
+    CLIENT_CLASS_COUNT
+} ClientClass;
+
+typedef struct OutputLimit {
+    size_t soft;              // Stop reading from the client above this (0 = off)
+    size_t hard;              // Disconnect the client above this (0 = off)
+} OutputLimit;
+
+typedef struct Client {
+    int fd;
+    char addr[64];            // "ip:port" for logging
+    ClientClass client_class;
+
+    // Input: bytes received but not yet forming a complete line
+    char *query_buf;
+    size_t query_len;
+    size_t query_cap;
+
+    // Output: queued replies
+    ReplyBlock *reply_head;
+    ReplyBlock *reply_tail;
+    size_t reply_bytes;       // Memory held by reply blocks
+
+    int input_eof;            // Peer closed its side
+    int closing;              // QUIT or EOF handled: close once replies drain
+    int killed;               // Hard output limit hit: drop without flushing
+    int db;                   // Database chosen with SELECT (default 0)
+
+    // Event loop bookkeeping
+    struct EventLoop *el;
+    struct Client *prev;
+    struct Client *next;
+    uint64_t last_active_ms;  // Last time data arrived
+    Timer idle_timer;
+    int io_events;            // Readiness backends: registered interest
+    int io_refs;              // io_uring: operations still owned by kernel
+    int io_sends;             // io_uring: send submissions in flight
+    int io_dead;              // io_uring: shut down, waiting for io_refs
+    int io_recv_armed;        // io_uring: multishot recv outstanding
+    int io_recv_cancel;       // io_uring: cancel requested for that recv
+} Client;
+
+// Create a client for an accepted socket (takes ownership of fd)
+Client *client_create(int fd);
+
+// Close the socket and free all client memory
+void client_free(Client *c);
+
+// Feed received bytes; complete lines are executed and replies queued
+// Returns 0 on success, -1 if the connection should be dropped
+int client_feed(Client *c, const char *data, size_t len);
+
+// Peer closed its side: run remaining commands and start closing
+void client_eof(Client *c);
+
+// Returns 1 if buffered input is waiting and output is below the soft limit
+int client_has_pending_input(const Client *c);
+
+// Execute buffered commands left over from a backpressure pause
+// Returns 0 on success, -1 if the connection should be dropped
+int client_process_input(Client *c);
+
+// Mark the first n pending bytes as sent, releasing finished blocks
+void client_reply_consume(Client *c, size_t n);
+
+// Returns 1 if the client has unsent output
+int client_has_pending_reply(const Client *c);
+
+// Returns 1 if the event loop should read from the client. Reading pauses
+// while queued output is above the client class's soft limit.
+int client_can_read(const Client *c);
+
+// ============================================================================
+// Event Loop (pluggable I/O backends: io_uring, epoll, poll)
+// ============================================================================
+typedef struct EventLoop EventLoop;
+
+// Create an event loop using the named backend ("auto", "io_uring",
+// "epoll" or "poll"). Unavailable backends fall back to the next one.
+EventLoop *el_create(const char *backend);
+
+// Name of the backend actually in use
+const char *el_backend_name(const EventLoop *el);
+
+// Register a listening socket; accepted clients are served by this loop
+int el_add_listener(EventLoop *el, int fd);
+
+// Run until *running becomes 0
+void el_run(EventLoop *el, volatile int *running);
+
+// Timers run on the loop's thread between I/O batches
+TimerWheel *el_timers(EventLoop *el);
+
+// Close clients that send nothing for this many seconds (0 disables)
+void el_set_idle_timeout(EventLoop *el, int seconds);
+
+// Close a client from outside the I/O path (timers, limits)
+void el_close_client(EventLoop *el, Client *c);
+
+// Free the loop and every client still attached to it
+void el_destroy(EventLoop *el);
+
 // ============================================================================
 // Server Functions
 // ============================================================================
+// How worker threads share the hash table
+typedef enum ConcurrencyMode {
+    CONCURRENCY_GLOBAL = 0,   // One engine lock around every command
+    CONCURRENCY_EPOCH,        // Lock-free GET, writers serialized by the lock
+    CONCURRENCY_STRIPED,      // Per-stripe reader-writer locks
+    CONCURRENCY_EXECUTOR      // Workers do I/O, one thread executes commands
+} ConcurrencyMode;
+
+typedef struct ServerConfig {
+    int port;
+    int backlog;              // listen() queue length per listener
+    int threads;              // Worker threads, each with its own listener
+    int reuseport_bpf;        // Steer connections to workers by receiving CPU
+    const char *unix_socket;  // Optional Unix domain socket path
+    OutputLimit output_limits[CLIENT_CLASS_COUNT];
+    int idle_timeout;         // Seconds before an idle client is closed
+    int tcp_keepalive;        // SO_KEEPALIVE idle time in seconds
+    const char *io_backend;   // "auto", "io_uring", "epoll" or "poll"
+    ConcurrencyMode concurrency;
+    int lock_stripes;         // Stripe count for CONCURRENCY_STRIPED
+    int numa;                 // Pin workers across NUMA nodes, local memory
+    int numa_node;            // Bind the whole process to this node (-1 = off)
+    int cpus[MAX_THREADS + 1]; // --cpu-list: worker i runs on cpus[i % num_cpus]
+    int num_cpus;
+    int busy_poll;            // SO_BUSY_POLL microseconds on client sockets
+    size_t reserve;           // Keys to size the table for at startup
+    const char *load;         // File to bulk load at startup
+    const char *load_dir;     // Directory LOAD may read from (NULL disables it)
+    unsigned hotkeys_sample;  // Key accesses per HOTKEYS sample (0 = off)
+    int databases;            // Independent tables, selected with SELECT
+    int vector_threads;       // Workers for exact VSIM scans
+    HugePageMode hugepages;   // Backing for bucket arrays and entry slabs
+    int active_defrag;        // Keep entries in slabs and compact them
+    double defrag_threshold;  // Fragmentation ratio that starts a defrag pass
+    int cluster;              // Serve only the hash slots assigned to us
+    const char *cluster_announce;  // Host other nodes and clients use for us
+} ServerConfig;
 
 // Start the TCP server
-int server_start(int port);
+int server_start(const ServerConfig *config);
 
 // Process a command and return response
 // Caller must free the returned string
@@ -0,0 +1,210 @@
+// ============================================================================
+// numa.c - NUMA Topology, Thread Pinning and Memory Placement
+// ============================================================================
+//
+// Topology is read from /sys/devices/system/node; memory policies are set
+// with the raw set_mempolicy / mbind syscalls so no libnuma is needed.
+// Without NUMA (or off Linux) everything reports a single node and the
+// binding calls fail softly.
+// ============================================================================
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "mini_redis.h"
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+#define NUMA_MAX_NODES 64
+
+// Parse a kernel-style cpulist ("0-3,8-11") into cpus
+int numa_parse_cpulist(const char *list, int *cpus, int max) {
+    const char *p = list;
+    int count = 0;
+
+    while (*p && *p != '\n') {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || first < 0) return -1;
+        if (*end == '-') {
+            const char *start = end + 1;
+            last = strtol(start, &end, 10);
+            if (end == start || last < first) return -1;
+        }
+        if (*end != ',' && *end != '\0' && *end != '\n') return -1;
+
+        for (long cpu = first; cpu <= last && count < max; cpu++) {
+            cpus[count++] = (int)cpu;
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+#ifdef __linux__
+typedef struct NumaNode {
+    int id;                           // Kernel node number
+    int cpus[CPU_SETSIZE];
+    int num_cpus;
+} NumaNode;
+
+static NumaNode g_nodes[NUMA_MAX_NODES];
+static int g_num_nodes = 0;
+
+int numa_init(void) {
+    if (g_num_nodes > 0) return g_num_nodes;
+
+    for (int id = 0; id < NUMA_MAX_NODES; id++) {
+        char path[64], list[4096];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", id);
+
+        FILE *f = fopen(path, "r");
+        if (!f) continue;
+        if (fgets(list, sizeof(list), f)) {
+            NumaNode *node = &g_nodes[g_num_nodes];
+            node->id = id;
+            node->num_cpus = numa_parse_cpulist(list, node->cpus, CPU_SETSIZE);
+            if (node->num_cpus < 0) node->num_cpus = 0;
+            // Memory-only nodes cannot host workers
+            if (node->num_cpus > 0) g_num_nodes++;
+        }
+        fclose(f);
+    }
+
+    if (g_num_nodes == 0) {
+        // No sysfs topology: one node holding every online CPU
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        g_nodes[0].id = 0;
+        g_nodes[0].num_cpus = 0;
+        for (long cpu = 0; cpu < ncpu && cpu < CPU_SETSIZE; cpu++) {
+            g_nodes[0].cpus[g_nodes[0].num_cpus++] = (int)cpu;
+        }
+        g_num_nodes = 1;
+    }
+    return g_num_nodes;
+}
+
+int numa_num_nodes(void) {
+    return g_num_nodes > 0 ? g_num_nodes : 1;
+}
+
+int numa_cpu_node(int cpu) {
+    for (int i = 0; i < g_num_nodes; i++) {
+        for (int j = 0; j < g_nodes[i].num_cpus; j++) {
+            if (g_nodes[i].cpus[j] == cpu) return g_nodes[i].id;
+        }
+    }
+    return 0;
+}
+
+int numa_worker_cpu(int worker) {
+    if (g_num_nodes == 0) numa_init();
+
+    // Round-robin over nodes so every socket gets its share of workers
+    NumaNode *node = &g_nodes[worker % g_num_nodes];
+    if (node->num_cpus == 0) return 0;
+    return node->cpus[(worker / g_num_nodes) % node->num_cpus];
+}
+
+int numa_bind_thread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) return -1;
+
+    if (numa_num_nodes() == 1) return 0;
+
+    // Prefer (rather than require) local memory so a full node degrades
+    // to remote allocations instead of failing them
+    unsigned long mask = 1UL << numa_cpu_node(cpu);
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, NUMA_MAX_NODES + 1) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int numa_bind_process(int node_id) {
+    if (g_num_nodes == 0) numa_init();
+
+    NumaNode *node = NULL;
+    for (int i = 0; i < g_num_nodes; i++) {
+        if (g_nodes[i].id == node_id) node = &g_nodes[i];
+    }
+    if (!node) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Threads created afterwards inherit both the CPU mask and the policy
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int i = 0; i < node->num_cpus; i++) CPU_SET(node->cpus[i], &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) return -1;
+
+    unsigned long mask = 1UL << node_id;
+    if (syscall(SYS_set_mempolicy, MPOL_BIND, &mask, NUMA_MAX_NODES + 1) != 0) {
+        // Single-node kernels without NUMA support: nothing to bind
+        if (errno != ENOSYS || g_num_nodes > 1) return -1;
+    }
+    return 0;
+}
+
+void numa_interleave(void *addr, size_t len) {
+    if (numa_num_nodes() < 2) return;
+
+    unsigned long mask = 0;
+    for (int i = 0; i < g_num_nodes; i++) mask |= 1UL << g_nodes[i].id;
+
+    // Only pages not yet touched are placed by the new policy
+    if (syscall(SYS_mbind, addr, len, MPOL_INTERLEAVE, &mask, NUMA_MAX_NODES + 1, 0) != 0) {
+        log_error("mbind(MPOL_INTERLEAVE) failed: %s", strerror(errno));
+    }
+}
+
+#else // !__linux__
+
+int numa_init(void) {
+    return 1;
+}
+
+int numa_num_nodes(void) {
+    return 1;
+}
+
+int numa_cpu_node(int cpu) {
+    (void)cpu;
+    return 0;
+}
+
+int numa_worker_cpu(int worker) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    return ncpu > 0 ? (int)(worker % ncpu) : 0;
+}
+
+int numa_bind_thread(int cpu) {
+    (void)cpu;
+    errno = ENOTSUP;
+    return -1;
+}
+
+int numa_bind_process(int node_id) {
+    (void)node_id;
+    errno = ENOTSUP;
+    return -1;
+}
+
+void numa_interleave(void *addr, size_t len) {
+    (void)addr;
+    (void)len;
+}
+
+#endif // __linux__
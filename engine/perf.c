@@ -0,0 +1,96 @@
+// ============================================================================
+// perf.c - Hardware Counters for INFO
+// ============================================================================
+//
+// Every thread that touches the table opens its own dTLB read-miss counter
+// with perf_event_open(); INFO sums them. A counter only sees its own
+// thread, and an inherited one would only fold in children once they exit,
+// hence one per thread. When perf is unavailable (non-Linux, containers,
+// kernel.perf_event_paranoid) the counters report as missing.
+// ============================================================================
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mini_redis.h"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#define PERF_MAX_THREADS (MAX_THREADS + 2)
+
+static int g_perf_fds[PERF_MAX_THREADS];
+static int g_num_perf_fds = 0;
+
+#ifdef __linux__
+
+int perf_thread_start(void) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.exclude_kernel = 1;  // Allowed at the default paranoia level
+    attr.exclude_hv = 1;
+
+    int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd < 0) return -1;
+
+    int slot = __atomic_fetch_add(&g_num_perf_fds, 1, __ATOMIC_RELAXED);
+    if (slot >= PERF_MAX_THREADS) {
+        close(fd);
+        return -1;
+    }
+    __atomic_store_n(&g_perf_fds[slot], fd, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int perf_dtlb_misses(uint64_t *misses) {
+    int n = __atomic_load_n(&g_num_perf_fds, __ATOMIC_ACQUIRE);
+    int opened = 0;
+    uint64_t total = 0;
+
+    if (n > PERF_MAX_THREADS) n = PERF_MAX_THREADS;
+    for (int i = 0; i < n; i++) {
+        // A slot is claimed before its descriptor is stored
+        int fd = __atomic_load_n(&g_perf_fds[i], __ATOMIC_ACQUIRE);
+        uint64_t value;
+        if (fd > 0 && read(fd, &value, sizeof(value)) == (ssize_t)sizeof(value)) {
+            total += value;
+            opened++;
+        }
+    }
+
+    if (opened == 0) return -1;
+    *misses = total;
+    return 0;
+}
+
+#else // !__linux__
+
+int perf_thread_start(void) {
+    return -1;
+}
+
+int perf_dtlb_misses(uint64_t *misses) {
+    (void)misses;
+    return -1;
+}
+
+#endif // __linux__
+
+void perf_shutdown(void) {
+    int n = __atomic_exchange_n(&g_num_perf_fds, 0, __ATOMIC_ACQ_REL);
+    if (n > PERF_MAX_THREADS) n = PERF_MAX_THREADS;
+    for (int i = 0; i < n; i++) {
+        if (g_perf_fds[i] > 0) close(g_perf_fds[i]);
+        g_perf_fds[i] = 0;
+    }
+}
@@ -2,7 +2,7 @@
 // server.c - TCP Server for Mini-Redis
 // ============================================================================
 
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,34 +12,102 @@
 #include <signal.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <ctype.h>
 #include <time.h>
 #include <stdarg.h>
+#include <strings.h>
+#include <pthread.h>
 #include "mini_redis.h"
 
-// Global hash table
-static HashTable *g_hash_table = NULL;
+#ifdef __linux__
+#include <sched.h>
+#include <linux/filter.h>
+#endif
 
-// Server socket (for cleanup)
-static int g_server_socket = -1;
+// Logical databases, one independent table each; clients pick one with
+// SELECT and start on database 0
+static HashTable **g_dbs = NULL;
+static int g_num_dbs = 0;
 
 // Running flag
 static volatile int g_running = 1;
 
+// Serializes command execution across worker threads (in epoch mode, only
+// commands that modify the table)
+static pthread_mutex_t g_engine_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Flushes retired table memory when writes alone would not (epoch mode)
+static Timer g_epoch_reclaimer;
+
+// Active configuration (set by server_start)
+static const ServerConfig *g_config = NULL;
+
+// Connection statistics, updated atomically by all workers
+static size_t g_connected_clients = 0;
+static size_t g_output_buffer_bytes = 0;
+static size_t g_query_buffer_bytes = 0;
+static size_t g_clients_killed = 0;
+
+// Command throughput, sampled periodically by a timer on the first worker
+static size_t g_commands_processed = 0;
+
+#define STATS_SAMPLES 16
+
+static struct {
+    Timer timer;
+    uint64_t last_ms;
+    size_t last_commands;
+    size_t samples[STATS_SAMPLES];    // Ops/sec per interval
+    int index;
+    size_t ops_per_sec;               // Mean over the sample window
+} g_stats_sampler;
+
+// Active defrag: a timer on the first worker starts a pass over the table
+// when the allocator's fragmentation ratio passes the threshold, and runs
+// it in short slices until the ratio is back under it
+static struct {
+    Timer timer;
+    int running;              // A pass is in progress
+    size_t floor;             // Waste left by a pass that could move nothing
+    int db;                   // Database the current pass is in
+    size_t cursor;            // Next bucket of that database
+    size_t passes;            // Completed passes
+    size_t pass_moved;        // Allocations moved by the current pass
+    size_t moved;             // Allocations moved by every pass
+} g_defrag;
+
+#define DEFRAG_STEP_BUCKETS 16        // Buckets between clock checks
+
+static const char *client_class_names[CLIENT_CLASS_COUNT] = {
+    "normal"
+};
+
+static const char *concurrency_names[] = {
+    "global", "epoch", "striped", "executor"
+};
+
+static const char *hugepage_names[] = {
+    "off", "thp", "explicit"
+};
+
 // ============================================================================
 // Logging Utilities
 // ============================================================================
 static void log_timestamp(void) {
     time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);
+    struct tm tm_buf;
+    struct tm *tm_info = localtime_r(&now, &tm_buf);
     char buffer[26];
     strftime(buffer, 26, "%Y-%m-%d %H:%M:%S", tm_info);
     printf("[%s] ", buffer);
 }
 
-static void log_info(const char *fmt, ...) {
+void log_info(const char *fmt, ...) {
+    flockfile(stdout);
     log_timestamp();
     printf("[INFO] ");
     va_list args;
@@ -48,9 +116,11 @@ static void log_info(const char *fmt, ...) {
     va_end(args);
     printf("\n");
     fflush(stdout);
+    funlockfile(stdout);
 }
 
-static void log_error(const char *fmt, ...) {
+void log_error(const char *fmt, ...) {
+    flockfile(stderr);
     log_timestamp();
     fprintf(stderr, "[ERROR] ");
     va_list args;
@@ -59,9 +129,11 @@ static void log_error(const char *fmt, ...) {
     va_end(args);
     fprintf(stderr, "\n");
     fflush(stderr);
+    funlockfile(stderr);
 }
 
-static void log_debug(const char *fmt, ...) {
+void log_debug(const char *fmt, ...) {
+    flockfile(stdout);
     log_timestamp();
     printf("[DEBUG] ");
     va_list args;
@@ -70,6 +142,7 @@ static void log_debug(const char *fmt, ...) {
     va_end(args);
     printf("\n");
     fflush(stdout);
+    funlockfile(stdout);
 }
 
 // ============================================================================
@@ -99,6 +172,19 @@ static char *str_duplicate(const char *str) {
     return dup;
 }
 
+// Parse a non-negative decimal count
+// Returns 0 on success, -1 on malformed input
+static int parse_count(const char *str, size_t *count) {
+    char *end;
+
+    if (!isdigit((unsigned char)*str)) return -1;
+    errno = 0;
+    unsigned long long value = strtoull(str, &end, 10);
+    if (*end != '\0' || errno == ERANGE || value > SIZE_MAX) return -1;
+    *count = (size_t)value;
+    return 0;
+}
+
 // ============================================================================
 // Parse Command - Extract tokens from command string
 // Returns number of tokens parsed
@@ -118,10 +204,452 @@ static int parse_command(char *cmd, char **tokens, int max_tokens) {
     return count;
 }
 
+// Bytes of this process's anonymous memory the kernel actually backs with
+// transparent huge pages; -1 where /proc does not report it
+static long long anon_huge_pages_bytes(void) {
+    long long kb = -1;
+#ifdef __linux__
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+    if (!f) return -1;
+
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "AnonHugePages: %lld kB", &kb) == 1) break;
+    }
+    fclose(f);
+#endif
+    return kb < 0 ? -1 : kb * 1024;
+}
+
+// Resident set size in bytes; -1 where /proc does not report it
+static long long rss_bytes(void) {
+    long long pages = -1;
+#ifdef __linux__
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f) return -1;
+
+    if (fscanf(f, "%*s %lld", &pages) != 1) pages = -1;
+    fclose(f);
+#endif
+    return pages < 0 ? -1 : pages * sysconf(_SC_PAGESIZE);
+}
+
+// Memory the engine holds, by what it holds it for
+typedef struct MemoryUsage {
+    size_t dataset;           // Entries: nodes, keys and values
+    size_t overhead;          // The table: bucket array, locks, bookkeeping
+    size_t lazyfree;          // Unlinked, waiting for the lazy-free thread
+    size_t buffers;           // Client query and output buffers
+    size_t total;
+} MemoryUsage;
+
+// Summed over every database. Caller holds them all as a writer would.
+static void memory_usage(MemoryUsage *mu) {
+    mu->dataset = mu->overhead = 0;
+    for (int i = 0; i < g_num_dbs; i++) {
+        size_t dataset, overhead;
+        ht_memory_stats(g_dbs[i], &dataset, &overhead);
+        mu->dataset += dataset;
+        mu->overhead += overhead;
+    }
+    mu->lazyfree = lazyfree_pending_bytes();
+    mu->buffers = __atomic_load_n(&g_output_buffer_bytes, __ATOMIC_RELAXED) +
+                  __atomic_load_n(&g_query_buffer_bytes, __ATOMIC_RELAXED);
+    mu->total = mu->dataset + mu->overhead + mu->lazyfree + mu->buffers;
+}
+
+// {"db<n>": keys, ...} for every database holding keys, plus the totals
+// over all of them. Caller holds every database as a writer would.
+static char *keyspace_json(size_t *total_keys, size_t *total_buckets) {
+    char *buffer = (char *)malloc((size_t)g_num_dbs * 40 + 3);
+    if (!buffer) return NULL;
+
+    size_t pos = 0;
+    *total_keys = *total_buckets = 0;
+    buffer[pos++] = '{';
+    for (int i = 0; i < g_num_dbs; i++) {
+        size_t keys;
+        ht_stats(g_dbs[i], &keys, NULL);
+        *total_keys += keys;
+        *total_buckets += g_dbs[i]->num_buckets;
+        if (keys == 0) continue;
+        pos += (size_t)sprintf(buffer + pos, "%s\"db%d\": %zu", pos > 1 ? ", " : "", i, keys);
+    }
+    buffer[pos++] = '}';
+    buffer[pos] = '\0';
+    return buffer;
+}
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// ============================================================================
+// Active Defragmentation
+// ============================================================================
+
+// Allocator fragmentation: slab pages in use per byte of live allocations
+static double defrag_ratio(size_t *waste) {
+    size_t resident, used;
+
+    if (ht_alloc_usage(&resident, &used) != 0 || used == 0) {
+        *waste = 0;
+        return 1.0;
+    }
+    *waste = resident > used ? resident - used : 0;
+    return (double)resident / (double)used;
+}
+
+// Run the current pass for up to DEFRAG_SLICE_US. A pass walks every
+// database in turn. At the end of a pass the job stops once the ratio is
+// under the threshold, or if nothing could be moved; it then waits for
+// fresh fragmentation before starting again. Runs with every database held
+// as for a write.
+static char *defrag_slice(void) {
+    size_t waste;
+    uint64_t start = now_us();
+
+    if (!g_config || !g_config->active_defrag) {
+        return str_duplicate("ERROR: Active defrag is off (start with --activedefrag)");
+    }
+
+    __atomic_store_n(&g_defrag.running, 1, __ATOMIC_RELAXED);
+    do {
+        size_t moved = ht_defrag(g_dbs[g_defrag.db], &g_defrag.cursor, DEFRAG_STEP_BUCKETS);
+        g_defrag.pass_moved += moved;
+        g_defrag.moved += moved;
+        if (g_defrag.cursor != 0) continue;
+        if (++g_defrag.db < g_num_dbs) continue;
+        g_defrag.db = 0;
+
+        g_defrag.passes++;
+        double ratio = defrag_ratio(&waste);
+        if (ratio <= g_config->defrag_threshold) {
+            __atomic_store_n(&g_defrag.floor, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&g_defrag.running, 0, __ATOMIC_RELAXED);
+        } else if (g_defrag.pass_moved == 0) {
+            __atomic_store_n(&g_defrag.floor, waste, __ATOMIC_RELAXED);
+            __atomic_store_n(&g_defrag.running, 0, __ATOMIC_RELAXED);
+        }
+        log_info("Defrag pass %zu moved %zu allocations, fragmentation %.2f",
+                 g_defrag.passes, g_defrag.pass_moved, ratio);
+        g_defrag.pass_moved = 0;
+        break;
+    } while (now_us() - start < DEFRAG_SLICE_US);
+
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer),
+             "{\"running\": %d, \"passes\": %zu, \"moved\": %zu, \"db\": %d, "
+             "\"cursor\": %zu, \"buckets\": %zu}",
+             __atomic_load_n(&g_defrag.running, __ATOMIC_RELAXED), g_defrag.passes,
+             g_defrag.moved, g_defrag.db, g_defrag.cursor, g_dbs[g_defrag.db]->num_buckets);
+    return str_duplicate(buffer);
+}
+
+// ============================================================================
+// DEBUG POPULATE - Synthetic datasets for benchmarks
+// ============================================================================
+// Adds <prefix>:0 .. <prefix>:<count-1> with values "value:<n>", padded
+// with 'x' or cut to size bytes if given. The table is reserved for the
+// final count first, and while it started empty every key is known to be
+// new, so entries go straight in without a duplicate scan. Keys that
+// already exist are otherwise left alone. Runs with the table held as for
+// a write.
+static char *debug_populate(HashTable *ht, char **tokens, int num_tokens) {
+    size_t count, size = 0;
+    const char *prefix = num_tokens >= 4 ? tokens[3] : "key";
+    char key[MAX_KEY_SIZE + 1];
+    char value[MAX_VALUE_SIZE + 1];
+
+    if (num_tokens < 3 || parse_count(tokens[2], &count) != 0 ||
+        (num_tokens >= 5 && (parse_count(tokens[4], &size) != 0 || size == 0 ||
+                             size > MAX_VALUE_SIZE))) {
+        return str_duplicate("ERROR: DEBUG POPULATE takes count [prefix] [size]");
+    }
+    if (strlen(prefix) + 21 > MAX_KEY_SIZE) {
+        return str_duplicate("ERROR: Key prefix too long");
+    }
+
+    size_t num_keys;
+    ht_stats(ht, &num_keys, NULL);
+    if (count > SIZE_MAX - num_keys || ht_reserve(ht, num_keys + count, 0) != 0) {
+        return str_duplicate("ERROR: Failed to reserve capacity");
+    }
+
+    int unique = num_keys == 0;
+    size_t added = 0;
+    for (size_t i = 0; i < count; i++) {
+        snprintf(key, sizeof(key), "%s:%zu", prefix, i);
+        int len = snprintf(value, sizeof(value), "value:%zu", i);
+        if (size > 0) {
+            if ((size_t)len < size) memset(value + len, 'x', size - (size_t)len);
+            value[size] = '\0';
+        }
+
+        ValueType type;
+        if (!unique && ht_lookup(ht, key, &type)) continue;
+        if (ht_insert_new(ht, key, value) != 0) {
+            log_error("DEBUG POPULATE stopped after %zu keys", added);
+            return str_duplicate("ERROR: Failed to set value");
+        }
+        keystats_write(VALUE_STRING, ht->db, key, strlen(value));
+        added++;
+    }
+
+    log_info("DEBUG POPULATE -> %zu keys added", added);
+    return str_duplicate("OK");
+}
+
+// ============================================================================
+// HOTKEYS and BIGKEYS - Most accessed keys and largest values
+// ============================================================================
+// Append str as a JSON string; keys cannot hold whitespace, but may hold
+// quotes and backslashes
+static size_t json_append_string(char *buf, size_t pos, const char *str) {
+    buf[pos++] = '"';
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\') buf[pos++] = '\\';
+        buf[pos++] = *str;
+    }
+    buf[pos++] = '"';
+    return pos;
+}
+
+// Room for one reply item: an escaped key plus its numeric fields
+#define KEYSTATS_ITEM_SIZE (2 * MAX_KEY_SIZE + 128)
+
+static int parse_keystats_count(char **tokens, int num_tokens, size_t *count) {
+    *count = KEYSTATS_TRACKED;
+    if (num_tokens < 2) return 0;
+    if (parse_count(tokens[1], count) != 0 || *count == 0) return -1;
+    if (*count > KEYSTATS_TRACKED) *count = KEYSTATS_TRACKED;
+    return 0;
+}
+
+// HOTKEYS [count] | HOTKEYS RESET
+static char *hotkeys_command(char **tokens, int num_tokens) {
+    KeyCount hot[KEYSTATS_TRACKED];
+    size_t count;
+
+    if (num_tokens >= 2 && strcasecmp(tokens[1], "RESET") == 0) {
+        keystats_reset();
+        return str_duplicate("OK");
+    }
+    if (parse_keystats_count(tokens, num_tokens, &count) != 0) {
+        return str_duplicate("ERROR: HOTKEYS takes [count] or RESET");
+    }
+    if (keystats_sample_rate() == 0) {
+        return str_duplicate("ERROR: Key sampling is disabled (--hotkeys-sample 0)");
+    }
+
+    size_t n = keystats_hot(hot, count);
+    char *buffer = (char *)malloc(n * KEYSTATS_ITEM_SIZE + 3);
+    if (!buffer) return str_duplicate("ERROR: Memory allocation failed");
+
+    size_t pos = 0;
+    buffer[pos++] = '[';
+    for (size_t i = 0; i < n; i++) {
+        pos += (size_t)sprintf(buffer + pos, "%s{\"db\": %d, \"key\": ", i ? ", " : "",
+                               hot[i].db);
+        pos = json_append_string(buffer, pos, hot[i].key);
+        pos += (size_t)sprintf(buffer + pos, ", \"hits\": %zu}", hot[i].count);
+    }
+    buffer[pos++] = ']';
+    buffer[pos] = '\0';
+    return buffer;
+}
+
+// Value bytes of a tracked big key, for keystats_big_refresh(); ctx points
+// to the type being refreshed, and a key that now holds another is dropped
+static int value_size(void *ctx, int db, const char *key, size_t *bytes) {
+    ValueType type;
+    void *value = ht_lookup(g_dbs[db], key, &type);
+    if (!value || type != *(const ValueType *)ctx) return -1;
+    switch (type) {
+    case VALUE_STREAM:
+        *bytes = stream_memory((Stream *)value);
+        break;
+    case VALUE_TIMESERIES:
+        *bytes = ts_memory((TimeSeries *)value);
+        break;
+    case VALUE_VECTORSET:
+        *bytes = vset_memory((VectorSet *)value);
+        break;
+    case VALUE_GEO:
+        *bytes = geo_memory((GeoSet *)value);
+        break;
+    case VALUE_BLOOM:
+        *bytes = bloom_memory((BloomFilter *)value);
+        break;
+    case VALUE_CUCKOO:
+        *bytes = cuckoo_memory((CuckooFilter *)value);
+        break;
+    default:
+        *bytes = strlen((const char *)value);
+        break;
+    }
+    return 0;
+}
+
+// BIGKEYS [count] - The largest values of each type, in every database.
+// Runs with every database held as for a write, so keys deleted or shrunk
+// since they were tracked can be dropped or updated first.
+static char *bigkeys_command(char **tokens, int num_tokens) {
+    KeyCount big[KEYSTATS_TRACKED];
+    size_t count, items = 0;
+
+    if (parse_keystats_count(tokens, num_tokens, &count) != 0) {
+        return str_duplicate("ERROR: BIGKEYS takes [count]");
+    }
+
+    char *buffer = (char *)malloc((size_t)VALUE_TYPES * count * KEYSTATS_ITEM_SIZE + 3);
+    if (!buffer) return str_duplicate("ERROR: Memory allocation failed");
+
+    size_t pos = 0;
+    buffer[pos++] = '[';
+    for (int type = 0; type < VALUE_TYPES; type++) {
+        ValueType value_type = (ValueType)type;
+        keystats_big_refresh(value_type, value_size, &value_type);
+        size_t n = keystats_big((ValueType)type, big, count);
+        for (size_t i = 0; i < n; i++) {
+            size_t memory = 0;
+            ht_key_memory(g_dbs[big[i].db], big[i].key, &memory);
+            pos += (size_t)sprintf(buffer + pos, "%s{\"db\": %d, \"key\": ",
+                                   items++ ? ", " : "", big[i].db);
+            pos = json_append_string(buffer, pos, big[i].key);
+            pos += (size_t)sprintf(buffer + pos,
+                                   ", \"type\": \"%s\", \"bytes\": %zu, \"memory\": %zu}",
+                                   keystats_type_name((ValueType)type), big[i].count, memory);
+        }
+    }
+    buffer[pos++] = ']';
+    buffer[pos] = '\0';
+    return buffer;
+}
+
+// ============================================================================
+// LOAD - Bulk import of a file under --load-dir
+// ============================================================================
+static char *load_result_json(const LoadResult *result) {
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer),
+             "{\"format\": \"%s\", \"loaded\": %zu, \"added\": %zu, \"skipped\": %zu, "
+             "\"bytes\": %zu, \"threads\": %d, \"seconds\": %.3f}",
+             load_format_name(result->format), result->loaded, result->added,
+             result->skipped, result->bytes, result->threads, result->seconds);
+    return str_duplicate(buffer);
+}
+
+// LOAD path [CSV|NDJSON|RESP] [UNIQUE]. Clients may only name files inside
+// the directory the operator opened with --load-dir. Runs with the table
+// held as for a write, for the whole load.
+static char *load_command(HashTable *ht, char **tokens, int num_tokens) {
+    LoadFormat format = LOAD_AUTO;
+    int unique = 0;
+    char path[1024];
+    LoadResult result;
+
+    if (!g_config || !g_config->load_dir) {
+        return str_duplicate("ERROR: LOAD is disabled (start with --load-dir <dir>)");
+    }
+    if (cluster_enabled()) {
+        return str_duplicate("ERROR: LOAD is not available in cluster mode");
+    }
+    if (num_tokens < 2) {
+        return str_duplicate("ERROR: LOAD takes path [CSV|NDJSON|RESP] [UNIQUE]");
+    }
+    for (int i = 2; i < num_tokens; i++) {
+        if (strcasecmp(tokens[i], "UNIQUE") == 0) {
+            unique = 1;
+        } else if (load_parse_format(tokens[i], &format) != 0) {
+            return str_duplicate("ERROR: LOAD takes path [CSV|NDJSON|RESP] [UNIQUE]");
+        }
+    }
+    if (tokens[1][0] == '/' || strstr(tokens[1], "..")) {
+        return str_duplicate("ERROR: LOAD path must be relative to the load directory");
+    }
+    if ((size_t)snprintf(path, sizeof(path), "%s/%s", g_config->load_dir, tokens[1]) >=
+        sizeof(path)) {
+        return str_duplicate("ERROR: LOAD path too long");
+    }
+
+    if (load_file(ht, path, format, unique, &result) != 0) {
+        log_error("LOAD %s failed: %s", tokens[1], result.error);
+        char buffer[192];
+        snprintf(buffer, sizeof(buffer), "ERROR: %s", result.error);
+        return str_duplicate(buffer);
+    }
+
+    log_info("LOAD %s -> %zu records (%zu skipped) in %.3fs on %d threads", tokens[1],
+             result.loaded, result.skipped, result.seconds, result.threads);
+    return load_result_json(&result);
+}
+
+// ============================================================================
+// Keys and Value Types
+// ============================================================================
+// Key a command reads or writes, or NULL if it has none. *writes is set if
+// it may change the key, *data_access if it reads or writes the value
+// (TYPE only looks at the entry).
+static const char *command_key(char **tokens, int num_tokens, int *writes, int *data_access) {
+    *writes = 0;
+    *data_access = 1;
+    if (num_tokens < 2) return NULL;
+
+    if (strcasecmp(tokens[0], "GET") == 0) return tokens[1];
+    if (strcasecmp(tokens[0], "SET") == 0 || strcasecmp(tokens[0], "DEL") == 0 ||
+        strcasecmp(tokens[0], "UNLINK") == 0) {
+        *writes = 1;
+        return tokens[1];
+    }
+    if (strcasecmp(tokens[0], "TYPE") == 0) {
+        *data_access = 0;
+        return tokens[1];
+    }
+    const char *key = stream_command_key(tokens, num_tokens, writes);
+    if (!key) key = ts_command_key(tokens, num_tokens, writes);
+    if (!key) key = vset_command_key(tokens, num_tokens, writes);
+    if (!key) key = geo_command_key(tokens, num_tokens, writes);
+    return key ? key : filter_command_key(tokens, num_tokens, writes);
+}
+
+// Commands of the other value types (stream.c, timeseries.c, vector.c,
+// geo.c, filters.c) take any number of arguments, so the line is tokenized
+// again in full.
+// Returns NULL if it is not one of them.
+static char *typed_execute(HashTable *ht, const char *command) {
+    char *copy = str_duplicate(command);
+    if (!copy) return str_duplicate("ERROR: Memory allocation failed");
+
+    // Tokens are separated by at least one character
+    int max_tokens = (int)(strlen(copy) / 2 + 1);
+    char **tokens = (char **)malloc((size_t)max_tokens * sizeof(char *));
+    if (!tokens) {
+        free(copy);
+        return str_duplicate("ERROR: Memory allocation failed");
+    }
+
+    int num_tokens = parse_command(trim_whitespace(copy), tokens, max_tokens);
+    char *response = NULL;
+    if (num_tokens > 0) {
+        response = stream_command(ht, tokens, num_tokens);
+        if (!response) response = ts_command(ht, tokens, num_tokens);
+        if (!response) response = vset_command(ht, tokens, num_tokens);
+        if (!response) response = geo_command(ht, tokens, num_tokens);
+        if (!response) response = filter_command(ht, tokens, num_tokens);
+    }
+
+    free(tokens);
+    free(copy);
+    return response;
+}
+
 // ============================================================================
 // Process Command
 // ============================================================================
-char *process_command(HashTable *ht, const char *command) {
+static char *execute_command(HashTable *ht, const char *command, int asking) {
     if (!ht || !command) {
         return str_duplicate("ERROR: Invalid parameters");
     }
@@ -155,6 +683,27 @@ char *process_command(HashTable *ht, const char *command) {
         *p = toupper((unsigned char)*p);
     }
     
+    // Cluster mode: keys in slots served elsewhere get a redirect instead
+    int writes, data_access;
+    const char *key = command_key(tokens, num_tokens, &writes, &data_access);
+    if (!key && num_tokens >= 3 && strcmp(tokens[0], "MEMORY") == 0 &&
+        strcasecmp(tokens[1], "USAGE") == 0) {
+        key = tokens[2];
+        data_access = 0;
+    }
+    if (key && cluster_enabled()) {
+        char *redirect = cluster_redirect(ht, key, asking);
+        if (redirect) {
+            free(cmd_copy);
+            return redirect;
+        }
+    }
+    
+    // HOTKEYS samples the commands that read or write a key's value
+    if (key && data_access) {
+        keystats_access(ht->db, key);
+    }
+    
     char *response = NULL;
     
     // ========================================================================
@@ -179,6 +728,7 @@ char *process_command(HashTable *ht, const char *command) {
             // p now points to the value
             if (*p) {
                 if (ht_set(ht, tokens[1], p) == 0) {
+                    keystats_write(VALUE_STRING, ht->db, tokens[1], strlen(p));
                     response = str_duplicate("OK");
                     log_info("SET %s = %s", tokens[1], p);
                 } else {
@@ -198,8 +748,11 @@ char *process_command(HashTable *ht, const char *command) {
         if (num_tokens < 2) {
             response = str_duplicate("ERROR: GET requires a key");
         } else {
-            const char *value = ht_get(ht, tokens[1]);
-            if (value) {
+            ValueType type;
+            const char *value = (const char *)ht_lookup(ht, tokens[1], &type);
+            if (value && type != VALUE_STRING) {
+                response = str_duplicate(WRONGTYPE_ERROR);
+            } else if (value) {
                 response = str_duplicate(value);
                 log_info("GET %s -> %s", tokens[1], value);
             } else {
@@ -209,6 +762,19 @@ char *process_command(HashTable *ht, const char *command) {
         }
     }
     // ========================================================================
+    // TYPE key
+    // ========================================================================
+    else if (strcmp(tokens[0], "TYPE") == 0) {
+        ValueType type;
+        if (num_tokens < 2) {
+            response = str_duplicate("ERROR: TYPE requires a key");
+        } else if (ht_lookup(ht, tokens[1], &type)) {
+            response = str_duplicate(keystats_type_name(type));
+        } else {
+            response = str_duplicate("none");
+        }
+    }
+    // ========================================================================
     // DEL key
     // ========================================================================
     else if (strcmp(tokens[0], "DEL") == 0) {
@@ -225,19 +791,168 @@ char *process_command(HashTable *ht, const char *command) {
         }
     }
     // ========================================================================
+    // UNLINK key - DEL that leaves the free to the lazy-free thread
+    // ========================================================================
+    else if (strcmp(tokens[0], "UNLINK") == 0) {
+        if (num_tokens < 2) {
+            response = str_duplicate("ERROR: UNLINK requires a key");
+        } else if (ht_unlink(ht, tokens[1]) == 0) {
+            response = str_duplicate("OK");
+            log_info("UNLINK %s -> OK", tokens[1]);
+        } else {
+            response = str_duplicate("NOT FOUND");
+            log_info("UNLINK %s -> NOT FOUND", tokens[1]);
+        }
+    }
+    // ========================================================================
+    // FLUSHALL [ASYNC|SYNC] - Remove every key in every database
+    // FLUSHDB [ASYNC|SYNC] - Remove every key in the current database
+    // ========================================================================
+    else if (strcmp(tokens[0], "FLUSHALL") == 0 || strcmp(tokens[0], "FLUSHDB") == 0) {
+        int all = strcmp(tokens[0], "FLUSHALL") == 0;
+        int async = num_tokens >= 2 && strcasecmp(tokens[1], "ASYNC") == 0;
+        if (num_tokens >= 2 && !async && strcasecmp(tokens[1], "SYNC") != 0) {
+            char buffer[64];
+            snprintf(buffer, sizeof(buffer), "ERROR: %s takes ASYNC or SYNC", tokens[0]);
+            response = str_duplicate(buffer);
+        } else {
+            // ASYNC swaps in an empty bucket array and hands the old one to
+            // the lazy-free thread, so even a large database goes in O(1)
+            int failed = 0;
+            for (int i = all ? 0 : ht->db; i < (all ? g_num_dbs : ht->db + 1); i++) {
+                if (ht_flush(g_dbs[i], async) != 0) failed = 1;
+            }
+            if (!failed) {
+                response = str_duplicate("OK");
+                log_info("%s%s -> OK", tokens[0], async ? " ASYNC" : "");
+            } else {
+                response = str_duplicate("ERROR: Failed to flush");
+            }
+        }
+    }
+    // ========================================================================
+    // DBSIZE - Keys in the current database
+    // ========================================================================
+    else if (strcmp(tokens[0], "DBSIZE") == 0) {
+        size_t num_keys;
+        char buffer[32];
+        ht_stats(ht, &num_keys, NULL);
+        snprintf(buffer, sizeof(buffer), "%zu", num_keys);
+        response = str_duplicate(buffer);
+        log_info("DBSIZE db%d -> %zu", ht->db, num_keys);
+    }
+    // ========================================================================
     // STATS
     // ========================================================================
     else if (strcmp(tokens[0], "STATS") == 0) {
-        size_t num_keys, memory_bytes;
-        ht_stats(ht, &num_keys, &memory_bytes);
+        size_t num_keys, num_buckets, rehashes = 0;
+        MemoryUsage mu;
+        char *keyspace = keyspace_json(&num_keys, &num_buckets);
+        memory_usage(&mu);
+        for (int i = 0; i < g_num_dbs; i++) rehashes += g_dbs[i]->rehashes;
+        
+        // Whatever the process holds beyond what the engine accounts for:
+        // allocator free space, slab runs not yet reused, code and stacks
+        char frag_bytes[32] = "null", frag_ratio[32] = "null";
+        long long rss_now = rss_bytes();
+        if (rss_now >= 0) {
+            snprintf(frag_bytes, sizeof(frag_bytes), "%lld", rss_now - (long long)mu.total);
+            snprintf(frag_ratio, sizeof(frag_ratio), "%.2f", (double)rss_now / (double)mu.total);
+        }
         
         // Format as JSON
-        char buffer[256];
-        snprintf(buffer, sizeof(buffer), 
-                 "{\"keys\": %zu, \"memory_bytes\": %zu}", 
-                 num_keys, memory_bytes);
+        size_t size = 1024 + (keyspace ? strlen(keyspace) : 0);
+        char *buffer = keyspace ? (char *)malloc(size) : NULL;
+        if (!buffer) {
+            response = str_duplicate("ERROR: Memory allocation failed");
+        } else {
+            snprintf(buffer, size, 
+                     "{\"keys\": %zu, \"buckets\": %zu, \"rehashes\": %zu, \"memory_bytes\": %zu, "
+                     "\"dataset_bytes\": %zu, \"overhead_bytes\": %zu, \"buffer_bytes\": %zu, "
+                     "\"fragmentation_bytes\": %s, \"fragmentation_ratio\": %s, "
+                     "\"lazyfree_pending_bytes\": %zu, \"lazyfree_pending_objects\": %zu, "
+                     "\"lazyfreed_objects\": %zu, "
+                     "\"connected_clients\": %zu, \"output_buffer_bytes\": %zu, "
+                     "\"query_buffer_bytes\": %zu, \"clients_killed\": %zu, "
+                     "\"total_commands_processed\": %zu, \"instantaneous_ops_per_sec\": %zu, "
+                     "\"databases\": %d, \"keyspace\": %s}", 
+                     num_keys, num_buckets, rehashes, mu.total, mu.dataset, mu.overhead, mu.buffers,
+                     frag_bytes, frag_ratio, mu.lazyfree, lazyfree_pending_objects(),
+                     lazyfree_freed_objects(),
+                     __atomic_load_n(&g_connected_clients, __ATOMIC_RELAXED),
+                     __atomic_load_n(&g_output_buffer_bytes, __ATOMIC_RELAXED),
+                     __atomic_load_n(&g_query_buffer_bytes, __ATOMIC_RELAXED),
+                     __atomic_load_n(&g_clients_killed, __ATOMIC_RELAXED),
+                     __atomic_load_n(&g_commands_processed, __ATOMIC_RELAXED),
+                     __atomic_load_n(&g_stats_sampler.ops_per_sec, __ATOMIC_RELAXED),
+                     g_num_dbs, keyspace);
+            response = buffer;
+            log_info("STATS -> keys=%zu, memory=%zu bytes", num_keys, mu.total);
+        }
+        free(keyspace);
+    }
+    // ========================================================================
+    // INFO - Placement and memory backing, with TLB behaviour
+    // ========================================================================
+    else if (strcmp(tokens[0], "INFO") == 0) {
+        char cpus[256] = "";
+        size_t len = 0;
+        for (int i = 0; g_config && i < g_config->num_cpus && len < sizeof(cpus); i++) {
+            len += (size_t)snprintf(cpus + len, sizeof(cpus) - len, "%s%d",
+                                    i ? "," : "", g_config->cpus[i]);
+        }
+
+        // Misses are summed over the threads that could open a counter
+        char misses[64] = "null", per_1k[64] = "null";
+        uint64_t dtlb;
+        if (perf_dtlb_misses(&dtlb) == 0) {
+            size_t commands = __atomic_load_n(&g_commands_processed, __ATOMIC_RELAXED);
+            snprintf(misses, sizeof(misses), "%llu", (unsigned long long)dtlb);
+            if (commands > 0) {
+                snprintf(per_1k, sizeof(per_1k), "%.2f", (double)dtlb * 1000.0 / (double)commands);
+            }
+        }
+
+        // Fragmentation as the OS sees it and as the slabs see it
+        char rss[32] = "null", mem_ratio[32] = "null", alloc_ratio[32] = "null";
+        long long rss_now = rss_bytes();
+        size_t resident = 0, used = 0, waste;
+        MemoryUsage mu;
+        memory_usage(&mu);
+        if (rss_now >= 0) {
+            snprintf(rss, sizeof(rss), "%lld", rss_now);
+            snprintf(mem_ratio, sizeof(mem_ratio), "%.2f", (double)rss_now / (double)mu.total);
+        }
+        if (ht_alloc_usage(&resident, &used) == 0) {
+            snprintf(alloc_ratio, sizeof(alloc_ratio), "%.2f", defrag_ratio(&waste));
+        }
+        int defrag = g_config && g_config->active_defrag;
+
+        char buffer[2048];
+        snprintf(buffer, sizeof(buffer),
+                 "{\"concurrency\": \"%s\", \"cpu_list\": \"%s\", \"busy_poll_usec\": %d, "
+                 "\"hugepages\": \"%s\", \"page_backing\": \"%s\", "
+                 "\"anon_huge_pages_bytes\": %lld, \"entry_slab_bytes\": %zu, "
+                 "\"dtlb_read_misses\": %s, \"dtlb_misses_per_1k_commands\": %s, "
+                 "\"rss_bytes\": %s, \"mem_fragmentation_ratio\": %s, "
+                 "\"allocator_resident_bytes\": %zu, \"allocator_used_bytes\": %zu, "
+                 "\"allocator_fragmentation_ratio\": %s, \"active_defrag\": %s, "
+                 "\"defrag_threshold\": %.2f, \"defrag_running\": %d, "
+                 "\"defrag_passes\": %zu, \"defrag_moved\": %zu, \"defrag_progress_pct\": %.1f, "
+                 "\"hotkeys_sample_rate\": %u, \"databases\": %d}",
+                 g_config ? concurrency_names[g_config->concurrency] : "global",
+                 cpus, g_config ? g_config->busy_poll : 0,
+                 hugepage_names[page_mode()], page_backing_name(),
+                 anon_huge_pages_bytes(), ht_entry_slab_bytes(), misses, per_1k,
+                 rss, mem_ratio, resident, used, alloc_ratio, defrag ? "true" : "false",
+                 defrag ? g_config->defrag_threshold : 0.0,
+                 __atomic_load_n(&g_defrag.running, __ATOMIC_RELAXED),
+                 g_defrag.passes, g_defrag.moved,
+                 100.0 * ((double)g_defrag.db + (double)g_defrag.cursor /
+                          (double)g_dbs[g_defrag.db]->num_buckets) / (double)g_num_dbs,
+                 keystats_sample_rate(), g_num_dbs);
         response = str_duplicate(buffer);
-        log_info("STATS -> keys=%zu, memory=%zu bytes", num_keys, memory_bytes);
+        log_info("INFO -> backing=%s, dtlb_misses=%s", page_backing_name(), misses);
     }
     // ========================================================================
     // KEYS - List all keys (bonus command)
@@ -306,6 +1021,88 @@ char *process_command(HashTable *ht, const char *command) {
         response = str_duplicate("BYE");
     }
     // ========================================================================
+    // RESERVE count - Size the table for count keys up front
+    // ========================================================================
+    else if (strcmp(tokens[0], "RESERVE") == 0) {
+        size_t count;
+        if (num_tokens < 2 || parse_count(tokens[1], &count) != 0) {
+            response = str_duplicate("ERROR: RESERVE requires a key count");
+        } else if (ht_reserve(ht, count, 1) == 0) {
+            response = str_duplicate("OK");
+            log_info("RESERVE %zu -> %zu buckets", count, ht->num_buckets);
+        } else {
+            response = str_duplicate("ERROR: Failed to reserve capacity");
+        }
+    }
+    // ========================================================================
+    // HOTKEYS [count] | RESET - Most accessed keys, from sampled accesses
+    // BIGKEYS [count] - Largest values per type
+    // ========================================================================
+    else if (strcmp(tokens[0], "HOTKEYS") == 0) {
+        response = hotkeys_command(tokens, num_tokens);
+    }
+    else if (strcmp(tokens[0], "BIGKEYS") == 0) {
+        response = bigkeys_command(tokens, num_tokens);
+    }
+    // ========================================================================
+    // LOAD path [format] [UNIQUE] - Bulk import a file
+    // ========================================================================
+    else if (strcmp(tokens[0], "LOAD") == 0) {
+        response = load_command(ht, tokens, num_tokens);
+    }
+    // ========================================================================
+    // DEBUG POPULATE count [prefix] [size]
+    // ========================================================================
+    else if (strcmp(tokens[0], "DEBUG") == 0) {
+        if (num_tokens >= 2 && strcasecmp(tokens[1], "POPULATE") == 0) {
+            response = debug_populate(ht, tokens, num_tokens);
+        } else {
+            response = str_duplicate("ERROR: DEBUG subcommand must be POPULATE");
+        }
+    }
+    // ========================================================================
+    // MEMORY USAGE key - Bytes held by one key
+    // MEMORY DEFRAG - Run one slice of active defrag now
+    // ========================================================================
+    else if (strcmp(tokens[0], "MEMORY") == 0) {
+        if (num_tokens >= 2 && strcasecmp(tokens[1], "USAGE") == 0) {
+            size_t bytes;
+            if (num_tokens < 3) {
+                response = str_duplicate("ERROR: MEMORY USAGE requires key");
+            } else if (ht_key_memory(ht, tokens[2], &bytes) == 0) {
+                char buffer[32];
+                snprintf(buffer, sizeof(buffer), "%zu", bytes);
+                response = str_duplicate(buffer);
+                log_info("MEMORY USAGE %s -> %zu", tokens[2], bytes);
+            } else {
+                response = str_duplicate("NULL");
+            }
+        } else if (num_tokens >= 2 && strcasecmp(tokens[1], "DEFRAG") == 0) {
+            response = defrag_slice();
+        } else {
+            response = str_duplicate("ERROR: MEMORY subcommand must be USAGE or DEFRAG");
+        }
+    }
+    // ========================================================================
+    // CLUSTER subcommand ...
+    // ========================================================================
+    else if (strcmp(tokens[0], "CLUSTER") == 0) {
+        response = cluster_command(ht, tokens, num_tokens);
+    }
+    // ========================================================================
+    // XADD, XRANGE, XREADGROUP, ... - Streams (see stream.c)
+    // TS.ADD, TS.RANGE, ... - Time series (see timeseries.c)
+    // VADD, VSIM, ... - Vector sets (see vector.c)
+    // GEOADD, GEOSEARCH, ... - Geo sets (see geo.c)
+    // BF.ADD, CF.DEL, ... - Bloom and Cuckoo filters (see filters.c)
+    // ========================================================================
+    else if ((tokens[0][0] == 'X' || tokens[0][0] == 'V' ||
+              strncmp(tokens[0], "TS.", 3) == 0 || strncmp(tokens[0], "GEO", 3) == 0 ||
+              strncmp(tokens[0], "BF.", 3) == 0 || strncmp(tokens[0], "CF.", 3) == 0) &&
+             (response = typed_execute(ht, command)) != NULL) {
+        // Replied
+    }
+    // ========================================================================
     // Unknown command
     // ========================================================================
     else {
@@ -319,179 +1116,1180 @@ char *process_command(HashTable *ht, const char *command) {
     return response;
 }
 
+char *process_command(HashTable *ht, const char *command) {
+    // "ASKING <command>" runs one command against a slot this node is
+    // importing; a redirected client retries with it after an ASK reply
+    const char *p = command;
+    while (p && (*p == ' ' || *p == '\t')) p++;
+    if (p && strncasecmp(p, "ASKING", 6) == 0 && (p[6] == ' ' || p[6] == '\t')) {
+        return execute_command(ht, p + 7, 1);
+    }
+    return execute_command(ht, command, 0);
+}
+
 // ============================================================================
 // Signal Handler
 // ============================================================================
 static void signal_handler(int sig) {
     if (sig == SIGINT || sig == SIGTERM) {
         log_info("Received signal %d, shutting down...", sig);
+        // Event loops wake up periodically and notice the flag
         g_running = 0;
-        
-        // Close server socket to unblock accept()
-        if (g_server_socket >= 0) {
-            close(g_server_socket);
-            g_server_socket = -1;
-        }
     }
 }
 
 // ============================================================================
-// Handle Client Connection
+// Client Connections
 // ============================================================================
-static void handle_client(int client_socket, struct sockaddr_in6 *client_addr) {
-    char buffer[BUFFER_SIZE];
-    char client_ip[INET6_ADDRSTRLEN];
+// Low-latency replies and dead-peer detection for TCP clients
+static void client_tune_tcp(int fd) {
+    int yes = 1;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes)) < 0) {
+        log_error("setsockopt(TCP_NODELAY) failed: %s", strerror(errno));
+    }
 
-    inet_ntop(AF_INET6, &client_addr->sin6_addr, client_ip, INET6_ADDRSTRLEN);
-    log_info("Client connected: %s:%d", client_ip, ntohs(client_addr->sin6_port));
-    
-    while (g_running) {
-        // Clear buffer
-        memset(buffer, 0, BUFFER_SIZE);
-        
-        // Read from client with bounds checking
-        ssize_t bytes_read = recv(client_socket, buffer, BUFFER_SIZE - 1, 0);
-        
-        if (bytes_read < 0) {
-            if (errno == EINTR) continue;
-            log_error("recv() failed: %s", strerror(errno));
-            break;
-        }
-        
-        if (bytes_read == 0) {
-            log_info("Client disconnected: %s:%d", client_ip, ntohs(client_addr->sin6_port));
-            break;
-        }
-        
-        // Null-terminate the buffer (already done by memset, but be explicit)
-        buffer[bytes_read] = '\0';
-        
-        // Process command
-        char *response = process_command(g_hash_table, buffer);
-        
-        if (response) {
-            // Send response with newline
-            size_t response_len = strlen(response);
-            char *response_with_newline = (char *)malloc(response_len + 2);
-            
-            if (response_with_newline) {
-                strcpy(response_with_newline, response);
-                response_with_newline[response_len] = '\n';
-                response_with_newline[response_len + 1] = '\0';
-                
-                ssize_t bytes_sent = send(client_socket, response_with_newline, 
-                                          response_len + 1, 0);
-                
-                if (bytes_sent < 0) {
-                    log_error("send() failed: %s", strerror(errno));
-                }
-                
-                free(response_with_newline);
-            }
-            
-            // Check if client wants to quit
-            if (strcmp(response, "BYE") == 0) {
-                free(response);
-                break;
-            }
-            
-            free(response);
+#if defined(__linux__) && defined(SO_BUSY_POLL)
+    // Spin on the NIC queue for this long before sleeping in a blocking read
+    int busy = g_config ? g_config->busy_poll : 0;
+    if (busy > 0 && setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busy, sizeof(busy)) < 0) {
+        static int warned = 0;
+        if (!__atomic_exchange_n(&warned, 1, __ATOMIC_RELAXED)) {
+            log_error("setsockopt(SO_BUSY_POLL) failed: %s", strerror(errno));
         }
     }
-    
-    close(client_socket);
-}
+#endif
 
-// ============================================================================
-// Start Server
-// ============================================================================
-int server_start(int port) {
-    struct sockaddr_in6 server_addr, client_addr;
-    socklen_t client_len = sizeof(client_addr);
+    int idle = g_config ? g_config->tcp_keepalive : 0;
+    if (idle <= 0) return;
 
-    // Create IPv6 socket (supports both IPv4 and IPv6)
-    g_server_socket = socket(AF_INET6, SOCK_STREAM, 0);
-    if (g_server_socket < 0) {
-        log_error("Failed to create socket: %s", strerror(errno));
-        return -1;
+    if (setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &yes, sizeof(yes)) < 0) {
+        log_error("setsockopt(SO_KEEPALIVE) failed: %s", strerror(errno));
+        return;
     }
 
-    // Set socket options (allow address reuse)
-    int opt = 1;
-    if (setsockopt(g_server_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        log_error("setsockopt() failed: %s", strerror(errno));
-        close(g_server_socket);
-        return -1;
-    }
+#ifdef __linux__
+    // Probe after `idle` seconds, then every idle/3 seconds, three times
+    int interval = idle / 3 > 0 ? idle / 3 : 1;
+    int count = 3;
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+#elif defined(TCP_KEEPALIVE)
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPALIVE, &idle, sizeof(idle));
+#endif
+}
 
-    // Allow both IPv4 and IPv6 connections (dual-stack)
-    int no = 0;
-    if (setsockopt(g_server_socket, IPPROTO_IPV6, IPV6_V6ONLY, &no, sizeof(no)) < 0) {
-        log_info("Note: Could not enable dual-stack mode, IPv6 only");
+Client *client_create(int fd) {
+    Client *c = (Client *)calloc(1, sizeof(Client));
+    if (!c) {
+        log_error("Failed to allocate client");
+        return NULL;
     }
+    c->fd = fd;
 
-    // Configure server address (IPv6)
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin6_family = AF_INET6;
-    server_addr.sin6_addr = in6addr_any;
-    server_addr.sin6_port = htons(port);
+    struct sockaddr_storage storage;
+    struct sockaddr_in6 *addr = (struct sockaddr_in6 *)&storage;
+    socklen_t addr_len = sizeof(storage);
+    char client_ip[INET6_ADDRSTRLEN];
 
-    // Bind socket
-    if (bind(g_server_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+    if (getpeername(fd, (struct sockaddr *)&storage, &addr_len) != 0) {
+        snprintf(c->addr, sizeof(c->addr), "fd:%d", fd);
+    } else if (storage.ss_family == AF_INET6) {
+        inet_ntop(AF_INET6, &addr->sin6_addr, client_ip, INET6_ADDRSTRLEN);
+        snprintf(c->addr, sizeof(c->addr), "%s:%d", client_ip, ntohs(addr->sin6_port));
+        client_tune_tcp(fd);
+    } else if (storage.ss_family == AF_UNIX) {
+        snprintf(c->addr, sizeof(c->addr), "unix:%d", fd);
+    } else {
+        snprintf(c->addr, sizeof(c->addr), "fd:%d", fd);
+    }
+
+    __atomic_add_fetch(&g_connected_clients, 1, __ATOMIC_RELAXED);
+    log_info("Client connected: %s", c->addr);
+    return c;
+}
+
+void client_free(Client *c) {
+    if (!c) return;
+
+    log_info("Client disconnected: %s", c->addr);
+    close(c->fd);
+
+    ReplyBlock *b = c->reply_head;
+    while (b) {
+        ReplyBlock *next = b->next;
+        free(b);
+        b = next;
+    }
+
+    __atomic_sub_fetch(&g_output_buffer_bytes, c->reply_bytes, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&g_query_buffer_bytes, alloc_usable_size(c->query_buf, c->query_cap),
+                       __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&g_connected_clients, 1, __ATOMIC_RELAXED);
+
+    free(c->query_buf);
+    free(c);
+}
+
+int client_has_pending_reply(const Client *c) {
+    return c->reply_head != NULL;
+}
+
+static int client_below_soft_limit(const Client *c) {
+    size_t soft = g_config ? g_config->output_limits[c->client_class].soft : 0;
+    return soft == 0 || c->reply_bytes < soft;
+}
+
+int client_can_read(const Client *c) {
+    if (c->closing || c->killed || c->input_eof) return 0;
+    return client_below_soft_limit(c);
+}
+
+// Disconnect clients whose queued output grew past the hard limit
+static void client_check_hard_limit(Client *c) {
+    size_t hard = g_config ? g_config->output_limits[c->client_class].hard : 0;
+
+    if (hard > 0 && c->reply_bytes > hard && !c->killed) {
+        c->killed = 1;
+        __atomic_add_fetch(&g_clients_killed, 1, __ATOMIC_RELAXED);
+        log_info("Client %s exceeded %s output buffer hard limit (%zu > %zu bytes), closing",
+                 c->addr, client_class_names[c->client_class], c->reply_bytes, hard);
+    }
+}
+
+static void client_account_block(Client *c, ReplyBlock *b, int sign) {
+    size_t bytes = alloc_usable_size(b, sizeof(ReplyBlock) + b->cap);
+
+    if (sign > 0) {
+        c->reply_bytes += bytes;
+        __atomic_add_fetch(&g_output_buffer_bytes, bytes, __ATOMIC_RELAXED);
+    } else {
+        c->reply_bytes -= bytes;
+        __atomic_sub_fetch(&g_output_buffer_bytes, bytes, __ATOMIC_RELAXED);
+    }
+}
+
+// Append bytes to the output queue, reusing the tail block when possible
+static int client_reply_append(Client *c, const char *data, size_t len) {
+    ReplyBlock *tail = c->reply_tail;
+
+    if (tail && !tail->inflight && tail->cap - tail->len >= len) {
+        memcpy(tail->data + tail->len, data, len);
+        tail->len += len;
+        return 0;
+    }
+
+    size_t cap = len > REPLY_BLOCK_SIZE ? len : REPLY_BLOCK_SIZE;
+    ReplyBlock *b = (ReplyBlock *)malloc(sizeof(ReplyBlock) + cap);
+    if (!b) return -1;
+
+    b->next = NULL;
+    b->len = len;
+    b->sent = 0;
+    b->cap = cap;
+    b->inflight = 0;
+    memcpy(b->data, data, len);
+
+    if (tail) tail->next = b;
+    else c->reply_head = b;
+    c->reply_tail = b;
+
+    client_account_block(c, b, 1);
+    client_check_hard_limit(c);
+    return 0;
+}
+
+// Queue a reply line (response + newline)
+static int client_reply_line(Client *c, const char *response) {
+    if (client_reply_append(c, response, strlen(response)) != 0) return -1;
+    return client_reply_append(c, "\n", 1);
+}
+
+void client_reply_consume(Client *c, size_t n) {
+    while (n > 0 && c->reply_head) {
+        ReplyBlock *b = c->reply_head;
+        size_t left = b->len - b->sent;
+
+        if (n < left) {
+            b->sent += n;
+            return;
+        }
+
+        n -= left;
+        c->reply_head = b->next;
+        if (!c->reply_head) c->reply_tail = NULL;
+        client_account_block(c, b, -1);
+        free(b);
+    }
+}
+
+// Returns 1 if the command line starts with the given command name
+static int command_is(const char *line, const char *name) {
+    size_t len = strlen(name);
+    while (*line == ' ' || *line == '\t') line++;
+    return strncasecmp(line, name, len) == 0 &&
+           (line[len] == ' ' || line[len] == '\t' || line[len] == '\r' || line[len] == '\n' ||
+            line[len] == '\0');
+}
+
+// Commands that read or write every database rather than the client's
+static int command_spans_dbs(char **tokens, int num_tokens) {
+    if (num_tokens < 1) return 0;
+    return strcasecmp(tokens[0], "FLUSHALL") == 0 || strcasecmp(tokens[0], "STATS") == 0 ||
+           strcasecmp(tokens[0], "INFO") == 0 || strcasecmp(tokens[0], "BIGKEYS") == 0 ||
+           (num_tokens == 2 && strcasecmp(tokens[0], "MEMORY") == 0 &&
+            strcasecmp(tokens[1], "DEFRAG") == 0);
+}
+
+// Execute a command on ht under the striped locks: single-key commands
+// lock the key's stripe, anything else locks the whole table, or every
+// table, in database order, if it spans them
+static char *execute_striped(HashTable *ht, const char *line) {
+    char *copy = str_duplicate(line);
+    if (!copy) return NULL;
+
+    // Tokenize exactly as process_command() will, so both agree on the key
+    char *tokens[10];
+    int num_tokens = parse_command(trim_whitespace(copy), tokens, 10);
+    int writes, data_access;
+    const char *key = command_key(tokens, num_tokens, &writes, &data_access);
+    int read_only = !writes;
+    char *response;
+
+    if (key) {
+        size_t stripe = ht_stripe(ht, key);
+        ht_stripe_lock(ht, stripe, !read_only);
+        size_t entries = __atomic_load_n(&ht->num_entries, __ATOMIC_RELAXED);
+        response = process_command(ht, line);
+        // Only a command that removed keys may shrink the table, so inserts
+        // never undo a reservation
+        int removed = __atomic_load_n(&ht->num_entries, __ATOMIC_RELAXED) < entries;
+        int grow = !read_only && ht_needs_resize(ht);
+        int shrink = !read_only && removed && ht_needs_shrink(ht);
+        ht_stripe_unlock(ht, stripe);
+
+        // Resizing needs every stripe, so it runs after the key's is released
+        if (grow || shrink) {
+            ht_lock_all(ht, 1);
+            if ((grow ? ht_maybe_resize(ht) : ht_maybe_shrink(ht)) != 0) {
+                log_error("Failed to resize hash table");
+            }
+            ht_unlock_all(ht);
+        }
+    } else if (command_spans_dbs(tokens, num_tokens)) {
+        for (int i = 0; i < g_num_dbs; i++) ht_lock_all(g_dbs[i], 1);
+        response = process_command(ht, line);
+        for (int i = g_num_dbs - 1; i >= 0; i--) ht_unlock_all(g_dbs[i]);
+    } else {
+        ht_lock_all(ht, 1);
+        response = process_command(ht, line);
+        ht_unlock_all(ht);
+    }
+
+    free(copy);
+    return response;
+}
+
+// SELECT index - Switch the client to another database. The choice is
+// connection state, so it is made here on the I/O thread and never reaches
+// the table or the executor.
+static char *select_command(Client *c, const char *line) {
+    char *copy = str_duplicate(line);
+    if (!copy) return NULL;
+
+    char *tokens[3];
+    int num_tokens = parse_command(trim_whitespace(copy), tokens, 3);
+    size_t db;
+    char buffer[64];
+
+    if (num_tokens != 2 || parse_count(tokens[1], &db) != 0) {
+        snprintf(buffer, sizeof(buffer), "ERROR: SELECT requires a database index");
+    } else if (db >= (size_t)g_num_dbs) {
+        snprintf(buffer, sizeof(buffer), "ERROR: Database index out of range (0-%d)",
+                 g_num_dbs - 1);
+    } else if (db != 0 && cluster_enabled()) {
+        snprintf(buffer, sizeof(buffer), "ERROR: SELECT is not allowed in cluster mode");
+    } else {
+        c->db = (int)db;
+        snprintf(buffer, sizeof(buffer), "OK");
+        log_info("SELECT %zu -> OK (%s)", db, c->addr);
+    }
+
+    free(copy);
+    return str_duplicate(buffer);
+}
+
+// Execute one command line and queue its reply
+// Returns 1 if the client asked to quit, -1 on allocation failure
+static int client_execute(Client *c, char *line) {
+    HashTable *ht = g_dbs[c->db];
+    char *response;
+
+    if (command_is(line, "SELECT")) {
+        response = select_command(c, line);
+    } else if (g_config->concurrency == CONCURRENCY_EPOCH && command_is(line, "GET")) {
+        // GET only reads the table and may skip the engine lock. The reply
+        // is a copy, so nothing outlives the critical section.
+        epoch_enter();
+        response = process_command(ht, line);
+        epoch_exit();
+    } else {
+        // A VSIM searches after the table locks are released, so a long
+        // search holds up no other key
+        vset_defer_begin();
+        if (g_config->concurrency == CONCURRENCY_STRIPED) {
+            response = execute_striped(ht, line);
+        } else {
+            pthread_mutex_lock(&g_engine_lock);
+            response = process_command(ht, line);
+            pthread_mutex_unlock(&g_engine_lock);
+        }
+        response = vset_defer_end(response);
+    }
+    __atomic_add_fetch(&g_commands_processed, 1, __ATOMIC_RELAXED);
+    if (!response) return -1;
+
+    int rc = client_reply_line(c, response) == 0 ? 0 : -1;
+    if (rc == 0 && strcmp(response, "BYE") == 0) rc = 1;
+
+    free(response);
+    return rc;
+}
+
+// Executor mode: runs on the executor thread, which owns every table; ctx
+// is the submitting client's database
+static char *exec_command(void *ctx, const char *line) {
+    char *response = process_command((HashTable *)ctx, line);
+    __atomic_add_fetch(&g_commands_processed, 1, __ATOMIC_RELAXED);
+    return response;
+}
+
+// Executor mode: queue one reply on the I/O thread
+static int exec_reply(void *arg, size_t index, const char *reply) {
+    Client *c = (Client *)arg;
+    (void)index;
+
+    if (client_reply_line(c, reply) != 0) return -1;
+    if (strcmp(reply, "BYE") == 0) c->closing = 1;
+    return 0;
+}
+
+// Keep the reply of a command the server issued itself
+static int exec_keep_reply(void *arg, size_t index, const char *reply) {
+    (void)index;
+    *(char **)arg = str_duplicate(reply);
+    return *(char **)arg ? 0 : -1;
+}
+
+// Run a command on behalf of the server (timers) against database 0,
+// locked exactly as a client's command would be. Returns the malloc'd
+// reply, or NULL
+static char *execute_internal(const char *line) {
+    HashTable *ht = g_dbs[0];
+    char *response = NULL;
+
+    if (g_config->concurrency == CONCURRENCY_EXECUTOR) {
+        // Timers run on a worker, which is bound to an executor channel
+        char *lines[1] = { (char *)line };
+        if (exec_submit(ht, lines, 1, exec_keep_reply, &response) != 0) {
+            free(response);
+            response = NULL;
+        }
+    } else if (g_config->concurrency == CONCURRENCY_STRIPED) {
+        response = execute_striped(ht, line);
+    } else {
+        pthread_mutex_lock(&g_engine_lock);
+        response = process_command(ht, line);
+        pthread_mutex_unlock(&g_engine_lock);
+    }
+    return response;
+}
+
+// Frame up to EXEC_BATCH lines starting at *start and run them on the
+// executor thread. A QUIT ends the batch so nothing after it executes, and
+// a batch stops short of a SELECT, which then runs on its own: every line
+// of a batch runs against the same database.
+// Returns 0 on success, -1 on failure
+static int client_execute_batch(Client *c, size_t *start) {
+    char *lines[EXEC_BATCH];
+    size_t count = 0;
+    char *nl;
+
+    while (count < EXEC_BATCH &&
+           (nl = memchr(c->query_buf + *start, '\n', c->query_len - *start)) != NULL) {
+        if (command_is(c->query_buf + *start, "SELECT")) {
+            if (count > 0) break;
+            *nl = '\0';
+            char *line = c->query_buf + *start;
+            *start = (size_t)(nl - c->query_buf) + 1;
+            return client_execute(c, line) < 0 ? -1 : 0;
+        }
+        *nl = '\0';
+        lines[count++] = c->query_buf + *start;
+        *start = (size_t)(nl - c->query_buf) + 1;
+        if (command_is(lines[count - 1], "QUIT")) break;
+    }
+
+    return exec_submit(g_dbs[c->db], lines, count, exec_reply, c);
+}
+
+int client_feed(Client *c, const char *data, size_t len) {
+    if (c->closing) return 0;
+
+    // Grow the query buffer to hold the new bytes plus a terminator
+    if (c->query_len + len + 1 > c->query_cap) {
+        size_t cap = c->query_cap ? c->query_cap : BUFFER_SIZE;
+        while (cap < c->query_len + len + 1) cap *= 2;
+
+        size_t old_bytes = alloc_usable_size(c->query_buf, c->query_cap);
+        char *buf = (char *)realloc(c->query_buf, cap);
+        if (!buf) {
+            log_error("Failed to grow query buffer for %s", c->addr);
+            return -1;
+        }
+        __atomic_add_fetch(&g_query_buffer_bytes, alloc_usable_size(buf, cap) - old_bytes,
+                           __ATOMIC_RELAXED);
+        c->query_buf = buf;
+        c->query_cap = cap;
+    }
+
+    memcpy(c->query_buf + c->query_len, data, len);
+    c->query_len += len;
+
+    return client_process_input(c);
+}
+
+int client_has_pending_input(const Client *c) {
+    return !c->closing && (c->query_len > 0 || c->input_eof) &&
+           client_below_soft_limit(c);
+}
+
+int client_process_input(Client *c) {
+    if (c->closing) return 0;
+
+    // Execute complete lines (commands are newline-terminated) until the
+    // input runs out or queued output crosses the soft limit
+    size_t start = 0;
+    char *nl;
+    while (!c->closing && client_below_soft_limit(c) &&
+           (nl = memchr(c->query_buf + start, '\n', c->query_len - start)) != NULL) {
+        if (g_config->concurrency == CONCURRENCY_EXECUTOR) {
+            if (client_execute_batch(c, &start) != 0 || c->killed) return -1;
+            continue;
+        }
+
+        *nl = '\0';
+        int rc = client_execute(c, c->query_buf + start);
+        start = (size_t)(nl - c->query_buf) + 1;
+
+        if (rc < 0 || c->killed) return -1;
+        if (rc == 1) c->closing = 1;
+    }
+
+    if (c->closing) {
+        c->query_len = 0;
+        return 0;
+    }
+
+    // Keep the unprocessed remainder for later
+    c->query_len -= start;
+    memmove(c->query_buf, c->query_buf + start, c->query_len);
+
+    int has_line = memchr(c->query_buf, '\n', c->query_len) != NULL;
+
+    if (!has_line && c->query_len > MAX_QUERY_SIZE) {
+        log_error("Command from %s exceeds %d bytes, closing", c->addr, MAX_QUERY_SIZE);
+        c->query_len = 0;
+        c->closing = 1;
+        return client_reply_line(c, "ERROR: Command too long");
+    }
+
+    // Peer finished sending and every complete line has run: clients such
+    // as `printf PING | nc` omit the final newline
+    if (c->input_eof && !has_line) {
+        c->closing = 1;
+        if (c->query_len > 0) {
+            c->query_buf[c->query_len] = '\0';
+            c->query_len = 0;
+            if (g_config->concurrency == CONCURRENCY_EXECUTOR &&
+                !command_is(c->query_buf, "SELECT")) {
+                char *line = c->query_buf;
+                if (exec_submit(g_dbs[c->db], &line, 1, exec_reply, c) != 0) return -1;
+            } else if (client_execute(c, c->query_buf) < 0) {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+void client_eof(Client *c) {
+    if (c->closing || c->input_eof) return;
+    c->input_eof = 1;
+    client_process_input(c);
+}
+
+// ============================================================================
+// Start Server
+// ============================================================================
+typedef struct Worker {
+    int id;
+    int listen_fd;
+    EventLoop *el;
+    const ServerConfig *config;
+    pthread_t thread;
+} Worker;
+
+// Warn when the kernel silently caps the requested backlog
+static void check_backlog(int backlog) {
+#ifdef __linux__
+    FILE *f = fopen("/proc/sys/net/core/somaxconn", "r");
+    int somaxconn = 0;
+
+    if (!f) return;
+    if (fscanf(f, "%d", &somaxconn) == 1 && somaxconn < backlog) {
+        log_info("Note: backlog %d is capped by net.core.somaxconn=%d", backlog, somaxconn);
+    }
+    fclose(f);
+#else
+    (void)backlog;
+#endif
+}
+
+static int create_listener(const ServerConfig *config, int reuseport) {
+    struct sockaddr_in6 server_addr;
+
+    // Create IPv6 socket (supports both IPv4 and IPv6)
+    int fd = socket(AF_INET6, SOCK_STREAM, 0);
+    if (fd < 0) {
+        log_error("Failed to create socket: %s", strerror(errno));
+        return -1;
+    }
+
+    // Set socket options (allow address reuse)
+    int opt = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+        log_error("setsockopt() failed: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    // One listener per worker: the kernel spreads incoming connections
+    // across the group instead of all threads contending on one queue
+    if (reuseport &&
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        log_error("setsockopt(SO_REUSEPORT) failed: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    // Allow both IPv4 and IPv6 connections (dual-stack)
+    int no = 0;
+    if (setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &no, sizeof(no)) < 0) {
+        log_info("Note: Could not enable dual-stack mode, IPv6 only");
+    }
+
+    // Configure server address (IPv6)
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin6_family = AF_INET6;
+    server_addr.sin6_addr = in6addr_any;
+    server_addr.sin6_port = htons(config->port);
+
+    // Bind socket
+    if (bind(fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
         log_error("bind() failed: %s", strerror(errno));
-        close(g_server_socket);
+        close(fd);
         return -1;
     }
     
     // Listen for connections
-    if (listen(g_server_socket, 10) < 0) {
+    if (listen(fd, config->backlog) < 0) {
         log_error("listen() failed: %s", strerror(errno));
-        close(g_server_socket);
+        close(fd);
         return -1;
     }
+
+    return fd;
+}
+
+// Listen on a Unix domain socket for co-located clients (no TCP/IP stack)
+static int create_unix_listener(const ServerConfig *config) {
+    struct sockaddr_un addr;
+
+    if (strlen(config->unix_socket) >= sizeof(addr.sun_path)) {
+        log_error("Unix socket path too long: %s", config->unix_socket);
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        log_error("Failed to create Unix socket: %s", strerror(errno));
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, config->unix_socket);
+
+    // Remove a stale socket file left by a previous run
+    unlink(config->unix_socket);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        log_error("bind(%s) failed: %s", config->unix_socket, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    if (listen(fd, config->backlog) < 0) {
+        log_error("listen() failed: %s", strerror(errno));
+        close(fd);
+        unlink(config->unix_socket);
+        return -1;
+    }
+
+    return fd;
+}
+
+// Attach a classic BPF program to the reuseport group that returns
+// (receiving CPU % workers), so a connection is accepted by the worker
+// pinned to the CPU that processed its packets
+static int attach_cpu_steering(int fd, int workers) {
+#ifdef __linux__
+    struct sock_filter code[] = {
+        { BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU) },
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)workers },
+        { BPF_RET | BPF_A, 0, 0, 0 },
+    };
+    struct sock_fprog prog = { sizeof(code) / sizeof(code[0]), code };
+
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0) {
+        log_error("SO_ATTACH_REUSEPORT_CBPF failed: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+#else
+    (void)fd;
+    (void)workers;
+    log_error("Reuseport CPU steering is only supported on Linux");
+    return -1;
+#endif
+}
+
+// Periodic job: turn the command counter into a smoothed ops/sec figure
+static void stats_sample(TimerWheel *tw, Timer *t) {
+    uint64_t now = tw_now_ms();
+    size_t commands = __atomic_load_n(&g_commands_processed, __ATOMIC_RELAXED);
+    uint64_t elapsed = now - g_stats_sampler.last_ms;
+
+    if (elapsed > 0) {
+        size_t ops = (size_t)((commands - g_stats_sampler.last_commands) * 1000 / elapsed);
+        g_stats_sampler.samples[g_stats_sampler.index] = ops;
+        g_stats_sampler.index = (g_stats_sampler.index + 1) % STATS_SAMPLES;
+
+        size_t sum = 0;
+        for (int i = 0; i < STATS_SAMPLES; i++) sum += g_stats_sampler.samples[i];
+        __atomic_store_n(&g_stats_sampler.ops_per_sec, sum / STATS_SAMPLES, __ATOMIC_RELAXED);
+    }
+
+    g_stats_sampler.last_ms = now;
+    g_stats_sampler.last_commands = commands;
+    tw_add(tw, t, STATS_SAMPLE_INTERVAL_MS);
+}
+
+// Periodic job: free memory retired by writes that have gone quiet
+static void epoch_reclaim_job(TimerWheel *tw, Timer *t) {
+    pthread_mutex_lock(&g_engine_lock);
+    epoch_reclaim();
+    pthread_mutex_unlock(&g_engine_lock);
+    tw_add(tw, t, EPOCH_RECLAIM_INTERVAL_MS);
+}
+
+// Periodic job: start a defrag pass once fragmentation has built up past
+// what the last pass left behind, and run the pass a slice at a time
+static void defrag_job(TimerWheel *tw, Timer *t) {
+    size_t waste;
+    double ratio = defrag_ratio(&waste);
+
+    if (!__atomic_load_n(&g_defrag.running, __ATOMIC_RELAXED) &&
+        ratio > g_config->defrag_threshold &&
+        waste > __atomic_load_n(&g_defrag.floor, __ATOMIC_RELAXED) + DEFRAG_MIN_WASTE) {
+        log_info("Starting defrag: fragmentation %.2f, %zu bytes wasted", ratio, waste);
+        __atomic_store_n(&g_defrag.running, 1, __ATOMIC_RELAXED);
+    }
+
+    if (__atomic_load_n(&g_defrag.running, __ATOMIC_RELAXED)) {
+        char *reply = execute_internal("MEMORY DEFRAG");
+        if (!reply) log_error("Defrag slice failed");
+        free(reply);
+    }
+    tw_add(tw, t, DEFRAG_INTERVAL_MS);
+}
+
+// Pin the calling thread to its --cpu-list entry
+static void pin_to_cpu_list(const ServerConfig *config, int index, const char *name) {
+    int cpu = config->cpus[index % config->num_cpus];
+    if (numa_bind_thread(cpu) != 0) {
+        log_error("%s: pinning to CPU %d failed: %s", name, cpu, strerror(errno));
+    } else {
+        log_info("%s pinned to CPU %d", name, cpu);
+    }
+}
+
+static void *worker_main(void *arg) {
+    Worker *w = (Worker *)arg;
+
+#ifdef __linux__
+    if (w->config->num_cpus > 0) {
+        char name[32];
+        snprintf(name, sizeof(name), "Worker %d", w->id);
+        pin_to_cpu_list(w->config, w->id, name);
+    } else if (w->config->numa) {
+        // CPU steering needs worker i on CPU i: connections are then served
+        // on the node whose NIC queue received them. Otherwise spread the
+        // workers evenly over the nodes.
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        int cpu = w->config->reuseport_bpf ? (ncpu > 0 ? (int)(w->id % ncpu) : 0)
+                                           : numa_worker_cpu(w->id);
+        if (numa_bind_thread(cpu) != 0) {
+            log_error("Worker %d: NUMA binding to CPU %d failed: %s", w->id, cpu,
+                      strerror(errno));
+        } else {
+            log_info("Worker %d pinned to CPU %d (node %d)", w->id, cpu, numa_cpu_node(cpu));
+        }
+    } else if (w->config->reuseport_bpf) {
+        // With CPU steering, worker i serves connections received on CPU i
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(ncpu > 0 ? w->id % ncpu : 0, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            log_error("Worker %d: sched_setaffinity() failed: %s", w->id, strerror(errno));
+        }
+    }
+#endif
+
+    // After pinning, so the counter follows the thread's final placement
+    perf_thread_start();
+
+    // Executor mode: this thread only does I/O
+    if (w->config->concurrency == CONCURRENCY_EXECUTOR) exec_bind_thread(w->id);
+    el_run(w->el, &g_running);
+    exec_unbind_thread();
+    return NULL;
+}
+
+int server_start(const ServerConfig *config) {
+    g_config = config;
+
+    int num_workers = config->threads > 0 ? config->threads : 1;
+    int started = 0;
+    int unix_fd = -1;
+    int result = -1;
+
+    Worker *workers = (Worker *)calloc(num_workers, sizeof(Worker));
+    if (!workers) {
+        log_error("Failed to allocate workers");
+        return -1;
+    }
+
+    for (int i = 0; i < num_workers; i++) {
+        workers[i].listen_fd = -1;
+    }
+
+    check_backlog(config->backlog);
+
+    if (config->concurrency == CONCURRENCY_EXECUTOR && exec_init(num_workers) != 0) {
+        log_error("Failed to create executor channels");
+        free(workers);
+        return -1;
+    }
+
+    // Listeners are created in worker order so the steering program's
+    // return value maps onto the same worker index
+    for (int i = 0; i < num_workers; i++) {
+        workers[i].id = i;
+        workers[i].config = config;
+        workers[i].listen_fd = create_listener(config, num_workers > 1);
+        if (workers[i].listen_fd < 0) goto cleanup;
+
+        workers[i].el = el_create(config->io_backend);
+        if (!workers[i].el) {
+            log_error("Failed to create event loop");
+            goto cleanup;
+        }
+
+        if (el_add_listener(workers[i].el, workers[i].listen_fd) != 0) {
+            log_error("Failed to register listener: %s", strerror(errno));
+            goto cleanup;
+        }
+        el_set_idle_timeout(workers[i].el, config->idle_timeout);
+    }
+
+    g_stats_sampler.last_ms = tw_now_ms();
+    tw_init_timer(&g_stats_sampler.timer, stats_sample, NULL);
+    tw_add(el_timers(workers[0].el), &g_stats_sampler.timer, STATS_SAMPLE_INTERVAL_MS);
+
+    if (config->concurrency == CONCURRENCY_EPOCH) {
+        tw_init_timer(&g_epoch_reclaimer, epoch_reclaim_job, NULL);
+        tw_add(el_timers(workers[0].el), &g_epoch_reclaimer, EPOCH_RECLAIM_INTERVAL_MS);
+    }
+
+    if (config->active_defrag) {
+        tw_init_timer(&g_defrag.timer, defrag_job, NULL);
+        tw_add(el_timers(workers[0].el), &g_defrag.timer, DEFRAG_INTERVAL_MS);
+    }
+
+    // The Unix listener is shared: every worker accepts from it
+    if (config->unix_socket) {
+        unix_fd = create_unix_listener(config);
+        if (unix_fd < 0) goto cleanup;
+
+        for (int i = 0; i < num_workers; i++) {
+            if (el_add_listener(workers[i].el, unix_fd) != 0) {
+                log_error("Failed to register Unix listener: %s", strerror(errno));
+                goto cleanup;
+            }
+        }
+    }
+
+    if (config->reuseport_bpf && num_workers > 1 &&
+        attach_cpu_steering(workers[0].listen_fd, num_workers) != 0) {
+        goto cleanup;
+    }
     
-    log_info("Mini-Redis server started on port %d", port);
+    log_info("Mini-Redis server started on port %d", config->port);
+    log_info("I/O backend: %s, %d worker thread%s, backlog %d",
+             el_backend_name(workers[0].el), num_workers,
+             num_workers == 1 ? "" : "s", config->backlog);
+    if (config->concurrency == CONCURRENCY_EPOCH) {
+        log_info("Concurrency: lock-free GET with epoch-based reclamation");
+    } else if (config->concurrency == CONCURRENCY_STRIPED) {
+        log_info("Concurrency: %d striped reader-writer locks", config->lock_stripes);
+    } else if (config->concurrency == CONCURRENCY_EXECUTOR) {
+        log_info("Concurrency: %d I/O thread%s, commands executed on the main thread",
+                 num_workers, num_workers == 1 ? "" : "s");
+    }
+    if (config->unix_socket) {
+        log_info("Unix socket: %s", config->unix_socket);
+    }
     log_info("Listening for connections...");
     
-    // Accept connections
-    while (g_running) {
-        int client_socket = accept(g_server_socket, 
-                                   (struct sockaddr *)&client_addr, 
-                                   &client_len);
-        
-        if (client_socket < 0) {
-            if (errno == EINTR || !g_running) {
+    if (num_workers == 1 && config->concurrency != CONCURRENCY_EXECUTOR) {
+        worker_main(&workers[0]);
+    } else {
+        for (started = 0; started < num_workers; started++) {
+            if (pthread_create(&workers[started].thread, NULL, worker_main,
+                               &workers[started]) != 0) {
+                log_error("Failed to start worker %d", started);
+                g_running = 0;
                 break;
             }
-            log_error("accept() failed: %s", strerror(errno));
-            continue;
         }
-        
-        // Handle client (single-threaded for MVP)
-        handle_client(client_socket, &client_addr);
+        if (config->concurrency == CONCURRENCY_EXECUTOR) {
+            // The executor takes the --cpu-list entry after the workers'
+            if (config->num_cpus > 0) pin_to_cpu_list(config, num_workers, "Executor");
+            perf_thread_start();
+            exec_run(exec_command, &g_running);
+        }
+        for (int i = 0; i < started; i++) {
+            pthread_join(workers[i].thread, NULL);
+        }
     }
-    
+    result = 0;
+
+cleanup:
     // Cleanup
-    if (g_server_socket >= 0) {
-        close(g_server_socket);
-        g_server_socket = -1;
+    for (int i = 0; i < num_workers; i++) {
+        el_destroy(workers[i].el);
+        if (workers[i].listen_fd >= 0) close(workers[i].listen_fd);
+    }
+    if (unix_fd >= 0) {
+        close(unix_fd);
+        unlink(config->unix_socket);
     }
+    free(workers);
+    exec_destroy();
     
-    return 0;
+    return result;
 }
 
 // ============================================================================
 // Main
 // ============================================================================
+// Parse a byte count with an optional kb/mb/gb suffix ("64mb")
+// Returns -1 on malformed input
+static long long parse_memory_size(const char *str) {
+    char *end;
+    long long value = strtoll(str, &end, 10);
+
+    if (end == str || value < 0) return -1;
+    if (*end == '\0' || strcasecmp(end, "b") == 0) return value;
+    if (strcasecmp(end, "kb") == 0 || strcasecmp(end, "k") == 0) return value << 10;
+    if (strcasecmp(end, "mb") == 0 || strcasecmp(end, "m") == 0) return value << 20;
+    if (strcasecmp(end, "gb") == 0 || strcasecmp(end, "g") == 0) return value << 30;
+    return -1;
+}
+
+static int parse_client_class(const char *name) {
+    for (int i = 0; i < CLIENT_CLASS_COUNT; i++) {
+        if (strcasecmp(name, client_class_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+// Create database index and give it the placement and locking the
+// configuration asks for. Returns 0 on success, -1 on failure (logged).
+static int create_database(const ServerConfig *config, int index) {
+    HashTable *ht = ht_create(INITIAL_BUCKETS);
+    if (!ht) {
+        log_error("Failed to create hash table");
+        return -1;
+    }
+    ht->db = index;
+    g_dbs[index] = ht;
+
+    // Chain nodes packed into 2 MB slabs: a bucket walk touches few pages
+    if (config->hugepages != HUGEPAGES_OFF && ht_enable_entry_slab(ht) != 0) {
+        log_error("Failed to create entry slab");
+        return -1;
+    }
+    if (config->active_defrag && ht_enable_defrag(ht) != 0) {
+        log_error("Failed to create defrag slabs");
+        return -1;
+    }
+    if (config->concurrency == CONCURRENCY_EPOCH && ht_enable_concurrent_reads(ht) != 0) {
+        log_error("Failed to enable lock-free reads");
+        return -1;
+    }
+    // Workers on every node share the table: spread its buckets over them
+    if (config->numa && config->numa_node < 0 && numa_num_nodes() > 1) {
+        ht_enable_numa_interleave(ht);
+    }
+    if (config->concurrency == CONCURRENCY_STRIPED &&
+        ht_enable_striped_locks(ht, (size_t)config->lock_stripes) != 0) {
+        log_error("Failed to create lock stripes");
+        return -1;
+    }
+    return 0;
+}
+
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [port] [options]\n", prog);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --io-backend <name>   auto, io_uring, epoll or poll (default: auto)\n");
+    fprintf(stderr, "  --threads <n>         Worker threads, one SO_REUSEPORT listener each (default: 1)\n");
+    fprintf(stderr, "  --concurrency <mode>  global (one lock), epoch (lock-free GET) or\n");
+    fprintf(stderr, "                        striped (per-stripe RW locks) or executor\n");
+    fprintf(stderr, "                        (workers do I/O, main thread executes)\n");
+    fprintf(stderr, "  --lock-stripes <n>    Stripe count for striped mode, a power of two\n");
+    fprintf(stderr, "                        dividing %d (default: %d)\n",
+            INITIAL_BUCKETS, DEFAULT_LOCK_STRIPES);
+    fprintf(stderr, "  --backlog <n>         Listen backlog per listener (default: %d)\n", DEFAULT_BACKLOG);
+    fprintf(stderr, "  --reuseport-bpf       Steer connections to workers by receiving CPU\n");
+    fprintf(stderr, "  --numa                Pin workers across NUMA nodes with node-local memory\n");
+    fprintf(stderr, "  --numa-node <n>       Bind the process's CPUs and memory to one node\n");
+    fprintf(stderr, "  --cpu-list <list>     Pin worker i to the i-th CPU of a list like 0-3,8\n");
+    fprintf(stderr, "                        (the executor takes the next one)\n");
+    fprintf(stderr, "  --busy-poll <usec>    SO_BUSY_POLL time on client sockets (default: 0)\n");
+    fprintf(stderr, "  --reserve <keys>      Size the table for this many keys at startup\n");
+    fprintf(stderr, "  --load <file>         Bulk load a .csv, .ndjson or .resp file at startup\n");
+    fprintf(stderr, "  --load-dir <dir>      Let clients LOAD files from this directory\n");
+    fprintf(stderr, "  --hotkeys-sample <n>  Count one in n key accesses for HOTKEYS\n");
+    fprintf(stderr, "                        (default: %d, 0 disables)\n", DEFAULT_HOTKEYS_SAMPLE);
+    fprintf(stderr, "  --databases <n>       Logical databases for SELECT (default: %d)\n",
+            DEFAULT_DATABASES);
+    fprintf(stderr, "  --vector-threads <n>  Workers splitting exact VSIM scans (default: %d)\n",
+            DEFAULT_VECTOR_THREADS);
+    fprintf(stderr, "  --hugepages <mode>    Back bucket arrays and entries with 2 MB pages:\n");
+    fprintf(stderr, "                        off, thp (transparent) or explicit (hugetlbfs pool)\n");
+    fprintf(stderr, "  --activedefrag        Keep keys and values in slabs and compact them in\n");
+    fprintf(stderr, "                        the background when they fragment\n");
+    fprintf(stderr, "  --defrag-threshold <ratio>\n");
+    fprintf(stderr, "                        Fragmentation ratio that starts defrag (default: %.1f)\n",
+            DEFAULT_DEFRAG_THRESHOLD);
+    fprintf(stderr, "  --cluster             Serve only the hash slots assigned with CLUSTER SETSLOT\n");
+    fprintf(stderr, "  --cluster-announce <host>\n");
+    fprintf(stderr, "                        Address other nodes and clients reach us at\n");
+    fprintf(stderr, "                        (default: 127.0.0.1)\n");
+    fprintf(stderr, "  --unixsocket <path>   Also listen on a Unix domain socket\n");
+    fprintf(stderr, "  --timeout <seconds>   Close clients idle this long (default: 0, never)\n");
+    fprintf(stderr, "  --tcp-keepalive <s>   TCP keepalive idle time (default: %d, 0 disables)\n",
+            DEFAULT_TCP_KEEPALIVE);
+    fprintf(stderr, "  --client-output-buffer-limit <class> <hard> <soft>\n");
+    fprintf(stderr, "                        Per-class output limits; class is normal (the\n");
+    fprintf(stderr, "                        only one), sizes accept kb/mb/gb, 0 disables\n");
+    fprintf(stderr, "  --help                Show this help message\n");
+}
+
 int main(int argc, char *argv[]) {
-    int port = DEFAULT_PORT;
+    ServerConfig config;
+    memset(&config, 0, sizeof(config));
+    config.port = DEFAULT_PORT;
+    config.backlog = DEFAULT_BACKLOG;
+    config.threads = 1;
+    config.lock_stripes = DEFAULT_LOCK_STRIPES;
+    config.numa_node = -1;
+    config.defrag_threshold = DEFAULT_DEFRAG_THRESHOLD;
+    config.hotkeys_sample = DEFAULT_HOTKEYS_SAMPLE;
+    config.databases = DEFAULT_DATABASES;
+    config.vector_threads = DEFAULT_VECTOR_THREADS;
+    config.io_backend = "auto";
+    config.tcp_keepalive = DEFAULT_TCP_KEEPALIVE;
+    config.output_limits[CLIENT_CLASS_NORMAL].soft = 16 << 20;
+    config.output_limits[CLIENT_CLASS_NORMAL].hard = 0;
     
     // Parse command line arguments
-    if (argc > 1) {
-        port = atoi(argv[1]);
-        if (port <= 0 || port > 65535) {
-            fprintf(stderr, "Invalid port number: %s\n", argv[1]);
-            fprintf(stderr, "Usage: %s [port]\n", argv[0]);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if (strcmp(argv[i], "--io-backend") == 0 && i + 1 < argc) {
+            config.io_backend = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            config.threads = atoi(argv[++i]);
+            if (config.threads < 1 || config.threads > MAX_THREADS) {
+                fprintf(stderr, "Invalid thread count: %s (1-%d)\n", argv[i], MAX_THREADS);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--concurrency") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "global") == 0) {
+                config.concurrency = CONCURRENCY_GLOBAL;
+            } else if (strcmp(argv[i], "epoch") == 0) {
+                config.concurrency = CONCURRENCY_EPOCH;
+            } else if (strcmp(argv[i], "striped") == 0) {
+                config.concurrency = CONCURRENCY_STRIPED;
+            } else if (strcmp(argv[i], "executor") == 0) {
+                config.concurrency = CONCURRENCY_EXECUTOR;
+            } else {
+                fprintf(stderr, "Invalid concurrency mode: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--lock-stripes") == 0 && i + 1 < argc) {
+            config.lock_stripes = atoi(argv[++i]);
+            if (config.lock_stripes < 1 || INITIAL_BUCKETS % config.lock_stripes != 0 ||
+                (config.lock_stripes & (config.lock_stripes - 1)) != 0) {
+                fprintf(stderr, "Invalid lock stripe count: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--backlog") == 0 && i + 1 < argc) {
+            config.backlog = atoi(argv[++i]);
+            if (config.backlog <= 0) {
+                fprintf(stderr, "Invalid backlog: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--reuseport-bpf") == 0) {
+            config.reuseport_bpf = 1;
+        } else if (strcmp(argv[i], "--numa") == 0) {
+            config.numa = 1;
+        } else if (strcmp(argv[i], "--numa-node") == 0 && i + 1 < argc) {
+            config.numa_node = atoi(argv[++i]);
+            if (config.numa_node < 0) {
+                fprintf(stderr, "Invalid NUMA node: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--cpu-list") == 0 && i + 1 < argc) {
+            config.num_cpus = numa_parse_cpulist(argv[++i], config.cpus, MAX_THREADS + 1);
+            if (config.num_cpus <= 0) {
+                fprintf(stderr, "Invalid CPU list: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--busy-poll") == 0 && i + 1 < argc) {
+            config.busy_poll = atoi(argv[++i]);
+            if (config.busy_poll < 0) {
+                fprintf(stderr, "Invalid busy-poll time: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--reserve") == 0 && i + 1 < argc) {
+            if (parse_count(argv[++i], &config.reserve) != 0) {
+                fprintf(stderr, "Invalid reserve count: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+            config.load = argv[++i];
+        } else if (strcmp(argv[i], "--load-dir") == 0 && i + 1 < argc) {
+            config.load_dir = argv[++i];
+        } else if (strcmp(argv[i], "--hotkeys-sample") == 0 && i + 1 < argc) {
+            int rate = atoi(argv[++i]);
+            if (rate < 0 || (rate == 0 && strcmp(argv[i], "0") != 0)) {
+                fprintf(stderr, "Invalid hot key sample rate: %s\n", argv[i]);
+                return 1;
+            }
+            config.hotkeys_sample = (unsigned)rate;
+        } else if (strcmp(argv[i], "--databases") == 0 && i + 1 < argc) {
+            config.databases = atoi(argv[++i]);
+            if (config.databases < 1 || config.databases > MAX_DATABASES) {
+                fprintf(stderr, "Invalid database count: %s (1-%d)\n", argv[i], MAX_DATABASES);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--vector-threads") == 0 && i + 1 < argc) {
+            config.vector_threads = atoi(argv[++i]);
+            if (config.vector_threads < 0 || config.vector_threads > MAX_THREADS ||
+                (config.vector_threads == 0 && strcmp(argv[i], "0") != 0)) {
+                fprintf(stderr, "Invalid vector thread count: %s (0-%d)\n", argv[i], MAX_THREADS);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--hugepages") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "off") == 0) {
+                config.hugepages = HUGEPAGES_OFF;
+            } else if (strcmp(argv[i], "thp") == 0) {
+                config.hugepages = HUGEPAGES_THP;
+            } else if (strcmp(argv[i], "explicit") == 0) {
+                config.hugepages = HUGEPAGES_EXPLICIT;
+            } else {
+                fprintf(stderr, "Invalid huge page mode: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--activedefrag") == 0) {
+            config.active_defrag = 1;
+        } else if (strcmp(argv[i], "--defrag-threshold") == 0 && i + 1 < argc) {
+            config.defrag_threshold = atof(argv[++i]);
+            if (config.defrag_threshold <= 1.0) {
+                fprintf(stderr, "Invalid defrag threshold: %s (must be above 1)\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--cluster") == 0) {
+            config.cluster = 1;
+        } else if (strcmp(argv[i], "--cluster-announce") == 0 && i + 1 < argc) {
+            config.cluster_announce = argv[++i];
+        } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            config.idle_timeout = atoi(argv[++i]);
+            if (config.idle_timeout < 0) {
+                fprintf(stderr, "Invalid timeout: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--tcp-keepalive") == 0 && i + 1 < argc) {
+            config.tcp_keepalive = atoi(argv[++i]);
+            if (config.tcp_keepalive < 0) {
+                fprintf(stderr, "Invalid TCP keepalive: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--unixsocket") == 0 && i + 1 < argc) {
+            config.unix_socket = argv[++i];
+        } else if (strcmp(argv[i], "--client-output-buffer-limit") == 0 && i + 3 < argc) {
+            int cls = parse_client_class(argv[i + 1]);
+            long long hard = parse_memory_size(argv[i + 2]);
+            long long soft = parse_memory_size(argv[i + 3]);
+            if (cls < 0 || hard < 0 || soft < 0) {
+                fprintf(stderr, "Invalid output buffer limit: %s %s %s\n",
+                        argv[i + 1], argv[i + 2], argv[i + 3]);
+                return 1;
+            }
+            config.output_limits[cls].hard = (size_t)hard;
+            config.output_limits[cls].soft = (size_t)soft;
+            i += 3;
+        } else if (argv[i][0] != '-') {
+            config.port = atoi(argv[i]);
+            if (config.port <= 0 || config.port > 65535) {
+                fprintf(stderr, "Invalid port number: %s\n", argv[i]);
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            print_usage(argv[0]);
             return 1;
         }
     }
@@ -501,25 +2299,100 @@ int main(int argc, char *argv[]) {
     signal(SIGTERM, signal_handler);
     signal(SIGPIPE, SIG_IGN);  // Ignore broken pipe
     
-    // Create hash table
-    g_hash_table = ht_create(INITIAL_BUCKETS);
-    if (!g_hash_table) {
-        log_error("Failed to create hash table");
+    // Bind before anything is allocated so the table lands on the node too
+    if (config.numa || config.numa_node >= 0) {
+        int nodes = numa_init();
+        if (config.numa_node >= 0 && numa_bind_process(config.numa_node) != 0) {
+            log_error("Failed to bind to NUMA node %d: %s", config.numa_node, strerror(errno));
+            return 1;
+        }
+        log_info("NUMA: %d node%s%s", nodes, nodes == 1 ? "" : "s",
+                 config.numa_node >= 0 ? ", process bound to one node" : "");
+    }
+
+    page_set_mode(config.hugepages);
+    keystats_set_sample_rate(config.hotkeys_sample);
+
+    // Create one table per database, all set up alike
+    g_dbs = (HashTable **)calloc((size_t)config.databases, sizeof(HashTable *));
+    if (!g_dbs) {
+        log_error("Failed to create databases");
+        return 1;
+    }
+    for (g_num_dbs = 0; g_num_dbs < config.databases; g_num_dbs++) {
+        if (create_database(&config, g_num_dbs) != 0) return 1;
+    }
+    // Allocated once, after the placement and locking choices above
+    if (config.reserve > 0 && ht_reserve(g_dbs[0], config.reserve, 1) != 0) {
+        log_error("Failed to reserve room for %zu keys", config.reserve);
+        return 1;
+    }
+    if (config.cluster &&
+        cluster_init(config.cluster_announce ? config.cluster_announce : "127.0.0.1",
+                     config.port) != 0) {
+        log_error("Invalid cluster address");
+        return 1;
+    }
+    
+    if (lazyfree_start() != 0) {
+        log_error("Failed to start the lazy-free thread");
+        return 1;
+    }
+    const char *vector_kernels = vset_init(config.vector_threads);
+    if (!vector_kernels) {
+        log_error("Failed to start the vector search threads");
         return 1;
     }
     
     log_info("===========================================");
     log_info("  Mini-Redis - In-Memory Key-Value Store  ");
     log_info("===========================================");
-    log_info("Hash table initialized with %d buckets", INITIAL_BUCKETS);
+    log_info("Hash table initialized with %zu buckets, %d databases",
+             g_dbs[0]->num_buckets, g_num_dbs);
+    if (config.hugepages != HUGEPAGES_OFF) {
+        log_info("Huge pages: %s", hugepage_names[config.hugepages]);
+    }
+    if (config.active_defrag) {
+        log_info("Active defrag: above fragmentation %.2f", config.defrag_threshold);
+    }
+    if (config.cluster) {
+        log_info("Cluster mode: %d hash slots, none assigned yet", CLUSTER_SLOTS);
+    }
+    log_info("Vector search: %s kernels, %d scan threads", vector_kernels,
+             config.vector_threads);
+    if (config.load_dir) {
+        log_info("LOAD enabled for files under %s", config.load_dir);
+    }
+    
+    // Bulk load before accepting clients: nobody sees a half-loaded table
+    if (config.load) {
+        LoadResult result;
+        if (config.cluster) {
+            log_error("--load is not available in cluster mode");
+            return 1;
+        }
+        if (load_file(g_dbs[0], config.load, LOAD_AUTO, 0, &result) != 0) {
+            log_error("Failed to load %s: %s", config.load, result.error);
+            return 1;
+        }
+        log_info("Loaded %zu records from %s (%zu skipped, %zu keys) in %.3fs on %d threads",
+                 result.loaded, config.load, result.skipped, g_dbs[0]->num_entries,
+                 result.seconds, result.threads);
+    }
     
     // Start server
-    int result = server_start(port);
+    int result = server_start(&config);
     
     // Cleanup
     log_info("Shutting down...");
-    ht_destroy(g_hash_table);
-    g_hash_table = NULL;
+    epoch_drain();
+    for (int i = 0; i < g_num_dbs; i++) ht_destroy(g_dbs[i]);
+    free(g_dbs);
+    g_dbs = NULL;
+    g_num_dbs = 0;
+    lazyfree_stop();
+    vset_shutdown();
+    perf_shutdown();
     
     log_info("Goodbye!");
     
@@ -0,0 +1,440 @@
+// ============================================================================
+// slab.c - Huge-Page Backed Memory and Fixed-Size Slabs
+// ============================================================================
+//
+// Large, long-lived structures (bucket arrays, entry slabs) are mapped with
+// page_map() so they can be backed by 2 MB pages:
+//   HUGEPAGES_OFF      - regular 4 KB pages
+//   HUGEPAGES_THP      - madvise(MADV_HUGEPAGE): the kernel backs the range
+//                        with transparent huge pages when it can
+//   HUGEPAGES_EXPLICIT - MAP_HUGETLB from the reserved pool
+//                        (vm.nr_hugepages); falls back to THP if empty
+//
+// A slab hands out fixed-size objects carved from 2 MB chunks, so objects
+// that are walked together (hash chain nodes) share a few TLB entries
+// instead of being scattered over the malloc heap. Unlike malloc, a slab
+// knows how full each of its pages is, which active defrag relies on.
+// ============================================================================
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "mini_redis.h"
+
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#elif defined(__linux__)
+#include <malloc.h>
+#endif
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+#define SLAB_CHUNK_SIZE HUGE_PAGE_SIZE
+
+static HugePageMode g_hugepage_mode = HUGEPAGES_OFF;
+
+// Set once a MAP_HUGETLB mapping has fallen back to regular pages
+static int g_explicit_failed = 0;
+
+void page_set_mode(HugePageMode mode) {
+    g_hugepage_mode = mode;
+}
+
+HugePageMode page_mode(void) {
+    return g_hugepage_mode;
+}
+
+const char *page_backing_name(void) {
+    switch (g_hugepage_mode) {
+        case HUGEPAGES_THP:
+            return "thp";
+        case HUGEPAGES_EXPLICIT:
+            return __atomic_load_n(&g_explicit_failed, __ATOMIC_RELAXED)
+                   ? "explicit-fallback-thp" : "explicit-2mb";
+        default:
+            return "4k";
+    }
+}
+
+// Explicit huge pages must be mapped and unmapped in whole pages
+static size_t page_round(size_t size) {
+    if (g_hugepage_mode != HUGEPAGES_EXPLICIT) return size;
+    return (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+}
+
+void *page_map(size_t size) {
+    size_t len = page_round(size);
+    void *addr = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    if (g_hugepage_mode == HUGEPAGES_EXPLICIT) {
+        addr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (addr == MAP_FAILED &&
+            !__atomic_exchange_n(&g_explicit_failed, 1, __ATOMIC_RELAXED)) {
+            log_error("MAP_HUGETLB failed (%s); is vm.nr_hugepages set? "
+                      "Falling back to transparent huge pages", strerror(errno));
+        }
+    }
+#endif
+
+    if (addr == MAP_FAILED) {
+        addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED) return NULL;
+
+#ifdef MADV_HUGEPAGE
+        if (g_hugepage_mode != HUGEPAGES_OFF) {
+            madvise(addr, len, MADV_HUGEPAGE);
+        }
+#endif
+    }
+
+    return addr;
+}
+
+void page_unmap(void *addr, size_t size) {
+    if (addr) munmap(addr, page_round(size));
+}
+
+size_t page_map_size(size_t size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size = page_round(size);
+    return (size + page - 1) & ~(page - 1);
+}
+
+// ============================================================================
+// Malloc Sizes
+// ============================================================================
+// What a malloc() of size bytes really costs: the size class the allocator
+// rounded it up to, plus glibc's per-chunk size header. Allocators that
+// cannot say are taken at their word.
+size_t alloc_usable_size(void *ptr, size_t size) {
+    (void)size;
+    if (!ptr) return 0;
+#if defined(__APPLE__)
+    return malloc_size(ptr);
+#elif defined(__GLIBC__)
+    return malloc_usable_size(ptr) + sizeof(size_t);
+#elif defined(__linux__)
+    return malloc_usable_size(ptr);
+#else
+    return size;
+#endif
+}
+
+// ============================================================================
+// Slabs
+// ============================================================================
+// Chunks are split into runs. Allocation fills one run (the current run)
+// and then moves on to the fullest partly used run it can find, so live
+// objects stay packed. A run that empties hands its pages back to the
+// kernel; a chunk that empties is unmapped. Active defrag moves objects
+// out of sparse runs with slab_should_move().
+#define SLAB_RUN_SIZE (64 * 1024)
+#define SLAB_RUNS_PER_CHUNK (SLAB_CHUNK_SIZE / SLAB_RUN_SIZE)
+#define SLAB_PICK_SCAN 16         // Partial runs compared when choosing the next one
+
+typedef struct SlabFree {
+    struct SlabFree *next;
+} SlabFree;
+
+enum { RUN_DETACHED = 0, RUN_PARTIAL, RUN_EMPTY };
+
+typedef struct SlabRun {
+    struct SlabRun *prev;
+    struct SlabRun *next;
+    SlabFree *free_list;      // Freed objects, reused before the bump area
+    char *base;
+    char *bump;               // Next never-used object
+    char *end;
+    uint32_t live;
+    uint32_t capacity;
+    uint8_t list;             // Current and full runs are on no list
+    uint8_t resident;         // Pages touched and not handed back
+} SlabRun;
+
+typedef struct SlabChunk {
+    struct SlabChunk *prev;
+    struct SlabChunk *next;
+    size_t live;
+    SlabRun runs[SLAB_RUNS_PER_CHUNK];
+} SlabChunk;
+
+typedef struct RunList {
+    SlabRun *head;
+} RunList;
+
+struct Slab {
+    pthread_mutex_t lock;     // Writers in different stripes share a slab
+    size_t obj_size;
+    SlabChunk *chunks;
+    size_t num_chunks;
+    SlabRun *current;         // New objects come from here
+    RunList partial;          // Runs with live objects and free space
+    RunList empty;            // Runs without live objects
+    size_t live;              // Objects allocated
+    size_t live_capacity;     // Objects that fit in runs holding any
+    size_t resident_runs;
+};
+
+// Chunks are aligned to their size, so an object finds its chunk (and its
+// run) by masking its address
+static SlabChunk *chunk_of(const void *obj) {
+    return (SlabChunk *)((uintptr_t)obj & ~(uintptr_t)(SLAB_CHUNK_SIZE - 1));
+}
+
+static SlabRun *run_of(const void *obj) {
+    SlabChunk *chunk = chunk_of(obj);
+    return &chunk->runs[((uintptr_t)obj - (uintptr_t)chunk) / SLAB_RUN_SIZE];
+}
+
+static void run_list_push(RunList *list, SlabRun *run, uint8_t which) {
+    run->prev = NULL;
+    run->next = list->head;
+    if (list->head) list->head->prev = run;
+    list->head = run;
+    run->list = which;
+}
+
+static void run_list_remove(Slab *slab, SlabRun *run) {
+    RunList *list = run->list == RUN_PARTIAL ? &slab->partial : &slab->empty;
+
+    if (run->list == RUN_DETACHED) return;
+    if (run->prev) run->prev->next = run->next;
+    else list->head = run->next;
+    if (run->next) run->next->prev = run->prev;
+    run->prev = run->next = NULL;
+    run->list = RUN_DETACHED;
+}
+
+static SlabChunk *chunk_map(void) {
+    char *addr = (char *)page_map(SLAB_CHUNK_SIZE);
+    if (!addr || ((uintptr_t)addr & (SLAB_CHUNK_SIZE - 1)) == 0) return (SlabChunk *)addr;
+
+    // Over-map and trim to an aligned chunk. Only regular mappings can be
+    // misaligned, so the trimmed ends need not be whole huge pages.
+    page_unmap(addr, SLAB_CHUNK_SIZE);
+    addr = (char *)page_map(2 * SLAB_CHUNK_SIZE);
+    if (!addr) return NULL;
+
+    uintptr_t aligned = ((uintptr_t)addr + SLAB_CHUNK_SIZE - 1) & ~(uintptr_t)(SLAB_CHUNK_SIZE - 1);
+    size_t head = aligned - (uintptr_t)addr;
+    if (head) munmap(addr, head);
+    munmap((char *)aligned + SLAB_CHUNK_SIZE, SLAB_CHUNK_SIZE - head);
+    return (SlabChunk *)aligned;
+}
+
+static int slab_add_chunk(Slab *slab) {
+    SlabChunk *chunk = chunk_map();
+    if (!chunk) return -1;
+
+    chunk->prev = NULL;
+    chunk->next = slab->chunks;
+    if (slab->chunks) slab->chunks->prev = chunk;
+    slab->chunks = chunk;
+    slab->num_chunks++;
+
+    // Objects of the first run start after the chunk header, 16-byte aligned
+    for (size_t i = SLAB_RUNS_PER_CHUNK; i > 0; i--) {
+        SlabRun *run = &chunk->runs[i - 1];
+        char *start = (char *)chunk + (i - 1) * SLAB_RUN_SIZE;
+
+        run->base = i == 1 ? (char *)chunk + ((sizeof(SlabChunk) + 15) & ~(size_t)15) : start;
+        run->bump = run->base;
+        run->end = start + SLAB_RUN_SIZE;
+        run->capacity = (uint32_t)((size_t)(run->end - run->base) / slab->obj_size);
+        run_list_push(&slab->empty, run, RUN_EMPTY);
+    }
+    return 0;
+}
+
+static void slab_remove_chunk(Slab *slab, SlabChunk *chunk) {
+    for (size_t i = 0; i < SLAB_RUNS_PER_CHUNK; i++) {
+        run_list_remove(slab, &chunk->runs[i]);
+        if (chunk->runs[i].resident) slab->resident_runs--;
+    }
+
+    if (chunk->prev) chunk->prev->next = chunk->next;
+    else slab->chunks = chunk->next;
+    if (chunk->next) chunk->next->prev = chunk->prev;
+    slab->num_chunks--;
+
+    page_unmap(chunk, SLAB_CHUNK_SIZE);
+}
+
+// Make the fullest of the first few partial runs current, else an empty
+// run, else a run of a new chunk
+static SlabRun *slab_next_run(Slab *slab) {
+    SlabRun *best = NULL;
+    int scanned = 0;
+
+    for (SlabRun *run = slab->partial.head; run && scanned < SLAB_PICK_SCAN;
+         run = run->next, scanned++) {
+        if (!best || run->live > best->live) best = run;
+    }
+    if (!best && !slab->empty.head && slab_add_chunk(slab) != 0) return NULL;
+    if (!best) best = slab->empty.head;
+
+    run_list_remove(slab, best);
+    slab->current = best;
+    return best;
+}
+
+// An emptied run goes back to the kernel; with huge pages that would split
+// the page, so only a whole empty chunk is released
+static void slab_run_emptied(Slab *slab, SlabRun *run) {
+    SlabChunk *chunk = chunk_of(run->base);
+
+    run->free_list = NULL;
+    run->bump = run->base;
+    run_list_push(&slab->empty, run, RUN_EMPTY);
+
+#ifdef MADV_DONTNEED
+    if (g_hugepage_mode == HUGEPAGES_OFF && run != &chunk->runs[0] && run->resident) {
+        madvise(run->base, SLAB_RUN_SIZE, MADV_DONTNEED);
+        run->resident = 0;
+        slab->resident_runs--;
+    }
+#endif
+
+    if (chunk->live == 0 && slab->num_chunks > 1 &&
+        (!slab->current || chunk_of(slab->current->base) != chunk)) {
+        slab_remove_chunk(slab, chunk);
+    }
+}
+
+Slab *slab_create(size_t obj_size) {
+    Slab *slab = (Slab *)calloc(1, sizeof(Slab));
+    if (!slab) return NULL;
+
+    // Keep objects pointer-aligned and large enough for the free list link
+    obj_size = (obj_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    if (obj_size < sizeof(SlabFree)) obj_size = sizeof(SlabFree);
+    if (obj_size > SLAB_RUN_SIZE / 4) {
+        free(slab);
+        return NULL;
+    }
+
+    pthread_mutex_init(&slab->lock, NULL);
+    slab->obj_size = obj_size;
+    return slab;
+}
+
+void slab_destroy(Slab *slab) {
+    if (!slab) return;
+
+    SlabChunk *chunk = slab->chunks;
+    while (chunk) {
+        SlabChunk *next = chunk->next;
+        page_unmap(chunk, SLAB_CHUNK_SIZE);
+        chunk = next;
+    }
+
+    pthread_mutex_destroy(&slab->lock);
+    free(slab);
+}
+
+void *slab_alloc(Slab *slab) {
+    void *obj;
+
+    pthread_mutex_lock(&slab->lock);
+
+    SlabRun *run = slab->current;
+    if (!run || run->live == run->capacity) {
+        run = slab_next_run(slab);
+        if (!run) {
+            pthread_mutex_unlock(&slab->lock);
+            return NULL;
+        }
+    }
+
+    if (run->free_list) {
+        obj = run->free_list;
+        run->free_list = run->free_list->next;
+    } else {
+        obj = run->bump;
+        run->bump += slab->obj_size;
+    }
+    if (!run->resident) {
+        run->resident = 1;
+        slab->resident_runs++;
+    }
+    if (run->live++ == 0) slab->live_capacity += run->capacity;
+    chunk_of(obj)->live++;
+    slab->live++;
+
+    pthread_mutex_unlock(&slab->lock);
+    return obj;
+}
+
+void slab_free(Slab *slab, void *obj) {
+    if (!obj) return;
+
+    pthread_mutex_lock(&slab->lock);
+
+    SlabRun *run = run_of(obj);
+    SlabFree *node = (SlabFree *)obj;
+    node->next = run->free_list;
+    run->free_list = node;
+
+    int was_full = run->live == run->capacity;
+    if (--run->live == 0) slab->live_capacity -= run->capacity;
+    chunk_of(obj)->live--;
+    slab->live--;
+
+    if (run != slab->current) {
+        if (run->live == 0) {
+            run_list_remove(slab, run);
+            slab_run_emptied(slab, run);
+        } else if (was_full) {
+            run_list_push(&slab->partial, run, RUN_PARTIAL);
+        }
+    }
+
+    pthread_mutex_unlock(&slab->lock);
+}
+
+int slab_should_move(Slab *slab, const void *obj) {
+    int move;
+
+    pthread_mutex_lock(&slab->lock);
+
+    // The replacement comes from the current run. Moving helps if that run
+    // is the fuller one, or if obj's run is emptier than average and
+    // should be drained.
+    SlabRun *current = slab->current;
+    if (!current || current->live == current->capacity) {
+        current = slab_next_run(slab);
+    }
+    SlabRun *run = run_of(obj);
+    move = current && run != current &&
+           (run->live <= current->live ||
+            (size_t)run->live * slab->live_capacity < slab->live * run->capacity);
+
+    pthread_mutex_unlock(&slab->lock);
+    return move;
+}
+
+size_t slab_object_size(const Slab *slab) {
+    return slab->obj_size;
+}
+
+size_t slab_bytes(const Slab *slab) {
+    return slab ? __atomic_load_n(&slab->num_chunks, __ATOMIC_RELAXED) * SLAB_CHUNK_SIZE : 0;
+}
+
+void slab_usage(Slab *slab, size_t *resident, size_t *used) {
+    pthread_mutex_lock(&slab->lock);
+    *resident = slab->resident_runs * SLAB_RUN_SIZE;
+    *used = slab->live * slab->obj_size;
+    pthread_mutex_unlock(&slab->lock);
+}
@@ -0,0 +1,104 @@
+// ============================================================================
+// strbuf.c - Growable Buffers for Structured Replies
+// ============================================================================
+//
+// Replies whose size depends on the data (stream ranges, consumer groups)
+// are built here instead of in fixed stack buffers. The buffer doubles as
+// it fills; after a failed allocation further appends are ignored and
+// sb_finish() returns NULL.
+// ============================================================================
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "mini_redis.h"
+
+#define SB_INITIAL_SIZE 256
+
+void sb_init(StrBuf *sb) {
+    sb->buf = NULL;
+    sb->len = 0;
+    sb->cap = 0;
+    sb->failed = 0;
+}
+
+// Make room for len more bytes plus a terminator
+static int sb_reserve(StrBuf *sb, size_t len) {
+    if (sb->failed) return -1;
+    if (sb->len + len + 1 <= sb->cap) return 0;
+
+    size_t cap = sb->cap ? sb->cap : SB_INITIAL_SIZE;
+    while (cap < sb->len + len + 1) cap *= 2;
+
+    char *buf = (char *)realloc(sb->buf, cap);
+    if (!buf) {
+        sb->failed = 1;
+        return -1;
+    }
+    sb->buf = buf;
+    sb->cap = cap;
+    return 0;
+}
+
+void sb_append(StrBuf *sb, const char *data, size_t len) {
+    if (sb_reserve(sb, len) != 0) return;
+    memcpy(sb->buf + sb->len, data, len);
+    sb->len += len;
+    sb->buf[sb->len] = '\0';
+}
+
+void sb_printf(StrBuf *sb, const char *fmt, ...) {
+    va_list args;
+
+    va_start(args, fmt);
+    int len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    if (len < 0 || sb_reserve(sb, (size_t)len) != 0) return;
+
+    va_start(args, fmt);
+    vsnprintf(sb->buf + sb->len, (size_t)len + 1, fmt, args);
+    va_end(args);
+    sb->len += (size_t)len;
+}
+
+void sb_json_string(StrBuf *sb, const char *str, size_t len) {
+    // Worst case every byte becomes a \u00XX escape
+    if (sb_reserve(sb, len * 6 + 2) != 0) return;
+
+    char *out = sb->buf + sb->len;
+    *out++ = '"';
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)str[i];
+        if (c == '"' || c == '\\') {
+            *out++ = '\\';
+            *out++ = (char)c;
+        } else if (c < 0x20 || c == 0x7f) {
+            out += sprintf(out, "\\u%04x", c);
+        } else {
+            *out++ = (char)c;
+        }
+    }
+    *out++ = '"';
+    *out = '\0';
+    sb->len = (size_t)(out - sb->buf);
+}
+
+char *sb_finish(StrBuf *sb) {
+    if (sb->failed) {
+        free(sb->buf);
+        sb_init(sb);
+        return NULL;
+    }
+    if (!sb->buf) {
+        // Nothing was appended: still hand back an empty string
+        sb->buf = (char *)malloc(1);
+        if (sb->buf) sb->buf[0] = '\0';
+    }
+
+    char *buf = sb->buf;
+    sb_init(sb);
+    return buf;
+}
@@ -0,0 +1,1543 @@
+// ============================================================================
+// stream.c - Append-Only Streams with Consumer Groups
+// ============================================================================
+//
+// A stream is a log of entries, each a list of field/value pairs under an
+// ID "<ms>-<seq>" that only ever grows. Entries are packed into nodes of up
+// to STREAM_NODE_ENTRIES entries or STREAM_NODE_BYTES bytes:
+//   - the node's first ID is its master ID; every other ID is stored as
+//     varint deltas from it
+//   - an entry with the same field names as the node's first entry stores
+//     only its values
+// Appends go to the last node, so XADD is O(1) and an entry costs a few
+// bytes beyond its own data. Nodes are indexed by master ID in a binary
+// radix tree, which finds the node holding any ID in at most 128 steps,
+// and are linked in ID order for range scans.
+//
+// A consumer group has a last-delivered ID and a pending entries list
+// (PEL): every entry XREADGROUP has handed out and nobody has XACKed yet,
+// with its consumer and delivery count, in another radix tree keyed by ID.
+// ============================================================================
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include "mini_redis.h"
+
+#define STREAM_NODE_ENTRIES 100
+#define STREAM_NODE_BYTES 4096
+#define STREAM_NODE_MIN_CAP 256
+
+// Entry flags, the first byte of every encoded entry
+#define ENTRY_DELETED 0x01
+#define ENTRY_SAME_FIELDS 0x02       // Field names are the first entry's
+
+typedef struct StreamId {
+    uint64_t ms;
+    uint64_t seq;
+} StreamId;
+
+static const StreamId ID_MIN = { 0, 0 };
+static const StreamId ID_MAX = { UINT64_MAX, UINT64_MAX };
+
+// ============================================================================
+// Accounted Allocations
+// ============================================================================
+// Every allocation a stream makes is added to its memory count, as the
+// allocator sizes it, so stream_memory() needs no walk
+static void *mem_alloc(size_t *memory, size_t size) {
+    void *ptr = malloc(size);
+    if (ptr) *memory += alloc_usable_size(ptr, size);
+    return ptr;
+}
+
+static void *mem_realloc(size_t *memory, void *ptr, size_t old_size, size_t size) {
+    size_t old_bytes = alloc_usable_size(ptr, old_size);
+    void *grown = realloc(ptr, size);
+    if (!grown) return NULL;
+    *memory += alloc_usable_size(grown, size) - old_bytes;
+    return grown;
+}
+
+static void mem_free(size_t *memory, void *ptr, size_t size) {
+    if (!ptr) return;
+    *memory -= alloc_usable_size(ptr, size);
+    free(ptr);
+}
+
+// ============================================================================
+// IDs
+// ============================================================================
+static int id_cmp(StreamId a, StreamId b) {
+    if (a.ms != b.ms) return a.ms < b.ms ? -1 : 1;
+    if (a.seq != b.seq) return a.seq < b.seq ? -1 : 1;
+    return 0;
+}
+
+// Next ID up; returns -1 past the largest
+static int id_incr(StreamId *id) {
+    if (id->seq < UINT64_MAX) {
+        id->seq++;
+    } else if (id->ms < UINT64_MAX) {
+        id->ms++;
+        id->seq = 0;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static int id_decr(StreamId *id) {
+    if (id->seq > 0) {
+        id->seq--;
+    } else if (id->ms > 0) {
+        id->ms--;
+        id->seq = UINT64_MAX;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+#define ID_STR_SIZE 48
+
+static void id_format(StreamId id, char *buf) {
+    snprintf(buf, ID_STR_SIZE, "%llu-%llu", (unsigned long long)id.ms,
+             (unsigned long long)id.seq);
+}
+
+static int parse_u64(const char *str, size_t len, uint64_t *value) {
+    char digits[24];
+
+    if (len == 0 || len >= sizeof(digits)) return -1;
+    for (size_t i = 0; i < len; i++) {
+        if (!isdigit((unsigned char)str[i])) return -1;
+    }
+    memcpy(digits, str, len);
+    digits[len] = '\0';
+
+    errno = 0;
+    unsigned long long v = strtoull(digits, NULL, 10);
+    if (errno == ERANGE) return -1;
+    *value = (uint64_t)v;
+    return 0;
+}
+
+// "<ms>-<seq>", or "<ms>" alone with seq taken as missing_seq
+static int id_parse(const char *str, uint64_t missing_seq, StreamId *id) {
+    const char *dash = strchr(str, '-');
+
+    if (!dash) {
+        id->seq = missing_seq;
+        return parse_u64(str, strlen(str), &id->ms);
+    }
+    if (parse_u64(str, (size_t)(dash - str), &id->ms) != 0) return -1;
+    return parse_u64(dash + 1, strlen(dash + 1), &id->seq);
+}
+
+// XRANGE bound: "-", "+", an ID, or "(" before an ID to exclude it
+static int range_bound(const char *str, int is_end, StreamId *id) {
+    if (strcmp(str, "-") == 0) {
+        *id = ID_MIN;
+        return 0;
+    }
+    if (strcmp(str, "+") == 0) {
+        *id = ID_MAX;
+        return 0;
+    }
+
+    int exclusive = str[0] == '(';
+    if (id_parse(str + exclusive, is_end ? UINT64_MAX : 0, id) != 0) return -1;
+    if (!exclusive) return 0;
+    return is_end ? id_decr(id) : id_incr(id);
+}
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+// ============================================================================
+// Radix Tree
+// ============================================================================
+// Binary radix tree with path compression (crit-bit): an inner node stores
+// the first bit at which the IDs below it differ, so there is one inner
+// node per leaf beyond the first and no chain of single-child nodes. Leaves
+// are the caller's structs, which start with their StreamId; pointers to
+// inner nodes carry a tag in their low bit.
+typedef struct RadixInner {
+    void *child[2];
+    unsigned bit;             // 0 is the top bit of ms, 127 the low bit of seq
+} RadixInner;
+
+typedef struct RadixTree {
+    void *root;
+    size_t size;              // Leaves
+} RadixTree;
+
+static int is_inner(const void *p) {
+    return ((uintptr_t)p & 1) != 0;
+}
+
+static RadixInner *inner_of(void *p) {
+    return (RadixInner *)((uintptr_t)p - 1);
+}
+
+static StreamId leaf_id(const void *leaf) {
+    return *(const StreamId *)leaf;
+}
+
+static unsigned id_bit(StreamId id, unsigned bit) {
+    return bit < 64 ? (unsigned)(id.ms >> (63 - bit)) & 1
+                    : (unsigned)(id.seq >> (127 - bit)) & 1;
+}
+
+// First bit at which a and b differ, or 128 if they are equal
+static unsigned id_crit_bit(StreamId a, StreamId b) {
+    if (a.ms != b.ms) return (unsigned)__builtin_clzll(a.ms ^ b.ms);
+    if (a.seq != b.seq) return 64 + (unsigned)__builtin_clzll(a.seq ^ b.seq);
+    return 128;
+}
+
+// Leaf the bits of id lead to: the only one that can equal it
+static void *radix_walk(const RadixTree *t, StreamId id) {
+    void *p = t->root;
+    while (p && is_inner(p)) {
+        RadixInner *n = inner_of(p);
+        p = n->child[id_bit(id, n->bit)];
+    }
+    return p;
+}
+
+// Returns 0 on success, -1 if the ID is present or memory ran out
+static int radix_insert(RadixTree *t, void *leaf, size_t *memory) {
+    StreamId id = leaf_id(leaf);
+
+    if (!t->root) {
+        t->root = leaf;
+        t->size = 1;
+        return 0;
+    }
+
+    unsigned bit = id_crit_bit(id, leaf_id(radix_walk(t, id)));
+    if (bit == 128) return -1;
+
+    RadixInner *n = (RadixInner *)mem_alloc(memory, sizeof(RadixInner));
+    if (!n) return -1;
+
+    // The new inner node goes above the first one deciding a later bit
+    void **where = &t->root;
+    while (is_inner(*where) && inner_of(*where)->bit < bit) {
+        RadixInner *q = inner_of(*where);
+        where = &q->child[id_bit(id, q->bit)];
+    }
+
+    unsigned dir = id_bit(id, bit);
+    n->bit = bit;
+    n->child[dir] = leaf;
+    n->child[1 - dir] = *where;
+    *where = (void *)((uintptr_t)n | 1);
+    t->size++;
+    return 0;
+}
+
+static void *radix_find(const RadixTree *t, StreamId id) {
+    void *leaf = radix_walk(t, id);
+    return leaf && id_cmp(leaf_id(leaf), id) == 0 ? leaf : NULL;
+}
+
+// Unlink the leaf for id; returns it, or NULL if there is none
+static void *radix_remove(RadixTree *t, StreamId id, size_t *memory) {
+    void **where = &t->root, **parent_link = NULL;
+    RadixInner *parent = NULL;
+    unsigned dir = 0;
+
+    if (!t->root) return NULL;
+    while (is_inner(*where)) {
+        parent_link = where;
+        parent = inner_of(*where);
+        dir = id_bit(id, parent->bit);
+        where = &parent->child[dir];
+    }
+
+    void *leaf = *where;
+    if (id_cmp(leaf_id(leaf), id) != 0) return NULL;
+
+    if (parent) {
+        // The sibling takes the parent's place
+        *parent_link = parent->child[1 - dir];
+        mem_free(memory, parent, sizeof(RadixInner));
+    } else {
+        t->root = NULL;
+    }
+    t->size--;
+    return leaf;
+}
+
+// Leftmost (dir 0) or rightmost (dir 1) leaf under p
+static void *radix_edge(void *p, unsigned dir) {
+    while (p && is_inner(p)) p = inner_of(p)->child[dir];
+    return p;
+}
+
+// Leaf with the greatest ID <= id (dir 0) or the smallest ID >= id (dir 1)
+static void *radix_seek(const RadixTree *t, StreamId id, unsigned dir) {
+    void *leaf = radix_walk(t, id);
+    if (!leaf) return NULL;
+
+    unsigned bit = id_crit_bit(id, leaf_id(leaf));
+    if (bit == 128) return leaf;
+
+    // Every ID in sub shares id's bits above bit and differs from id at
+    // bit, all the same way. sibling is the nearest subtree on the side
+    // being sought, in case sub lies on the other.
+    void *sub = t->root, *sibling = NULL;
+    while (is_inner(sub) && inner_of(sub)->bit < bit) {
+        RadixInner *n = inner_of(sub);
+        unsigned b = id_bit(id, n->bit);
+        if (b != dir) sibling = n->child[dir];
+        sub = n->child[b];
+    }
+
+    // id's bit is 1 where sub's are 0: all of sub lies below id
+    if (id_bit(id, bit) != dir) return radix_edge(sub, 1 - dir);
+    return radix_edge(sibling, 1 - dir);
+}
+
+// Free every inner node, and every leaf too if leaf_size is not 0
+static void radix_clear_node(void *p, size_t leaf_size, size_t *memory) {
+    if (!p) return;
+    if (is_inner(p)) {
+        RadixInner *n = inner_of(p);
+        radix_clear_node(n->child[0], leaf_size, memory);
+        radix_clear_node(n->child[1], leaf_size, memory);
+        mem_free(memory, n, sizeof(RadixInner));
+    } else if (leaf_size) {
+        mem_free(memory, p, leaf_size);
+    }
+}
+
+static void radix_clear(RadixTree *t, size_t leaf_size, size_t *memory) {
+    radix_clear_node(t->root, leaf_size, memory);
+    t->root = NULL;
+    t->size = 0;
+}
+
+// ============================================================================
+// Stream Layout
+// ============================================================================
+typedef struct StreamNode {
+    StreamId master;          // First entry's ID; the tree key, so first
+    struct StreamNode *prev;
+    struct StreamNode *next;
+    unsigned char *data;      // Encoded entries, back to back
+    uint32_t used;
+    uint32_t cap;
+    uint16_t count;           // Entries, deleted ones included
+    uint16_t live;            // Entries not deleted; never 0 for long
+} StreamNode;
+
+typedef struct StreamConsumer {
+    struct StreamConsumer *next;
+    size_t pending;           // PEL entries it owns
+    uint64_t seen_ms;         // Last time it read
+    size_t size;              // Allocation size
+    char name[];
+} StreamConsumer;
+
+typedef struct StreamPending {
+    StreamId id;              // Tree key, so first
+    StreamConsumer *consumer;
+    uint64_t delivered_ms;    // Last delivery
+    uint64_t deliveries;
+} StreamPending;
+
+typedef struct StreamGroup {
+    struct StreamGroup *next;
+    StreamId last_delivered;
+    RadixTree pel;            // StreamPending by ID
+    StreamConsumer *consumers;
+    size_t size;              // Allocation size
+    char name[];
+} StreamGroup;
+
+struct Stream {
+    RadixTree nodes;          // StreamNode by master ID
+    StreamNode *first;        // Nodes are also linked in ID order
+    StreamNode *last;         // Appends go here
+    size_t length;            // Entries not deleted
+    StreamId last_id;         // Highest ID ever added: IDs are never reused
+    StreamGroup *groups;
+    size_t memory;            // Allocator bytes of all of the above
+};
+
+// ============================================================================
+// Entry Encoding
+// ============================================================================
+// flags, varint ms - master.ms, varint seq (seq - master.seq when ms
+// matches the master's), varint field count, then per field its name (not
+// with ENTRY_SAME_FIELDS) and value, each a varint length and the bytes
+static size_t varint_len(uint64_t v) {
+    size_t n = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+static unsigned char *varint_put(unsigned char *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (unsigned char)v;
+    return p;
+}
+
+static unsigned char *varint_get(unsigned char *p, uint64_t *v) {
+    uint64_t value = 0;
+    unsigned shift = 0;
+    while (*p & 0x80) {
+        value |= (uint64_t)(*p++ & 0x7f) << shift;
+        shift += 7;
+    }
+    *v = value | (uint64_t)*p++ << shift;
+    return p;
+}
+
+static unsigned char *string_skip(unsigned char *p) {
+    uint64_t len;
+    p = varint_get(p, &len);
+    return p + len;
+}
+
+typedef struct EntryRef {
+    StreamId id;
+    unsigned char *flags;     // In the node, so it can be marked deleted
+    uint64_t num_fields;
+    unsigned char *fields;    // First name, or first value with same fields
+    unsigned char *names;     // First entry's first name, with same fields
+    unsigned char *end;       // Next entry
+} EntryRef;
+
+static unsigned char *entry_header(const StreamNode *node, unsigned char *p, EntryRef *e) {
+    uint64_t ms_delta, seq;
+
+    e->flags = p++;
+    p = varint_get(p, &ms_delta);
+    p = varint_get(p, &seq);
+    e->id.ms = node->master.ms + ms_delta;
+    e->id.seq = ms_delta == 0 ? node->master.seq + seq : seq;
+    return varint_get(p, &e->num_fields);
+}
+
+// Decode the entry at p; returns the start of the next one
+static unsigned char *entry_decode(const StreamNode *node, unsigned char *p, EntryRef *e) {
+    p = entry_header(node, p, e);
+    e->fields = p;
+    e->names = NULL;
+
+    int same = (*e->flags & ENTRY_SAME_FIELDS) != 0;
+    for (uint64_t i = 0; i < e->num_fields; i++) {
+        if (!same) p = string_skip(p);
+        p = string_skip(p);
+    }
+    e->end = p;
+
+    if (same) {
+        EntryRef first;
+        e->names = entry_header(node, node->data, &first);
+    }
+    return p;
+}
+
+// Bytes to encode an entry after the given master; same_fields drops names
+static size_t entry_size(StreamId master, StreamId id, char **fields, size_t num_fields,
+                         int same_fields) {
+    uint64_t ms_delta = id.ms - master.ms;
+    size_t size = 1 + varint_len(ms_delta) +
+                  varint_len(ms_delta == 0 ? id.seq - master.seq : id.seq) +
+                  varint_len(num_fields);
+
+    for (size_t i = 0; i < num_fields; i += 2) {
+        size_t name = strlen(fields[i]), value = strlen(fields[i + 1]);
+        if (!same_fields) size += varint_len(name) + name;
+        size += varint_len(value) + value;
+    }
+    return size;
+}
+
+// Returns 1 if the node's first entry has exactly these field names
+static int node_same_fields(const StreamNode *node, char **fields, size_t num_fields) {
+    EntryRef first;
+    unsigned char *p = entry_header(node, node->data, &first);
+
+    if (first.num_fields != num_fields / 2) return 0;
+    for (size_t i = 0; i < num_fields; i += 2) {
+        uint64_t len;
+        p = varint_get(p, &len);
+        if (len != strlen(fields[i]) || memcmp(p, fields[i], len) != 0) return 0;
+        p = string_skip(p + len);
+    }
+    return 1;
+}
+
+static void entry_encode(const StreamNode *node, unsigned char *p, StreamId id,
+                         char **fields, size_t num_fields, int same_fields) {
+    uint64_t ms_delta = id.ms - node->master.ms;
+
+    *p++ = same_fields ? ENTRY_SAME_FIELDS : 0;
+    p = varint_put(p, ms_delta);
+    p = varint_put(p, ms_delta == 0 ? id.seq - node->master.seq : id.seq);
+    p = varint_put(p, num_fields / 2);
+    for (size_t i = 0; i < num_fields; i += 2) {
+        size_t name = strlen(fields[i]), value = strlen(fields[i + 1]);
+        if (!same_fields) {
+            p = varint_put(p, name);
+            memcpy(p, fields[i], name);
+            p += name;
+        }
+        p = varint_put(p, value);
+        memcpy(p, fields[i + 1], value);
+        p += value;
+    }
+}
+
+// {"id": "...", "fields": ["name", "value", ...]}
+static void entry_json(StrBuf *sb, const EntryRef *e) {
+    char id[ID_STR_SIZE];
+    unsigned char *p = e->fields, *names = e->names;
+    uint64_t len;
+
+    id_format(e->id, id);
+    sb_printf(sb, "{\"id\": \"%s\", \"fields\": [", id);
+    for (uint64_t i = 0; i < e->num_fields; i++) {
+        if (names) {
+            names = varint_get(names, &len);
+            sb_json_string(sb, (const char *)names, len);
+            names = string_skip(names + len);
+        } else {
+            p = varint_get(p, &len);
+            sb_json_string(sb, (const char *)p, len);
+            p += len;
+        }
+        sb_append(sb, ", ", 2);
+        p = varint_get(p, &len);
+        sb_json_string(sb, (const char *)p, len);
+        p += len;
+        if (i + 1 < e->num_fields) sb_append(sb, ", ", 2);
+    }
+    sb_append(sb, "]}", 2);
+}
+
+// ============================================================================
+// Nodes
+// ============================================================================
+static StreamNode *node_create(Stream *s, StreamId master) {
+    StreamNode *node = (StreamNode *)mem_alloc(&s->memory, sizeof(StreamNode));
+    if (!node) return NULL;
+
+    node->master = master;
+    node->data = NULL;
+    node->used = node->cap = 0;
+    node->count = node->live = 0;
+    if (radix_insert(&s->nodes, node, &s->memory) != 0) {
+        mem_free(&s->memory, node, sizeof(StreamNode));
+        return NULL;
+    }
+
+    node->prev = s->last;
+    node->next = NULL;
+    if (s->last) {
+        s->last->next = node;
+    } else {
+        s->first = node;
+    }
+    s->last = node;
+    return node;
+}
+
+static void node_remove(Stream *s, StreamNode *node) {
+    radix_remove(&s->nodes, node->master, &s->memory);
+    if (node->prev) node->prev->next = node->next; else s->first = node->next;
+    if (node->next) node->next->prev = node->prev; else s->last = node->prev;
+    mem_free(&s->memory, node->data, node->cap);
+    mem_free(&s->memory, node, sizeof(StreamNode));
+}
+
+// Append an entry (fields holds name, value pairs), opening a new node
+// when the last one is full
+static int stream_append(Stream *s, StreamId id, char **fields, size_t num_fields) {
+    StreamNode *node = s->last;
+    int same = node && node->count > 0 && node_same_fields(node, fields, num_fields);
+    size_t size = node ? entry_size(node->master, id, fields, num_fields, same) : 0;
+
+    if (!node || node->count >= STREAM_NODE_ENTRIES ||
+        (node->used > 0 && node->used + size > STREAM_NODE_BYTES)) {
+        node = node_create(s, id);
+        if (!node) return -1;
+        same = 0;
+        size = entry_size(id, id, fields, num_fields, 0);
+    }
+
+    if (node->used + size > node->cap) {
+        // Double up to the node limit; one huge entry gets a node to itself
+        size_t cap = node->cap ? node->cap : STREAM_NODE_MIN_CAP;
+        while (cap < node->used + size) cap *= 2;
+        if (cap > STREAM_NODE_BYTES) cap = node->used + size > STREAM_NODE_BYTES
+                                           ? node->used + size : STREAM_NODE_BYTES;
+
+        unsigned char *data = (unsigned char *)mem_realloc(&s->memory, node->data,
+                                                           node->cap, cap);
+        if (!data) {
+            if (node->count == 0) node_remove(s, node);
+            return -1;
+        }
+        node->data = data;
+        node->cap = (uint32_t)cap;
+    }
+
+    entry_encode(node, node->data + node->used, id, fields, num_fields, same);
+    node->used += (uint32_t)size;
+    node->count++;
+    node->live++;
+    s->length++;
+    s->last_id = id;
+    return 0;
+}
+
+static void entry_delete(Stream *s, StreamNode *node, EntryRef *e) {
+    *e->flags |= ENTRY_DELETED;
+    node->live--;
+    s->length--;
+    if (node->live == 0) node_remove(s, node);
+}
+
+// Find the live entry with this ID
+// Returns 0 with *node and *e set, or -1 if there is none
+static int entry_find(Stream *s, StreamId id, StreamNode **node, EntryRef *e) {
+    StreamNode *n = (StreamNode *)radix_seek(&s->nodes, id, 0);
+    if (!n) return -1;
+
+    for (unsigned char *p = n->data; p < n->data + n->used;) {
+        p = entry_decode(n, p, e);
+        int cmp = id_cmp(e->id, id);
+        if (cmp > 0) break;
+        if (cmp == 0 && !(*e->flags & ENTRY_DELETED)) {
+            *node = n;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Keep the newest maxlen entries. approx only drops whole nodes, leaving
+// up to a node's worth more, which costs no entry decoding.
+// Returns the number of entries removed
+static size_t stream_trim(Stream *s, size_t maxlen, int approx) {
+    size_t removed = 0;
+
+    while (s->length > maxlen && s->first) {
+        StreamNode *node = s->first;
+        if (node->live <= s->length - maxlen) {
+            removed += node->live;
+            s->length -= node->live;
+            node_remove(s, node);
+            continue;
+        }
+        if (approx) break;
+
+        // The cut falls inside the first node: mark its oldest entries
+        unsigned char *p = node->data;
+        while (s->length > maxlen) {
+            EntryRef e;
+            p = entry_decode(node, p, &e);
+            if (*e.flags & ENTRY_DELETED) continue;
+            entry_delete(s, node, &e);
+            removed++;
+        }
+    }
+    return removed;
+}
+
+// ============================================================================
+// Range Iteration
+// ============================================================================
+typedef struct StreamIter {
+    StreamNode *node;
+    StreamId start, end;
+    int reverse;
+    unsigned char *pos;       // Forward: next entry in node
+    unsigned char *entries[STREAM_NODE_ENTRIES];  // Reverse: the node's entries
+    int index;                // Reverse: entries left in node
+} StreamIter;
+
+static void iter_load(StreamIter *it) {
+    if (!it->node) return;
+    if (!it->reverse) {
+        it->pos = it->node->data;
+        return;
+    }
+
+    // Entries only decode forwards: note where each starts
+    EntryRef e;
+    it->index = 0;
+    for (unsigned char *p = it->node->data; p < it->node->data + it->node->used;) {
+        it->entries[it->index++] = p;
+        p = entry_decode(it->node, p, &e);
+    }
+}
+
+static void iter_start(StreamIter *it, Stream *s, StreamId start, StreamId end, int reverse) {
+    it->start = start;
+    it->end = end;
+    it->reverse = reverse;
+    it->node = (StreamNode *)radix_seek(&s->nodes, reverse ? end : start, 0);
+    if (!it->node && !reverse) it->node = s->first;
+    iter_load(it);
+}
+
+// Next live entry within the range; returns 0 once there are no more
+static int iter_next(StreamIter *it, EntryRef *e) {
+    while (it->node) {
+        if (!it->reverse && it->pos < it->node->data + it->node->used) {
+            it->pos = entry_decode(it->node, it->pos, e);
+            if (id_cmp(e->id, it->end) > 0) break;
+            if (id_cmp(e->id, it->start) < 0 || (*e->flags & ENTRY_DELETED)) continue;
+            return 1;
+        }
+        if (it->reverse && it->index > 0) {
+            entry_decode(it->node, it->entries[--it->index], e);
+            if (id_cmp(e->id, it->start) < 0) break;
+            if (id_cmp(e->id, it->end) > 0 || (*e->flags & ENTRY_DELETED)) continue;
+            return 1;
+        }
+        it->node = it->reverse ? it->node->prev : it->node->next;
+        iter_load(it);
+    }
+    it->node = NULL;
+    return 0;
+}
+
+// ============================================================================
+// Consumer Groups
+// ============================================================================
+static StreamGroup *group_find(Stream *s, const char *name) {
+    for (StreamGroup *g = s->groups; g; g = g->next) {
+        if (strcmp(g->name, name) == 0) return g;
+    }
+    return NULL;
+}
+
+static StreamConsumer *consumer_get(Stream *s, StreamGroup *g, const char *name, int create) {
+    for (StreamConsumer *c = g->consumers; c; c = c->next) {
+        if (strcmp(c->name, name) == 0) return c;
+    }
+    if (!create) return NULL;
+
+    size_t size = sizeof(StreamConsumer) + strlen(name) + 1;
+    StreamConsumer *c = (StreamConsumer *)mem_alloc(&s->memory, size);
+    if (!c) return NULL;
+    c->pending = 0;
+    c->seen_ms = now_ms();
+    c->size = size;
+    strcpy(c->name, name);
+    c->next = g->consumers;
+    g->consumers = c;
+    return c;
+}
+
+// Record a delivery of id to c; an entry delivered before changes owner
+static int pending_add(Stream *s, StreamGroup *g, StreamConsumer *c, StreamId id, uint64_t now) {
+    StreamPending *p = (StreamPending *)radix_find(&g->pel, id);
+
+    if (p) {
+        p->consumer->pending--;
+    } else {
+        p = (StreamPending *)mem_alloc(&s->memory, sizeof(StreamPending));
+        if (!p) return -1;
+        p->id = id;
+        p->deliveries = 0;
+        if (radix_insert(&g->pel, p, &s->memory) != 0) {
+            mem_free(&s->memory, p, sizeof(StreamPending));
+            return -1;
+        }
+    }
+    p->consumer = c;
+    p->delivered_ms = now;
+    p->deliveries++;
+    c->pending++;
+    return 0;
+}
+
+// Next PEL entry at or after id, or NULL
+static StreamPending *pending_from(StreamGroup *g, StreamId id) {
+    return (StreamPending *)radix_seek(&g->pel, id, 1);
+}
+
+static StreamPending *pending_after(StreamGroup *g, const StreamPending *p) {
+    StreamId next = p->id;
+    return id_incr(&next) == 0 ? pending_from(g, next) : NULL;
+}
+
+static void consumer_free(Stream *s, StreamConsumer *c) {
+    mem_free(&s->memory, c, c->size);
+}
+
+static void group_free(Stream *s, StreamGroup *g) {
+    radix_clear(&g->pel, sizeof(StreamPending), &s->memory);
+    while (g->consumers) {
+        StreamConsumer *c = g->consumers;
+        g->consumers = c->next;
+        consumer_free(s, c);
+    }
+    mem_free(&s->memory, g, g->size);
+}
+
+// ============================================================================
+// Stream Object
+// ============================================================================
+static Stream *stream_create(void) {
+    Stream *s = (Stream *)malloc(sizeof(Stream));
+    if (!s) return NULL;
+
+    memset(s, 0, sizeof(Stream));
+    s->memory = alloc_usable_size(s, sizeof(Stream));
+    return s;
+}
+
+void stream_free(Stream *s) {
+    if (!s) return;
+
+    while (s->groups) {
+        StreamGroup *g = s->groups;
+        s->groups = g->next;
+        group_free(s, g);
+    }
+    while (s->first) node_remove(s, s->first);
+    free(s);
+}
+
+size_t stream_memory(const Stream *s) {
+    return s->memory;
+}
+
+// ============================================================================
+// Commands
+// ============================================================================
+static char *stream_reply(const char *fmt, ...) {
+    char buffer[512];
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, args);
+    va_end(args);
+
+    size_t len = strlen(buffer) + 1;
+    char *reply = (char *)malloc(len);
+    if (reply) memcpy(reply, buffer, len);
+    return reply;
+}
+
+static char *stream_finish(StrBuf *sb) {
+    char *reply = sb_finish(sb);
+    return reply ? reply : stream_reply("ERROR: Memory allocation failed");
+}
+
+// The stream at key, or NULL if there is none; *wrongtype is set if the
+// key holds another type
+static Stream *stream_lookup(HashTable *ht, const char *key, int *wrongtype) {
+    ValueType type;
+    void *value = ht_lookup(ht, key, &type);
+
+    *wrongtype = value && type != VALUE_STREAM;
+    return value && type == VALUE_STREAM ? (Stream *)value : NULL;
+}
+
+// Store a stream created by a command under key, or free it on failure
+static int stream_store(HashTable *ht, const char *key, Stream *s) {
+    if (ht_set_object(ht, key, VALUE_STREAM, s) != 0) {
+        stream_free(s);
+        return -1;
+    }
+    keystats_write(VALUE_STREAM, ht->db, key, s->memory);
+    return 0;
+}
+
+// Report an in-place change of an existing stream to the table and BIGKEYS
+static void stream_changed(HashTable *ht, const char *key, Stream *s, size_t before) {
+    ht_account_value(ht, (long long)s->memory - (long long)before);
+    keystats_write(VALUE_STREAM, ht->db, key, s->memory);
+}
+
+static int parse_count_arg(const char *str, size_t *count) {
+    uint64_t value;
+    if (parse_u64(str, strlen(str), &value) != 0 || value > SIZE_MAX) return -1;
+    *count = (size_t)value;
+    return 0;
+}
+
+// MAXLEN [=|~] count at tokens[*i]; advances *i past it
+static int parse_maxlen(char **tokens, int num_tokens, int *i, size_t *maxlen, int *approx) {
+    (*i)++;
+    *approx = 0;
+    if (*i < num_tokens && (strcmp(tokens[*i], "~") == 0 || strcmp(tokens[*i], "=") == 0)) {
+        *approx = tokens[*i][0] == '~';
+        (*i)++;
+    }
+    if (*i >= num_tokens || parse_count_arg(tokens[*i], maxlen) != 0) return -1;
+    (*i)++;
+    return 0;
+}
+
+// ID for a new entry from "*", "<ms>-*" or an explicit ID
+// Returns NULL on success or an error reply
+static const char *next_id(const Stream *s, const char *spec, StreamId *id) {
+    StreamId last = s ? s->last_id : ID_MIN;
+    size_t len = strlen(spec);
+
+    if (strcmp(spec, "*") == 0) {
+        uint64_t ms = now_ms();
+        if (ms > last.ms) {
+            id->ms = ms;
+            id->seq = 0;
+            return NULL;
+        }
+        // The clock went back or this millisecond is taken: keep counting
+        *id = last;
+        return id_incr(id) == 0 ? NULL : "ERROR: The stream has exhausted the last possible ID";
+    }
+
+    if (len > 2 && strcmp(spec + len - 2, "-*") == 0) {
+        if (parse_u64(spec, len - 2, &id->ms) != 0) {
+            return "ERROR: Invalid stream ID specified as stream command argument";
+        }
+        if (id->ms > last.ms || (id->ms == 0 && s == NULL)) {
+            id->seq = id->ms == 0 ? 1 : 0;
+            return NULL;
+        }
+        if (id->ms == last.ms && last.seq < UINT64_MAX) {
+            id->seq = last.seq + 1;
+            return NULL;
+        }
+        return "ERROR: The ID specified in XADD is equal or smaller than the target stream top item";
+    }
+
+    if (id_parse(spec, 0, id) != 0) {
+        return "ERROR: Invalid stream ID specified as stream command argument";
+    }
+    if (id_cmp(*id, ID_MIN) == 0) {
+        return "ERROR: The ID specified in XADD must be greater than 0-0";
+    }
+    if (id_cmp(*id, last) <= 0) {
+        return "ERROR: The ID specified in XADD is equal or smaller than the target stream top item";
+    }
+    return NULL;
+}
+
+// XADD key [NOMKSTREAM] [MAXLEN [=|~] count] id|* field value [field value ...]
+static char *cmd_xadd(HashTable *ht, char **tokens, int num_tokens) {
+    int i = 2, nomkstream = 0, approx = 0, trim = 0, wrongtype;
+    size_t maxlen = 0;
+
+    while (i < num_tokens) {
+        if (strcasecmp(tokens[i], "NOMKSTREAM") == 0) {
+            nomkstream = 1;
+            i++;
+        } else if (strcasecmp(tokens[i], "MAXLEN") == 0) {
+            if (parse_maxlen(tokens, num_tokens, &i, &maxlen, &approx) != 0) {
+                return stream_reply("ERROR: MAXLEN requires a count");
+            }
+            trim = 1;
+        } else {
+            break;
+        }
+    }
+
+    int num_fields = num_tokens - i - 1;
+    if (num_fields < 2 || num_fields % 2 != 0) {
+        return stream_reply("ERROR: XADD takes key [NOMKSTREAM] [MAXLEN [~] count] id "
+                            "field value [field value ...]");
+    }
+    char **fields = tokens + i + 1;
+    for (int f = 0; f < num_fields; f++) {
+        if (strlen(fields[f]) > MAX_VALUE_SIZE) {
+            return stream_reply("ERROR: Stream field or value too long");
+        }
+    }
+
+    Stream *s = stream_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) return stream_reply(WRONGTYPE_ERROR);
+    if (!s && nomkstream) return stream_reply("NULL");
+
+    StreamId id;
+    const char *error = next_id(s, tokens[i], &id);
+    if (error) return stream_reply("%s", error);
+
+    int created = !s;
+    if (created && !(s = stream_create())) {
+        return stream_reply("ERROR: Memory allocation failed");
+    }
+
+    size_t before = s->memory;
+    if (stream_append(s, id, fields, (size_t)num_fields) != 0) {
+        if (created) {
+            stream_free(s);
+        } else {
+            stream_changed(ht, tokens[1], s, before);
+        }
+        return stream_reply("ERROR: Memory allocation failed");
+    }
+    if (trim) stream_trim(s, maxlen, approx);
+
+    if (created) {
+        if (stream_store(ht, tokens[1], s) != 0) {
+            return stream_reply("ERROR: Failed to create stream");
+        }
+    } else {
+        stream_changed(ht, tokens[1], s, before);
+    }
+
+    char buf[ID_STR_SIZE];
+    id_format(id, buf);
+    log_info("XADD %s -> %s", tokens[1], buf);
+    return stream_reply("%s", buf);
+}
+
+// XRANGE key start end [COUNT n] / XREVRANGE key end start [COUNT n]
+static char *cmd_xrange(HashTable *ht, char **tokens, int num_tokens, int reverse) {
+    StreamId start, end;
+    size_t count = SIZE_MAX;
+    int wrongtype;
+
+    if (num_tokens != 4 && num_tokens != 6) {
+        return stream_reply("ERROR: %s takes key %s [COUNT n]", tokens[0],
+                            reverse ? "end start" : "start end");
+    }
+    if (range_bound(tokens[reverse ? 3 : 2], 0, &start) != 0 ||
+        range_bound(tokens[reverse ? 2 : 3], 1, &end) != 0) {
+        return stream_reply("ERROR: Invalid stream ID specified as stream command argument");
+    }
+    if (num_tokens == 6 && (strcasecmp(tokens[4], "COUNT") != 0 ||
+                            parse_count_arg(tokens[5], &count) != 0)) {
+        return stream_reply("ERROR: %s takes key %s [COUNT n]", tokens[0],
+                            reverse ? "end start" : "start end");
+    }
+
+    Stream *s = stream_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) return stream_reply(WRONGTYPE_ERROR);
+
+    StrBuf sb;
+    sb_init(&sb);
+    sb_append(&sb, "[", 1);
+    if (s && count > 0 && id_cmp(start, end) <= 0) {
+        StreamIter it;
+        EntryRef e;
+        size_t n = 0;
+        iter_start(&it, s, start, end, reverse);
+        while (n < count && iter_next(&it, &e)) {
+            if (n++) sb_append(&sb, ", ", 2);
+            entry_json(&sb, &e);
+        }
+    }
+    sb_append(&sb, "]", 1);
+    return stream_finish(&sb);
+}
+
+// XLEN key
+static char *cmd_xlen(HashTable *ht, char **tokens, int num_tokens) {
+    int wrongtype;
+
+    if (num_tokens != 2) return stream_reply("ERROR: XLEN requires a key");
+    Stream *s = stream_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) return stream_reply(WRONGTYPE_ERROR);
+    return stream_reply("%zu", s ? s->length : 0);
+}
+
+// XDEL key id [id ...]
+static char *cmd_xdel(HashTable *ht, char **tokens, int num_tokens) {
+    int wrongtype;
+    size_t deleted = 0;
+
+    if (num_tokens < 3) return stream_reply("ERROR: XDEL takes key id [id ...]");
+
+    // Parse every ID before deleting any
+    for (int i = 2; i < num_tokens; i++) {
+        StreamId id;
+        if (id_parse(tokens[i], 0, &id) != 0) {
+            return stream_reply("ERROR: Invalid stream ID specified as stream command argument");
+        }
+    }
+
+    Stream *s = stream_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) return stream_reply(WRONGTYPE_ERROR);
+    if (!s) return stream_reply("0");
+
+    size_t before = s->memory;
+    for (int i = 2; i < num_tokens; i++) {
+        StreamId id;
+        StreamNode *node;
+        EntryRef e;
+        id_parse(tokens[i], 0, &id);
+        if (entry_find(s, id, &node, &e) == 0) {
+            entry_delete(s, node, &e);
+            deleted++;
+        }
+    }
+    stream_changed(ht, tokens[1], s, before);
+    return stream_reply("%zu", deleted);
+}
+
+// XTRIM key MAXLEN [=|~] count
+static char *cmd_xtrim(HashTable *ht, char **tokens, int num_tokens) {
+    int i = 2, approx, wrongtype;
+    size_t maxlen;
+
+    if (num_tokens < 4 || strcasecmp(tokens[2], "MAXLEN") != 0 ||
+        parse_maxlen(tokens, num_tokens, &i, &maxlen, &approx) != 0 || i != num_tokens) {
+        return stream_reply("ERROR: XTRIM takes key MAXLEN [=|~] count");
+    }
+
+    Stream *s = stream_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) return stream_reply(WRONGTYPE_ERROR);
+    if (!s) return stream_reply("0");
+
+    size_t before = s->memory;
+    size_t removed = stream_trim(s, maxlen, approx);
+    stream_changed(ht, tokens[1], s, before);
+    return stream_reply("%zu", removed);
+}
+
+// Group ID argument: an ID, or "$" for the stream's last
+static int group_id(const Stream *s, const char *str, StreamId *id) {
+    if (strcmp(str, "$") == 0) {
+        *id = s ? s->last_id : ID_MIN;
+        return 0;
+    }
+    return id_parse(str, 0, id);
+}
+
+// XGROUP CREATE key group id|$ [MKSTREAM] | SETID key group id|$ |
+// DESTROY key group | DELCONSUMER key group consumer
+static char *cmd_xgroup(HashTable *ht, char **tokens, int num_tokens) {
+    int wrongtype;
+
+    if (num_tokens < 4) {
+        return stream_reply("ERROR: XGROUP subcommand must be CREATE, SETID, DESTROY or DELCONSUMER");
+    }
+    const char *sub = tokens[1], *key = tokens[2], *name = tokens[3];
+
+    Stream *s = stream_lookup(ht, key, &wrongtype);
+    if (wrongtype) return stream_reply(WRONGTYPE_ERROR);
+
+    if (strcasecmp(sub, "CREATE") == 0) {
+        StreamId id;
+        int mkstream = num_tokens == 6 && strcasecmp(tokens[5], "MKSTREAM") == 0;
+        if ((num_tokens != 5 && !mkstream) || group_id(s, tokens[4], &id) != 0) {
+            return stream_reply("ERROR: XGROUP CREATE takes key group id|$ [MKSTREAM]");
+        }
+        if (strlen(name) > MAX_KEY_SIZE) return stream_reply("ERROR: Group name too long");
+        if (!s && !mkstream) {
+            return stream_reply("ERROR: The XGROUP subcommand requires the key to exist");
+        }
+        if (s && group_find(s, name)) {
+            return stream_reply("ERROR: BUSYGROUP Consumer Group name already exists");
+        }
+
+        int created = !s;
+        if (created && !(s = stream_create())) {
+            return stream_reply("ERROR: Memory allocation failed");
+        }
+
+        size_t before = s->memory;
+        size_t size = sizeof(StreamGroup) + strlen(name) + 1;
+        StreamGroup *g = (StreamGroup *)mem_alloc(&s->memory, size);
+        if (!g) {
+            if (created) stream_free(s);
+            return stream_reply("ERROR: Memory allocation failed");
+        }
+        memset(g, 0, sizeof(StreamGroup));
+        g->last_delivered = id;
+        g->size = size;
+        strcpy(g->name, name);
+        g->next = s->groups;
+        s->groups = g;
+
+        if (created) {
+            if (stream_store(ht, key, s) != 0) return stream_reply("ERROR: Failed to create stream");
+        } else {
+            stream_changed(ht, key, s, before);
+        }
+        log_info("XGROUP CREATE %s %s", key, name);
+        return stream_reply("OK");
+    }
+
+    StreamGroup *g = s ? group_find(s, name) : NULL;
+
+    if (strcasecmp(sub, "SETID") == 0 && num_tokens == 5) {
+        StreamId id;
+        if (group_id(s, tokens[4], &id) != 0) {
+            return stream_reply("ERROR: Invalid stream ID specified as stream command argument");
+        }
+        if (!g) return stream_reply("ERROR: NOGROUP No such key '%s' or consumer group '%s'", key, name);
+        g->last_delivered = id;
+        return stream_reply("OK");
+    }
+    if (strcasecmp(sub, "DESTROY") == 0 && num_tokens == 4) {
+        if (!g) return stream_reply("0");
+
+        size_t before = s->memory;
+        StreamGroup **link = &s->groups;
+        while (*link != g) link = &(*link)->next;
+        *link = g->next;
+        group_free(s, g);
+        stream_changed(ht, key, s, before);
+        return stream_reply("1");
+    }
+    if (strcasecmp(sub, "DELCONSUMER") == 0 && num_tokens == 5) {
+        if (!g) return stream_reply("ERROR: NOGROUP No such key '%s' or consumer group '%s'", key, name);
+        StreamConsumer *c = consumer_get(s, g, tokens[4], 0);
+        if (!c) return stream_reply("0");
+
+        // Its pending entries go with it
+        size_t before = s->memory, dropped = c->pending;
+        for (StreamPending *p = pending_from(g, ID_MIN); p;) {
+            StreamPending *next = pending_after(g, p);
+            if (p->consumer == c) {
+                radix_remove(&g->pel, p->id, &s->memory);
+                mem_free(&s->memory, p, sizeof(StreamPending));
+            }
+            p = next;
+        }
+        StreamConsumer **link = &g->consumers;
+        while (*link != c) link = &(*link)->next;
+        *link = c->next;
+        consumer_free(s, c);
+        stream_changed(ht, key, s, before);
+        return stream_reply("%zu", dropped);
+    }
+    return stream_reply("ERROR: XGROUP subcommand must be CREATE, SETID, DESTROY or DELCONSUMER");
+}
+
+// XREADGROUP GROUP group consumer [COUNT n] [NOACK] STREAMS key id
+//   id ">" hands out entries no consumer of the group has seen; any other
+//   ID replays the consumer's own pending entries after it
+static char *cmd_xreadgroup(HashTable *ht, char **tokens, int num_tokens) {
+    size_t count = SIZE_MAX;
+    int noack = 0, i = 4, wrongtype;
+
+    if (num_tokens < 7 || strcasecmp(tokens[1], "GROUP") != 0) {
+        return stream_reply("ERROR: XREADGROUP takes GROUP group consumer [COUNT n] [NOACK] "
+                            "STREAMS key id");
+    }
+    while (i < num_tokens && strcasecmp(tokens[i], "STREAMS") != 0) {
+        if (strcasecmp(tokens[i], "COUNT") == 0 && i + 1 < num_tokens &&
+            parse_count_arg(tokens[i + 1], &count) == 0) {
+            i += 2;
+        } else if (strcasecmp(tokens[i], "NOACK") == 0) {
+            noack = 1;
+            i++;
+        } else if (strcasecmp(tokens[i], "BLOCK") == 0) {
+            return stream_reply("ERROR: XREADGROUP does not support BLOCK");
+        } else {
+            return stream_reply("ERROR: XREADGROUP takes GROUP group consumer [COUNT n] [NOACK] "
+                                "STREAMS key id");
+        }
+    }
+    if (i + 3 != num_tokens) {
+        return stream_reply("ERROR: XREADGROUP reads one stream: STREAMS key id");
+    }
+    const char *name = tokens[2], *key = tokens[i + 1], *from = tokens[i + 2];
+    int deliver_new = strcmp(from, ">") == 0;
+    StreamId after = ID_MIN;
+    if (!deliver_new && id_parse(from, 0, &after) != 0) {
+        return stream_reply("ERROR: Invalid stream ID specified as stream command argument");
+    }
+    if (strlen(tokens[3]) > MAX_KEY_SIZE) return stream_reply("ERROR: Consumer name too long");
+
+    Stream *s = stream_lookup(ht, key, &wrongtype);
+    if (wrongtype) return stream_reply(WRONGTYPE_ERROR);
+    StreamGroup *g = s ? group_find(s, name) : NULL;
+    if (!g) return stream_reply("ERROR: NOGROUP No such key '%s' or consumer group '%s'", key, name);
+
+    size_t before = s->memory;
+    StreamConsumer *c = consumer_get(s, g, tokens[3], 1);
+    if (!c) return stream_reply("ERROR: Memory allocation failed");
+    uint64_t now = now_ms();
+    c->seen_ms = now;
+
+    StrBuf sb;
+    size_t n = 0;
+    sb_init(&sb);
+    sb_append(&sb, "[", 1);
+
+    if (deliver_new) {
+        StreamId start = g->last_delivered;
+        if (count > 0 && id_incr(&start) == 0) {
+            StreamIter it;
+            EntryRef e;
+            iter_start(&it, s, start, ID_MAX, 0);
+            while (n < count && iter_next(&it, &e)) {
+                if (!noack && pending_add(s, g, c, e.id, now) != 0) break;
+                g->last_delivered = e.id;
+                if (n++) sb_append(&sb, ", ", 2);
+                entry_json(&sb, &e);
+            }
+        }
+    } else if (id_incr(&after) == 0) {
+        // History: entries deleted since delivery come back without fields
+        for (StreamPending *p = pending_from(g, after); p && n < count; p = pending_after(g, p)) {
+            if (p->consumer != c) continue;
+
+            StreamNode *node;
+            EntryRef e;
+            if (n++) sb_append(&sb, ", ", 2);
+            if (entry_find(s, p->id, &node, &e) == 0) {
+                entry_json(&sb, &e);
+            } else {
+                char id[ID_STR_SIZE];
+                id_format(p->id, id);
+                sb_printf(&sb, "{\"id\": \"%s\", \"fields\": null}", id);
+            }
+        }
+    }
+
+    sb_append(&sb, "]", 1);
+    stream_changed(ht, key, s, before);
+    return stream_finish(&sb);
+}
+
+// XACK key group id [id ...]
+static char *cmd_xack(HashTable *ht, char **tokens, int num_tokens) {
+    int wrongtype;
+    size_t acked = 0;
+
+    if (num_tokens < 4) return stream_reply("ERROR: XACK takes key group id [id ...]");
+    for (int i = 3; i < num_tokens; i++) {
+        StreamId id;
+        if (id_parse(tokens[i], 0, &id) != 0) {
+            return stream_reply("ERROR: Invalid stream ID specified as stream command argument");
+        }
+    }
+
+    Stream *s = stream_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) return stream_reply(WRONGTYPE_ERROR);
+    StreamGroup *g = s ? group_find(s, tokens[2]) : NULL;
+    if (!g) return stream_reply("0");
+
+    size_t before = s->memory;
+    for (int i = 3; i < num_tokens; i++) {
+        StreamId id;
+        id_parse(tokens[i], 0, &id);
+        StreamPending *p = (StreamPending *)radix_remove(&g->pel, id, &s->memory);
+        if (p) {
+            p->consumer->pending--;
+            mem_free(&s->memory, p, sizeof(StreamPending));
+            acked++;
+        }
+    }
+    stream_changed(ht, tokens[1], s, before);
+    return stream_reply("%zu", acked);
+}
+
+// XPENDING key group [start end count [consumer]]
+static char *cmd_xpending(HashTable *ht, char **tokens, int num_tokens) {
+    int wrongtype;
+    StrBuf sb;
+    char id[ID_STR_SIZE];
+
+    if (num_tokens != 3 && num_tokens != 6 && num_tokens != 7) {
+        return stream_reply("ERROR: XPENDING takes key group [start end count [consumer]]");
+    }
+
+    Stream *s = stream_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) return stream_reply(WRONGTYPE_ERROR);
+    StreamGroup *g = s ? group_find(s, tokens[2]) : NULL;
+    if (!g) {
+        return stream_reply("ERROR: NOGROUP No such key '%s' or consumer group '%s'",
+                            tokens[1], tokens[2]);
+    }
+
+    sb_init(&sb);
+    if (num_tokens == 3) {
+        // Summary: how much is pending, the ID span and who holds it
+        StreamPending *min = (StreamPending *)radix_edge(g->pel.root, 0);
+        StreamPending *max = (StreamPending *)radix_edge(g->pel.root, 1);
+        sb_printf(&sb, "{\"pending\": %zu, \"min\": ", g->pel.size);
+        if (min) {
+            id_format(min->id, id);
+            sb_printf(&sb, "\"%s\", \"max\": ", id);
+            id_format(max->id, id);
+            sb_printf(&sb, "\"%s\"", id);
+        } else {
+            sb_printf(&sb, "null, \"max\": null");
+        }
+        sb_printf(&sb, ", \"consumers\": [");
+        int first = 1;
+        for (StreamConsumer *c = g->consumers; c; c = c->next) {
+            if (c->pending == 0) continue;
+            sb_printf(&sb, "%s{\"name\": ", first ? "" : ", ");
+            sb_json_string(&sb, c->name, strlen(c->name));
+            sb_printf(&sb, ", \"pending\": %zu}", c->pending);
+            first = 0;
+        }
+        sb_append(&sb, "]}", 2);
+        return stream_finish(&sb);
+    }
+
+    StreamId start, end;
+    size_t count;
+    if (range_bound(tokens[3], 0, &start) != 0 || range_bound(tokens[4], 1, &end) != 0 ||
+        parse_count_arg(tokens[5], &count) != 0) {
+        return stream_reply("ERROR: XPENDING takes key group [start end count [consumer]]");
+    }
+    const char *owner = num_tokens == 7 ? tokens[6] : NULL;
+    uint64_t now = now_ms();
+    size_t n = 0;
+
+    sb_append(&sb, "[", 1);
+    for (StreamPending *p = pending_from(g, start);
+         p && n < count && id_cmp(p->id, end) <= 0; p = pending_after(g, p)) {
+        if (owner && strcmp(p->consumer->name, owner) != 0) continue;
+        id_format(p->id, id);
+        sb_printf(&sb, "%s{\"id\": \"%s\", \"consumer\": ", n++ ? ", " : "", id);
+        sb_json_string(&sb, p->consumer->name, strlen(p->consumer->name));
+        sb_printf(&sb, ", \"idle_ms\": %llu, \"deliveries\": %llu}",
+                  (unsigned long long)(now > p->delivered_ms ? now - p->delivered_ms : 0),
+                  (unsigned long long)p->deliveries);
+    }
+    sb_append(&sb, "]", 1);
+    return stream_finish(&sb);
+}
+
+// XINFO STREAM key | XINFO GROUPS key | XINFO CONSUMERS key group
+static char *cmd_xinfo(HashTable *ht, char **tokens, int num_tokens) {
+    int wrongtype;
+    StrBuf sb;
+    char id[ID_STR_SIZE];
+
+    if (num_tokens < 3) {
+        return stream_reply("ERROR: XINFO subcommand must be STREAM, GROUPS or CONSUMERS");
+    }
+    Stream *s = stream_lookup(ht, tokens[2], &wrongtype);
+    if (wrongtype) return stream_reply(WRONGTYPE_ERROR);
+    if (!s) return stream_reply("ERROR: no such key");
+
+    sb_init(&sb);
+    if (strcasecmp(tokens[1], "STREAM") == 0 && num_tokens == 3) {
+        size_t groups = 0;
+        for (StreamGroup *g = s->groups; g; g = g->next) groups++;
+
+        id_format(s->last_id, id);
+        sb_printf(&sb, "{\"length\": %zu, \"nodes\": %zu, \"memory\": %zu, "
+                  "\"last_generated_id\": \"%s\", \"groups\": %zu, \"first_entry\": ",
+                  s->length, s->nodes.size, s->memory, id, groups);
+        for (int last = 0; last <= 1; last++) {
+            StreamIter it;
+            EntryRef e;
+            iter_start(&it, s, ID_MIN, ID_MAX, last);
+            if (iter_next(&it, &e)) {
+                entry_json(&sb, &e);
+            } else {
+                sb_printf(&sb, "null");
+            }
+            if (!last) sb_printf(&sb, ", \"last_entry\": ");
+        }
+        sb_append(&sb, "}", 1);
+        return stream_finish(&sb);
+    }
+    if (strcasecmp(tokens[1], "GROUPS") == 0 && num_tokens == 3) {
+        sb_append(&sb, "[", 1);
+        for (StreamGroup *g = s->groups; g; g = g->next) {
+            size_t consumers = 0;
+            for (StreamConsumer *c = g->consumers; c; c = c->next) consumers++;
+            id_format(g->last_delivered, id);
+            sb_printf(&sb, "%s{\"name\": ", g == s->groups ? "" : ", ");
+            sb_json_string(&sb, g->name, strlen(g->name));
+            sb_printf(&sb, ", \"consumers\": %zu, \"pending\": %zu, \"last_delivered_id\": \"%s\"}",
+                      consumers, g->pel.size, id);
+        }
+        sb_append(&sb, "]", 1);
+        return stream_finish(&sb);
+    }
+    if (strcasecmp(tokens[1], "CONSUMERS") == 0 && num_tokens == 4) {
+        StreamGroup *g = group_find(s, tokens[3]);
+        if (!g) {
+            return stream_reply("ERROR: NOGROUP No such key '%s' or consumer group '%s'",
+                                tokens[2], tokens[3]);
+        }
+        uint64_t now = now_ms();
+        sb_append(&sb, "[", 1);
+        for (StreamConsumer *c = g->consumers; c; c = c->next) {
+            sb_printf(&sb, "%s{\"name\": ", c == g->consumers ? "" : ", ");
+            sb_json_string(&sb, c->name, strlen(c->name));
+            sb_printf(&sb, ", \"pending\": %zu, \"idle_ms\": %llu}", c->pending,
+                      (unsigned long long)(now > c->seen_ms ? now - c->seen_ms : 0));
+        }
+        sb_append(&sb, "]", 1);
+        return stream_finish(&sb);
+    }
+    return stream_reply("ERROR: XINFO subcommand must be STREAM, GROUPS or CONSUMERS");
+}
+
+// ============================================================================
+// Dispatch
+// ============================================================================
+// Where each command's key is: a token index, or -1 for the token after
+// STREAMS
+static const struct {
+    const char *name;
+    int key_index;
+    int writes;
+} stream_commands[] = {
+    { "XADD", 1, 1 },       { "XRANGE", 1, 0 },     { "XREVRANGE", 1, 0 },
+    { "XLEN", 1, 0 },       { "XDEL", 1, 1 },       { "XTRIM", 1, 1 },
+    { "XGROUP", 2, 1 },     { "XREADGROUP", -1, 1 }, { "XACK", 1, 1 },
+    { "XPENDING", 1, 0 },   { "XINFO", 2, 0 },
+};
+
+const char *stream_command_key(char **tokens, int num_tokens, int *writes) {
+    for (size_t i = 0; i < sizeof(stream_commands) / sizeof(stream_commands[0]); i++) {
+        if (strcasecmp(tokens[0], stream_commands[i].name) != 0) continue;
+
+        *writes = stream_commands[i].writes;
+        int index = stream_commands[i].key_index;
+        if (index < 0) {
+            for (int t = 1; t + 1 < num_tokens; t++) {
+                if (strcasecmp(tokens[t], "STREAMS") == 0) return tokens[t + 1];
+            }
+            return NULL;
+        }
+        return index < num_tokens ? tokens[index] : NULL;
+    }
+    return NULL;
+}
+
+char *stream_command(HashTable *ht, char **tokens, int num_tokens) {
+    const char *name = tokens[0];
+
+    if (num_tokens < 2 && strcasecmp(name, "XADD") == 0) {
+        return stream_reply("ERROR: XADD requires a key");
+    }
+    if (strcasecmp(name, "XADD") == 0) return cmd_xadd(ht, tokens, num_tokens);
+    if (strcasecmp(name, "XRANGE") == 0) return cmd_xrange(ht, tokens, num_tokens, 0);
+    if (strcasecmp(name, "XREVRANGE") == 0) return cmd_xrange(ht, tokens, num_tokens, 1);
+    if (strcasecmp(name, "XLEN") == 0) return cmd_xlen(ht, tokens, num_tokens);
+    if (strcasecmp(name, "XDEL") == 0) return cmd_xdel(ht, tokens, num_tokens);
+    if (strcasecmp(name, "XTRIM") == 0) return cmd_xtrim(ht, tokens, num_tokens);
+    if (strcasecmp(name, "XGROUP") == 0) return cmd_xgroup(ht, tokens, num_tokens);
+    if (strcasecmp(name, "XREADGROUP") == 0) return cmd_xreadgroup(ht, tokens, num_tokens);
+    if (strcasecmp(name, "XACK") == 0) return cmd_xack(ht, tokens, num_tokens);
+    if (strcasecmp(name, "XPENDING") == 0) return cmd_xpending(ht, tokens, num_tokens);
+    if (strcasecmp(name, "XINFO") == 0) return cmd_xinfo(ht, tokens, num_tokens);
+    return NULL;
+}
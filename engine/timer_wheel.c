@@ -0,0 +1,202 @@
+// ============================================================================
+// timer_wheel.c - Hierarchical Timer Wheel for Mini-Redis
+// ============================================================================
+//
+// TW_LEVELS wheels of TW_SLOTS slots each. Level 0 has one slot per tick;
+// every higher level's slot spans a full turn of the level below it. A timer
+// is filed in the lowest level that can hold its deadline, and is moved
+// ("cascaded") one level down when the lower wheel wraps around to it.
+//
+// Insert and cancel are O(1) (doubly-linked slot lists); advancing costs one
+// slot visit per tick plus the occasional cascade.
+// ============================================================================
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mini_redis.h"
+
+#define TW_BITS 6
+#define TW_SLOTS (1 << TW_BITS)
+#define TW_MASK (TW_SLOTS - 1)
+#define TW_LEVELS 4
+
+struct TimerWheel {
+    Timer *slots[TW_LEVELS][TW_SLOTS];
+    uint64_t start_ms;        // Wall time of tick 0
+    uint64_t now;             // Current tick
+    size_t count;             // Pending timers
+};
+
+// ============================================================================
+// Monotonic Clock
+// ============================================================================
+uint64_t tw_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+// ============================================================================
+// Slot Lists
+// ============================================================================
+static void slot_push(Timer **slot, Timer *t) {
+    t->prev = NULL;
+    t->next = *slot;
+    if (*slot) (*slot)->prev = t;
+    *slot = t;
+    t->slot = slot;
+}
+
+static void slot_remove(Timer *t) {
+    if (t->prev) t->prev->next = t->next;
+    else *t->slot = t->next;
+    if (t->next) t->next->prev = t->prev;
+    t->prev = t->next = NULL;
+    t->slot = NULL;
+}
+
+// File a timer in the lowest level whose range covers its deadline
+static void tw_place(TimerWheel *tw, Timer *t) {
+    uint64_t delta = t->expires - tw->now;
+    int level = 0;
+
+    while (level < TW_LEVELS - 1 && delta >= ((uint64_t)1 << (TW_BITS * (level + 1)))) {
+        level++;
+    }
+
+    // Deadlines beyond the top wheel wait in its furthest slot and are
+    // re-filed every time it comes around
+    uint64_t max_delta = ((uint64_t)1 << (TW_BITS * TW_LEVELS)) - 1;
+    uint64_t expires = delta > max_delta ? tw->now + max_delta : t->expires;
+
+    size_t index = (size_t)((expires >> (TW_BITS * level)) & TW_MASK);
+    slot_push(&tw->slots[level][index], t);
+}
+
+// ============================================================================
+// Create / Destroy
+// ============================================================================
+TimerWheel *tw_create(void) {
+    TimerWheel *tw = (TimerWheel *)calloc(1, sizeof(TimerWheel));
+    if (!tw) return NULL;
+    tw->start_ms = tw_now_ms();
+    return tw;
+}
+
+void tw_destroy(TimerWheel *tw) {
+    // Timers are owned by their embedders; just detach them
+    if (!tw) return;
+    for (int level = 0; level < TW_LEVELS; level++) {
+        for (int i = 0; i < TW_SLOTS; i++) {
+            while (tw->slots[level][i]) slot_remove(tw->slots[level][i]);
+        }
+    }
+    free(tw);
+}
+
+// ============================================================================
+// Add / Cancel
+// ============================================================================
+void tw_init_timer(Timer *t, TimerCallback callback, void *arg) {
+    memset(t, 0, sizeof(*t));
+    t->callback = callback;
+    t->arg = arg;
+}
+
+void tw_add(TimerWheel *tw, Timer *t, uint64_t delay_ms) {
+    if (t->slot) tw_cancel(tw, t);
+
+    uint64_t ticks = (delay_ms + TW_TICK_MS - 1) / TW_TICK_MS;
+    if (ticks == 0) ticks = 1;
+
+    t->expires = tw->now + ticks;
+    tw_place(tw, t);
+    tw->count++;
+}
+
+void tw_cancel(TimerWheel *tw, Timer *t) {
+    if (!t->slot) return;
+    slot_remove(t);
+    tw->count--;
+}
+
+int tw_pending(const Timer *t) {
+    return t->slot != NULL;
+}
+
+// ============================================================================
+// Advance
+// ============================================================================
+
+// Move every timer in a higher-level slot down to where it now belongs
+static void tw_cascade(TimerWheel *tw, int level, size_t index) {
+    Timer *t = tw->slots[level][index];
+    tw->slots[level][index] = NULL;
+
+    while (t) {
+        Timer *next = t->next;
+        t->slot = NULL;
+        tw_place(tw, t);
+        t = next;
+    }
+}
+
+void tw_advance(TimerWheel *tw, uint64_t now_ms) {
+    uint64_t target = (now_ms - tw->start_ms) / TW_TICK_MS;
+
+    while (tw->now < target) {
+        tw->now++;
+
+        // Wrapping a wheel pulls the next slot of the wheel above down
+        size_t index = (size_t)(tw->now & TW_MASK);
+        for (int level = 1; index == 0 && level < TW_LEVELS; level++) {
+            index = (size_t)((tw->now >> (TW_BITS * level)) & TW_MASK);
+            tw_cascade(tw, level, index);
+        }
+
+        // Detach the due slot first: callbacks may re-arm their own timer
+        Timer **slot = &tw->slots[0][tw->now & TW_MASK];
+        Timer *due = *slot;
+        *slot = NULL;
+
+        while (due) {
+            Timer *t = due;
+            due = t->next;
+            if (due) due->prev = NULL;
+
+            t->prev = t->next = NULL;
+            t->slot = NULL;
+            tw->count--;
+
+            if (t->expires > tw->now) {
+                // Parked in an overflow slot; not due yet
+                tw_place(tw, t);
+                tw->count++;
+                continue;
+            }
+            t->callback(tw, t);
+        }
+    }
+}
+
+int tw_next_timeout(const TimerWheel *tw, uint64_t now_ms, int max_ms) {
+    if (tw->count == 0) return max_ms;
+
+    // Nearest occupied level-0 slot before the wheel wraps; past that the
+    // next cascade is the earliest point anything can become due
+    uint64_t ticks = TW_SLOTS - (tw->now & TW_MASK);
+    for (uint64_t i = 1; i < TW_SLOTS; i++) {
+        if (tw->slots[0][(tw->now + i) & TW_MASK]) {
+            ticks = i;
+            break;
+        }
+    }
+
+    uint64_t due_ms = tw->start_ms + (tw->now + ticks) * TW_TICK_MS;
+    if (due_ms <= now_ms) return 0;
+    if (due_ms - now_ms >= (uint64_t)max_ms) return max_ms;
+    return (int)(due_ms - now_ms);
+}
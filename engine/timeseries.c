@@ -0,0 +1,838 @@
+// ============================================================================
+// timeseries.c - Compressed Time Series with Downsampling
+// ============================================================================
+//
+// A series is a list of (timestamp ms, double) samples with increasing
+// timestamps, packed into chunks of up to TS_CHUNK_BYTES with the Gorilla
+// encoding:
+//   - timestamps as the delta of the delta from the previous one, which is
+//     0 for a regular interval and costs one bit
+//   - values XORed with the previous one; an unchanged value costs one bit,
+//     and a slowly moving one only the bits that differ
+// A metric sampled every second takes one to two bytes per sample instead
+// of a key per sample.
+//
+// TS.RANGE ... AGGREGATION decodes a batch of samples at a time into
+// timestamp and value arrays and reduces each bucket's run of values with
+// four-lane loops the compiler can keep in SIMD registers. Retention drops
+// whole chunks that have fallen out of the window as samples are added.
+// ============================================================================
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include "mini_redis.h"
+
+#define TS_CHUNK_BYTES 4096       // A chunk takes no more samples once this full
+#define TS_CHUNK_MIN_BYTES 128
+#define TS_SAMPLE_MAX_BITS 146    // Worst case: 4 + 64 timestamp, 2 + 12 + 64 value
+#define TS_BATCH 256              // Samples decoded per aggregation pass
+#define TS_NO_WINDOW 0xff         // No XOR window written yet in the chunk
+
+typedef struct TsChunk {
+    struct TsChunk *next;
+    int64_t first_ts;
+    int64_t last_ts;
+    uint64_t *words;          // Bit stream, most significant bit first
+    uint32_t cap_words;
+    uint32_t bits;            // Bits written
+    uint32_t count;           // Samples
+    // Encoder state for the next append
+    int64_t last_delta;
+    uint64_t last_bits;       // Previous value's bits
+    uint8_t leading;          // Window of the last XOR written in full
+    uint8_t trailing;
+} TsChunk;
+
+struct TimeSeries {
+    TsChunk *first;
+    TsChunk *last;            // Appends go here
+    size_t chunks;
+    size_t samples;
+    int64_t retention_ms;     // 0 keeps every sample
+    size_t memory;            // Allocator bytes of all of the above
+};
+
+// ============================================================================
+// Accounted Allocations
+// ============================================================================
+static void *mem_alloc(size_t *memory, size_t size) {
+    void *ptr = malloc(size);
+    if (ptr) *memory += alloc_usable_size(ptr, size);
+    return ptr;
+}
+
+static void *mem_realloc(size_t *memory, void *ptr, size_t old_size, size_t size) {
+    size_t old_bytes = alloc_usable_size(ptr, old_size);
+    void *grown = realloc(ptr, size);
+    if (!grown) return NULL;
+    *memory += alloc_usable_size(grown, size) - old_bytes;
+    return grown;
+}
+
+static void mem_free(size_t *memory, void *ptr, size_t size) {
+    if (!ptr) return;
+    *memory -= alloc_usable_size(ptr, size);
+    free(ptr);
+}
+
+// ============================================================================
+// Bit Stream
+// ============================================================================
+// Append the low n bits of value (1 <= n <= 64); the words must be zeroed
+static void bits_put(TsChunk *c, uint64_t value, unsigned n) {
+    uint32_t word = c->bits / 64;
+    unsigned room = 64 - c->bits % 64;
+
+    if (n < 64) value &= (1ULL << n) - 1;
+    if (n <= room) {
+        c->words[word] |= value << (room - n);
+    } else {
+        c->words[word] |= value >> (n - room);
+        c->words[word + 1] |= value << (64 - (n - room));
+    }
+    c->bits += n;
+}
+
+typedef struct BitReader {
+    const uint64_t *words;
+    uint32_t pos;
+} BitReader;
+
+static uint64_t bits_get(BitReader *r, unsigned n) {
+    uint32_t word = r->pos / 64;
+    unsigned room = 64 - r->pos % 64;
+    uint64_t value;
+
+    if (n <= room) {
+        value = r->words[word] >> (room - n);
+    } else {
+        value = r->words[word] << (n - room) | r->words[word + 1] >> (64 - (n - room));
+    }
+    r->pos += n;
+    return n < 64 ? value & ((1ULL << n) - 1) : value;
+}
+
+static int64_t sign_extend(uint64_t value, unsigned n) {
+    uint64_t sign = 1ULL << (n - 1);
+    return n < 64 ? (int64_t)((value ^ sign) - sign) : (int64_t)value;
+}
+
+static uint64_t double_bits(double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+static double bits_double(uint64_t bits) {
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+// ============================================================================
+// Gorilla Encoding
+// ============================================================================
+// Delta of delta: '0' for none, then '10', '110' and '1110' before 7, 9 and
+// 12 bit values, '1111' before a full 64 bits
+static void put_timestamp(TsChunk *c, int64_t ts) {
+    int64_t delta = ts - c->last_ts;
+    int64_t dod = delta - c->last_delta;
+
+    if (dod == 0) {
+        bits_put(c, 0, 1);
+    } else if (dod >= -64 && dod <= 63) {
+        bits_put(c, 0x2, 2);
+        bits_put(c, (uint64_t)dod, 7);
+    } else if (dod >= -256 && dod <= 255) {
+        bits_put(c, 0x6, 3);
+        bits_put(c, (uint64_t)dod, 9);
+    } else if (dod >= -2048 && dod <= 2047) {
+        bits_put(c, 0xe, 4);
+        bits_put(c, (uint64_t)dod, 12);
+    } else {
+        bits_put(c, 0xf, 4);
+        bits_put(c, (uint64_t)dod, 64);
+    }
+    c->last_delta = delta;
+    c->last_ts = ts;
+}
+
+// XOR with the previous value: '0' if equal; '10' and the bits inside the
+// last window if they fit; else '11', 6 bits of leading zeros, 6 bits of
+// length - 1 and the meaningful bits, which become the new window
+static void put_value(TsChunk *c, double v) {
+    uint64_t bits = double_bits(v);
+    uint64_t x = bits ^ c->last_bits;
+
+    if (x == 0) {
+        bits_put(c, 0, 1);
+    } else {
+        unsigned leading = (unsigned)__builtin_clzll(x);
+        unsigned trailing = (unsigned)__builtin_ctzll(x);
+        if (c->leading != TS_NO_WINDOW && leading >= c->leading && trailing >= c->trailing) {
+            bits_put(c, 0x2, 2);
+            bits_put(c, x >> c->trailing, 64 - c->leading - c->trailing);
+        } else {
+            unsigned meaningful = 64 - leading - trailing;
+            bits_put(c, 0x3, 2);
+            bits_put(c, leading, 6);
+            bits_put(c, meaningful - 1, 6);
+            bits_put(c, x >> trailing, meaningful);
+            c->leading = (uint8_t)leading;
+            c->trailing = (uint8_t)trailing;
+        }
+    }
+    c->last_bits = bits;
+}
+
+typedef struct TsDecoder {
+    BitReader r;
+    uint32_t left;            // Samples still to decode
+    int first;
+    int64_t ts;
+    int64_t delta;
+    uint64_t bits;
+    unsigned leading;
+    unsigned trailing;
+} TsDecoder;
+
+static void decoder_init(TsDecoder *d, const TsChunk *c) {
+    d->r.words = c->words;
+    d->r.pos = 0;
+    d->left = c->count;
+    d->first = 1;
+    d->ts = c->first_ts;
+    d->delta = 0;
+    d->bits = 0;
+    d->leading = d->trailing = 0;
+}
+
+static void decoder_next(TsDecoder *d, int64_t *ts, double *value) {
+    d->left--;
+    if (d->first) {
+        // The first sample's timestamp is the chunk's; its value is raw
+        d->first = 0;
+        d->bits = bits_get(&d->r, 64);
+        *ts = d->ts;
+        *value = bits_double(d->bits);
+        return;
+    }
+
+    unsigned prefix = 0;
+    while (prefix < 4 && bits_get(&d->r, 1)) prefix++;
+    static const unsigned dod_bits[] = { 0, 7, 9, 12, 64 };
+    if (prefix > 0) d->delta += sign_extend(bits_get(&d->r, dod_bits[prefix]), dod_bits[prefix]);
+    d->ts += d->delta;
+
+    if (bits_get(&d->r, 1)) {
+        if (bits_get(&d->r, 1)) {
+            d->leading = (unsigned)bits_get(&d->r, 6);
+            unsigned meaningful = (unsigned)bits_get(&d->r, 6) + 1;
+            d->trailing = 64 - d->leading - meaningful;
+        }
+        d->bits ^= bits_get(&d->r, 64 - d->leading - d->trailing) << d->trailing;
+    }
+    *ts = d->ts;
+    *value = bits_double(d->bits);
+}
+
+// ============================================================================
+// Chunks
+// ============================================================================
+static TsChunk *chunk_create(TimeSeries *ts) {
+    TsChunk *c = (TsChunk *)mem_alloc(&ts->memory, sizeof(TsChunk));
+    if (!c) return NULL;
+
+    size_t bytes = TS_CHUNK_MIN_BYTES;
+    c->words = (uint64_t *)mem_alloc(&ts->memory, bytes);
+    if (!c->words) {
+        mem_free(&ts->memory, c, sizeof(TsChunk));
+        return NULL;
+    }
+    memset(c->words, 0, bytes);
+    c->cap_words = (uint32_t)(bytes / sizeof(uint64_t));
+    c->bits = c->count = 0;
+    c->next = NULL;
+
+    if (ts->last) {
+        ts->last->next = c;
+    } else {
+        ts->first = c;
+    }
+    ts->last = c;
+    ts->chunks++;
+    return c;
+}
+
+static void chunk_remove_first(TimeSeries *ts) {
+    TsChunk *c = ts->first;
+
+    ts->first = c->next;
+    if (!ts->first) ts->last = NULL;
+    ts->chunks--;
+    ts->samples -= c->count;
+    mem_free(&ts->memory, c->words, c->cap_words * sizeof(uint64_t));
+    mem_free(&ts->memory, c, sizeof(TsChunk));
+}
+
+// Make room for one more sample of the worst-case size
+static int chunk_reserve(TimeSeries *ts, TsChunk *c) {
+    size_t need = (c->bits + TS_SAMPLE_MAX_BITS + 63) / 64;
+    if (need <= c->cap_words) return 0;
+
+    size_t words = c->cap_words * 2;
+    while (words < need) words *= 2;
+    uint64_t *grown = (uint64_t *)mem_realloc(&ts->memory, c->words,
+                                              c->cap_words * sizeof(uint64_t),
+                                              words * sizeof(uint64_t));
+    if (!grown) return -1;
+    memset(grown + c->cap_words, 0, (words - c->cap_words) * sizeof(uint64_t));
+    c->words = grown;
+    c->cap_words = (uint32_t)words;
+    return 0;
+}
+
+// Append a sample newer than every other; opens a new chunk when the last
+// one is full
+static int series_append(TimeSeries *ts, int64_t t, double value) {
+    TsChunk *c = ts->last;
+
+    if (!c || c->bits + TS_SAMPLE_MAX_BITS > TS_CHUNK_BYTES * 8) {
+        c = chunk_create(ts);
+        if (!c) return -1;
+    }
+    if (chunk_reserve(ts, c) != 0) return -1;
+
+    if (c->count == 0) {
+        c->first_ts = c->last_ts = t;
+        c->last_delta = 0;
+        c->leading = c->trailing = TS_NO_WINDOW;
+        c->last_bits = double_bits(value);
+        bits_put(c, c->last_bits, 64);
+    } else {
+        put_timestamp(c, t);
+        put_value(c, value);
+    }
+    c->count++;
+    ts->samples++;
+    return 0;
+}
+
+// Drop the chunks wholly older than the retention window; the newest chunk
+// always stays
+static void series_trim(TimeSeries *ts) {
+    if (ts->retention_ms <= 0 || !ts->last) return;
+
+    int64_t cutoff = ts->last->last_ts - ts->retention_ms;
+    while (ts->first != ts->last && ts->first->last_ts < cutoff) chunk_remove_first(ts);
+}
+
+// ============================================================================
+// Series Object
+// ============================================================================
+static TimeSeries *series_create(int64_t retention_ms) {
+    TimeSeries *ts = (TimeSeries *)malloc(sizeof(TimeSeries));
+    if (!ts) return NULL;
+
+    memset(ts, 0, sizeof(TimeSeries));
+    ts->retention_ms = retention_ms;
+    ts->memory = alloc_usable_size(ts, sizeof(TimeSeries));
+    return ts;
+}
+
+void ts_free(TimeSeries *ts) {
+    if (!ts) return;
+    while (ts->first) chunk_remove_first(ts);
+    free(ts);
+}
+
+size_t ts_memory(const TimeSeries *ts) {
+    return ts->memory;
+}
+
+// ============================================================================
+// Aggregation
+// ============================================================================
+typedef enum TsAggregation {
+    AGG_NONE = 0,
+    AGG_AVG,
+    AGG_SUM,
+    AGG_MIN,
+    AGG_MAX,
+    AGG_COUNT
+} TsAggregation;
+
+static const char *aggregation_names[] = { "", "AVG", "SUM", "MIN", "MAX", "COUNT" };
+
+// Reductions over one bucket's run of values, in four independent lanes so
+// the loop carries no dependency from one value to the next
+static double values_sum(const double *v, size_t n) {
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        s0 += v[i];
+        s1 += v[i + 1];
+        s2 += v[i + 2];
+        s3 += v[i + 3];
+    }
+    for (; i < n; i++) s0 += v[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+static double values_min(const double *v, size_t n) {
+    double m0 = v[0], m1 = v[0], m2 = v[0], m3 = v[0];
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        m0 = v[i] < m0 ? v[i] : m0;
+        m1 = v[i + 1] < m1 ? v[i + 1] : m1;
+        m2 = v[i + 2] < m2 ? v[i + 2] : m2;
+        m3 = v[i + 3] < m3 ? v[i + 3] : m3;
+    }
+    for (; i < n; i++) m0 = v[i] < m0 ? v[i] : m0;
+    m0 = m1 < m0 ? m1 : m0;
+    m2 = m3 < m2 ? m3 : m2;
+    return m2 < m0 ? m2 : m0;
+}
+
+static double values_max(const double *v, size_t n) {
+    double m0 = v[0], m1 = v[0], m2 = v[0], m3 = v[0];
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        m0 = v[i] > m0 ? v[i] : m0;
+        m1 = v[i + 1] > m1 ? v[i + 1] : m1;
+        m2 = v[i + 2] > m2 ? v[i + 2] : m2;
+        m3 = v[i + 3] > m3 ? v[i + 3] : m3;
+    }
+    for (; i < n; i++) m0 = v[i] > m0 ? v[i] : m0;
+    m0 = m1 > m0 ? m1 : m0;
+    m2 = m3 > m2 ? m3 : m2;
+    return m2 > m0 ? m2 : m0;
+}
+
+// One bucket being accumulated across batches
+typedef struct TsBucket {
+    int64_t start;
+    size_t count;
+    double sum;
+    double min;
+    double max;
+} TsBucket;
+
+static void bucket_add(TsBucket *b, TsAggregation agg, const double *v, size_t n) {
+    if (agg == AGG_AVG || agg == AGG_SUM) b->sum += values_sum(v, n);
+    if (agg == AGG_MIN) {
+        double m = values_min(v, n);
+        b->min = b->count == 0 || m < b->min ? m : b->min;
+    }
+    if (agg == AGG_MAX) {
+        double m = values_max(v, n);
+        b->max = b->count == 0 || m > b->max ? m : b->max;
+    }
+    b->count += n;
+}
+
+static double bucket_value(const TsBucket *b, TsAggregation agg) {
+    switch (agg) {
+    case AGG_AVG:
+        return b->sum / (double)b->count;
+    case AGG_SUM:
+        return b->sum;
+    case AGG_MIN:
+        return b->min;
+    case AGG_MAX:
+        return b->max;
+    default:
+        return (double)b->count;
+    }
+}
+
+// ============================================================================
+// Commands
+// ============================================================================
+static char *ts_reply(const char *fmt, ...) {
+    char buffer[256];
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, args);
+    va_end(args);
+
+    size_t len = strlen(buffer) + 1;
+    char *reply = (char *)malloc(len);
+    if (reply) memcpy(reply, buffer, len);
+    return reply;
+}
+
+// Shortest of %.15g and %.17g that reads back as the same double; null
+// for the infinities a sum can overflow to, which JSON cannot hold
+static void format_value(StrBuf *sb, double v) {
+    char buf[32];
+
+    if (!isfinite(v)) {
+        sb_append(sb, "null", 4);
+        return;
+    }
+    snprintf(buf, sizeof(buf), "%.15g", v);
+    if (strtod(buf, NULL) != v) snprintf(buf, sizeof(buf), "%.17g", v);
+    sb_append(sb, buf, strlen(buf));
+}
+
+static int parse_timestamp(const char *str, int64_t *ts) {
+    char *end;
+
+    if (!isdigit((unsigned char)*str)) return -1;
+    errno = 0;
+    long long value = strtoll(str, &end, 10);
+    if (*end != '\0' || errno == ERANGE) return -1;
+    *ts = (int64_t)value;
+    return 0;
+}
+
+// Any finite double; strtod() reports underflow to a subnormal as ERANGE,
+// so only overflow, which gives infinity, is refused
+static int parse_value(const char *str, double *value) {
+    char *end;
+
+    *value = strtod(str, &end);
+    return end != str && *end == '\0' && isfinite(*value) ? 0 : -1;
+}
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// The series at key, or NULL if there is none; *wrongtype is set if the
+// key holds another type
+static TimeSeries *series_lookup(HashTable *ht, const char *key, int *wrongtype) {
+    ValueType type;
+    void *value = ht_lookup(ht, key, &type);
+
+    *wrongtype = value && type != VALUE_TIMESERIES;
+    return value && type == VALUE_TIMESERIES ? (TimeSeries *)value : NULL;
+}
+
+// Store a series created by a command under key, or free it on failure
+static int series_store(HashTable *ht, const char *key, TimeSeries *ts) {
+    if (ht_set_object(ht, key, VALUE_TIMESERIES, ts) != 0) {
+        ts_free(ts);
+        return -1;
+    }
+    keystats_write(VALUE_TIMESERIES, ht->db, key, ts->memory);
+    return 0;
+}
+
+// RETENTION ms at tokens[i], if present
+// Returns the tokens consumed, or -1 on a malformed option
+static int parse_retention(char **tokens, int num_tokens, int i, int64_t *retention_ms) {
+    if (i >= num_tokens) return 0;
+    if (i + 2 != num_tokens || strcasecmp(tokens[i], "RETENTION") != 0 ||
+        parse_timestamp(tokens[i + 1], retention_ms) != 0) {
+        return -1;
+    }
+    return 2;
+}
+
+// TS.CREATE key [RETENTION ms]
+static char *cmd_create(HashTable *ht, char **tokens, int num_tokens) {
+    int64_t retention_ms = 0;
+    int wrongtype;
+
+    if (num_tokens < 2 || parse_retention(tokens, num_tokens, 2, &retention_ms) < 0) {
+        return ts_reply("ERROR: TS.CREATE takes key [RETENTION ms]");
+    }
+    if (series_lookup(ht, tokens[1], &wrongtype) || wrongtype) {
+        return ts_reply("ERROR: TSDB: key already exists");
+    }
+
+    TimeSeries *ts = series_create(retention_ms);
+    if (!ts) return ts_reply("ERROR: Memory allocation failed");
+    if (series_store(ht, tokens[1], ts) != 0) return ts_reply("ERROR: Failed to create series");
+    return ts_reply("OK");
+}
+
+// TS.ALTER key RETENTION ms
+static char *cmd_alter(HashTable *ht, char **tokens, int num_tokens) {
+    int64_t retention_ms = 0;
+    int wrongtype;
+
+    if (num_tokens != 4 || parse_retention(tokens, num_tokens, 2, &retention_ms) < 0) {
+        return ts_reply("ERROR: TS.ALTER takes key RETENTION ms");
+    }
+    TimeSeries *ts = series_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) return ts_reply(WRONGTYPE_ERROR);
+    if (!ts) return ts_reply("ERROR: TSDB: the key does not exist");
+
+    size_t before = ts->memory;
+    ts->retention_ms = retention_ms;
+    series_trim(ts);
+    ht_account_value(ht, (long long)ts->memory - (long long)before);
+    return ts_reply("OK");
+}
+
+// TS.ADD key timestamp|* value [RETENTION ms]
+// RETENTION only applies when the add creates the series
+static char *cmd_add(HashTable *ht, char **tokens, int num_tokens) {
+    int64_t t, retention_ms = 0;
+    double value;
+    int wrongtype;
+
+    if (num_tokens < 4 || parse_retention(tokens, num_tokens, 4, &retention_ms) < 0) {
+        return ts_reply("ERROR: TS.ADD takes key timestamp|* value [RETENTION ms]");
+    }
+    if (strcmp(tokens[2], "*") == 0) {
+        t = now_ms();
+    } else if (parse_timestamp(tokens[2], &t) != 0) {
+        return ts_reply("ERROR: TSDB: invalid timestamp");
+    }
+    if (parse_value(tokens[3], &value) != 0) return ts_reply("ERROR: TSDB: invalid value");
+
+    TimeSeries *ts = series_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) return ts_reply(WRONGTYPE_ERROR);
+    if (ts && ts->last && t <= ts->last->last_ts) {
+        return ts_reply("ERROR: TSDB: timestamp must be newer than the series' last sample");
+    }
+
+    int created = !ts;
+    if (created && !(ts = series_create(retention_ms))) {
+        return ts_reply("ERROR: Memory allocation failed");
+    }
+
+    size_t before = ts->memory;
+    int rc = series_append(ts, t, value);
+    if (rc == 0) series_trim(ts);
+
+    if (created) {
+        if (rc != 0) {
+            ts_free(ts);
+        } else if (series_store(ht, tokens[1], ts) != 0) {
+            return ts_reply("ERROR: Failed to create series");
+        }
+    } else {
+        ht_account_value(ht, (long long)ts->memory - (long long)before);
+        keystats_write(VALUE_TIMESERIES, ht->db, tokens[1], ts->memory);
+    }
+    if (rc != 0) return ts_reply("ERROR: Memory allocation failed");
+    return ts_reply("%lld", (long long)t);
+}
+
+// TS.GET key - The newest sample
+static char *cmd_get(HashTable *ht, char **tokens, int num_tokens) {
+    int wrongtype;
+
+    if (num_tokens != 2) return ts_reply("ERROR: TS.GET requires a key");
+    TimeSeries *ts = series_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) return ts_reply(WRONGTYPE_ERROR);
+    if (!ts || !ts->last) return ts_reply("NULL");
+
+    StrBuf sb;
+    sb_init(&sb);
+    sb_printf(&sb, "[%lld, ", (long long)ts->last->last_ts);
+    format_value(&sb, bits_double(ts->last->last_bits));
+    sb_append(&sb, "]", 1);
+    char *reply = sb_finish(&sb);
+    return reply ? reply : ts_reply("ERROR: Memory allocation failed");
+}
+
+typedef struct TsRange {
+    int64_t from;
+    int64_t to;
+    size_t count;
+    TsAggregation agg;
+    int64_t bucket_ms;
+} TsRange;
+
+// from|- to|+ [COUNT n] [AGGREGATION type bucket_ms] at tokens[2]
+static int parse_range(char **tokens, int num_tokens, TsRange *q) {
+    q->count = SIZE_MAX;
+    q->agg = AGG_NONE;
+    q->bucket_ms = 0;
+
+    if (num_tokens < 4) return -1;
+    if (strcmp(tokens[2], "-") == 0) {
+        q->from = 0;
+    } else if (parse_timestamp(tokens[2], &q->from) != 0) {
+        return -1;
+    }
+    if (strcmp(tokens[3], "+") == 0) {
+        q->to = INT64_MAX;
+    } else if (parse_timestamp(tokens[3], &q->to) != 0) {
+        return -1;
+    }
+
+    for (int i = 4; i < num_tokens;) {
+        int64_t n;
+        if (i + 1 < num_tokens && strcasecmp(tokens[i], "COUNT") == 0) {
+            if (parse_timestamp(tokens[i + 1], &n) != 0) return -1;
+            q->count = (uint64_t)n > SIZE_MAX ? SIZE_MAX : (size_t)n;
+            i += 2;
+        } else if (i + 2 < num_tokens && strcasecmp(tokens[i], "AGGREGATION") == 0) {
+            for (int a = AGG_AVG; a <= AGG_COUNT; a++) {
+                if (strcasecmp(tokens[i + 1], aggregation_names[a]) == 0) q->agg = (TsAggregation)a;
+            }
+            if (q->agg == AGG_NONE || parse_timestamp(tokens[i + 2], &q->bucket_ms) != 0 ||
+                q->bucket_ms <= 0) {
+                return -1;
+            }
+            i += 3;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// TS.RANGE key from|- to|+ [COUNT n] [AGGREGATION avg|sum|min|max|count bucket_ms]
+static char *cmd_range(HashTable *ht, char **tokens, int num_tokens) {
+    TsRange q;
+    int wrongtype;
+
+    if (parse_range(tokens, num_tokens, &q) != 0) {
+        return ts_reply("ERROR: TS.RANGE takes key from|- to|+ [COUNT n] "
+                        "[AGGREGATION avg|sum|min|max|count bucket_ms]");
+    }
+
+    TimeSeries *ts = series_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) return ts_reply(WRONGTYPE_ERROR);
+
+    StrBuf sb;
+    size_t emitted = 0;
+    sb_init(&sb);
+    sb_append(&sb, "[", 1);
+
+    // Samples retention has not dropped yet are still out of range
+    if (ts && ts->last && ts->retention_ms > 0 && ts->last->last_ts - ts->retention_ms > q.from) {
+        q.from = ts->last->last_ts - ts->retention_ms;
+    }
+
+    TsBucket bucket = { 0, 0, 0, 0, 0 };
+    int64_t times[TS_BATCH];
+    double values[TS_BATCH];
+
+    for (TsChunk *c = ts ? ts->first : NULL; c && emitted < q.count && c->first_ts <= q.to;
+         c = c->next) {
+        if (c->last_ts < q.from) continue;
+
+        TsDecoder d;
+        decoder_init(&d, c);
+        while (d.left > 0 && emitted < q.count) {
+            // Decode a batch, keeping the samples in range
+            size_t n = 0;
+            int done = 0;
+            while (d.left > 0 && n < TS_BATCH) {
+                decoder_next(&d, &times[n], &values[n]);
+                if (times[n] > q.to) {
+                    done = 1;
+                    break;
+                }
+                if (times[n] >= q.from) n++;
+            }
+
+            if (q.agg == AGG_NONE) {
+                for (size_t i = 0; i < n && emitted < q.count; i++, emitted++) {
+                    sb_printf(&sb, "%s[%lld, ", emitted ? ", " : "", (long long)times[i]);
+                    format_value(&sb, values[i]);
+                    sb_append(&sb, "]", 1);
+                }
+            } else {
+                // Timestamps only grow, so each bucket is one run of the batch
+                for (size_t i = 0; i < n && emitted < q.count;) {
+                    int64_t start = times[i] - times[i] % q.bucket_ms;
+                    if (bucket.count > 0 && start != bucket.start) {
+                        sb_printf(&sb, "%s[%lld, ", emitted ? ", " : "", (long long)bucket.start);
+                        format_value(&sb, bucket_value(&bucket, q.agg));
+                        sb_append(&sb, "]", 1);
+                        emitted++;
+                        bucket.count = 0;
+                        bucket.sum = 0;
+                    }
+                    bucket.start = start;
+
+                    size_t j = i + 1;
+                    int64_t limit = start > INT64_MAX - q.bucket_ms ? INT64_MAX : start + q.bucket_ms;
+                    while (j < n && times[j] < limit) j++;
+                    bucket_add(&bucket, q.agg, values + i, j - i);
+                    i = j;
+                }
+            }
+            if (done) break;
+        }
+    }
+    if (q.agg != AGG_NONE && bucket.count > 0 && emitted < q.count) {
+        sb_printf(&sb, "%s[%lld, ", emitted ? ", " : "", (long long)bucket.start);
+        format_value(&sb, bucket_value(&bucket, q.agg));
+        sb_append(&sb, "]", 1);
+    }
+    sb_append(&sb, "]", 1);
+
+    char *reply = sb_finish(&sb);
+    return reply ? reply : ts_reply("ERROR: Memory allocation failed");
+}
+
+// TS.INFO key
+static char *cmd_info(HashTable *ht, char **tokens, int num_tokens) {
+    int wrongtype;
+
+    if (num_tokens != 2) return ts_reply("ERROR: TS.INFO requires a key");
+    TimeSeries *ts = series_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) return ts_reply(WRONGTYPE_ERROR);
+    if (!ts) return ts_reply("ERROR: TSDB: the key does not exist");
+
+    size_t encoded = 0;
+    for (TsChunk *c = ts->first; c; c = c->next) encoded += (c->bits + 7) / 8;
+
+    return ts_reply("{\"samples\": %zu, \"chunks\": %zu, \"memory\": %zu, "
+                    "\"encoded_bytes\": %zu, \"bytes_per_sample\": %.2f, "
+                    "\"first_timestamp\": %lld, \"last_timestamp\": %lld, \"retention_ms\": %lld}",
+                    ts->samples, ts->chunks, ts->memory, encoded,
+                    ts->samples ? (double)encoded / (double)ts->samples : 0.0,
+                    ts->first ? (long long)ts->first->first_ts : -1,
+                    ts->last ? (long long)ts->last->last_ts : -1,
+                    (long long)ts->retention_ms);
+}
+
+// ============================================================================
+// Dispatch
+// ============================================================================
+static const struct {
+    const char *name;
+    int writes;
+} ts_commands[] = {
+    { "TS.CREATE", 1 }, { "TS.ALTER", 1 }, { "TS.ADD", 1 },
+    { "TS.GET", 0 },    { "TS.RANGE", 0 }, { "TS.INFO", 0 },
+};
+
+const char *ts_command_key(char **tokens, int num_tokens, int *writes) {
+    for (size_t i = 0; i < sizeof(ts_commands) / sizeof(ts_commands[0]); i++) {
+        if (strcasecmp(tokens[0], ts_commands[i].name) == 0) {
+            *writes = ts_commands[i].writes;
+            return num_tokens >= 2 ? tokens[1] : NULL;
+        }
+    }
+    return NULL;
+}
+
+char *ts_command(HashTable *ht, char **tokens, int num_tokens) {
+    const char *name = tokens[0];
+
+    if (strcasecmp(name, "TS.CREATE") == 0) return cmd_create(ht, tokens, num_tokens);
+    if (strcasecmp(name, "TS.ALTER") == 0) return cmd_alter(ht, tokens, num_tokens);
+    if (strcasecmp(name, "TS.ADD") == 0) return cmd_add(ht, tokens, num_tokens);
+    if (strcasecmp(name, "TS.GET") == 0) return cmd_get(ht, tokens, num_tokens);
+    if (strcasecmp(name, "TS.RANGE") == 0) return cmd_range(ht, tokens, num_tokens);
+    if (strcasecmp(name, "TS.INFO") == 0) return cmd_info(ht, tokens, num_tokens);
+    return NULL;
+}
@@ -0,0 +1,1437 @@
+// ============================================================================
+// vector.c - Vector Sets with SIMD Distance Kernels and an HNSW Index
+// ============================================================================
+//
+// A vector set maps element names to fixed-dimension vectors and answers
+// k-nearest-neighbour queries (VSIM) by cosine, L2 or inner product
+// distance.
+//   - Distances run on kernels picked for the CPU at startup: AVX-512,
+//     AVX2 with FMA, or portable C
+//   - Vectors are stored as floats or, with Q8, as int8 codes and a scale
+//     per vector, a quarter of the memory
+//   - An HNSW graph (a hierarchy of proximity graphs) answers approximate
+//     queries in about logarithmic time. TRUTH, or a set created FLAT,
+//     scans every vector instead, split across the vector worker pool.
+//
+// Searches run outside the table locks: VSIM pins the set while the table
+// is held, and the search runs once the caller has released it, under the
+// set's own read lock only. GET and SET go ahead in the meantime; a VADD to
+// the same set waits for the searches already running on it.
+// ============================================================================
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include "mini_redis.h"
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+#define VEC_MAX_DIM 4096
+#define VEC_DEFAULT_M 16
+#define VEC_MAX_M 64
+#define VEC_DEFAULT_EF_CONSTRUCTION 200
+#define VEC_DEFAULT_EF 100         // Search breadth when VSIM gives no EF
+#define VEC_DEFAULT_COUNT 10
+#define VEC_MAX_COUNT 10000
+#define VEC_MAX_LEVEL 16
+#define VEC_MIN_CAP 16
+#define VEC_PART_SIZE 4096         // Vectors per worker task in a scan
+#define VEC_NO_SLOT UINT32_MAX
+#define VEC_TOMBSTONE (UINT32_MAX - 1)
+
+typedef enum VecMetric {
+    METRIC_COSINE = 0,
+    METRIC_L2,
+    METRIC_IP
+} VecMetric;
+
+static const char *metric_names[] = { "cosine", "l2", "ip" };
+
+struct VectorSet {
+    pthread_rwlock_t lock;    // Searches read; VADD and VREM write
+    int refs;                 // The table's, plus one per pinned search
+    uint32_t dim;
+    VecMetric metric;
+    int quantized;            // int8 codes and a scale instead of floats
+    int flat;                 // No graph: every search scans
+    uint32_t m;               // Links per node above level 0, 2m at level 0
+    uint32_t ef_construction;
+    uint32_t count;           // Slots used, removed elements included
+    uint32_t cap;
+    uint32_t live;            // Elements
+    float *vectors;           // cap * dim floats, unless quantized
+    int8_t *codes;            // cap * dim codes, if quantized
+    float *scales;            // Per slot, if quantized
+    float *norms;             // Squared norm per slot, for L2 over codes
+    char **elements;          // Name per slot; NULL once removed
+    uint8_t *levels;          // Top graph level per slot
+    uint32_t **links;         // Per slot and level: a count, then slot ids
+    uint32_t entry;           // Graph entry point, VEC_NO_SLOT when empty
+    int max_level;
+    uint32_t *names;          // Open addressing: slot by element name
+    uint32_t names_cap;       // Power of two
+    uint32_t names_used;      // Entries and tombstones
+    uint64_t rng;
+    size_t memory;            // Allocator bytes of all of the above
+};
+
+// ============================================================================
+// Distance Kernels
+// ============================================================================
+typedef struct VecKernels {
+    const char *name;
+    float (*dot)(const float *a, const float *b, size_t n);
+    float (*l2)(const float *a, const float *b, size_t n);     // Squared
+    int32_t (*dot_i8)(const int8_t *a, const int8_t *b, size_t n);
+} VecKernels;
+
+static float dot_scalar(const float *a, const float *b, size_t n) {
+    float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    for (; i < n; i++) s0 += a[i] * b[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+static float l2_scalar(const float *a, const float *b, size_t n) {
+    float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        float d0 = a[i] - b[i], d1 = a[i + 1] - b[i + 1];
+        float d2 = a[i + 2] - b[i + 2], d3 = a[i + 3] - b[i + 3];
+        s0 += d0 * d0;
+        s1 += d1 * d1;
+        s2 += d2 * d2;
+        s3 += d3 * d3;
+    }
+    for (; i < n; i++) s0 += (a[i] - b[i]) * (a[i] - b[i]);
+    return (s0 + s1) + (s2 + s3);
+}
+
+static int32_t dot_i8_scalar(const int8_t *a, const int8_t *b, size_t n) {
+    int32_t sum = 0;
+    for (size_t i = 0; i < n; i++) sum += (int32_t)a[i] * b[i];
+    return sum;
+}
+
+#ifdef __x86_64__
+// Compiled for their instruction sets whatever the build flags; only
+// called once the CPU has been checked for them
+__attribute__((target("avx2,fma")))
+static float hsum_avx2(__m256 v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+__attribute__((target("avx2,fma")))
+static float dot_avx2(const float *a, const float *b, size_t n) {
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+        s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), s1);
+    }
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+    }
+    float sum = hsum_avx2(_mm256_add_ps(s0, s1));
+    for (; i < n; i++) sum += a[i] * b[i];
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+static float l2_avx2(const float *a, const float *b, size_t n) {
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+        s0 = _mm256_fmadd_ps(d0, d0, s0);
+        s1 = _mm256_fmadd_ps(d1, d1, s1);
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        s0 = _mm256_fmadd_ps(d, d, s0);
+    }
+    float sum = hsum_avx2(_mm256_add_ps(s0, s1));
+    for (; i < n; i++) sum += (a[i] - b[i]) * (a[i] - b[i]);
+    return sum;
+}
+
+// Codes widened to 16 bits, multiplied and summed in pairs into 32 bits
+__attribute__((target("avx2")))
+static int32_t dot_i8_avx2(const int8_t *a, const int8_t *b, size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(a + i)));
+        __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(b + i)));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+    }
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+    int32_t sum = _mm_cvtsi128_si32(s);
+    for (; i < n; i++) sum += (int32_t)a[i] * b[i];
+    return sum;
+}
+
+// The tail is a masked load, so no scalar loop is left
+__attribute__((target("avx512f")))
+static float dot_avx512(const float *a, const float *b, size_t n) {
+    __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), s0);
+        s1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), s1);
+    }
+    for (; i + 16 <= n; i += 16) {
+        s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), s0);
+    }
+    if (i < n) {
+        __mmask16 mask = (__mmask16)((1u << (n - i)) - 1);
+        s1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + i),
+                             _mm512_maskz_loadu_ps(mask, b + i), s1);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(s0, s1));
+}
+
+__attribute__((target("avx512f")))
+static float l2_avx512(const float *a, const float *b, size_t n) {
+    __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+        s0 = _mm512_fmadd_ps(d0, d0, s0);
+        s1 = _mm512_fmadd_ps(d1, d1, s1);
+    }
+    for (; i + 16 <= n; i += 16) {
+        __m512 d = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        s0 = _mm512_fmadd_ps(d, d, s0);
+    }
+    if (i < n) {
+        __mmask16 mask = (__mmask16)((1u << (n - i)) - 1);
+        __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i),
+                                 _mm512_maskz_loadu_ps(mask, b + i));
+        s1 = _mm512_fmadd_ps(d, d, s1);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(s0, s1));
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static int32_t dot_i8_avx512(const int8_t *a, const int8_t *b, size_t n) {
+    __m512i acc = _mm512_setzero_si512();
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m512i va = _mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i *)(a + i)));
+        __m512i vb = _mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i *)(b + i)));
+        acc = _mm512_add_epi32(acc, _mm512_madd_epi16(va, vb));
+    }
+    int32_t sum = _mm512_reduce_add_epi32(acc);
+    for (; i < n; i++) sum += (int32_t)a[i] * b[i];
+    return sum;
+}
+#endif
+
+static VecKernels g_kernels = { "scalar", dot_scalar, l2_scalar, dot_i8_scalar };
+
+static void kernels_pick(void) {
+#ifdef __x86_64__
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        g_kernels = (VecKernels){ "avx2", dot_avx2, l2_avx2, dot_i8_avx2 };
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        g_kernels.name = "avx512";
+        g_kernels.dot = dot_avx512;
+        g_kernels.l2 = l2_avx512;
+        if (__builtin_cpu_supports("avx512bw")) g_kernels.dot_i8 = dot_i8_avx512;
+    }
+#endif
+}
+
+// ============================================================================
+// Worker Pool
+// ============================================================================
+// Scans are cut into parts. The querying thread queues its job, works on
+// its own parts alongside the pool and waits for the rest to finish.
+typedef struct PoolJob {
+    struct PoolJob *next;
+    void (*fn)(void *arg, size_t part);
+    void *arg;
+    size_t parts;
+    size_t next_part;         // Next unclaimed part
+    size_t done;              // Parts finished
+} PoolJob;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;      // A job was queued, or the pool is stopping
+    pthread_cond_t done;      // A part finished
+    PoolJob *jobs;            // Jobs with unclaimed parts, oldest first
+    pthread_t *threads;
+    int num_threads;
+    int stopping;
+} g_pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,
+             NULL, NULL, 0, 0 };
+
+static void pool_unlink(PoolJob *job) {
+    PoolJob **link = &g_pool.jobs;
+    while (*link && *link != job) link = &(*link)->next;
+    if (*link) *link = job->next;
+}
+
+// Claim the next part of job; called with the lock held
+static size_t pool_claim(PoolJob *job) {
+    size_t part = job->next_part++;
+    if (job->next_part == job->parts) pool_unlink(job);
+    return part;
+}
+
+// Finish a part; called with the lock held
+static void pool_finish(PoolJob *job) {
+    if (++job->done == job->parts) pthread_cond_broadcast(&g_pool.done);
+}
+
+static void *pool_main(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&g_pool.lock);
+    while (!g_pool.stopping) {
+        PoolJob *job = g_pool.jobs;
+        if (!job) {
+            pthread_cond_wait(&g_pool.work, &g_pool.lock);
+            continue;
+        }
+        size_t part = pool_claim(job);
+        pthread_mutex_unlock(&g_pool.lock);
+        job->fn(job->arg, part);
+        pthread_mutex_lock(&g_pool.lock);
+        pool_finish(job);
+    }
+    pthread_mutex_unlock(&g_pool.lock);
+    return NULL;
+}
+
+// Run fn on parts 0 .. parts - 1 and return once all have finished
+static void pool_run(void (*fn)(void *arg, size_t part), void *arg, size_t parts) {
+    if (g_pool.num_threads == 0 || parts <= 1) {
+        for (size_t part = 0; part < parts; part++) fn(arg, part);
+        return;
+    }
+
+    PoolJob job = { NULL, fn, arg, parts, 0, 0 };
+    pthread_mutex_lock(&g_pool.lock);
+    PoolJob **tail = &g_pool.jobs;
+    while (*tail) tail = &(*tail)->next;
+    *tail = &job;
+    pthread_cond_broadcast(&g_pool.work);
+
+    while (job.next_part < job.parts) {
+        size_t part = pool_claim(&job);
+        pthread_mutex_unlock(&g_pool.lock);
+        fn(arg, part);
+        pthread_mutex_lock(&g_pool.lock);
+        pool_finish(&job);
+    }
+    while (job.done < job.parts) pthread_cond_wait(&g_pool.done, &g_pool.lock);
+    pthread_mutex_unlock(&g_pool.lock);
+}
+
+const char *vset_init(int threads) {
+    kernels_pick();
+    if (threads <= 0) return g_kernels.name;
+
+    g_pool.threads = (pthread_t *)calloc((size_t)threads, sizeof(pthread_t));
+    if (!g_pool.threads) return NULL;
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&g_pool.threads[i], NULL, pool_main, NULL) != 0) break;
+        g_pool.num_threads++;
+    }
+    return g_pool.num_threads == threads ? g_kernels.name : NULL;
+}
+
+void vset_shutdown(void) {
+    pthread_mutex_lock(&g_pool.lock);
+    g_pool.stopping = 1;
+    pthread_cond_broadcast(&g_pool.work);
+    pthread_mutex_unlock(&g_pool.lock);
+
+    for (int i = 0; i < g_pool.num_threads; i++) pthread_join(g_pool.threads[i], NULL);
+    free(g_pool.threads);
+    g_pool.threads = NULL;
+    g_pool.num_threads = 0;
+}
+
+// ============================================================================
+// Accounted Allocations
+// ============================================================================
+static void *mem_alloc(size_t *memory, size_t size) {
+    void *ptr = malloc(size);
+    if (ptr) *memory += alloc_usable_size(ptr, size);
+    return ptr;
+}
+
+static void *mem_realloc(size_t *memory, void *ptr, size_t old_size, size_t size) {
+    size_t old_bytes = ptr ? alloc_usable_size(ptr, old_size) : 0;
+    void *grown = realloc(ptr, size);
+    if (!grown) return NULL;
+    *memory += alloc_usable_size(grown, size) - old_bytes;
+    return grown;
+}
+
+static void mem_free(size_t *memory, void *ptr, size_t size) {
+    if (!ptr) return;
+    *memory -= alloc_usable_size(ptr, size);
+    free(ptr);
+}
+
+// ============================================================================
+// Vectors and Distances
+// ============================================================================
+// A vector as the set compares it: floats (unit length for cosine), or
+// codes and their scale. norm is the squared length.
+typedef struct VecRef {
+    const float *f;
+    const int8_t *q;
+    float scale;
+    float norm;
+} VecRef;
+
+static VecRef slot_ref(const VectorSet *s, uint32_t slot) {
+    VecRef r;
+    size_t offset = (size_t)slot * s->dim;
+
+    r.f = s->quantized ? NULL : s->vectors + offset;
+    r.q = s->quantized ? s->codes + offset : NULL;
+    r.scale = s->quantized ? s->scales[slot] : 1.0f;
+    r.norm = s->norms[slot];
+    return r;
+}
+
+// Symmetric int8: the largest magnitude maps to 127
+static float quantize(const float *v, uint32_t dim, int8_t *codes) {
+    float max = 0;
+    for (uint32_t i = 0; i < dim; i++) {
+        float a = v[i] < 0 ? -v[i] : v[i];
+        if (a > max) max = a;
+    }
+
+    float scale = max > 0 ? max / 127.0f : 1.0f;
+    for (uint32_t i = 0; i < dim; i++) {
+        float x = v[i] / scale;
+        codes[i] = (int8_t)(x >= 0 ? x + 0.5f : x - 0.5f);
+    }
+    return scale;
+}
+
+// Prepare in as the set stores vectors: normalized into buf for cosine,
+// then quantized into codes for Q8. buf holds dim floats, codes dim bytes.
+static VecRef make_ref(const VectorSet *s, const float *in, float *buf, int8_t *codes) {
+    VecRef r;
+
+    memcpy(buf, in, s->dim * sizeof(float));
+    r.norm = g_kernels.dot(buf, buf, s->dim);
+    if (s->metric == METRIC_COSINE && r.norm > 0) {
+        float inv = 1.0f / sqrtf(r.norm);
+        for (uint32_t i = 0; i < s->dim; i++) buf[i] *= inv;
+        r.norm = 1.0f;
+    }
+
+    r.f = buf;
+    r.q = NULL;
+    r.scale = 1.0f;
+    if (s->quantized) {
+        r.scale = quantize(buf, s->dim, codes);
+        r.f = NULL;
+        r.q = codes;
+    }
+    return r;
+}
+
+// Smaller is closer: 1 - cosine, squared L2, or the negated inner product
+static float vec_distance(const VectorSet *s, const VecRef *a, const VecRef *b) {
+    float dot;
+
+    if (s->quantized) {
+        dot = a->scale * b->scale * (float)g_kernels.dot_i8(a->q, b->q, s->dim);
+        if (s->metric == METRIC_L2) {
+            float d = a->norm + b->norm - 2.0f * dot;
+            return d > 0 ? d : 0;
+        }
+    } else {
+        if (s->metric == METRIC_L2) return g_kernels.l2(a->f, b->f, s->dim);
+        dot = g_kernels.dot(a->f, b->f, s->dim);
+    }
+    return s->metric == METRIC_COSINE ? 1.0f - dot : -dot;
+}
+
+static float slot_distance(const VectorSet *s, const VecRef *q, uint32_t slot) {
+    VecRef r = slot_ref(s, slot);
+    return vec_distance(s, q, &r);
+}
+
+// Distance as VSIM reports it: L2 is returned unsquared
+static float reported_distance(const VectorSet *s, float d) {
+    return s->metric == METRIC_L2 ? sqrtf(d) : d;
+}
+
+// ============================================================================
+// Candidate Heaps
+// ============================================================================
+typedef struct VecHit {
+    float dist;
+    uint32_t slot;
+} VecHit;
+
+// Binary heap of hits: the farthest on top if max, else the closest
+typedef struct VecHeap {
+    VecHit *items;
+    size_t len;
+    size_t cap;
+    int max;
+} VecHeap;
+
+static int hit_before(const VecHeap *h, VecHit a, VecHit b) {
+    return h->max ? a.dist > b.dist : a.dist < b.dist;
+}
+
+static int heap_push(VecHeap *h, float dist, uint32_t slot) {
+    if (h->len == h->cap) {
+        size_t cap = h->cap ? h->cap * 2 : 64;
+        VecHit *items = (VecHit *)realloc(h->items, cap * sizeof(VecHit));
+        if (!items) return -1;
+        h->items = items;
+        h->cap = cap;
+    }
+
+    size_t i = h->len++;
+    VecHit hit = { dist, slot };
+    while (i > 0 && hit_before(h, hit, h->items[(i - 1) / 2])) {
+        h->items[i] = h->items[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    h->items[i] = hit;
+    return 0;
+}
+
+static VecHit heap_pop(VecHeap *h) {
+    VecHit top = h->items[0];
+    VecHit last = h->items[--h->len];
+    size_t i = 0;
+
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= h->len) break;
+        if (child + 1 < h->len && hit_before(h, h->items[child + 1], h->items[child])) child++;
+        if (!hit_before(h, h->items[child], last)) break;
+        h->items[i] = h->items[child];
+        i = child;
+    }
+    if (h->len > 0) h->items[i] = last;
+    return top;
+}
+
+static int hit_compare(const void *a, const void *b) {
+    const VecHit *x = (const VecHit *)a, *y = (const VecHit *)b;
+    if (x->dist != y->dist) return x->dist < y->dist ? -1 : 1;
+    return x->slot < y->slot ? -1 : x->slot > y->slot;
+}
+
+// ============================================================================
+// Element Names
+// ============================================================================
+static uint32_t name_hash(const char *name) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        h = (h ^ *p) * 16777619u;
+    }
+    return h;
+}
+
+// Slot of a live element, or VEC_NO_SLOT; *pos is its map position
+static uint32_t name_find(const VectorSet *s, const char *name, uint32_t *pos) {
+    if (s->names_cap == 0) return VEC_NO_SLOT;
+
+    uint32_t mask = s->names_cap - 1;
+    for (uint32_t i = name_hash(name) & mask;; i = (i + 1) & mask) {
+        uint32_t slot = s->names[i];
+        if (slot == VEC_NO_SLOT) return VEC_NO_SLOT;
+        if (slot != VEC_TOMBSTONE && strcmp(s->elements[slot], name) == 0) {
+            if (pos) *pos = i;
+            return slot;
+        }
+    }
+}
+
+static void name_place(uint32_t *names, uint32_t cap, const char *name, uint32_t slot) {
+    uint32_t mask = cap - 1;
+    uint32_t i = name_hash(name) & mask;
+    while (names[i] != VEC_NO_SLOT && names[i] != VEC_TOMBSTONE) i = (i + 1) & mask;
+    names[i] = slot;
+}
+
+// Room for one more name: rebuilt without tombstones at 3/4 full
+static int names_reserve(VectorSet *s) {
+    if ((s->names_used + 1) * 4 <= s->names_cap * 3) return 0;
+
+    uint32_t cap = s->names_cap ? s->names_cap : VEC_MIN_CAP;
+    while ((s->live + 1) * 2 > cap) cap *= 2;
+
+    uint32_t *names = (uint32_t *)mem_alloc(&s->memory, cap * sizeof(uint32_t));
+    if (!names) return -1;
+    memset(names, 0xff, cap * sizeof(uint32_t));
+    for (uint32_t slot = 0; slot < s->count; slot++) {
+        if (s->elements[slot]) name_place(names, cap, s->elements[slot], slot);
+    }
+
+    mem_free(&s->memory, s->names, s->names_cap * sizeof(uint32_t));
+    s->names = names;
+    s->names_cap = cap;
+    s->names_used = s->live;
+    return 0;
+}
+
+// ============================================================================
+// HNSW Graph
+// ============================================================================
+// A slot's links: level 0 holds up to 2m, each level above up to m; every
+// level starts with its count
+static size_t links_words(const VectorSet *s, int level) {
+    return (2 * s->m + 1) + (size_t)level * (s->m + 1);
+}
+
+static uint32_t *node_links(const VectorSet *s, uint32_t slot, int level) {
+    uint32_t *links = s->links[slot];
+    return level == 0 ? links : links + (2 * s->m + 1) + (size_t)(level - 1) * (s->m + 1);
+}
+
+static uint32_t level_cap(const VectorSet *s, int level) {
+    return level == 0 ? 2 * s->m : s->m;
+}
+
+static int random_level(VectorSet *s) {
+    // xorshift64*, then an exponentially distributed level
+    s->rng ^= s->rng >> 12;
+    s->rng ^= s->rng << 25;
+    s->rng ^= s->rng >> 27;
+    double u = (double)((s->rng * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+    int level = (int)(-log(1.0 - u) / log((double)s->m));
+    return level < VEC_MAX_LEVEL ? level : VEC_MAX_LEVEL;
+}
+
+// Visited marks for one search, one bit per slot
+static uint8_t *visited_create(const VectorSet *s) {
+    return (uint8_t *)calloc(s->count / 8 + 1, 1);
+}
+
+static int visit(uint8_t *visited, uint32_t slot) {
+    if (visited[slot / 8] & (1u << (slot % 8))) return 0;
+    visited[slot / 8] |= (uint8_t)(1u << (slot % 8));
+    return 1;
+}
+
+// Closest node to q at one level, walking greedily from ep
+static uint32_t greedy_closest(const VectorSet *s, const VecRef *q, uint32_t ep, int level) {
+    float best = slot_distance(s, q, ep);
+
+    for (int changed = 1; changed;) {
+        changed = 0;
+        uint32_t *links = node_links(s, ep, level);
+        for (uint32_t i = 1; i <= links[0]; i++) {
+            float d = slot_distance(s, q, links[i]);
+            if (d < best) {
+                best = d;
+                ep = links[i];
+                changed = 1;
+            }
+        }
+    }
+    return ep;
+}
+
+// The ef closest nodes to q at one level found from ep, as a max-heap in
+// *found. Returns -1 if memory ran out.
+static int search_layer(const VectorSet *s, const VecRef *q, uint32_t ep, size_t ef, int level,
+                        uint8_t *visited, VecHeap *found) {
+    VecHeap candidates = { NULL, 0, 0, 0 };
+    float d = slot_distance(s, q, ep);
+    int rc = 0;
+
+    visit(visited, ep);
+    if (heap_push(&candidates, d, ep) != 0 || heap_push(found, d, ep) != 0) rc = -1;
+
+    while (rc == 0 && candidates.len > 0) {
+        VecHit c = heap_pop(&candidates);
+        if (found->len >= ef && c.dist > found->items[0].dist) break;
+
+        uint32_t *links = node_links(s, c.slot, level);
+        for (uint32_t i = 1; i <= links[0] && rc == 0; i++) {
+            uint32_t n = links[i];
+            if (!visit(visited, n)) continue;
+
+            d = slot_distance(s, q, n);
+            if (found->len < ef || d < found->items[0].dist) {
+                if (heap_push(&candidates, d, n) != 0 || heap_push(found, d, n) != 0) rc = -1;
+                if (found->len > ef) heap_pop(found);
+            }
+        }
+    }
+    free(candidates.items);
+    return rc;
+}
+
+// Pick up to max neighbours from hits (sorted, closest first), skipping a
+// candidate closer to one already picked than to the target, which keeps
+// links spread in every direction. Returns the number written to out.
+static uint32_t select_neighbors(const VectorSet *s, const VecHit *hits, size_t num_hits,
+                                 uint32_t max, uint32_t *out) {
+    uint32_t picked = 0;
+
+    for (size_t i = 0; i < num_hits && picked < max; i++) {
+        VecRef c = slot_ref(s, hits[i].slot);
+        int keep = 1;
+        for (uint32_t j = 0; j < picked && keep; j++) {
+            if (slot_distance(s, &c, out[j]) < hits[i].dist) keep = 0;
+        }
+        if (keep) out[picked++] = hits[i].slot;
+    }
+
+    // Fill up with the closest skipped ones, so sparse areas stay linked
+    for (size_t i = 0; i < num_hits && picked < max; i++) {
+        int present = 0;
+        for (uint32_t j = 0; j < picked && !present; j++) present = out[j] == hits[i].slot;
+        if (!present) out[picked++] = hits[i].slot;
+    }
+    return picked;
+}
+
+// Link n to slot at level, re-selecting n's links when it is full
+static int link_back(VectorSet *s, uint32_t n, uint32_t slot, int level) {
+    uint32_t *links = node_links(s, n, level);
+    uint32_t cap = level_cap(s, level);
+
+    if (links[0] < cap) {
+        links[++links[0]] = slot;
+        return 0;
+    }
+
+    VecHit hits[2 * VEC_MAX_M + 1];
+    VecRef base = slot_ref(s, n);
+    size_t num_hits = 0;
+    for (uint32_t i = 1; i <= links[0]; i++) {
+        hits[num_hits].slot = links[i];
+        hits[num_hits++].dist = slot_distance(s, &base, links[i]);
+    }
+    hits[num_hits].slot = slot;
+    hits[num_hits++].dist = slot_distance(s, &base, slot);
+    qsort(hits, num_hits, sizeof(VecHit), hit_compare);
+    links[0] = select_neighbors(s, hits, num_hits, cap, links + 1);
+    return 0;
+}
+
+// Link a new slot into the graph
+static int graph_insert(VectorSet *s, uint32_t slot) {
+    int level = s->levels[slot];
+    VecRef q = slot_ref(s, slot);
+
+    if (s->entry == VEC_NO_SLOT) {
+        s->entry = slot;
+        s->max_level = level;
+        return 0;
+    }
+
+    uint32_t ep = s->entry;
+    for (int l = s->max_level; l > level; l--) ep = greedy_closest(s, &q, ep, l);
+
+    uint8_t *visited = visited_create(s);
+    if (!visited) return -1;
+
+    int rc = 0;
+    for (int l = level < s->max_level ? level : s->max_level; l >= 0 && rc == 0; l--) {
+        VecHeap found = { NULL, 0, 0, 1 };
+        memset(visited, 0, s->count / 8 + 1);
+        rc = search_layer(s, &q, ep, s->ef_construction, l, visited, &found);
+        if (rc == 0) {
+            qsort(found.items, found.len, sizeof(VecHit), hit_compare);
+            uint32_t *links = node_links(s, slot, l);
+            links[0] = select_neighbors(s, found.items, found.len, s->m, links + 1);
+            for (uint32_t i = 1; i <= links[0]; i++) link_back(s, links[i], slot, l);
+            ep = found.items[0].slot;
+        }
+        free(found.items);
+    }
+    free(visited);
+
+    if (rc == 0 && level > s->max_level) {
+        s->entry = slot;
+        s->max_level = level;
+    }
+    return rc;
+}
+
+// ============================================================================
+// Set Object
+// ============================================================================
+static VectorSet *set_create(uint32_t dim, VecMetric metric, int quantized, int flat,
+                             uint32_t m, uint32_t ef_construction) {
+    VectorSet *s = (VectorSet *)calloc(1, sizeof(VectorSet));
+    if (!s) return NULL;
+
+    if (pthread_rwlock_init(&s->lock, NULL) != 0) {
+        free(s);
+        return NULL;
+    }
+    s->refs = 1;
+    s->dim = dim;
+    s->metric = metric;
+    s->quantized = quantized;
+    s->flat = flat;
+    s->m = m;
+    s->ef_construction = ef_construction;
+    s->entry = VEC_NO_SLOT;
+    s->rng = 0x9e3779b97f4a7c15ULL ^ (uintptr_t)s;
+    s->memory = alloc_usable_size(s, sizeof(VectorSet));
+    return s;
+}
+
+static void set_destroy(VectorSet *s) {
+    for (uint32_t slot = 0; slot < s->count; slot++) {
+        free(s->elements[slot]);
+        if (s->links) free(s->links[slot]);
+    }
+    free(s->vectors);
+    free(s->codes);
+    free(s->scales);
+    free(s->norms);
+    free(s->elements);
+    free(s->levels);
+    free(s->links);
+    free(s->names);
+    pthread_rwlock_destroy(&s->lock);
+    free(s);
+}
+
+static void set_retain(VectorSet *s) {
+    __atomic_add_fetch(&s->refs, 1, __ATOMIC_RELAXED);
+}
+
+static void set_release(VectorSet *s) {
+    if (__atomic_sub_fetch(&s->refs, 1, __ATOMIC_ACQ_REL) == 0) set_destroy(s);
+}
+
+void vset_free(VectorSet *s) {
+    if (s) set_release(s);
+}
+
+size_t vset_memory(const VectorSet *s) {
+    return s->memory;
+}
+
+// Grow every per-slot array to hold cap slots
+static int set_grow(VectorSet *s) {
+    uint32_t cap = s->cap ? s->cap * 2 : VEC_MIN_CAP;
+    size_t old = s->cap, dim = s->dim;
+    void *p;
+
+#define GROW(field, size)                                                                  \
+    do {                                                                                   \
+        p = mem_realloc(&s->memory, s->field, old * (size), (size_t)cap * (size));         \
+        if (!p) return -1;                                                                 \
+        s->field = p;                                                                      \
+    } while (0)
+
+    if (s->quantized) {
+        GROW(codes, dim * sizeof(int8_t));
+        GROW(scales, sizeof(float));
+    } else {
+        GROW(vectors, dim * sizeof(float));
+    }
+    GROW(norms, sizeof(float));
+    GROW(elements, sizeof(char *));
+    if (!s->flat) {
+        GROW(levels, sizeof(uint8_t));
+        GROW(links, sizeof(uint32_t *));
+    }
+#undef GROW
+
+    s->cap = cap;
+    return 0;
+}
+
+static void set_remove_slot(VectorSet *s, uint32_t slot, uint32_t pos) {
+    s->names[pos] = VEC_TOMBSTONE;
+    mem_free(&s->memory, s->elements[slot], strlen(s->elements[slot]) + 1);
+    s->elements[slot] = NULL;
+    s->live--;
+}
+
+// Add or replace an element. A replaced vector's slot stays in the graph,
+// unnamed, so the paths through it keep working.
+// Returns 1 if added, 0 if replaced, -1 if memory ran out
+static int set_add(VectorSet *s, const char *name, const float *vec) {
+    uint32_t pos, old = name_find(s, name, &pos);
+    if (old != VEC_NO_SLOT) set_remove_slot(s, old, pos);
+
+    if ((s->count == s->cap && set_grow(s) != 0) || names_reserve(s) != 0) return -1;
+
+    size_t name_len = strlen(name) + 1;
+    char *copy = (char *)mem_alloc(&s->memory, name_len);
+    float *buf = (float *)malloc(s->dim * sizeof(float));
+    int level = s->flat ? 0 : random_level(s);
+    uint32_t *links = s->flat ? NULL
+                              : (uint32_t *)mem_alloc(&s->memory,
+                                                      links_words(s, level) * sizeof(uint32_t));
+    if (!copy || !buf || (!s->flat && !links)) {
+        mem_free(&s->memory, copy, name_len);
+        mem_free(&s->memory, links, links ? links_words(s, level) * sizeof(uint32_t) : 0);
+        free(buf);
+        return -1;
+    }
+    memcpy(copy, name, name_len);
+
+    uint32_t slot = s->count++;
+    size_t offset = (size_t)slot * s->dim;
+    VecRef r = make_ref(s, vec, buf, s->quantized ? s->codes + offset : NULL);
+    if (s->quantized) {
+        s->scales[slot] = r.scale;
+    } else {
+        memcpy(s->vectors + offset, buf, s->dim * sizeof(float));
+    }
+    s->norms[slot] = r.norm;
+    free(buf);
+
+    s->elements[slot] = copy;
+    name_place(s->names, s->names_cap, copy, slot);
+    s->names_used++;
+    s->live++;
+
+    if (!s->flat) {
+        s->levels[slot] = (uint8_t)level;
+        s->links[slot] = links;
+        for (int l = 0; l <= level; l++) node_links(s, slot, l)[0] = 0;
+        if (graph_insert(s, slot) != 0) {
+            // Reachable or not, the slot stays valid; only the name goes
+            name_find(s, name, &pos);
+            set_remove_slot(s, slot, pos);
+            return -1;
+        }
+    }
+    return old == VEC_NO_SLOT ? 1 : 0;
+}
+
+// ============================================================================
+// Searches
+// ============================================================================
+typedef struct VecSearch {
+    VectorSet *set;           // Pinned
+    float *query;             // dim floats
+    size_t count;
+    size_t ef;
+    int truth;                // Scan every vector
+} VecSearch;
+
+// One scan part: the closest count live slots of its range
+typedef struct ScanJob {
+    const VectorSet *set;
+    const VecRef *q;
+    size_t count;
+    size_t parts;
+    VecHeap *heaps;           // One per part, max-heaps
+    int failed;
+} ScanJob;
+
+static void scan_part(void *arg, size_t part) {
+    ScanJob *job = (ScanJob *)arg;
+    const VectorSet *s = job->set;
+    VecHeap *h = &job->heaps[part];
+    uint32_t lo = (uint32_t)((uint64_t)s->count * part / job->parts);
+    uint32_t hi = (uint32_t)((uint64_t)s->count * (part + 1) / job->parts);
+
+    for (uint32_t slot = lo; slot < hi; slot++) {
+        if (!s->elements[slot]) continue;
+        float d = slot_distance(s, job->q, slot);
+        if (h->len < job->count) {
+            if (heap_push(h, d, slot) != 0) {
+                __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+                return;
+            }
+        } else if (d < h->items[0].dist) {
+            heap_pop(h);
+            heap_push(h, d, slot);
+        }
+    }
+}
+
+// Exact search: every vector, in parts across the worker pool
+static int scan_search(const VectorSet *s, const VecRef *q, size_t count, VecHeap *out) {
+    size_t parts = s->count / VEC_PART_SIZE;
+    size_t max_parts = (size_t)g_pool.num_threads + 1;
+    if (parts > max_parts) parts = max_parts;
+    if (parts == 0) parts = 1;
+
+    ScanJob job = { s, q, count, parts, NULL, 0 };
+    job.heaps = (VecHeap *)calloc(parts, sizeof(VecHeap));
+    if (!job.heaps) return -1;
+    for (size_t i = 0; i < parts; i++) job.heaps[i].max = 1;
+
+    pool_run(scan_part, &job, parts);
+
+    int rc = job.failed ? -1 : 0;
+    for (size_t i = 0; i < parts; i++) {
+        for (size_t j = 0; j < job.heaps[i].len && rc == 0; j++) {
+            rc = heap_push(out, job.heaps[i].items[j].dist, job.heaps[i].items[j].slot);
+        }
+        free(job.heaps[i].items);
+    }
+    free(job.heaps);
+    return rc;
+}
+
+static int graph_search(const VectorSet *s, const VecRef *q, size_t ef, VecHeap *out) {
+    if (s->entry == VEC_NO_SLOT) return 0;
+
+    uint32_t ep = s->entry;
+    for (int l = s->max_level; l > 0; l--) ep = greedy_closest(s, q, ep, l);
+
+    uint8_t *visited = visited_create(s);
+    if (!visited) return -1;
+    int rc = search_layer(s, q, ep, ef, 0, visited, out);
+    free(visited);
+    return rc;
+}
+
+// Run a search, unpin its set and free it
+// Returns the reply: [{"element": ..., "distance": ...}, ...]
+static char *search_run(VecSearch *search) {
+    VectorSet *s = search->set;
+    VecHeap hits = { NULL, 0, 0, 1 };
+    StrBuf sb;
+    int rc;
+
+    float *buf = (float *)malloc(s->dim * sizeof(float));
+    int8_t *codes = (int8_t *)malloc(s->dim);
+    pthread_rwlock_rdlock(&s->lock);
+    if (!buf || !codes) {
+        rc = -1;
+    } else {
+        VecRef q = make_ref(s, search->query, buf, codes);
+        rc = search->truth || s->flat ? scan_search(s, &q, search->count, &hits)
+                                      : graph_search(s, &q, search->ef, &hits);
+    }
+
+    sb_init(&sb);
+    sb_append(&sb, "[", 1);
+    if (rc == 0) {
+        if (hits.len > 1) qsort(hits.items, hits.len, sizeof(VecHit), hit_compare);
+        size_t emitted = 0;
+        for (size_t i = 0; i < hits.len && emitted < search->count; i++) {
+            const char *name = s->elements[hits.items[i].slot];
+            if (!name) continue;
+            sb_printf(&sb, "%s{\"element\": ", emitted++ ? ", " : "");
+            sb_json_string(&sb, name, strlen(name));
+            sb_printf(&sb, ", \"distance\": %.6g}",
+                      (double)reported_distance(s, hits.items[i].dist));
+        }
+    }
+    sb_append(&sb, "]", 1);
+    pthread_rwlock_unlock(&s->lock);
+
+    free(hits.items);
+    free(buf);
+    free(codes);
+    free(search->query);
+    set_release(s);
+    free(search);
+
+    char *reply = sb_finish(&sb);
+    if (rc != 0 || !reply) {
+        free(reply);
+        reply = (char *)malloc(sizeof("ERROR: Memory allocation failed"));
+        if (reply) strcpy(reply, "ERROR: Memory allocation failed");
+    }
+    return reply;
+}
+
+// A search set up while the table is held and run after it is released,
+// when the thread asked for that
+static _Thread_local int tls_defer = 0;
+static _Thread_local VecSearch *tls_deferred = NULL;
+
+void vset_defer_begin(void) {
+    tls_defer = 1;
+}
+
+char *vset_defer_end(char *reply) {
+    VecSearch *search = tls_deferred;
+
+    tls_defer = 0;
+    tls_deferred = NULL;
+    if (!search) return reply;
+
+    free(reply);
+    return search_run(search);
+}
+
+// ============================================================================
+// Commands
+// ============================================================================
+static char *vset_reply(const char *fmt, ...) {
+    char buffer[256];
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, args);
+    va_end(args);
+
+    size_t len = strlen(buffer) + 1;
+    char *reply = (char *)malloc(len);
+    if (reply) memcpy(reply, buffer, len);
+    return reply;
+}
+
+static int parse_u32(const char *str, uint32_t min, uint32_t max, uint32_t *value) {
+    char *end;
+
+    if (*str < '0' || *str > '9') return -1;
+    errno = 0;
+    unsigned long long v = strtoull(str, &end, 10);
+    if (*end != '\0' || errno == ERANGE || v < min || v > max) return -1;
+    *value = (uint32_t)v;
+    return 0;
+}
+
+// n finite floats from tokens into a malloc'd array, or NULL
+static float *parse_vector(char **tokens, uint32_t n) {
+    float *vec = (float *)malloc((n ? n : 1) * sizeof(float));
+    if (!vec) return NULL;
+
+    for (uint32_t i = 0; i < n; i++) {
+        char *end;
+        vec[i] = strtof(tokens[i], &end);
+        if (end == tokens[i] || *end != '\0' || !isfinite(vec[i])) {
+            free(vec);
+            return NULL;
+        }
+    }
+    return vec;
+}
+
+// The set at key, or NULL if there is none; *wrongtype is set if the key
+// holds another type
+static VectorSet *set_lookup(HashTable *ht, const char *key, int *wrongtype) {
+    ValueType type;
+    void *value = ht_lookup(ht, key, &type);
+
+    *wrongtype = value && type != VALUE_VECTORSET;
+    return value && type == VALUE_VECTORSET ? (VectorSet *)value : NULL;
+}
+
+// VADD key VALUES n v1 .. vn element [METRIC COSINE|L2|IP] [Q8|NOQUANT] [FLAT]
+//      [M links] [EF build_ef]
+// The options after the element only apply when VADD creates the set
+static char *cmd_vadd(HashTable *ht, char **tokens, int num_tokens) {
+    uint32_t dim, m = VEC_DEFAULT_M, ef = VEC_DEFAULT_EF_CONSTRUCTION;
+    VecMetric metric = METRIC_COSINE;
+    int quantized = 0, flat = 0, wrongtype;
+
+    if (num_tokens < 5 || strcasecmp(tokens[2], "VALUES") != 0 ||
+        parse_u32(tokens[3], 1, VEC_MAX_DIM, &dim) != 0 || (uint32_t)num_tokens < 5 + dim) {
+        return vset_reply("ERROR: VADD takes key VALUES n v1 .. vn element [METRIC COSINE|L2|IP] "
+                          "[Q8|NOQUANT] [FLAT] [M links] [EF build_ef]");
+    }
+    const char *element = tokens[4 + dim];
+    if (strlen(element) > MAX_KEY_SIZE) return vset_reply("ERROR: Element name too long");
+
+    for (int i = 5 + (int)dim; i < num_tokens; i++) {
+        const char *opt = tokens[i];
+        if (strcasecmp(opt, "Q8") == 0) {
+            quantized = 1;
+        } else if (strcasecmp(opt, "NOQUANT") == 0) {
+            quantized = 0;
+        } else if (strcasecmp(opt, "FLAT") == 0) {
+            flat = 1;
+        } else if (strcasecmp(opt, "METRIC") == 0 && i + 1 < num_tokens) {
+            i++;
+            if (strcasecmp(tokens[i], "COSINE") == 0) {
+                metric = METRIC_COSINE;
+            } else if (strcasecmp(tokens[i], "L2") == 0) {
+                metric = METRIC_L2;
+            } else if (strcasecmp(tokens[i], "IP") == 0) {
+                metric = METRIC_IP;
+            } else {
+                return vset_reply("ERROR: METRIC must be COSINE, L2 or IP");
+            }
+        } else if (strcasecmp(opt, "M") == 0 && i + 1 < num_tokens) {
+            if (parse_u32(tokens[++i], 2, VEC_MAX_M, &m) != 0) {
+                return vset_reply("ERROR: M must be between 2 and %d", VEC_MAX_M);
+            }
+        } else if (strcasecmp(opt, "EF") == 0 && i + 1 < num_tokens) {
+            if (parse_u32(tokens[++i], 1, 100000, &ef) != 0) {
+                return vset_reply("ERROR: EF must be between 1 and 100000");
+            }
+        } else {
+            return vset_reply("ERROR: Unknown VADD option '%s'", opt);
+        }
+    }
+
+    float *vec = parse_vector(tokens + 4, dim);
+    if (!vec) return vset_reply("ERROR: Vector components must be finite numbers");
+    if (metric == METRIC_COSINE && dot_scalar(vec, vec, dim) == 0) {
+        free(vec);
+        return vset_reply("ERROR: A zero vector has no direction for COSINE");
+    }
+
+    VectorSet *s = set_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) {
+        free(vec);
+        return vset_reply(WRONGTYPE_ERROR);
+    }
+    if (s && s->dim != dim) {
+        free(vec);
+        return vset_reply("ERROR: Vector dimension mismatch: the set has %u", s->dim);
+    }
+    if (s && s->metric == METRIC_COSINE && dot_scalar(vec, vec, dim) == 0) {
+        free(vec);
+        return vset_reply("ERROR: A zero vector has no direction for COSINE");
+    }
+
+    int created = !s;
+    if (created && !(s = set_create(dim, metric, quantized, flat, m, ef))) {
+        free(vec);
+        return vset_reply("ERROR: Memory allocation failed");
+    }
+
+    pthread_rwlock_wrlock(&s->lock);
+    size_t before = s->memory;
+    int rc = set_add(s, element, vec);
+    size_t after = s->memory;
+    pthread_rwlock_unlock(&s->lock);
+    free(vec);
+
+    if (created) {
+        if (rc < 0 || ht_set_object(ht, tokens[1], VALUE_VECTORSET, s) != 0) {
+            set_release(s);
+            return vset_reply(rc < 0 ? "ERROR: Memory allocation failed"
+                                     : "ERROR: Failed to create vector set");
+        }
+    } else {
+        ht_account_value(ht, (long long)after - (long long)before);
+    }
+    keystats_write(VALUE_VECTORSET, ht->db, tokens[1], after);
+    if (rc < 0) return vset_reply("ERROR: Memory allocation failed");
+    return vset_reply("%d", rc);
+}
+
+// VREM key element
+static char *cmd_vrem(HashTable *ht, char **tokens, int num_tokens) {
+    int wrongtype;
+
+    if (num_tokens != 3) return vset_reply("ERROR: VREM takes key element");
+    VectorSet *s = set_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) return vset_reply(WRONGTYPE_ERROR);
+    if (!s) return vset_reply("0");
+
+    pthread_rwlock_wrlock(&s->lock);
+    size_t before = s->memory;
+    uint32_t pos, slot = name_find(s, tokens[2], &pos);
+    if (slot != VEC_NO_SLOT) set_remove_slot(s, slot, pos);
+    size_t after = s->memory;
+    pthread_rwlock_unlock(&s->lock);
+
+    ht_account_value(ht, (long long)after - (long long)before);
+    return vset_reply("%d", slot != VEC_NO_SLOT);
+}
+
+static char *vsim_usage(void) {
+    return vset_reply("ERROR: VSIM takes key VALUES n v1 .. vn | ELE element [COUNT k] "
+                      "[EF search_ef] [TRUTH]");
+}
+
+// VSIM key VALUES n v1 .. vn | ELE element [COUNT k] [EF search_ef] [TRUTH]
+static char *cmd_vsim(HashTable *ht, char **tokens, int num_tokens) {
+    uint32_t n = 0, count = VEC_DEFAULT_COUNT, ef = 0;
+    int truth = 0, wrongtype, i;
+
+    if (num_tokens < 4) return vsim_usage();
+    if (strcasecmp(tokens[2], "VALUES") == 0) {
+        if (parse_u32(tokens[3], 1, VEC_MAX_DIM, &n) != 0 || (uint32_t)num_tokens < 4 + n) {
+            return vsim_usage();
+        }
+        i = 4 + (int)n;
+    } else if (strcasecmp(tokens[2], "ELE") == 0) {
+        i = 4;
+    } else {
+        return vsim_usage();
+    }
+    for (; i < num_tokens; i++) {
+        if (strcasecmp(tokens[i], "TRUTH") == 0) {
+            truth = 1;
+        } else if (strcasecmp(tokens[i], "COUNT") == 0 && i + 1 < num_tokens &&
+                   parse_u32(tokens[i + 1], 1, VEC_MAX_COUNT, &count) == 0) {
+            i++;
+        } else if (strcasecmp(tokens[i], "EF") == 0 && i + 1 < num_tokens &&
+                   parse_u32(tokens[i + 1], 1, 100000, &ef) == 0) {
+            i++;
+        } else {
+            return vsim_usage();
+        }
+    }
+
+    VectorSet *s = set_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) return vset_reply(WRONGTYPE_ERROR);
+    if (!s) return vset_reply("[]");
+
+    float *query;
+    if (n > 0) {
+        if (n != s->dim) return vset_reply("ERROR: Vector dimension mismatch: the set has %u", s->dim);
+        if (!(query = parse_vector(tokens + 4, n))) {
+            return vset_reply("ERROR: Vector components must be finite numbers");
+        }
+    } else {
+        // The element's stored vector, decoded from codes if need be
+        pthread_rwlock_rdlock(&s->lock);
+        uint32_t slot = name_find(s, tokens[3], NULL);
+        query = slot != VEC_NO_SLOT ? (float *)malloc(s->dim * sizeof(float)) : NULL;
+        if (query) {
+            VecRef r = slot_ref(s, slot);
+            for (uint32_t d = 0; d < s->dim; d++) query[d] = r.f ? r.f[d] : r.q[d] * r.scale;
+        }
+        pthread_rwlock_unlock(&s->lock);
+        if (slot == VEC_NO_SLOT) return vset_reply("ERROR: Element not found");
+        if (!query) return vset_reply("ERROR: Memory allocation failed");
+    }
+
+    VecSearch *search = (VecSearch *)malloc(sizeof(VecSearch));
+    if (!search) {
+        free(query);
+        return vset_reply("ERROR: Memory allocation failed");
+    }
+    set_retain(s);
+    search->set = s;
+    search->query = query;
+    search->count = count;
+    search->ef = ef > count ? ef : (count > VEC_DEFAULT_EF ? count : VEC_DEFAULT_EF);
+    search->truth = truth;
+
+    if (tls_defer) {
+        // Pinned; vset_defer_end() runs it once the caller lets go of the table
+        tls_deferred = search;
+        return vset_reply("");
+    }
+    return search_run(search);
+}
+
+// VCARD key / VDIM key
+static char *cmd_vcard(HashTable *ht, char **tokens, int num_tokens, int dim) {
+    int wrongtype;
+
+    if (num_tokens != 2) return vset_reply("ERROR: %s requires a key", tokens[0]);
+    VectorSet *s = set_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) return vset_reply(WRONGTYPE_ERROR);
+    if (!s) return vset_reply(dim ? "ERROR: no such key" : "0");
+    return vset_reply("%u", dim ? s->dim : s->live);
+}
+
+// VEMB key element - The vector as stored: unit length for COSINE, and
+// decoded from its codes with Q8
+static char *cmd_vemb(HashTable *ht, char **tokens, int num_tokens) {
+    int wrongtype;
+
+    if (num_tokens != 3) return vset_reply("ERROR: VEMB takes key element");
+    VectorSet *s = set_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) return vset_reply(WRONGTYPE_ERROR);
+
+    uint32_t slot = s ? name_find(s, tokens[2], NULL) : VEC_NO_SLOT;
+    if (slot == VEC_NO_SLOT) return vset_reply("NULL");
+
+    StrBuf sb;
+    VecRef r = slot_ref(s, slot);
+    sb_init(&sb);
+    sb_append(&sb, "[", 1);
+    for (uint32_t d = 0; d < s->dim; d++) {
+        sb_printf(&sb, "%s%.9g", d ? ", " : "", (double)(r.f ? r.f[d] : r.q[d] * r.scale));
+    }
+    sb_append(&sb, "]", 1);
+
+    char *reply = sb_finish(&sb);
+    return reply ? reply : vset_reply("ERROR: Memory allocation failed");
+}
+
+// VINFO key
+static char *cmd_vinfo(HashTable *ht, char **tokens, int num_tokens) {
+    int wrongtype;
+
+    if (num_tokens != 2) return vset_reply("ERROR: VINFO requires a key");
+    VectorSet *s = set_lookup(ht, tokens[1], &wrongtype);
+    if (wrongtype) return vset_reply(WRONGTYPE_ERROR);
+    if (!s) return vset_reply("ERROR: no such key");
+
+    return vset_reply("{\"size\": %u, \"slots\": %u, \"dim\": %u, \"metric\": \"%s\", "
+                      "\"quantization\": \"%s\", \"index\": \"%s\", \"m\": %u, "
+                      "\"ef_construction\": %u, \"max_level\": %d, \"memory\": %zu, "
+                      "\"kernels\": \"%s\", \"search_threads\": %d}",
+                      s->live, s->count, s->dim, metric_names[s->metric],
+                      s->quantized ? "q8" : "none", s->flat ? "flat" : "hnsw", s->m,
+                      s->ef_construction, s->entry == VEC_NO_SLOT ? -1 : s->max_level,
+                      s->memory, g_kernels.name, g_pool.num_threads);
+}
+
+// ============================================================================
+// Dispatch
+// ============================================================================
+static const struct {
+    const char *name;
+    int writes;
+} vset_commands[] = {
+    { "VADD", 1 }, { "VREM", 1 }, { "VSIM", 0 }, { "VCARD", 0 },
+    { "VDIM", 0 }, { "VEMB", 0 }, { "VINFO", 0 },
+};
+
+const char *vset_command_key(char **tokens, int num_tokens, int *writes) {
+    for (size_t i = 0; i < sizeof(vset_commands) / sizeof(vset_commands[0]); i++) {
+        if (strcasecmp(tokens[0], vset_commands[i].name) == 0) {
+            *writes = vset_commands[i].writes;
+            return num_tokens >= 2 ? tokens[1] : NULL;
+        }
+    }
+    return NULL;
+}
+
+char *vset_command(HashTable *ht, char **tokens, int num_tokens) {
+    const char *name = tokens[0];
+
+    if (strcasecmp(name, "VADD") == 0) return cmd_vadd(ht, tokens, num_tokens);
+    if (strcasecmp(name, "VREM") == 0) return cmd_vrem(ht, tokens, num_tokens);
+    if (strcasecmp(name, "VSIM") == 0) return cmd_vsim(ht, tokens, num_tokens);
+    if (strcasecmp(name, "VCARD") == 0) return cmd_vcard(ht, tokens, num_tokens, 0);
+    if (strcasecmp(name, "VDIM") == 0) return cmd_vcard(ht, tokens, num_tokens, 1);
+    if (strcasecmp(name, "VEMB") == 0) return cmd_vemb(ht, tokens, num_tokens);
+    if (strcasecmp(name, "VINFO") == 0) return cmd_vinfo(ht, tokens, num_tokens);
+    return NULL;
+}
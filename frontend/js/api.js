@@ -11,6 +11,10 @@ const api = {
         const res = await fetch(`${API_BASE}/stats`);
         return res.json();
     },
+    async keyspace() {
+        const res = await fetch(`${API_BASE}/keyspace`);
+        return res.json();
+    },
     async keysAll() {
         const res = await fetch(`${API_BASE}/keys/all`);
         return res.json();
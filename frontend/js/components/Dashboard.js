@@ -4,6 +4,7 @@ function Dashboard() {
     const [connected, setConnected] = useState(false);
     const [entries, setEntries] = useState([]);
     const [stats, setStats] = useState({ keys: 0, memory_bytes: 0 });
+    const [keyspace, setKeyspace] = useState({ hotkeys: [], bigkeys: [] });
     const [selectedKey, setSelectedKey] = useState(null);
     const [activeTab, setActiveTab] = useState('editor');
     const [searchTerm, setSearchTerm] = useState('');
@@ -37,13 +38,18 @@ function Dashboard() {
 
     const fetchData = useCallback(async () => {
         try {
-            const [healthData, statsData, entriesData] = await Promise.all([
+            const [healthData, statsData, entriesData, keyspaceData] = await Promise.all([
                 api.health(),
                 api.stats(),
-                api.keysAll()
+                api.keysAll(),
+                api.keyspace()
             ]);
             setConnected(healthData.redis === 'connected');
             setStats(statsData);
+            setKeyspace({
+                hotkeys: keyspaceData.hotkeys || [],
+                bigkeys: keyspaceData.bigkeys || []
+            });
             setEntries(entriesData.entries || []);
         } catch (err) {
             setConnected(false);
@@ -326,6 +332,32 @@ function Dashboard() {
                             />
                         </div>
                     </div>
+                    <div className="stat-card">
+                        <div className="stat-label">Hot Keys</div>
+                        {keyspace.hotkeys.length === 0 ? (
+                            <div className="rank-empty">No samples yet</div>
+                        ) : (
+                            keyspace.hotkeys.slice(0, 5).map(item => (
+                                <div key={item.key} className="rank-item">
+                                    <span className="rank-key">{item.key}</span>
+                                    <span className="rank-count">~{item.hits} hits</span>
+                                </div>
+                            ))
+                        )}
+                    </div>
+                    <div className="stat-card">
+                        <div className="stat-label">Big Keys</div>
+                        {keyspace.bigkeys.length === 0 ? (
+                            <div className="rank-empty">No values yet</div>
+                        ) : (
+                            keyspace.bigkeys.slice(0, 5).map(item => (
+                                <div key={item.key} className="rank-item">
+                                    <span className="rank-key">{item.key}</span>
+                                    <span className="rank-count">{formatBytes(item.bytes)}</span>
+                                </div>
+                            ))
+                        )}
+                    </div>
                     <div className="stat-card">
                         <div className="stat-label">Connection Status</div>
                         <div className={`stat-value ${connected ? 'green' : 'orange'}`}>
@@ -35,6 +35,10 @@ show_help() {
     echo "Environment variables (for server deployment):"
     echo "  REDIS_HOST    Host for Redis engine (default: localhost)"
     echo "  REDIS_PORT    Port for Redis engine (default: 6379)"
+    echo "  REDIS_SOCKET  Unix socket path for a co-located engine (optional)"
+    echo "  REDIS_CLUSTER Cluster seed nodes, e.g. 127.0.0.1:7000,127.0.0.1:7001"
+    echo "                (see engine/cluster.sh for a local cluster)"
+    echo "  REDIS_SHARDS  Independent engines sharded by the backend, e.g. 127.0.0.1:7001,127.0.0.1:7002"
     echo "  PORT          Port for HTTP API (default: 3001)"
     exit 0
 }
@@ -62,6 +66,7 @@ done
 if [ "$MODE" = "local" ]; then
     export REDIS_HOST="localhost"
     export REDIS_PORT="6379"
+    export REDIS_SOCKET="/tmp/mini-redis.sock"
     export PORT="3001"
 fi
 
@@ -106,7 +111,7 @@ echo -e "${GREEN}✓ C Engine built successfully${NC}\n"
 
 # Start C Engine
 echo -e "${YELLOW}Starting C Engine on port 6379...${NC}"
-./mini-redis 6379 &
+./mini-redis 6379 --unixsocket "$REDIS_SOCKET" &
 ENGINE_PID=$!
 sleep 1
 
@@ -151,6 +156,7 @@ echo "╔═══════════════════════
 echo "║                    Services Running                           ║"
 echo "╠═══════════════════════════════════════════════════════════════╣"
 echo "║  C Engine:        localhost:6379 (TCP)                        ║"
+echo "║                   /tmp/mini-redis.sock (Unix socket)          ║"
 echo "║  Node.js API:     http://localhost:3001                       ║"
 echo "║  Dashboard:       http://localhost:8080/dashboard.html        ║"
 echo "╠═══════════════════════════════════════════════════════════════╣"